@@ -0,0 +1,42 @@
+// With allowDiskUse, a $sort bigger than aggregationSortMemoryLimitMB writes
+// sorted runs to disk and merges them.
+
+t = db.aggregation_sort_spill;
+t.drop();
+
+N = 20000;
+pad = new Array( 200 ).join( 'x' );
+for ( i = 0; i < N; ++i ) {
+    t.insert( { _id:i, a:( i * 7919 ) % N, b:i % 10, pad:pad } );
+}
+assert.eq( null, db.getLastError() );
+
+function aggregate( pipeline, allowDiskUse ) {
+    var res = db.runCommand( { aggregate:t.getName(), pipeline:pipeline, allowDiskUse:allowDiskUse } );
+    assert.commandWorked( res );
+    return res.result;
+}
+
+old = db.adminCommand( { getParameter:1, aggregationSortMemoryLimitMB:1 } ).aggregationSortMemoryLimitMB;
+assert.commandWorked( db.adminCommand( { setParameter:1, aggregationSortMemoryLimitMB:1 } ) );
+
+// several runs, merged in order
+res = aggregate( [ { $sort:{ a:1 } }, { $project:{ a:1 } } ], true );
+assert.eq( N, res.length );
+for ( i = 0; i < N; ++i ) {
+    assert.eq( i, res[ i ].a );
+}
+
+// compound and descending keys give the same results as an in memory sort
+pipeline = [ { $sort:{ b:-1, a:1 } }, { $project:{ a:1, b:1 } } ];
+spilled = aggregate( pipeline, true );
+assert.commandWorked( db.adminCommand( { setParameter:1, aggregationSortMemoryLimitMB:old } ) );
+assert.eq( aggregate( pipeline, false ), spilled );
+assert.commandWorked( db.adminCommand( { setParameter:1, aggregationSortMemoryLimitMB:1 } ) );
+
+// $sort + $limit still keeps just the top documents
+res = aggregate( [ { $sort:{ a:-1 } }, { $limit:3 }, { $project:{ a:1 } } ], true );
+assert.eq( [ N - 1, N - 2, N - 3 ], res.map( function( o ) { return o.a; } ) );
+
+assert.commandWorked( db.adminCommand( { setParameter:1, aggregationSortMemoryLimitMB:old } ) );
+t.drop();
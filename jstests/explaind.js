@@ -0,0 +1,41 @@
+// Test explain()'s bulkFetch counters for index cursors.
+
+t = db.jstests_explaind;
+t.drop();
+
+for( i = 0; i < 1000; ++i ) {
+    t.insert( { _id:i, a:i, b:i, s:'aaaaaaaaaaaaaaaaaaaaaaaaaaaaaa' } );
+}
+t.ensureIndex( { a:1 } );
+t.ensureIndex( { b:1 }, { clustering:true } );
+assert.eq( null, db.getLastError() );
+
+// A full scan fetches every row exactly once, and ramps up to full buffers
+// in a handful of getf calls.
+e = t.find().explain();
+assert.eq( 1000, e.n );
+assert.eq( 0, e.bulkFetch.rowsWanted );
+assert.eq( 1000, e.bulkFetch.rowsFetched );
+assert.lt( 0, e.bulkFetch.bytesFetched );
+assert.gte( 7, e.bulkFetch.getfCalls, tojson( e.bulkFetch ) );
+
+// A limit is used as a hint for the first getf, so only a few rows more
+// than the limit are buffered.
+e = t.find().limit( 10 ).explain();
+assert.eq( 10, e.n );
+assert.eq( 10, e.bulkFetch.rowsWanted );
+assert.gte( 11, e.bulkFetch.rowsFetched, tojson( e.bulkFetch ) );
+assert.gte( 2, e.bulkFetch.getfCalls, tojson( e.bulkFetch ) );
+
+// Same with skip, on a secondary index.
+e = t.find( { a:{ $gte:100 } } ).skip( 5 ).limit( 20 ).hint( { a:1 } ).explain();
+assert.eq( 20, e.n );
+assert.eq( 25, e.bulkFetch.rowsWanted );
+assert.gte( 26, e.bulkFetch.rowsFetched, tojson( e.bulkFetch ) );
+
+// Covered scans over a clustering index don't buffer the document.
+full = t.find( { b:{ $gte:0 } } ).hint( { b:1 } ).explain().bulkFetch;
+covered = t.find( { b:{ $gte:0 } }, { _id:0, b:1 } ).hint( { b:1 } ).explain().bulkFetch;
+assert.eq( 1000, full.rowsFetched );
+assert.eq( 1000, covered.rowsFetched );
+assert.lt( covered.bytesFetched, full.bytesFetched );
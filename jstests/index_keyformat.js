@@ -0,0 +1,89 @@
+// Indexes created with keyFormat:'binary' store byte-comparable keys, and
+// must return the same results in the same order as v1 indexes.
+
+t = db.jstests_index_keyformat;
+t.drop();
+
+values = [ MinKey, null, -Infinity, -2.5, NumberLong(-2), -1, 0, -0.0, 1, NumberInt(1), 1.5,
+           NumberLong("9007199254740991"), NumberLong("1152921504606846976"), NaN, Infinity,
+           "", "a", "a\u0000b", "ab", "\u00ff", new BinData(0, "AQID"), new BinData(2, "AQID"),
+           ObjectId("4f5e4d3c2b1a000000000001"), false, true, new Date(-5), new Date(0),
+           new Date(5), /re/, { x:1 }, MaxKey ];
+for( i = 0; i < values.length; ++i ) {
+    t.insert( { _id:i, a:values[ i ], b:i % 3, c:values[ values.length - 1 - i ] } );
+}
+// missing fields too
+t.insert( { _id:values.length } );
+
+t.ensureIndex( { a:1, b:-1 } );
+t.ensureIndex( { a:1, b:-1, z:1 }, { keyFormat:'binary' } );
+t.ensureIndex( { c:-1 }, { keyFormat:'binary' } );
+assert.eq( null, db.getLastError() );
+
+idx = t.getIndexes().filter( function( i ) { return i.name == 'a_1_b_-1_z_1'; } )[ 0 ];
+assert.eq( 'binary', idx.keyFormat );
+
+function ids( cursor ) {
+    return cursor.map( function( o ) { return o._id; } );
+}
+
+// full scans in both directions visit the same documents in the same order
+assert.eq( ids( t.find().sort( { a:1, b:-1 } ).hint( { a:1, b:-1 } ) ),
+           ids( t.find().sort( { a:1, b:-1 } ).hint( { a:1, b:-1, z:1 } ) ) );
+assert.eq( ids( t.find().sort( { a:-1, b:1 } ).hint( { a:1, b:-1 } ) ),
+           ids( t.find().sort( { a:-1, b:1 } ).hint( { a:1, b:-1, z:1 } ) ) );
+
+// ranges and point lookups
+queries = [ { a:1 }, { a:{ $gte:-1, $lt:2 } }, { a:{ $gt:'a' } }, { a:{ $in:[ null, 0, 'ab', true ] } },
+            { a:{ $lte:new Date(0) } }, { a:1, b:{ $gte:1 } }, { a:{ $type:5 } } ];
+queries.forEach( function( q ) {
+    assert.eq( ids( t.find( q ).sort( { a:1, b:-1 } ).hint( { a:1, b:-1 } ) ),
+               ids( t.find( q ).sort( { a:1, b:-1 } ).hint( { a:1, b:-1, z:1 } ) ), tojson( q ) );
+} );
+assert.eq( t.count( { c:{ $gt:-3 } } ), t.find( { c:{ $gt:-3 } } ).sort( { c:-1 } ).hint( { c:-1 } ).itcount() );
+assert.eq( t.count( { c:{ $gte:"", $lte:"z" } } ),
+           t.find( { c:{ $gte:"", $lte:"z" } } ).hint( { c:-1 } ).itcount() );
+
+// covered queries get back the original number types
+q = { a:{ $gte:-2.5, $lt:2 } };
+e = t.find( q, { _id:0, a:1 } ).hint( { a:1, b:-1, z:1 } ).explain();
+assert( e.indexOnly, tojson( e ) );
+covered = t.find( q, { _id:0, a:1 } ).hint( { a:1, b:-1, z:1 } ).toArray();
+assert.eq( t.find( q, { _id:0, a:1 } ).hint( { a:1, b:-1 } ).toArray(), covered );
+assert( covered.some( function( o ) { return o.a instanceof NumberLong; } ) );
+
+// numbers of different types that are equal are duplicates
+u = db.jstests_index_keyformat_unique;
+u.drop();
+u.ensureIndex( { a:1 }, { unique:true, keyFormat:'binary' } );
+u.insert( { a:1 } );
+assert.eq( null, db.getLastError() );
+u.insert( { a:1.0 } );
+assert.eq( 11000, db.getLastErrorObj().code );
+u.insert( { a:NumberLong(1) } );
+assert.eq( 11000, db.getLastErrorObj().code );
+u.insert( { a:"1" } );
+assert.eq( null, db.getLastError() );
+assert.eq( 2, u.count() );
+
+// bad options
+u.ensureIndex( { b:1 }, { keyFormat:'memcmp' } );
+assert.eq( 17350, db.getLastErrorObj().code );
+u.ensureIndex( { b:'hashed' }, { keyFormat:'binary' } );
+assert.eq( 17351, db.getLastErrorObj().code );
+// primary keys are always v1, whether _id or defined
+u.ensureIndex( { _id:1 }, { keyFormat:'binary' } );
+assert.eq( 17385, db.getLastErrorObj().code );
+assert.eq( 2, u.getIndexes().length );
+
+p = db.jstests_index_keyformat_pk;
+p.drop();
+assert.commandWorked( db.runCommand( { create:p.getName(), primaryKey:{ a:1, _id:1 } } ) );
+p.ensureIndex( { a:1, _id:1 }, { keyFormat:'binary' } );
+assert.eq( 17385, db.getLastErrorObj().code );
+p.ensureIndex( { a:1, _id:1 }, { keyFormat:'v1' } );
+assert.eq( null, db.getLastError() );
+p.drop();
+
+t.drop();
+u.drop();
@@ -0,0 +1,44 @@
+// Multi-interval index scans warm their upcoming intervals in the background.
+
+t = db.jstests_index_prefetch;
+t.drop();
+
+for( i = 0; i < 10000; ++i ) {
+    t.insert( { _id:i, a:i % 100, b:i } );
+}
+t.ensureIndex( { a:1 } );
+t.ensureIndex( { a:1, b:-1 } );
+assert.eq( null, db.getLastError() );
+
+function prefetchedRanges() {
+    return db.serverStatus().metrics.queryExecutor.prefetch.ranges;
+}
+
+before = prefetchedRanges();
+
+// $in on a single field index
+inList = [];
+for( i = 0; i < 100; i += 3 ) {
+    inList.push( i );
+}
+assert.eq( inList.length * 100, t.find( { a:{ $in:inList } } ).hint( { a:1 } ).itcount() );
+// reverse
+assert.eq( inList.length * 100, t.find( { a:{ $in:inList } } ).hint( { a:1 } ).sort( { a:-1 } ).itcount() );
+// $in on the prefix of a compound index, with a range on the second field
+assert.eq( inList.length * 50,
+           t.find( { a:{ $in:inList }, b:{ $gte:5000 } } ).hint( { a:1, b:-1 } ).itcount() );
+// results don't depend on how the scan is split into batches
+assert.eq( t.find( { a:{ $in:inList } } ).hint( { a:1 } ).toArray(),
+           t.find( { a:{ $in:inList } } ).hint( { a:1 } ).batchSize( 7 ).toArray() );
+
+// the prefetcher may lose the race against a scan of hot data, but not every time
+assert.soon( function() {
+    t.find( { a:{ $in:inList } } ).hint( { a:1 } ).itcount();
+    return prefetchedRanges() > before;
+} );
+
+// the prefetcher is cancelled along with a cursor that is dropped early
+c = t.find( { a:{ $in:inList } } ).hint( { a:1 } ).batchSize( 2 );
+c.next();
+c.close();
+t.drop();
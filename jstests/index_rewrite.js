@@ -0,0 +1,86 @@
+// Changing index attributes with reIndex schedules a background rewrite of
+// the existing nodes, tracked in local.indexRewrites and serverStatus.
+
+var collname = 'index_rewrite';
+t = db[collname];
+t.drop();
+
+pad = new Array( 500 ).join( 'x' );
+for ( i = 0; i < 20000; ++i ) {
+    t.insert( { _id:i, a:i % 1000, s:pad + i } );
+}
+t.ensureIndex( { a:1 } );
+assert.eq( null, db.getLastError() );
+
+function rewriteStatus() {
+    return db.serverStatus().indexRewrite;
+}
+
+function indexStats( name ) {
+    var stats = t.stats().indexDetails;
+    for ( var i = 0; i < stats.length; ++i ) {
+        if ( stats[i].name == name ) {
+            return stats[i];
+        }
+    }
+    assert( false, 'no index ' + name );
+}
+
+function pendingRewrites() {
+    return db.getSisterDB( 'local' ).indexRewrites.count( { ns:t.getFullName() } );
+}
+
+// paused rewrites stay pending
+assert.commandWorked( db.adminCommand( { setParameter:1, indexRewriteMBPerSecond:0 } ) );
+before = rewriteStatus();
+assert.commandWorked( t.reIndex( 'a_1', { compression:'lzma' } ) );
+assert.soon( function() { return pendingRewrites() == 1; } );
+sleep( 1000 );
+assert.eq( before.completed, rewriteStatus().completed );
+assert.eq( 1, pendingRewrites() );
+
+// unpaused, the rewrite finishes and the data is unchanged
+assert.commandWorked( db.adminCommand( { setParameter:1, indexRewriteMBPerSecond:100, indexRewriteIOPS:0 } ) );
+assert.soon( function() { return pendingRewrites() == 0; } );
+assert.eq( before.completed + 1, rewriteStatus().completed );
+assert.lt( before.bytesRewritten, rewriteStatus().bytesRewritten );
+assert.eq( 'lzma', indexStats( 'a_1' ).compression );
+assert.eq( 20, t.find( { a:7 } ).hint( { a:1 } ).itcount() );
+
+// rewrites of dropped indexes are forgotten
+assert.commandWorked( db.adminCommand( { setParameter:1, indexRewriteMBPerSecond:0 } ) );
+assert.commandWorked( t.reIndex( 'a_1', { compression:'zlib' } ) );
+assert.soon( function() { return pendingRewrites() == 1; } );
+t.dropIndex( { a:1 } );
+assert.commandWorked( db.adminCommand( { setParameter:1, indexRewriteMBPerSecond:10, indexRewriteIOPS:100 } ) );
+assert.soon( function() { return pendingRewrites() == 0; } );
+assert.eq( before.completed + 1, rewriteStatus().completed );
+
+// descending indexes are walked from their own first key
+t.ensureIndex( { a:-1 } );
+assert.eq( null, db.getLastError() );
+before = rewriteStatus();
+assert.commandWorked( t.reIndex( 'a_-1', { compression:'lzma' } ) );
+assert.soon( function() { return pendingRewrites() == 0; } );
+assert.eq( before.completed + 1, rewriteStatus().completed );
+assert.lt( before.bytesRewritten, rewriteStatus().bytesRewritten );
+assert.eq( 'lzma', indexStats( 'a_-1' ).compression );
+assert.eq( 20, t.find( { a:7 } ).hint( { a:-1 } ).itcount() );
+
+// rewritten nodes take the new compression, so the index shrinks
+t.ensureIndex( { s:1 }, { compression:'uncompressed' } );
+assert.eq( null, db.getLastError() );
+assert.commandWorked( db.adminCommand( { checkpoint:1 } ) );
+var was = indexStats( 's_1' );
+assert.eq( 'uncompressed', was.compression );
+before = rewriteStatus();
+assert.commandWorked( t.reIndex( 's_1', { compression:'lzma' } ) );
+assert.soon( function() { return pendingRewrites() == 0; } );
+assert.eq( before.completed + 1, rewriteStatus().completed );
+assert.commandWorked( db.adminCommand( { checkpoint:1 } ) );
+var now = indexStats( 's_1' );
+assert.eq( 'lzma', now.compression );
+assert.lt( now.storageSize, was.storageSize );
+assert.eq( 20000, t.find().hint( { s:1 } ).itcount() );
+
+t.drop();
@@ -0,0 +1,44 @@
+// Hot index builds generate keys on helper threads, ahead of the indexer's scan.
+// The result must match a foreground build, including for documents written
+// while the hot build runs.
+
+t = db.jstests_indexer_bg_keygen;
+t.drop();
+
+N = 50000;
+for( i = 0; i < N; ++i ) {
+    t.insert( { _id:i, a:i % 1000, b:[ i, -i ], s:'x' + i } );
+}
+assert.eq( null, db.getLastError() );
+
+// update and remove documents while the build runs
+s = startParallelShell( 'c = db.jstests_indexer_bg_keygen;' +
+                        'for( i = 0; i < ' + N + '; i += 7 ) { c.update( { _id:i }, { $set:{ a:-1, b:[ 0 ] } } ); }' +
+                        'for( i = 3; i < ' + N + '; i += 11 ) { c.remove( { _id:i } ); }' +
+                        'db.getLastError();' );
+t.ensureIndex( { a:1, b:1 }, { background:true } );
+assert.eq( null, db.getLastError() );
+s();
+
+t.ensureIndex( { a:1, b:-1 } );
+assert.eq( null, db.getLastError() );
+
+function ids( q, hint ) {
+    return t.find( q ).hint( hint ).sort( { _id:1 } ).map( function( o ) { return o._id; } );
+}
+
+queries = [ {}, { a:-1 }, { a:{ $gte:10, $lt:20 } }, { b:{ $lt:-49000 } }, { a:5, b:{ $gte:0 } } ];
+queries.forEach( function( q ) {
+    assert.eq( ids( q, { a:1, b:-1 } ), ids( q, { a:1, b:1 } ), tojson( q ) );
+} );
+assert( t.find( { a:5 } ).hint( { a:1, b:1 } ).explain().isMultiKey );
+
+// with no helper threads, the indexer generates every key itself
+assert.commandWorked( db.adminCommand( { setParameter:1, hotIndexerThreads:0 } ) );
+t.ensureIndex( { s:1 }, { background:true } );
+assert.eq( null, db.getLastError() );
+assert.commandWorked( db.adminCommand( { setParameter:1, hotIndexerThreads:4 } ) );
+assert.eq( t.count(), t.find( { s:{ $gte:'' } } ).hint( { s:1 } ).itcount() );
+assert( !t.find( { s:'x1' } ).hint( { s:1 } ).explain().isMultiKey );
+
+t.drop();
@@ -0,0 +1,67 @@
+// Bulk loads and foreground index builds generate secondary keys on a pool
+// of threads, in batches. Results must not depend on how rows were batched.
+
+var filename;
+if (TestData.testDir !== undefined) {
+    load(TestData.testDir + "/_loader_helpers.js");
+} else {
+    load('jstests/_loader_helpers.js');
+}
+
+N = 30000;
+pad = new Array( 200 ).join( 'x' );
+
+function doc( i ) {
+    return { _id:i, a:i % 100, b:[ i, -i ], c:{ d:'s' + i }, p:pad };
+}
+
+function ids( t, q, hint ) {
+    return t.find( q ).hint( hint ).sort( { _id:1 } ).map( function( o ) { return o._id; } );
+}
+
+// bulk load, enough rows for several batches
+t = db.loaderkeygen;
+t.drop();
+begin();
+beginLoad( 'loaderkeygen', [ { key:{ a:1, b:1 }, name:'a_1_b_1' },
+                             { key:{ 'c.d':1 }, name:'c.d_1', unique:true } ], { } );
+for( i = 0; i < N; ++i ) {
+    t.insert( doc( i ) );
+}
+commitLoad();
+commit();
+assert.eq( N, t.count() );
+assert( t.find( { a:1 } ).hint( { a:1, b:1 } ).explain().isMultiKey );
+assert( !t.find( { 'c.d':'s1' } ).hint( { 'c.d':1 } ).explain().isMultiKey );
+
+// foreground index builds go through the same key generator
+t.ensureIndex( { a:1, b:-1 } );
+t.ensureIndex( { 'c.d':-1 } );
+assert.eq( null, db.getLastError() );
+queries = [ {}, { a:7 }, { a:{ $gte:10, $lt:20 } }, { b:{ $lt:-29000 } }, { a:5, b:{ $gte:0 } } ];
+queries.forEach( function( q ) {
+    assert.eq( ids( t, q, { a:1, b:-1 } ), ids( t, q, { a:1, b:1 } ), tojson( q ) );
+} );
+assert.eq( ids( t, { 'c.d':{ $gt:'s2' } }, { 'c.d':-1 } ), ids( t, { 'c.d':{ $gt:'s2' } }, { 'c.d':1 } ) );
+
+// rows whose keys can't be generated still fail the load and the build
+t.drop();
+begin();
+beginLoad( 'loaderkeygen', [ { key:{ a:1, b:1 }, name:'a_1_b_1' } ], { } );
+for( i = 0; i < 1000; ++i ) {
+    t.insert( { _id:i, a:i, b:i } );
+}
+t.insert( { _id:-1, a:[ 1, 2 ], b:[ 1, 2 ] } );
+commitLoadShouldFail();
+rollback();
+
+t.drop();
+t.insert( { _id:0, a:[ 1, 2 ], b:[ 1, 2 ] } );
+for( i = 1; i < 1000; ++i ) {
+    t.insert( { _id:i, a:i, b:i } );
+}
+t.ensureIndex( { a:1, b:1 } );
+assert.eq( 10888, db.getLastErrorObj().code );
+assert.eq( 1, t.getIndexes().length );
+
+t.drop();
@@ -0,0 +1,46 @@
+// Test _negotiateCompression and compressed replies.
+
+var conn = new Mongo( db.getMongo().host );
+var admin = conn.getDB( "admin" );
+var t = conn.getDB( db.getName() ).network_compression;
+t.drop();
+
+// nothing in common
+var res = new Mongo( db.getMongo().host ).getDB( "admin" ).runCommand( { _negotiateCompression : 1, compressors : [ "snappy" ] } );
+assert.commandWorked( res );
+assert.eq( "none", res.compressor );
+
+// not allowed
+var old = admin.runCommand( { getParameter : 1, networkCompression : 1 } ).networkCompression;
+assert.commandWorked( admin.runCommand( { setParameter : 1, networkCompression : false } ) );
+res = new Mongo( db.getMongo().host ).getDB( "admin" ).runCommand( { _negotiateCompression : 1, compressors : [ "zlib" ] } );
+assert.eq( "none", res.compressor );
+assert.commandWorked( admin.runCommand( { setParameter : 1, networkCompression : old } ) );
+
+var before = admin.serverStatus().network.compression;
+
+// the server compresses its replies on conn from now on, the shell decompresses whatever it gets
+res = admin.runCommand( { _negotiateCompression : 1, compressors : [ "snappy", "zlib" ] } );
+assert.commandWorked( res );
+assert.eq( "zlib", res.compressor );
+
+var big = new Array( 2000 ).join( "compressible " );
+for ( var i = 0; i < 500; i++ ) {
+    t.insert( { _id : i, s : big } );
+}
+assert.eq( null, t.getDB().getLastError() );
+
+var n = 0;
+t.find().sort( { _id : 1 } ).forEach( function( o ) {
+    assert.eq( n++, o._id );
+    assert.eq( big, o.s );
+} );
+assert.eq( 500, n );
+assert.eq( big, t.findOne( { _id : 123 } ).s );
+
+var after = admin.serverStatus().network.compression;
+assert.lt( before.out.messages, after.out.messages, "nothing was compressed" );
+assert.lt( after.out.wireBytes - before.out.wireBytes, after.out.bytes - before.out.bytes,
+           "compression didn't make messages smaller" );
+
+t.drop();
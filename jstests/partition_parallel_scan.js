@@ -0,0 +1,84 @@
+// test that queries over partitioned collections return the same results
+// when partitionScanParallelism reads several partitions at once
+tn = "partition_parallel_scan";
+t = db[tn];
+t.drop();
+
+assert.commandWorked(db.createCollection(tn, {partitioned:1, primaryKey : {ts:1, _id:1}}));
+t.ensureIndex({a:1});
+assert.eq(null, db.getLastError());
+for (i = 1; i <= 9; i++) {
+    assert.commandWorked(t.addPartition({ts: 1000*i}));
+}
+// leave one partition empty
+for (i = 0; i < 10000; i++) {
+    if (i < 3000 || i >= 4000) {
+        t.insert({_id : i, ts: i, a : i % 97, b: i % 13});
+    }
+}
+assert.eq(null, db.getLastError());
+
+setParallelism = function(n) {
+    assert.commandWorked(db.adminCommand({setParameter : 1, partitionScanParallelism : n}));
+}
+
+runQueries = function() {
+    var ret = {};
+    ret.all = t.find().toArray();
+    ret.reverse = t.find().sort({ts:-1}).toArray();
+    ret.range = t.find({ts : {$gte : 1500, $lt : 8500}}).toArray();
+    ret.matched = t.find({b : 3}).toArray();
+    ret.where = t.find({$where : "this.b == 3"}).toArray();
+    ret.sorted = t.find({a : {$lt : 10}}).sort({a:1}).hint({a:1}).toArray();
+    ret.sortedReverse = t.find({a : {$gte : 90}, b : {$ne : 5}}).sort({a:-1}).hint({a:1}).toArray();
+    ret.unsorted = t.find({a : {$lt : 10}}).hint({a:1}).toArray();
+    ret.covered = t.find({a : {$lt : 10}}, {_id:0, a:1}).hint({a:1}).toArray();
+    ret.limited = t.find({b : 7}).limit(5).toArray();
+    ret.count = t.count();
+    ret.countMatched = t.count({b : 3});
+    ret.countIndexed = t.find({a : {$lt : 10}}).hint({a:1}).count();
+    return ret;
+}
+
+// every partition but the first is handed to the parallel scan
+compareResults = function(serial, parallel) {
+    for (var k in serial) {
+        if (typeof(serial[k]) == "number") {
+            assert.eq(serial[k], parallel[k], k);
+        }
+        else {
+            assert.eq(serial[k].length, parallel[k].length, k);
+            for (var i = 0; i < serial[k].length; i++) {
+                assert(friendlyEqual(serial[k][i], parallel[k][i]), k + " differs at " + i);
+            }
+        }
+    }
+}
+
+setParallelism(0);
+serial = runQueries();
+assert.eq(9000, serial.count);
+
+fillsBefore = db.serverStatus().metrics.queryExecutor.partitionScan.fills;
+setParallelism(4);
+compareResults(serial, runQueries());
+fillsAfter = db.serverStatus().metrics.queryExecutor.partitionScan.fills;
+assert.lt(fillsBefore, fillsAfter, "no partitions read in parallel");
+
+// small batches, so each partition is read in several fills
+assert.commandWorked(db.adminCommand({setParameter : 1, partitionScanBatchSize : 7}));
+compareResults(serial, runQueries());
+
+// a getMore reads on from where the parallel scan left off
+setParallelism(3);
+c = t.find().batchSize(100);
+n = 0;
+while (c.hasNext()) {
+    assert.eq(serial.all[n]._id, c.next()._id);
+    n++;
+}
+assert.eq(serial.all.length, n);
+
+assert.commandWorked(db.adminCommand({setParameter : 1, partitionScanBatchSize : 1000}));
+setParallelism(0);
+t.drop();
@@ -0,0 +1,87 @@
+// test that a partitionPolicy adds and drops partitions in the background
+tn = "partition_rollover";
+t = db[tn];
+t.drop();
+
+// bad policies
+assert.commandFailed(db.createCollection(tn, {partitionPolicy : {rolloverHours : 1}}));
+assert.commandFailed(db.createCollection(tn, {partitioned:1, partitionPolicy : {rolloverMinutes : 1}}));
+assert.commandFailed(db.createCollection(tn, {partitioned:1, partitionPolicy : {keepPartitions : -1}}));
+assert.commandFailed(db.createCollection(tn, {partitioned:1, partitionPolicy : 5}));
+
+assert.commandWorked(db.createCollection(tn, {partitioned:1, primaryKey : {ts:1, _id:1}, partitionPolicy : {rolloverHours : 1}}));
+assert.eq({rolloverHours : 1}, db.system.namespaces.findOne({name : t.getFullName()}).options.partitionPolicy);
+assert.commandWorked(db.adminCommand({setParameter : 1, partitionRolloverIntervalSecs : 1}));
+
+numPartitions = function() {
+    return t.getPartitionInfo().numPartitions;
+}
+ts = 0;
+insertSome = function() {
+    for (var i = 0; i < 100; i++, ts++) {
+        t.insert({_id : ts, ts : ts});
+    }
+    assert.eq(null, db.getLastError());
+}
+makeOld = function(index, hours) {
+    var time = new Date();
+    time.setTime(time.valueOf() - hours*60*60*1000);
+    assert.commandWorked(db.runCommand({_changePartitionCreateTime : tn, index : index, createTime : time}));
+}
+// wait long enough for a few passes of the rollover job
+waitForPasses = function() {
+    var passes = db.serverStatus().metrics.partitionRollover.passes;
+    assert.soon(function() { return db.serverStatus().metrics.partitionRollover.passes > passes + 1; });
+}
+
+// an empty last partition is never rolled over, however old
+makeOld(0, 2);
+waitForPasses();
+assert.eq(1, numPartitions());
+
+// rollover by age
+insertSome();
+assert.soon(function() { return numPartitions() == 2; });
+waitForPasses();
+assert.eq(2, numPartitions(), "a new partition was rolled over too soon");
+assert.eq(100, t.count());
+
+// rollover by size
+insertSome();
+res = t.setPartitionPolicy({rolloverBytes : 1});
+assert.commandWorked(res);
+assert.eq({rolloverHours : 1}, res.was);
+assert.soon(function() { return numPartitions() == 3; });
+waitForPasses();
+assert.eq(3, numPartitions());
+
+// retention by count drops the oldest partitions
+insertSome();
+assert.commandWorked(t.setPartitionPolicy({keepPartitions : 2}));
+assert.soon(function() { return numPartitions() == 2; });
+info = t.getPartitionInfo();
+assert.eq(1, info.partitions[0]._id);
+assert.eq(200, t.count());
+assert.eq(100, t.find().sort({ts:1}).next().ts);
+
+// retention by age, judged by when the next partition was created
+assert.commandWorked(t.setPartitionPolicy({expireDays : 1}));
+waitForPasses();
+assert.eq(2, numPartitions());
+makeOld(1, 25);
+assert.soon(function() { return numPartitions() == 1; });
+assert.eq(100, t.count());
+
+// an empty policy removes it
+assert.commandWorked(t.setPartitionPolicy({}));
+assert(!db.system.namespaces.findOne({name : t.getFullName()}).options.partitionPolicy);
+assert.commandFailed(t.setPartitionPolicy({rolloverHours : "often"}));
+
+// only partitioned collections have a policy
+db.partition_rollover_plain.drop();
+db.partition_rollover_plain.insert({});
+assert.commandFailed(db.partition_rollover_plain.setPartitionPolicy({rolloverHours : 1}));
+db.partition_rollover_plain.drop();
+
+assert.commandWorked(db.adminCommand({setParameter : 1, partitionRolloverIntervalSecs : 60}));
+t.drop();
@@ -0,0 +1,98 @@
+// test that zoneMap indexes let queries skip partitions that cannot match
+tn = "partition_zone_maps";
+t = db[tn];
+t.drop();
+
+// zoneMap indexes are only for partitioned collections, and not sparse
+db.partition_zone_maps_plain.drop();
+db.partition_zone_maps_plain.ensureIndex({a:1}, {zoneMap:true});
+assert.neq(null, db.getLastError());
+db.partition_zone_maps_plain.drop();
+
+assert.commandWorked(db.createCollection(tn, {partitioned:1, primaryKey : {ts:1, _id:1}}));
+t.ensureIndex({a:1}, {sparse:true, zoneMap:true});
+assert.neq(null, db.getLastError());
+t.ensureIndex({a:1}, {zoneMap:true});
+t.ensureIndex({b:-1}, {zoneMap:true});
+t.ensureIndex({c:1});
+assert.eq(null, db.getLastError());
+
+// a follows ts, b runs against it, c is all over the place
+for (p = 0; p < 4; p++) {
+    for (i = 1000*p; i < 1000*(p+1); i++) {
+        t.insert({_id : i, ts : i, a : i, b : -i, c : i % 7});
+    }
+    assert.eq(null, db.getLastError());
+    assert.commandWorked(t.addPartition({ts : 1000*(p+1) - 0.5}));
+}
+// and the last partition stays empty
+
+info = t.getPartitionInfo();
+assert.eq(5, info.numPartitions);
+for (p = 0; p < 4; p++) {
+    assert.eq({min : 1000*p, max : 1000*(p+1) - 1}, info.partitions[p].zoneMaps.a_1, tojson(info.partitions[p]));
+    assert.eq({min : -(1000*(p+1) - 1), max : -1000*p}, info.partitions[p].zoneMaps["b_-1"], tojson(info.partitions[p]));
+}
+assert(!info.partitions[4].zoneMaps);
+
+skipped = function() {
+    return db.serverStatus().metrics.queryExecutor.zoneMaps.partitionsSkipped;
+}
+// the same answer, with and without zone maps
+check = function(query, hint, n) {
+    var before = skipped();
+    var withZoneMaps = t.find(query).hint(hint).sort({_id:1}).toArray();
+    assert.lt(before, skipped(), "no partitions skipped for " + tojson(query));
+    var tableScan = t.find(query).hint({$natural:1}).sort({_id:1}).toArray();
+    assert.eq(n, withZoneMaps.length, tojson(query));
+    assert.eq(tableScan, withZoneMaps, tojson(query));
+}
+
+check({a : 1500}, {a:1}, 1);
+check({a : {$gte : 1500, $lt : 2500}}, {a:1}, 1000);
+check({b : {$lte : -3500}}, {b:-1}, 500);
+check({a : 10, b : -3990}, {a:1}, 0);
+// zone maps on one index skip partitions for a scan of another
+n = 0;
+for (i = 2991; i < 4000; i++) {
+    if (i % 7 == 3) {
+        n++;
+    }
+}
+check({a : {$gt : 2990}, c : 3}, {c:1}, n);
+check({$or : [{a : 10}, {a : 3500}]}, {c:1}, 2);
+check({a : {$in : [5, 3005]}}, {a:1}, 2);
+check({a : 12345}, {a:1}, 0);
+assert.eq(1000, t.find({a : {$gte : 1000, $lt : 2000}}).hint({a:1}).count());
+
+// late inserts into capped partitions widen their zone maps
+t.insert({_id : "late", ts : 500, a : 5000, b : 1, c : 1});
+t.insert({_id : "array", ts : 1500, a : [1, 7777], b : -1500, c : 1});
+assert.eq(null, db.getLastError());
+info = t.getPartitionInfo();
+assert.eq({min : 0, max : 5000}, info.partitions[0].zoneMaps.a_1);
+assert.eq({min : -999, max : 1}, info.partitions[0].zoneMaps["b_-1"]);
+assert.eq({min : 1, max : 7777}, info.partitions[1].zoneMaps.a_1);
+assert.eq("late", t.find({a : 5000}).hint({a:1}).next()._id);
+assert.eq("array", t.find({a : 7777}).hint({c:1}).next()._id);
+assert.eq("late", t.find({b : 1}).hint({b:-1}).next()._id);
+
+// and so do updates
+t.update({_id : 10, ts : 10}, {$set : {a : -50}});
+assert.eq(null, db.getLastError());
+assert.eq(-50, t.getPartitionInfo().partitions[0].zoneMaps.a_1.min);
+assert.eq(10, t.find({a : -50}).hint({a:1}).next()._id);
+
+// an index built later gets zone maps for what is already there
+t.ensureIndex({ts:1, c:1}, {zoneMap:true});
+assert.eq(null, db.getLastError());
+info = t.getPartitionInfo();
+assert.eq({min : 1000, max : 1999}, info.partitions[1].zoneMaps["ts_1_c_1"]);
+
+// dropping partitions keeps the rest in step
+assert.commandWorked(t.dropPartition(info.partitions[1]._id));
+check({a : {$gte : 2500, $lt : 2600}}, {a:1}, 100);
+t.dropIndex({a:1});
+assert.eq(999, t.find({b : {$gt : -3500, $lt : -2500}}).hint({b:-1}).itcount());
+
+t.drop();
@@ -0,0 +1,51 @@
+/**
+ *  Measures how mongod copes with many mostly idle connections, serving each
+ *  connection from its own thread and from the connectionReactor worker pool.
+ *
+ *  For each number of idle connections, reports mongod's resident memory and
+ *  the throughput of a few busy benchRun clients next to them.
+ */
+
+var idleCounts = [ 0, 500, 2000 ];
+var busyThreads = 16;
+var seconds = 5;
+
+function measure( options ) {
+    var conn = MongoRunner.runMongod( options );
+    var t = conn.getDB( "test" ).connection_scaling;
+    for ( var i = 0; i < 1000; i++ ) {
+        t.insert( { _id : i, x : i } );
+    }
+    assert.eq( null, t.getDB().getLastError() );
+
+    var results = [];
+    var idle = [];
+    idleCounts.forEach( function( n ) {
+        while ( idle.length < n ) {
+            var c = new Mongo( conn.host );
+            // make the server set up the connection before it goes idle
+            assert.commandWorked( c.getDB( "admin" ).runCommand( { ping : 1 } ) );
+            idle.push( c );
+        }
+        var res = benchRun( { ops : [ { op : "findOne", ns : t.getFullName(),
+                                        query : { _id : { "#RAND_INT" : [ 0, 1000 ] } } } ],
+                              parallel : busyThreads,
+                              seconds : seconds,
+                              host : conn.host } );
+        var status = conn.getDB( "admin" ).serverStatus();
+        results.push( { idle : n,
+                        open : status.connections.current,
+                        residentMB : status.mem.resident,
+                        queriesPerSec : Math.round( res.query ),
+                        latencyMicros : res.findOneLatencyAverageMicros } );
+    } );
+    MongoRunner.stopMongod( conn );
+    return results;
+}
+
+var threads = measure( {} );
+var reactor = measure( { setParameter : "connectionReactor=true" } );
+print( "connection_scaling: thread per connection" );
+printjson( threads );
+print( "connection_scaling: connectionReactor" );
+printjson( reactor );
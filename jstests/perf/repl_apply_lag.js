@@ -0,0 +1,70 @@
+/**
+ *  Measures how long secondaries take to catch up on a recorded oplog,
+ *  with the serial applier and with parallel applier workers.
+ *
+ *  Both secondaries are stopped while the workload runs on the primary, so
+ *  the oplog they replay when restarted is the same.
+ */
+
+var numCollections = 8;
+var numTxns = 20000;
+var opsPerTxn = 4;
+var parallelThreads = 8;
+
+var rt = new ReplSetTest( { name : "repl_apply_lag", nodes : 3 } );
+var nodes = rt.nodeList();
+rt.startSet();
+rt.initiate( { _id : "repl_apply_lag",
+               members : [ { _id : 0, host : nodes[0], priority : 10 },
+                           { _id : 1, host : nodes[1], priority : 0 },
+                           { _id : 2, host : nodes[2], priority : 0 } ] } );
+var primary = rt.getMaster();
+rt.awaitSecondaryNodes();
+rt.awaitReplication();
+
+// record the oplog: every transaction writes to one collection,
+// consecutive transactions write to different collections
+rt.stop( 1 );
+rt.stop( 2 );
+var testDB = primary.getDB( "test" );
+for ( var i = 0; i < numTxns; i++ ) {
+    var docs = [];
+    for ( var j = 0; j < opsPerTxn; j++ ) {
+        docs.push( { _id : i * opsPerTxn + j, x : i, s : "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaa" } );
+    }
+    testDB[ "c" + ( i % numCollections ) ].insert( docs );
+}
+assert.eq( null, testDB.getLastError() );
+var last = primary.getDB( "local" )[ "oplog.rs" ].find().sort( { $natural : -1 } ).limit( 1 ).next()._id;
+
+function replay( n, threads ) {
+    var start = new Date();
+    var conn = rt.restart( n, { setParameter : "replApplierThreads=" + threads } );
+    conn.setSlaveOk();
+    // with parallel apply, the last entry can be applied before earlier
+    // ones, so wait for every document as well
+    assert.soon( function() {
+        var entry = conn.getDB( "local" )[ "oplog.rs" ].findOne( { _id : last } );
+        if ( entry == null || entry.a != true ) {
+            return false;
+        }
+        var count = 0;
+        for ( var c = 0; c < numCollections; c++ ) {
+            count += conn.getDB( "test" )[ "c" + c ].count();
+        }
+        return count == numTxns * opsPerTxn;
+    }, "secondary " + n + " did not catch up", 30 * 60 * 1000, 100 );
+    var millis = new Date() - start;
+    for ( var c = 0; c < numCollections; c++ ) {
+        assert.eq( numTxns * opsPerTxn / numCollections, conn.getDB( "test" )[ "c" + c ].count() );
+    }
+    printjson( conn.getDB( "test" ).serverStatus().metrics.repl.apply );
+    return millis;
+}
+
+var serial = replay( 1, 1 );
+var parallel = replay( 2, parallelThreads );
+print( "repl_apply_lag: " + numTxns + " transactions, serial applier: " + serial + "ms, " +
+       parallelThreads + " applier threads: " + parallel + "ms" );
+
+rt.stopSet();
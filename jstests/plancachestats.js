@@ -0,0 +1,81 @@
+// The query plan cache drops a pattern's plan when it scans much more per match than when it was
+// recorded, and planCacheStats reports hits, misses and replans per pattern.
+
+t = db.jstests_plancachestats;
+t.drop();
+
+t.ensureIndex( { a:1 } );
+t.ensureIndex( { b:1 } );
+// b:1 is a poor index for { a:1, b:1 }, its first 1500 keys don't match.
+for( i = 0; i < 1500; ++i ) {
+    t.insert( { a:2, b:1 } );
+}
+for( i = 0; i < 150; ++i ) {
+    t.insert( { a:1, b:1 } );
+}
+// a:1 scans 500 keys for only 20 matches of { a:3, b:7 }.
+for( i = 0; i < 500; ++i ) {
+    t.insert( { a:3, b:( i < 20 ? 7 : 0 ) } );
+}
+assert.eq( null, db.getLastError() );
+
+function patternStats() {
+    var res = db.runCommand( { planCacheStats:t.getName() } );
+    assert.commandWorked( res );
+    var ret = null;
+    res.patterns.forEach( function( p ) {
+                         if ( friendlyEqual( p.pattern.query, { a:'Equality', b:'Equality' } ) ) {
+                             ret = p;
+                         }
+                         } );
+    assert( ret, tojson( res ) );
+    return ret;
+}
+
+// The first query races the plans, the second one uses the cached plan.
+assert.eq( 150, t.find( { a:1, b:1 } ).itcount() );
+stats = patternStats();
+assert.eq( { a:1 }, stats.cachedPlan.index );
+assert.eq( 1, stats.misses );
+assert.eq( 0, stats.hits );
+assert.eq( 150, t.find( { a:1, b:1 } ).itcount() );
+assert.eq( 1, patternStats().hits );
+
+// The cached plan finds far fewer matches per key scanned, so it is dropped.
+assert.eq( 20, t.find( { a:3, b:7 } ).itcount() );
+stats = patternStats();
+assert.eq( 1, stats.replans );
+assert( !stats.cachedPlan, tojson( stats ) );
+assert.eq( 150, t.find( { a:1, b:1 } ).itcount() );
+stats = patternStats();
+assert.eq( 2, stats.misses );
+assert.eq( { a:1 }, stats.cachedPlan.index );
+
+// A ratio of 0 keeps the plan.
+old = db.adminCommand( { getParameter:1, queryCacheReplanRatio:1 } ).queryCacheReplanRatio;
+assert.commandWorked( db.adminCommand( { setParameter:1, queryCacheReplanRatio:0 } ) );
+assert.eq( 20, t.find( { a:3, b:7 } ).itcount() );
+assert.eq( { a:1 }, patternStats().cachedPlan.index );
+assert.commandWorked( db.adminCommand( { setParameter:1, queryCacheReplanRatio:old } ) );
+
+// Index changes still clear the cache, but the counters are kept.
+t.ensureIndex( { c:1 } );
+stats = patternStats();
+assert( !stats.cachedPlan, tojson( stats ) );
+assert.eq( 1, stats.replans );
+
+// Plans are ignored after queryCacheWritesPerPlan writes.
+old = db.adminCommand( { getParameter:1, queryCacheWritesPerPlan:1 } ).queryCacheWritesPerPlan;
+assert.commandWorked( db.adminCommand( { setParameter:1, queryCacheWritesPerPlan:5 } ) );
+assert.eq( 150, t.find( { a:1, b:1 } ).itcount() );
+assert.eq( { a:1 }, patternStats().cachedPlan.index );
+for( i = 0; i < 10; ++i ) {
+    t.insert( { a:4, b:4 } );
+}
+assert.eq( null, db.getLastError() );
+assert( !patternStats().cachedPlan );
+assert.commandWorked( db.adminCommand( { setParameter:1, queryCacheWritesPerPlan:old } ) );
+
+assert.commandFailed( db.runCommand( { planCacheStats:'jstests_plancachestats_missing' } ) );
+
+t.drop();
@@ -0,0 +1,111 @@
+// test that a batch of inserts goes into the oplog as one entry, and replicates
+var name = "batched_insert";
+
+var replTest = new ReplSetTest( {name: name, nodes: 2} );
+var nodes = replTest.startSet();
+var config = replTest.getReplSetConfig();
+config.members[1].priority = 0;
+replTest.initiate(config);
+
+var primary = replTest.getMaster().getDB(name);
+var primaryOplog = replTest.getMaster().getDB("local").oplog.rs;
+var slaveConns = replTest.liveNodes.slaves;
+slaveConns[0].setSlaveOk();
+var secondary = slaveConns[0].getDB(name);
+
+var primaryRefs = replTest.getMaster().getDB("local").oplog.refs;
+// the ops of the last transaction, whether or not it spilled to oplog.refs
+var lastOps = function() {
+    var entry = primaryOplog.find().sort({_id:-1}).next();
+    if (entry.ops) {
+        return entry.ops;
+    }
+    var ops = [];
+    primaryRefs.find({ "_id.oid": entry.ref }).sort({ _id: 1 }).forEach(function(refs) {
+        ops = ops.concat(refs.ops);
+    });
+    return ops;
+}
+
+// off by default, until every member can apply batched entries
+var res = primary.adminCommand({ getParameter: 1, logBatchedInserts: 1 });
+assert.commandWorked(res);
+assert.eq(false, res.logBatchedInserts);
+assert.commandWorked(primary.adminCommand({ setParameter: 1, logBatchedInserts: true }));
+
+assert.commandWorked(primary.runCommand({ create: 'x', primaryKey: { z: 1, _id: 1 }}));
+primary.x.ensureIndex({ c: 1 });
+primary.x.ensureIndex({ u: 1 }, { unique: true });
+
+// given out of pk order, with no _ids
+var batch = [];
+for (var i = 0; i < 100; i++) {
+    batch.push({ z: (i * 37) % 100, c: [i, -i], u: i });
+}
+primary.x.insert(batch);
+assert.eq(null, primary.getLastError());
+var ops = lastOps();
+assert.eq(1, ops.length, tojson(ops));
+assert.eq("ib", ops[0].op);
+assert.eq(100, ops[0].o.length);
+// the oplog has the rows in the order they were given, with their _ids
+assert.eq(37, ops[0].o[1].z);
+assert(ops[0].o[1]._id);
+replTest.awaitReplication();
+assert.eq(100, secondary.x.count());
+assert.eq(100, secondary.x.find().hint({ c: 1 }).itcount());
+assert.eq(primary.x.find().sort({ z: 1 }).toArray(), secondary.x.find().sort({ z: 1 }).toArray());
+
+// with keepGoing, only the rows that went in are logged
+batch = [];
+for (i = 100; i < 110; i++) {
+    batch.push({ z: i, u: (i == 105 ? 5 : i) });
+}
+primary.x.insert(batch, 1 /* continueOnError */);
+assert.eq(109, primary.x.count());
+ops = lastOps();
+assert.eq("ib", ops[0].op);
+assert.eq(9, ops[0].o.length);
+replTest.awaitReplication();
+assert.eq(109, secondary.x.count());
+
+// rows of one batch that collide on a unique key: the one given first wins,
+// even though it has the higher primary key
+primary.x.insert([{ z: 3001, u: 3000 }, { z: 3000, u: 3000 }, { z: 3002, u: 3002 }], 1 /* continueOnError */);
+assert.eq(1, primary.x.count({ u: 3000 }));
+assert.eq(3001, primary.x.findOne({ u: 3000 }).z);
+replTest.awaitReplication();
+assert.eq(3001, secondary.x.findOne({ u: 3000 }).z);
+
+// without keepGoing, a bad row fails the whole batch
+primary.x.insert([{ z: 200, u: 200 }, { z: 201, u: 0 }]);
+assert.neq(null, primary.getLastError());
+assert.eq(0, primary.x.count({ z: 200 }));
+
+// large rows are spread over a few entries, small enough to spill
+var big = new Array(300 * 1024).join("x");
+batch = [];
+for (i = 0; i < 10; i++) {
+    batch.push({ z: 1000 + i, u: 1000 + i, big: big });
+}
+primary.x.insert(batch);
+assert.eq(null, primary.getLastError());
+ops = lastOps();
+assert.lt(1, ops.length);
+var rows = 0;
+ops.forEach(function(op) { rows += (op.op == "ib" ? op.o.length : 1); });
+assert.eq(10, rows);
+replTest.awaitReplication();
+assert.eq(10, secondary.x.count({ z: { $gte: 1000 } }));
+
+// secondaries that don't know batched entries get one entry per row
+assert.commandWorked(primary.adminCommand({ setParameter: 1, logBatchedInserts: false }));
+primary.x.insert([{ z: 2000, u: 2000 }, { z: 2001, u: 2001 }]);
+ops = lastOps();
+assert.eq(2, ops.length);
+assert.eq("i", ops[0].op);
+assert.eq("i", ops[1].op);
+replTest.awaitReplication();
+assert.eq(primary.x.count(), secondary.x.count());
+
+replTest.stopSet(15);
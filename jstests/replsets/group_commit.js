@@ -0,0 +1,33 @@
+// Test that transactions writing to the oplog share log flushes when
+// they commit with fsync (logFlushPeriod = 0).
+
+var rt = new ReplSetTest( { name : "group_commit", nodes : 1,
+                            nodeOptions : { logFlushPeriod : 0 } } );
+rt.startSet();
+rt.initiate();
+var primary = rt.getPrimary();
+var adminDB = primary.getDB( "admin" );
+
+assert.commandWorked( adminDB.runCommand( { setParameter : 1, groupCommitWaitMicros : 500 } ) );
+var before = primary.getDB( "test" ).serverStatus().metrics.storage.groupCommit;
+
+var shells = [];
+for ( var i = 0; i < 8; i++ ) {
+    shells.push( startParallelShell( "for ( var j = 0; j < 500; j++ ) { " +
+                                     "db.getSiblingDB( 'test' ).c" + i + ".insert( { x : j } ); " +
+                                     "db.getSiblingDB( 'test' ).getLastError(); }",
+                                     primary.port ) );
+}
+shells.forEach( function( join ) { join(); } );
+
+var after = primary.getDB( "test" ).serverStatus().metrics.storage.groupCommit;
+printjson( after );
+var commits = after.commits - before.commits;
+var flushes = after.flushes.num - before.flushes.num;
+assert( commits >= 8 * 500, "too few group commits " + commits );
+assert( flushes > 0 && flushes <= commits, "bad number of flushes " + flushes );
+for ( var i = 0; i < 8; i++ ) {
+    assert.eq( 500, primary.getDB( "test" )[ "c" + i ].count() );
+}
+
+rt.stopSet();
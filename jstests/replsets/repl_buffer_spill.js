@@ -0,0 +1,40 @@
+// Test that a secondary applies transactions that did not fit in the
+// replication buffer, by reading them back from its oplog.
+
+var rt = new ReplSetTest( { name : "repl_buffer_spill" , nodes : 2 } );
+rt.startSet();
+rt.initiate();
+rt.awaitSecondaryNodes();
+
+var primary = rt.getPrimary();
+var secondary = rt.getSecondary();
+
+// spill every transaction
+assert.commandWorked( secondary.getDB( "admin" ).runCommand( { setParameter : 1, replBufferMaxSize : 0 } ) );
+
+var testDB = primary.getDB( "test" );
+for ( var i = 0; i < 1000; i++ ) {
+    testDB.a.insert( { _id : i, x : i } );
+    testDB.a.update( { _id : i }, { $inc : { x : 1 } } );
+}
+testDB.a.remove( { _id : { $lt : 100 } } );
+assert.eq( null, testDB.getLastError() );
+rt.awaitReplication();
+
+secondary.setSlaveOk();
+var ss = secondary.getDB( "test" ).serverStatus();
+assert.eq( 0, ss.metrics.repl.buffer.maxSizeBytes );
+// everything spilled has been applied by now
+assert.eq( 0, ss.metrics.repl.buffer.spilled );
+// 1000 inserts, 1000 updates and the remove
+assert.gte( ss.metrics.repl.buffer.spilledTotal, 2001 );
+assert.eq( 900, secondary.getDB( "test" ).a.count() );
+assert.eq( 901, secondary.getDB( "test" ).a.findOne( { _id : 900 } ).x );
+
+// go back to buffering in memory
+assert.commandWorked( secondary.getDB( "admin" ).runCommand( { setParameter : 1, replBufferMaxSize : "64MB" } ) );
+testDB.a.insert( { _id : 1000, x : 1000 } );
+rt.awaitReplication();
+assert.eq( 901, secondary.getDB( "test" ).a.count() );
+
+rt.stopSet();
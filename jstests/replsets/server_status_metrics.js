@@ -13,8 +13,8 @@ function testSecondaryMetrics(secondary, opCount, offset) {
 
     assert(ss.metrics.repl.buffer.count >= 0, "buffer count missing")
     assert(ss.metrics.repl.buffer.sizeBytes >= 0, "size (bytes)] missing")
-    // doesn't exist in tokumx
-    //assert(ss.metrics.repl.buffer.maxSizeBytes >= 0, "maxSize (bytes) missing")
+    assert(ss.metrics.repl.buffer.maxSizeBytes >= 0, "maxSize (bytes) missing")
+    assert(ss.metrics.repl.buffer.spilled >= 0, "spilled count missing")
 
     //assert(ss.metrics.repl.preload.docs.num >= 0, "preload.docs num  missing")
     //assert(ss.metrics.repl.preload.docs.totalMillis  >= 0, "preload.docs time missing")
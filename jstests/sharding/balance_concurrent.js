@@ -0,0 +1,60 @@
+// The balancer picks several chunks per collection per round, between disjoint pairs of shards, and
+// runs migrations of different collections at the same time.  It reports how fast it went in the
+// changelog and in serverStatus.
+
+s = new ShardingTest( "balance_concurrent" , 4 , 0 , 1 , { chunksize : 1 } );
+s.stopBalancer();
+
+shards = s.config.shards.find().sort( { _id : 1 } ).toArray();
+admin = s.s.getDB( "admin" );
+
+// two collections in two databases, half of each one's chunks on each of its first two shards
+[ "a" , "b" ].forEach( function( name , n ) {
+    var ns = name + ".data";
+    s.adminCommand( { enablesharding : name } );
+    admin.runCommand( { moveprimary : name , to : shards[2 * n]._id } );
+    s.adminCommand( { shardcollection : ns , key : { _id : 1 } } );
+    for ( var i = 1; i < 16; i++ ) {
+        s.adminCommand( { split : ns , middle : { _id : i } } );
+    }
+    for ( var i = 8; i < 16; i++ ) {
+        s.adminCommand( { movechunk : ns , find : { _id : i } , to : shards[2 * n + 1]._id } );
+    }
+} );
+
+function counts( ns ) {
+    return shards.map( function( shard ) {
+        return s.config.chunks.count( { ns : ns , shard : shard._id } );
+    } );
+}
+
+s.startBalancer();
+assert.soon( function() {
+    var balanced = true;
+    [ "a.data" , "b.data" ].forEach( function( ns ) {
+        var c = counts( ns );
+        print( ns + ": " + tojson( c ) );
+        balanced = balanced && Math.max.apply( null , c ) - Math.min.apply( null , c ) <= 2;
+    } );
+    return balanced;
+} , "not balanced" , 5 * 60 * 1000 , 1000 );
+s.stopBalancer();
+
+rounds = s.config.changelog.find( { what : "balancer.round" } ).toArray();
+printjson( rounds );
+assert.lt( 0 , rounds.length , "no rounds in the changelog" );
+assert( rounds.some( function( r ) { return r.details.candidates > 2; } ) ,
+        "never more than one chunk per collection in a round" );
+assert( rounds.some( function( r ) { return r.details.concurrency > 1; } ) ,
+        "never ran migrations concurrently" );
+rounds.forEach( function( r ) {
+    assert.lte( 0 , r.details.chunksPerMinute );
+} );
+
+status = admin.runCommand( { serverStatus : 1 } ).balancer;
+printjson( status );
+assert.lt( 0 , status.migrations.moved );
+assert.lte( status.migrations.moved , status.migrations.attempted );
+assert( status.lastRound , "no last round" );
+
+s.stop();
@@ -0,0 +1,55 @@
+// Shards count the reads and writes to each of their chunks, report them with chunkHeat, and
+// suggest splitting a chunk where its writes are with splitVector's hot option.
+
+s = new ShardingTest( "chunk_heat" , 2 , 0 , 1 );
+s.stopBalancer();
+
+s.adminCommand( { enablesharding : "test" } );
+s.adminCommand( { shardcollection : "test.data" , key : { _id : 1 } } );
+s.adminCommand( { split : "test.data" , middle : { _id : 0 } } );
+
+db = s.getDB( "test" );
+shard = s.getServer( "test" );
+shardAdmin = shard.getDB( "admin" );
+
+// a low bar, so this many writes make a chunk hot
+assert.commandWorked( shardAdmin.runCommand( { setParameter : 1 , chunkHeatSplitWritesPerSec : 1 } ) );
+
+N = 1000;
+for ( i = 0; i < N; i++ ) {
+    db.data.insert( { _id : i } );
+}
+db.getLastError();
+for ( i = 0; i < 100; i++ ) {
+    assert( db.data.findOne( { _id : i } ) );
+}
+
+heat = shardAdmin.runCommand( { chunkHeat : "test.data" } );
+printjson( heat );
+assert.commandWorked( heat );
+assert.eq( 1 , heat.chunks.length , "only the written chunk: " + tojson( heat.chunks ) );
+chunk = heat.chunks[0];
+assert.eq( { _id : 0 } , chunk.min );
+assert.lt( 0 , chunk.writesPerSec );
+assert.lt( 0 , chunk.readsPerSec );
+assert.lt( 0 , chunk.writeBytesPerSec );
+assert.lte( chunk.writesPerSec + chunk.readsPerSec - 0.01 , chunk.opsPerSec );
+
+res = shardAdmin.runCommand( { splitVector : "test.data" , keyPattern : { _id : 1 } ,
+                               min : { _id : 0 } , max : { _id : MaxKey } ,
+                               maxChunkSizeBytes : 1024 * 1024 , hot : true } );
+printjson( res );
+assert.commandWorked( res );
+assert( res.hot , "not split for heat" );
+assert.eq( 1 , res.splitKeys.length );
+assert.lt( 0 , res.splitKeys[0]._id );
+assert.gt( N , res.splitKeys[0]._id );
+
+// nothing to say about a range no one wrote to
+res = shardAdmin.runCommand( { splitVector : "test.data" , keyPattern : { _id : 1 } ,
+                               min : { _id : MinKey } , max : { _id : 0 } ,
+                               maxChunkSizeBytes : 1024 * 1024 , hot : true } );
+assert.commandWorked( res );
+assert( ! res.hot );
+
+s.stop();
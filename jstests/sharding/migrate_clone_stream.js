@@ -0,0 +1,41 @@
+// The recipient of a migration streams the clone from the donor, and reports how it went in
+// _recvChunkStatus.
+
+s = new ShardingTest( "migrate_clone_stream" , 2 , 0 , 1 );
+s.stopBalancer();
+
+s.adminCommand( { enablesharding : "test" } );
+s.adminCommand( { shardcollection : "test.data" , key : { _id : 1 } } );
+
+db = s.getDB( "test" );
+
+N = 20000;
+big = new Array( 1000 ).join( "x" );
+for ( i = 0; i < N; i++ ) {
+    db.data.insert( { _id : i , s : big } );
+}
+db.getLastError();
+
+primary = s.getServer( "test" );
+other = s.getOther( primary );
+
+// a small batch count, so the fetcher has to wait for the inserts to catch up
+assert.commandWorked( other.getDB( "admin" ).runCommand( { setParameter : 1 ,
+                                                          migrateCloneBatchesInFlight : 1 } ) );
+s.adminCommand( { movechunk : "test.data" , find : { _id : 0 } , to : other.name } );
+
+assert.eq( N , other.getDB( "test" ).data.count() , "recipient count" );
+assert.eq( N , db.data.find().itcount() , "count through mongos" );
+
+status = other.getDB( "admin" ).runCommand( { _recvChunkStatus : 1 } );
+printjson( status );
+assert.eq( "done" , status.state );
+assert.eq( N , status.counts.cloned );
+assert( status.clone.streaming , "clone didn't stream" );
+// documents are inserted a batch at a time, not one by one
+assert.lt( 1 , status.clone.batches );
+assert.gt( N / 10 , status.clone.batches , "clone didn't insert in batches" );
+assert.lte( 0 , status.clone.bytesPerSec );
+assert.eq( 0 , status.lag.lastRoundOps );
+
+s.stop();
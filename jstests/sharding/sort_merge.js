@@ -0,0 +1,69 @@
+// Sorted queries through mongos merge the shards' results in order, with and without prefetching
+// the shards' next batches.
+
+s = new ShardingTest( "sort_merge" , 3 , 0 , 1 );
+s.stopBalancer();
+
+s.adminCommand( { enablesharding : "test" } );
+s.adminCommand( { shardcollection : "test.data" , key : { _id : 1 } } );
+
+db = s.getDB( "test" );
+
+N = 3000;
+big = new Array( 2000 ).join( "x" );
+for ( i = 0; i < N; i++ ) {
+    o = { _id : i , a : i % 17 , b : { c : ( i * 7 ) % 101 } , s : big };
+    if ( i % 13 == 0 )
+        delete o.a; // sorts like null
+    db.data.insert( o );
+}
+db.getLastError();
+
+shards = s.config.shards.find().toArray();
+for ( i = 1; i < shards.length; i++ ) {
+    s.adminCommand( { split : "test.data" , middle : { _id : i * N / shards.length } } );
+    s.adminCommand( { movechunk : "test.data" , find : { _id : i * N / shards.length } ,
+                      to : shards[i]._id , waitForDelete : true } );
+}
+assert.eq( shards.length , s.config.chunks.count( { ns : "test.data" } ) , "chunks" );
+
+function key( o , f ) {
+    var v = f == "b.c" ? o.b.c : o[f];
+    return v === undefined ? null : v;
+}
+
+function cmp( x , y ) {
+    if ( x === y ) return 0;
+    if ( x === null ) return -1;
+    if ( y === null ) return 1;
+    return x < y ? -1 : 1;
+}
+
+function check( sort ) {
+    var fields = Object.keySet( sort );
+    var all = db.data.find( {} , { s : 0 } ).sort( sort ).toArray();
+    assert.eq( N , all.length , tojson( sort ) );
+    for ( var i = 1; i < all.length; i++ ) {
+        var c = 0;
+        for ( var k = 0; k < fields.length && c == 0; k++ ) {
+            c = cmp( key( all[i - 1] , fields[k] ) , key( all[i] , fields[k] ) ) * sort[fields[k]];
+        }
+        assert.lte( c , 0 , tojson( sort ) + " out of order at " + i + ": " +
+                    tojson( all[i - 1] ) + " " + tojson( all[i] ) );
+    }
+}
+
+admin = s.s.getDB( "admin" );
+[ 25 , 0 , 100 ].forEach( function( percent ) {
+    assert.commandWorked( admin.runCommand( { setParameter : 1 ,
+                                              shardCursorPrefetchPercent : percent } ) );
+    check( { _id : 1 } );
+    check( { _id : -1 } );
+    check( { a : 1 , _id : 1 } );
+    check( { a : -1 , "b.c" : 1 } );
+
+    // big documents, so each shard returns several batches
+    assert.eq( N , db.data.find().sort( { "b.c" : 1 } ).itcount() , "big " + percent );
+} );
+
+s.stop();
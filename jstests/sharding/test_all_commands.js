@@ -151,6 +151,7 @@ var commands = [
     //'rsreconfig',
     'serverStatus',
     'setParameter',
+    'setPartitionPolicy',
     'setShardVersion',
     'shardCollection',
     'shardConnPoolStats',
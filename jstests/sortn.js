@@ -0,0 +1,58 @@
+// In memory sorts keep sort keys and pks rather than documents, and spill them
+// to disk when they don't fit. Results past the first 32MB are left to getMore.
+
+t = db.jstests_sortn;
+t.drop();
+
+// 40MB of documents, but small sort keys and small results
+big = new Array( 1000000 ).toString();
+for( i = 0; i < 40; ++i ) {
+    t.save( { _id:i, a:( i * 7 ) % 40, big:big } );
+}
+assert.eq( null, db.getLastError() );
+
+res = t.find( {}, { a:1 } ).sort( { a:-1 } ).toArray();
+assert.eq( 40, res.length );
+for( i = 0; i < 40; ++i ) {
+    assert.eq( 39 - i, res[ i ].a );
+}
+res = t.find( {}, { a:1 } ).sort( { a:1 } ).skip( 5 ).limit( 3 ).toArray();
+assert.eq( [ 5, 6, 7 ], res.map( function( o ) { return o.a; } ) );
+
+// 40MB of results take more than one batch
+res = [];
+t.find().sort( { a:1 } ).forEach( function( o ) { res.push( o.a ); } );
+assert.eq( 40, res.length );
+for( i = 0; i < 40; ++i ) {
+    assert.eq( i, res[ i ] );
+}
+
+// unless a single batch is asked for
+assert.throws( function() { t.find().sort( { a:1 } ).limit( -40 ).itcount(); } );
+assert( db.getLastError().match( /too much data for sort\(\) with no index/ ) );
+
+// 40MB of sort keys are spilled to disk and merged, ties keep their order
+t.drop();
+key = new Array( 100000 ).toString();
+for( i = 0; i < 400; ++i ) {
+    t.save( { _id:i, k:key + ( ( i * 7 ) % 200 ) } );
+}
+assert.eq( null, db.getLastError() );
+
+res = t.find( {}, { _id:1 } ).sort( { k:1 } ).toArray();
+assert.eq( 400, res.length );
+expected = t.find( {}, { _id:1 } ).toArray().sort( function( l, r ) {
+    var lk = ( l._id * 7 ) % 200 + '', rk = ( r._id * 7 ) % 200 + '';
+    return lk < rk ? -1 : lk > rk ? 1 : l._id - r._id;
+} );
+assert.eq( expected, res );
+
+// the whole documents don't fit in one batch either
+res = [];
+t.find().sort( { k:1 } ).forEach( function( o ) { res.push( { _id:o._id } ); } );
+assert.eq( expected, res );
+
+res = t.find( {}, { _id:1 } ).sort( { k:-1 } ).limit( 10 ).toArray();
+assert.eq( 10, res.length );
+
+t.drop();
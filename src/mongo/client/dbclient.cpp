@@ -947,6 +947,32 @@ namespace mongo {
                     ex.what() << std::endl;
             }
         }
+        if ( _wantCompression ) {
+            _negotiateCompression();
+        }
+    }
+
+    bool DBClientConnection::negotiateCompression() {
+        _wantCompression = true;
+        return _negotiateCompression();
+    }
+
+    bool DBClientConnection::_negotiateCompression() {
+        BSONObj info;
+        // Servers that don't know the command just say so, and the connection stays as it was.
+        if ( !runCommand( "admin", BSON( "_negotiateCompression" << 1 <<
+                                         "compressors" << BSON_ARRAY( "zlib" ) ), info ) ) {
+            LOG(_logLevel) << "not compressing connection to " << _serverString << ": " << info << endl;
+            return false;
+        }
+        MessageCompressor::Id id = MessageCompressor::fromName( info["compressor"].valuestrsafe() );
+        if ( id == MessageCompressor::None ) {
+            return false;
+        }
+        p->setCompressor( id );
+        LOG(_logLevel) << "compressing connection to " << _serverString << " with "
+                       << MessageCompressor::name( id ) << endl;
+        return true;
     }
 
     void DBClientConnection::setSoTimeout(double timeout) {
@@ -1438,7 +1438,7 @@ namespace mongo {
     const size_t DBClientReplicaSet::MAX_RETRY = 3;
 
     DBClientReplicaSet::DBClientReplicaSet( const string& name , const vector<HostAndPort>& servers, double so_timeout )
-        : _setName( name ), _so_timeout( so_timeout ) {
+        : _setName( name ), _so_timeout( so_timeout ), _wantCompression( false ) {
         ReplicaSetMonitor::createIfNeeded( name, servers );
     }
 
@@ -1553,9 +1553,17 @@ namespace mongo {
         _master->setReplSetClientCallback(this);
 
         _auth( _master.get() );
+        if ( _wantCompression ) {
+            _master->negotiateCompression();
+        }
         return _master.get();
     }
 
+    bool DBClientReplicaSet::negotiateCompression() {
+        _wantCompression = true;
+        return checkMaster()->negotiateCompression();
+    }
+
     bool DBClientReplicaSet::checkLastHost(const ReadPreferenceSetting* readPref) {
         if (_lastSlaveOkHost.empty()) {
             return false;
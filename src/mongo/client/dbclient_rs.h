@@ -514,6 +514,9 @@ namespace mongo {
         virtual ConnectionString::ConnectionType type() const { return ConnectionString::SET; }
         virtual bool lazySupported() const { return true; }
 
+        /** Negotiated with the primary, and again with each new primary. */
+        virtual bool negotiateCompression();
+
         // ---- low level ------
 
         virtual bool call( Message &toSend, Message &response, bool assertOk=true , string * actualServer = 0 );
@@ -648,6 +651,7 @@ namespace mongo {
         boost::shared_ptr<ReadPreferenceSetting> _lastReadPref;
         
         double _so_timeout;
+        bool _wantCompression;
 
         // we need to store so that when we connect to a new node on failure
         // we can re-auth
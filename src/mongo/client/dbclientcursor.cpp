@@ -117,9 +117,7 @@ namespace mongo {
         return ok;
     }
 
-    void DBClientCursor::requestMore() {
-        verify( cursorId && batch.pos == batch.nReturned );
-
+    void DBClientCursor::_assembleGetMore( Message& toSend ) {
         if (haveLimit) {
             nToReturn -= batch.nReturned;
             verify(nToReturn > 0);
@@ -130,10 +128,31 @@ namespace mongo {
         b.appendNum(nextBatchSize());
         b.appendNum(cursorId);
 
-        Message toSend;
         toSend.setData(dbGetMore, b.buf(), b.len());
+    }
+
+    void DBClientCursor::requestMore() {
+        verify( cursorId && batch.pos == batch.nReturned );
+
         auto_ptr<Message> response(new Message());
 
+        if ( _prefetchConn ) {
+            // prefetch() already sent the getMore
+            auto_ptr<ScopedDbConnection> conn( _prefetchConn );
+            _prefetchConn = NULL;
+            uassert( 17364, "recv failed while reading prefetched getMore",
+                     conn->get()->recv( *response ) );
+            _client = conn->get();
+            this->batch.m = response;
+            dataReceived();
+            _client = 0;
+            conn->done();
+            return;
+        }
+
+        Message toSend;
+        _assembleGetMore( toSend );
+
         if ( _client ) {
             _client->call( toSend, *response );
             this->batch.m = response;
@@ -152,6 +171,21 @@ namespace mongo {
         }
     }
 
+    void DBClientCursor::prefetch() {
+        if ( _prefetchConn || _client || _scopedHost.empty() || !cursorId || haveLimit ||
+             ( opts & ( QueryOption_CursorTailable | QueryOption_Exhaust ) ) ) {
+            return;
+        }
+
+        Message toSend;
+        _assembleGetMore( toSend );
+
+        auto_ptr<ScopedDbConnection> conn(
+                ScopedDbConnection::getScopedDbConnection( _scopedHost ) );
+        conn->get()->say( toSend );
+        _prefetchConn = conn.release();
+    }
+
     /** with QueryOption_Exhaust, the server just blasts data at us (marked at end with cursorid==0). */
     void DBClientCursor::exhaustReceiveMore() {
         verify( cursorId && batch.pos == batch.nReturned );
@@ -221,7 +255,13 @@ namespace mongo {
         if ( cursorId == 0 )
             return false;
 
-        requestMore();
+        if ( ( opts & QueryOption_Exhaust ) && !batch.m->empty() ) {
+            // the server sends the next batch without being asked, once it has sent one
+            exhaustReceiveMore();
+        }
+        else {
+            requestMore();
+        }
         return batch.pos < batch.nReturned;
     }
 
@@ -321,6 +361,18 @@ namespace mongo {
 
         DESTRUCTOR_GUARD (
 
+        if ( _prefetchConn ) {
+            // Read the reply so the connection can go back to the pool.
+            auto_ptr<ScopedDbConnection> conn( _prefetchConn );
+            _prefetchConn = NULL;
+            Message response;
+            if ( conn->get()->recv( response ) ) {
+                QueryResult *qr = (QueryResult *) response.singleData();
+                cursorId = qr->cursorId;
+                conn->done();
+            }
+        }
+
         if ( cursorId && _ownCursor && ! inShutdown() ) {
             BufBuilder b;
             b.appendNum( (int)0 ); // reserved
@@ -29,6 +29,7 @@
 namespace mongo {
 
     class AScopedConnection;
+    class ScopedDbConnection;
 
     /** for mock purposes only -- do not create variants of DBClientCursor, nor hang code here 
         @see DBClientMockCursor
@@ -57,6 +58,19 @@ namespace mongo {
         int objsLeftInBatch() const { _assertIfNull(); return _putBack.size() + batch.nReturned - batch.pos; }
         bool moreInCurrentBatch() { return objsLeftInBatch() > 0; }
 
+        /** number of objects in the last batch received from the server */
+        int objsInBatch() const { _assertIfNull(); return batch.nReturned; }
+
+        /**
+         * Ask the server for the next batch now, if there will be one, so that it's on its way
+         * while the rest of this batch is used.  more() reads it once this batch runs out.
+         * Only for cursors that have been attach()ed, since the getMore goes out on a pooled
+         * connection of the cursor's own, which it holds until the reply has been read.  Not for
+         * tailable or exhaust cursors, or cursors with a limit.
+         */
+        void prefetch();
+        bool prefetching() const { return _prefetchConn != NULL; }
+
         /** next
            @return next object in the result cursor.
            on an error at the remote server, you will get back:
@@ -147,7 +161,8 @@ namespace mongo {
             resultFlags(0),
             cursorId(),
             _ownCursor( true ),
-            wasError( false ) {
+            wasError( false ),
+            _prefetchConn( NULL ) {
             _finishConsInit();
         }
 
@@ -163,7 +178,8 @@ namespace mongo {
             resultFlags(0),
             cursorId(_cursorId),
             _ownCursor(true),
-            wasError(false) {
+            wasError(false),
+            _prefetchConn(NULL) {
             _finishConsInit();
         }
 
@@ -262,11 +278,14 @@ namespace mongo {
         string _scopedHost;
         string _lazyHost;
         bool wasError;
+        // holds the connection a prefetch()ed getMore was sent on
+        ScopedDbConnection* _prefetchConn;
 
         void dataReceived() { bool retry; string lazyHost; dataReceived( retry, lazyHost ); }
         void dataReceived( bool& retry, string& lazyHost );
         void requestMore();
         void exhaustReceiveMore(); // for exhaust
+        void _assembleGetMore( Message& toSend );
 
         // Don't call from a virtual function
         void _assertIfNull() const { uassert(13348, "connection died", this); }
@@ -1130,6 +1130,13 @@ namespace mongo {
             return INVALID_SOCK_CREATION_TIME;
         }
 
+        /**
+         * Ask the server to compress what it sends on this connection, and compress what is
+         * sent to it.  Worth it for connections that move a lot of data, like replication's.
+         * @return true if the server agreed, false if it didn't or doesn't know how.
+         */
+        virtual bool negotiateCompression() { return false; }
+
     }; // DBClientBase
 
     class DBClientReplicaSet;
@@ -1154,7 +1161,8 @@ namespace mongo {
            Connect timeout is fixed, but short, at 5 seconds.
          */
         DBClientConnection(bool _autoReconnect=false, DBClientReplicaSet* cp=0, double so_timeout=0) :
-            clientSet(cp), _failed(false), autoReconnect(_autoReconnect), lastReconnectTry(0), _so_timeout(so_timeout) {
+            clientSet(cp), _failed(false), autoReconnect(_autoReconnect), lastReconnectTry(0), _so_timeout(so_timeout),
+            _wantCompression(false) {
             _numConnections++;
         }
 
@@ -1274,6 +1282,9 @@ namespace mongo {
 
         uint64_t getSockCreationMicroSec() const;
 
+        /** Compression is negotiated again after a reconnect. */
+        virtual bool negotiateCompression();
+
     protected:
         friend class SyncClusterConnection;
         virtual void _auth(const BSONObj& params);
@@ -1294,7 +1305,9 @@ namespace mongo {
 
         map<string, BSONObj> authCache;
         double _so_timeout;
+        bool _wantCompression;
         bool _connect( string& errmsg );
+        bool _negotiateCompression();
 
         static AtomicUInt _numConnections;
         static bool _lazyKillCursor; // lazy means we piggy back kill cursors on next op
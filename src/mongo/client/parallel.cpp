@@ -23,6 +23,7 @@
 #include "mongo/client/dbclientcursor.h"
 #include "mongo/client/parallel.h"
 #include "mongo/db/dbmessage.h"
+#include "mongo/db/server_parameters.h"
 #include "mongo/s/chunk.h"
 #include "mongo/s/chunk_version.h"
 #include "mongo/s/config.h"
@@ -34,6 +35,10 @@ namespace mongo {
 
     LabeledLevel pc( "pcursor", 2 );
 
+    // ParallelSortClusteredCursor asks a shard for its next batch once no more than this percent
+    // of its current batch is left.  Zero waits for the batch to run out.
+    MONGO_EXPORT_SERVER_PARAMETER(shardCursorPrefetchPercent, int, 25);
+
     // --------  ClusteredCursor -----------
 
     ClusteredCursor::ClusteredCursor( const QuerySpec& q ) {
@@ -478,6 +483,7 @@ namespace mongo {
         _numServers = _servers.size();
         _lastFrom = 0;
         _cursors = 0;
+        _heapReady = false;
 
         if( ! _qSpec.isEmpty() ){
 
@@ -1599,6 +1605,12 @@ namespace mongo {
             _needToSkip = n;
         }
 
+        if ( ! _sortKey.isEmpty() ) {
+            if ( ! _heapReady )
+                _initHeap();
+            return ! _heap.empty();
+        }
+
         for ( int i=0; i<_numServers; i++ ) {
             if ( _cursors[i].more() )
                 return true;
@@ -1606,7 +1618,97 @@ namespace mongo {
         return false;
     }
 
+    class ParallelSortClusteredCursor::HeadGreater {
+    public:
+        explicit HeadGreater( const ParallelSortClusteredCursor* c ) : _c( c ) {}
+        bool operator()( int a, int b ) const {
+            int cmp = _c->_compareHeads( a, b );
+            // ties go to the lower numbered cursor. the old linear scan let the
+            // cursor it examined last win, rotating from the last one used, but
+            // the order of documents with equal sort keys was never specified
+            return cmp > 0 || ( cmp == 0 && a > b );
+        }
+    private:
+        const ParallelSortClusteredCursor* _c;
+    };
+
+    void ParallelSortClusteredCursor::_initHeap() {
+        verify( ! _heapReady );
+        BSONForEach( f, _sortKey ) {
+            _sortFields.push_back( f.fieldName() );
+            _sortDirections.push_back( f.number() < 0 ? -1 : 1 );
+        }
+        _heads.resize( _numServers );
+        for ( int i = 0; i < _numServers; i++ ) {
+            if ( _loadHead( i ) )
+                _heap.push_back( i );
+        }
+        std::make_heap( _heap.begin(), _heap.end(), HeadGreater( this ) );
+        _heapReady = true;
+    }
+
+    bool ParallelSortClusteredCursor::_loadHead( int i ) {
+        if ( ! _cursors[i].more() ) {
+            if( _cursors[i].rawMData() )
+                _cursors[i].rawMData()->pcState->done = true;
+            return false;
+        }
+
+        // Valid until _cursors[i].next(), since the cursor holds onto the object it peeked at.
+        BSONObj me = _cursors[i].peek();
+        vector<BSONElement>& key = _heads[i];
+        key.resize( _sortFields.size() );
+        for ( size_t k = 0; k < _sortFields.size(); k++ ) {
+            key[k] = me.getFieldDotted( _sortFields[k] );
+        }
+        return true;
+    }
+
+    int ParallelSortClusteredCursor::_compareHeads( int a, int b ) const {
+        // same order as BSONObj::woSortOrder( other, _sortKey, true )
+        static const BSONObj null = BSON( "" << BSONNULL );
+        const vector<BSONElement>& l = _heads[a];
+        const vector<BSONElement>& r = _heads[b];
+        for ( size_t k = 0; k < l.size(); k++ ) {
+            const BSONElement& le = l[k].eoo() ? null.firstElement() : l[k];
+            const BSONElement& re = r[k].eoo() ? null.firstElement() : r[k];
+            int x = le.woCompare( re, false );
+            if ( x != 0 )
+                return x * _sortDirections[k];
+        }
+        return 0;
+    }
+
+    void ParallelSortClusteredCursor::_prefetch( int i ) {
+        DBClientCursor* c = _cursors[i].raw();
+        if ( shardCursorPrefetchPercent <= 0 || ! c || c->prefetching() )
+            return;
+        if ( c->objsLeftInBatch() * 100 <= c->objsInBatch() * shardCursorPrefetchPercent )
+            c->prefetch();
+    }
+
     BSONObj ParallelSortClusteredCursor::next() {
+        if ( ! _sortKey.isEmpty() ) {
+            if ( ! _heapReady )
+                _initHeap();
+            uassert( 17384 ,  "no more elements" , ! _heap.empty() );
+
+            std::pop_heap( _heap.begin(), _heap.end(), HeadGreater( this ) );
+            const int i = _heap.back();
+            _heap.pop_back();
+
+            BSONObj best = _cursors[i].next();
+            if( _cursors[i].rawMData() )
+                _cursors[i].rawMData()->pcState->count++;
+            _prefetch( i );
+
+            if ( _loadHead( i ) ) {
+                _heap.push_back( i );
+                std::push_heap( _heap.begin(), _heap.end(), HeadGreater( this ) );
+            }
+            return best;
+        }
+
         BSONObj best = BSONObj();
         int bestFrom = -1;
 
@@ -1647,6 +1749,7 @@ namespace mongo {
 
         if( _cursors[bestFrom].rawMData() )
             _cursors[bestFrom].rawMData()->pcState->count++;
+        _prefetch( bestFrom );
 
         return best;
     }
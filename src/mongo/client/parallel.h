@@ -393,6 +393,24 @@ namespace mongo {
         int _needToSkip;
 
     private:
+        class HeadGreater;
+
+        // With a sort, next() merges the cursors with a heap of the ones that have more results,
+        // ordered by their next result.  The sort key of each cursor's next result is extracted
+        // into _heads once, instead of on every comparison.
+        void _initHeap();
+        // @return false if cursor i has no more results
+        bool _loadHead( int i );
+        int _compareHeads( int a, int b ) const;
+        // Starts the getMore for cursor i's next batch if it's running low.
+        void _prefetch( int i );
+
+        bool _heapReady;
+        vector<int> _heap;
+        vector<string> _sortFields;
+        vector<int> _sortDirections;
+        vector< vector<BSONElement> > _heads;
+
         /**
          * Setups the shard version of the connection. When using a replica
          * set connection and the primary cannot be reached, the version
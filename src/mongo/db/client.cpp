@@ -28,6 +28,7 @@
 #include <string>
 #include <vector>
 
+#include "mongo/base/init.h"
 #include "mongo/base/status.h"
 #include "mongo/db/auth/action_set.h"
 #include "mongo/db/auth/action_type.h"
@@ -49,6 +50,7 @@
 #include "mongo/s/d_logic.h"
 #include "mongo/s/stale_exception.h" // for SendStaleConfigException
 #include "mongo/scripting/engine.h"
+#include "mongo/util/concurrency/connection_thread_locals.h"
 #include "mongo/util/mongoutils/html.h"
 #include "mongo/util/mongoutils/str.h"
 
@@ -62,6 +64,11 @@ namespace mongo {
 
     TSP_DEFINE(Client, currentClient)
 
+    MONGO_INITIALIZER(ClientConnectionThreadLocal)(InitializerContext* context) {
+        ConnectionThreadLocals::add(currentClient);
+        return Status::OK();
+    }
+
     Client::CreatingSystemUsersScope::CreatingSystemUsersScope()
             : _prev(cc()._creatingSystemUsers) {
         Client &c = cc();
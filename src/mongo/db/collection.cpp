@@ -24,8 +24,10 @@
 #include "mongo/db/database.h"
 #include "mongo/db/d_concurrency.h"
 #include "mongo/db/index.h"
+#include "mongo/db/index_rewrite.h"
 #include "mongo/db/index_set.h"
 #include "mongo/db/oplog_helpers.h"
+#include "mongo/db/partition_rollover.h"
 #include "mongo/db/relock.h"
 #include "mongo/db/server_parameters.h"
 #include "mongo/db/txn_context.h"
@@ -367,6 +369,18 @@ namespace mongo {
         uassert(12505, str::stream() << "add index fails, too many indexes for " <<
                        name << " key:" << keyPattern.toString(),
                        nIndexes() < Collection::NIndexesMax);
+        // primary keys are always stored in the v1 format, whatever the spec says
+        uassert(17385, "the primary key index cannot use the binary key format",
+                       keyPattern.woCompare(pkPattern()) != 0 ||
+                       storage::KeyFormat::parse(info["keyFormat"]) == storage::KeyFormat::V1);
+        if (info["zoneMap"].trueValue()) {
+            uassert(17381, "zoneMap indexes are only supported on partitioned collections",
+                           isPartitioned());
+            uassert(17382, "a zoneMap index cannot be sparse",
+                           !info["sparse"].trueValue());
+            uassert(17383, "a zoneMap index must be ascending or descending on its first field",
+                           keyPattern.firstElement().isNumber());
+        }
         _cd->addIndexOK();
     }
 
@@ -409,6 +423,36 @@ namespace mongo {
             noteMultiKeyChanged();
         }
     }
+
+    void Collection::insertObjects(vector<BSONObj> &objs, uint64_t flags, bool keepGoing) {
+        if (flags & Collection::NO_VALIDATION) {
+            bool indexBitChanged = false;
+            _cd->insertObjects(objs, flags, keepGoing, &indexBitChanged);
+            if (indexBitChanged) {
+                noteMultiKeyChanged();
+            }
+            return;
+        }
+
+        vector<BSONObj> valid;
+        valid.reserve(objs.size());
+        for (size_t i = 0; i < objs.size(); i++) {
+            try {
+                validateInsert(objs[i]);
+                valid.push_back(_cd->requiresIDField() ? addIdField(objs[i]) : objs[i]);
+            } catch (const UserException &) {
+                if (!keepGoing || i == objs.size() - 1) {
+                    throw;
+                }
+            }
+        }
+        bool indexBitChanged = false;
+        _cd->insertObjects(valid, flags, keepGoing, &indexBitChanged);
+        if (indexBitChanged) {
+            noteMultiKeyChanged();
+        }
+        objs.swap(valid);
+    }
     
 
     // ------------------------------------------------------------------------
@@ -636,14 +680,20 @@ namespace mongo {
     MONGO_EXPORT_SERVER_PARAMETER(pkUniqueChecks, bool, true);
 
     void CollectionBase::insertIntoIndexes(const BSONObj &pk, const BSONObj &obj, uint64_t flags, bool* indexBitChanged) {
+        const int n = nIndexesBeingBuilt();
+        storage::DBTArrays keyArrays(n);
+        storage::DBTArrays valArrays(n);
+        insertIntoIndexes(pk, obj, flags, indexBitChanged, keyArrays, valArrays);
+    }
+
+    void CollectionBase::insertIntoIndexes(const BSONObj &pk, const BSONObj &obj, uint64_t flags, bool* indexBitChanged,
+                                           storage::DBTArrays &keyArrays, storage::DBTArrays &valArrays) {
         *indexBitChanged = false; // just for initialization
         dassert(!pk.isEmpty());
         dassert(!obj.isEmpty());
 
         const int n = nIndexesBeingBuilt();
         DB *dbs[n];
-        storage::DBTArrays keyArrays(n);
-        storage::DBTArrays valArrays(n);
         uint32_t put_flags[n];
 
         storage::Key sPK(pk, NULL);
@@ -664,6 +714,9 @@ namespace mongo {
             put_flags[i] = (isPK && doUniqueChecks ? DB_NOOVERWRITE : 0) |
                            (prelocked ? DB_PRELOCKED_WRITE : 0);
 
+            // The arrays may still hold keys from the previous row of a batch.
+            storage::dbt_array_clear_and_resize(&keyArrays[i], 0);
+
             // It is not our responsibility to set the multikey bits
             // for a hot index. Further, a hot index cannot be unique,
             if (i >= _nIndexes) {
@@ -686,7 +739,7 @@ namespace mongo {
                 DBT_ARRAY *array = &keyArrays[i];
                 storage::dbt_array_clear_and_resize(array, idxKeys.size());
                 for (BSONObjSet::const_iterator it = idxKeys.begin(); it != idxKeys.end(); it++) {
-                    const storage::Key sKey(*it, &pk);
+                    const storage::Key sKey(*it, &pk, idx.keyFormat());
                     storage::dbt_array_push(array, sKey.buf(), sKey.size());
                 }
             }
@@ -756,7 +809,7 @@ namespace mongo {
                 DBT_ARRAY *array = &keyArrays[i];
                 storage::dbt_array_clear_and_resize(array, idxKeys.size());
                 for (BSONObjSet::const_iterator it = idxKeys.begin(); it != idxKeys.end(); it++) {
-                    const storage::Key sKey(*it, &pk);
+                    const storage::Key sKey(*it, &pk, idx.keyFormat());
                     storage::dbt_array_push(array, sKey.buf(), sKey.size());
                 }
             }
@@ -870,13 +923,13 @@ namespace mongo {
                 DBT_ARRAY *array = &keyArrays[i];
                 storage::dbt_array_clear_and_resize(array, newIdxKeys.size());
                 for (BSONObjSet::const_iterator it = newIdxKeys.begin(); it != newIdxKeys.end(); it++) {
-                    const storage::Key sKey(*it, &pk);
+                    const storage::Key sKey(*it, &pk, idx.keyFormat());
                     storage::dbt_array_push(array, sKey.buf(), sKey.size());
                 }
                 array = &keyArrays[i + n];
                 storage::dbt_array_clear_and_resize(array, oldIdxKeys.size());
                 for (BSONObjSet::const_iterator it = oldIdxKeys.begin(); it != oldIdxKeys.end(); it++) {
-                    const storage::Key sKey(*it, &pk);
+                    const storage::Key sKey(*it, &pk, idx.keyFormat());
                     storage::dbt_array_push(array, sKey.buf(), sKey.size());
                 }
             }
@@ -1148,15 +1201,21 @@ namespace mongo {
             const bool isPK = isPKIndex(idx);
 
             storage::Key leftSKey(ascending ? minKey : maxKey,
-                                  isPK ? NULL : &minKey);
+                                  isPK ? NULL : &minKey, idx.keyFormat());
             storage::Key rightSKey(ascending ? maxKey : minKey,
-                                   isPK ? NULL : &maxKey);
+                                   isPK ? NULL : &maxKey, idx.keyFormat());
             uint64_t loops_run;
             idx.optimize(leftSKey, rightSKey, true, 0, &loops_run);
             return false;
         } else {
             LOG(1) << _ns << ": altering index " << idx.keyPattern() << ", options " << options << endl;
-            return idx.changeAttributes(options, wasBuilder);
+            const string indexName = idx.indexName();
+            if (!idx.changeAttributes(options, wasBuilder)) {
+                return false;
+            }
+            // Existing nodes keep the old attributes until rewritten.
+            scheduleIndexRewrite(_ns, indexName);
+            return true;
         }
     }
 
@@ -1234,6 +1293,50 @@ namespace mongo {
         }
     }
 
+    void Collection::setPartitionPolicy(const BSONObj &policy) {
+        uassert(17373, "partitionPolicy is only allowed on partitioned collections", isPartitioned());
+        // validate it before changing anything
+        PartitionPolicy::parse(policy);
+
+        // If this transaction aborts, close this ns so the next user reloads our options.
+        CollectionMapRollback &rollback = cc().txn().collectionMapRollback();
+        rollback.noteNs(_ns);
+
+        BSONObjBuilder optionsBuilder;
+        for (BSONObjIterator it(_options); it.more(); ++it) {
+            BSONElement e = *it;
+            if (!str::equals(e.fieldName(), "partitionPolicy")) {
+                optionsBuilder.append(e);
+            }
+        }
+        if (!policy.isEmpty()) {
+            optionsBuilder.append("partitionPolicy", policy);
+        }
+        _options = optionsBuilder.obj();
+        removeFromNamespacesCatalog(_ns);
+        addToNamespacesCatalog(_ns, &_options);
+        collectionMap(_ns)->update_ns(_ns, serialize(), true);
+    }
+
+    void CollectionData::insertObjects(vector<BSONObj> &objs, uint64_t flags, bool keepGoing, bool* indexBitChanged) {
+        *indexBitChanged = false;
+        vector<BSONObj> inserted;
+        inserted.reserve(objs.size());
+        for (size_t i = 0; i < objs.size(); i++) {
+            try {
+                bool bitChanged = false;
+                insertObject(objs[i], flags, &bitChanged);
+                *indexBitChanged = *indexBitChanged || bitChanged;
+                inserted.push_back(objs[i]);
+            } catch (const UserException &) {
+                if (!keepGoing || i == objs.size() - 1) {
+                    throw;
+                }
+            }
+        }
+        objs.swap(inserted);
+    }
+
     void CollectionData::fillCollectionStats(
         Stats &aggStats,
         BSONObjBuilder *result,
@@ -1375,6 +1478,15 @@ namespace mongo {
             }
         }
 
+        {
+            BSONElement e = options.getField("partitionPolicy");
+            if (e.ok()) {
+                uassert(17374, "partitionPolicy is only allowed on partitioned collections", options["partitioned"].trueValue());
+                uassert(17375, "partitionPolicy must be an object", e.type() == Object);
+                PartitionPolicy::parse(e.Obj());
+            }
+        }
+
         // This creates the namespace as well as its _id index
         _getOrCreateCollection(ns, options);
         if ( logForReplication ) {
@@ -1845,6 +1957,83 @@ namespace mongo {
         insertIntoIndexes(pk, obj, flags | (!_idPrimaryKey ? Collection::NO_PK_UNIQUE_CHECKS : 0), indexBitChanged);
     }
 
+    namespace {
+
+        // Orders the rows of a batch by primary key. Rows with equal keys keep
+        // the order they were given in, so the first one is the one inserted.
+        class RowPKLess {
+        public:
+            RowPKLess(const Ordering &ordering) : _ordering(ordering) {}
+            bool operator()(const pair<BSONObj, size_t> &a, const pair<BSONObj, size_t> &b) const {
+                const int c = a.first.woCompare(b.first, _ordering, false);
+                return c < 0 || (c == 0 && a.second < b.second);
+            }
+        private:
+            const Ordering &_ordering;
+        };
+
+    } // namespace
+
+    void IndexedCollection::insertObjects(vector<BSONObj> &objs, uint64_t flags, bool keepGoing, bool* indexBitChanged) {
+        *indexBitChanged = false;
+        if (objs.empty()) {
+            return;
+        }
+        const size_t last = objs.size() - 1;
+
+        vector<pair<BSONObj, size_t> > rows;
+        rows.reserve(objs.size());
+        for (size_t i = 0; i < objs.size(); i++) {
+            try {
+                rows.push_back(make_pair(getValidatedPKFromObject(objs[i]), i));
+            } catch (const UserException &) {
+                if (!keepGoing || i == last) {
+                    throw;
+                }
+            }
+        }
+        // When two rows collide on a unique secondary key, the one given first must
+        // win, as it would inserting them one by one, so then keep the given order.
+        bool uniqueSecondary = false;
+        if (!(flags & Collection::NO_UNIQUE_CHECKS)) {
+            for (int i = 1; i < _nIndexes; i++) {
+                uniqueSecondary = uniqueSecondary || _indexes[i]->unique();
+            }
+        }
+        const Ordering ordering = Ordering::make(_pk);
+        if (!uniqueSecondary) {
+            std::sort(rows.begin(), rows.end(), RowPKLess(ordering));
+        }
+
+        // See insertObject() for why we may skip primary key unique checks.
+        const uint64_t rowFlags = flags | (!_idPrimaryKey ? Collection::NO_PK_UNIQUE_CHECKS : 0);
+        const int n = nIndexesBeingBuilt();
+        storage::DBTArrays keyArrays(n);
+        storage::DBTArrays valArrays(n);
+        vector<bool> inserted(objs.size(), false);
+        for (vector<pair<BSONObj, size_t> >::const_iterator it = rows.begin(); it != rows.end(); ++it) {
+            try {
+                bool bitChanged = false;
+                insertIntoIndexes(it->first, objs[it->second], rowFlags, &bitChanged, keyArrays, valArrays);
+                *indexBitChanged = *indexBitChanged || bitChanged;
+                inserted[it->second] = true;
+            } catch (const UserException &) {
+                if (!keepGoing || it->second == last) {
+                    throw;
+                }
+            }
+        }
+
+        vector<BSONObj> result;
+        result.reserve(rows.size());
+        for (size_t i = 0; i < objs.size(); i++) {
+            if (inserted[i]) {
+                result.push_back(objs[i]);
+            }
+        }
+        objs.swap(result);
+    }
+
     void IndexedCollection::updateObject(const BSONObj &pk, const BSONObj &oldObj, BSONObj &newObj,
                                          const bool fromMigrate,
                                          uint64_t flags, bool* indexBitChanged) {
@@ -2510,6 +2699,23 @@ namespace mongo {
             _dbs[i] = idx.db();
             _multiKeyTrackers[i].reset(new MultiKeyTracker(_dbs[i]));
         }
+
+        // Generate secondary keys on other threads, the loader takes
+        // them from the key generator in storage::generate_keys().
+        if (LoaderKeyGenerator::enabled() && _nIndexes > 1) {
+            vector<shared_ptr<Descriptor> > descriptors;
+            vector<const Descriptor *> descriptorPtrs;
+            for (int i = 1; i < _nIndexes; i++) {
+                const DBT *desc = &_dbs[i]->cmp_descriptor->dbt;
+                descriptors.push_back(shared_ptr<Descriptor>(
+                        new Descriptor(reinterpret_cast<const char *>(desc->data), desc->size)));
+                descriptorPtrs.push_back(descriptors.back().get());
+            }
+            _keyGenerator.reset(new LoaderKeyGenerator(descriptorPtrs, true));
+            for (int i = 1; i < _nIndexes; i++) {
+                _multiKeyTrackers[i]->setKeySource(_keyGenerator->keySource(i - 1));
+            }
+        }
         _loader.reset(new storage::Loader(_dbs.get(), n, str::stream() << "Loader build progress for " << _ns));
     }
 
@@ -2529,6 +2735,12 @@ namespace mongo {
         } finallyClose(*this, abortingLoad);
 
         if (!abortingLoad) {
+            if (_keyGenerator) {
+                for (shared_ptr<LoaderKeyGenerator::Batch> batch = _keyGenerator->finish();
+                     batch; batch = _keyGenerator->finish()) {
+                    putBatch(*batch);
+                }
+            }
             const int r = _loader->close();
             if (r != 0) {
                 storage::handle_ydb_error(r);
@@ -2556,7 +2768,19 @@ namespace mongo {
 
     void BulkLoadedCollection::insertObject(BSONObj &obj, uint64_t flags, bool* indexBitChanged) {
         const BSONObj pk = getValidatedPKFromObject(obj);
+        if (_keyGenerator) {
+            // Rows reach the loader in batches, once their keys are generated.
+            shared_ptr<LoaderKeyGenerator::Batch> batch = _keyGenerator->add(pk, obj);
+            if (batch) {
+                putBatch(*batch);
+            }
+        } else {
+            put(pk, obj);
+        }
+        // multiKey stuff taken care of during close(), so indexBitChanged is not set
+    }
 
+    void BulkLoadedCollection::put(const BSONObj &pk, const BSONObj &obj) {
         storage::Key sPK(pk, NULL);
         DBT key = storage::dbt_make(sPK.buf(), sPK.size());
         DBT val = storage::dbt_make(obj.objdata(), obj.objsize());
@@ -2564,7 +2788,12 @@ namespace mongo {
         if (r != 0) {
             storage::handle_ydb_error(r);
         }
-        // multiKey stuff taken care of during close(), so indexBitChanged is not set
+    }
+
+    void BulkLoadedCollection::putBatch(const LoaderKeyGenerator::Batch &batch) {
+        for (size_t i = 0; i < batch.objs.size(); i++) {
+            put(batch.pks[i], batch.objs[i]);
+        }
     }
 
     void BulkLoadedCollection::deleteObject(const BSONObj &pk, const BSONObj &obj, uint64_t flags) {
@@ -2601,6 +2830,7 @@ namespace mongo {
     void BulkLoadedCollection::_close(bool aborting, bool* indexBitsChanged) {
         _loader.reset();
         _multiKeyTrackers.reset();
+        _keyGenerator.reset();
         CollectionBase::close(aborting, indexBitsChanged);
     }
 
@@ -2651,7 +2881,8 @@ namespace mongo {
         CollectionData(ns, getPrimaryKeyFromOptions(options)),
         _options(options.getOwned()),
         _ordering(Ordering::make(BSONObj())), // dummy for now, we create it properly below
-        _shardKeyPattern(_pk)
+        _shardKeyPattern(_pk),
+        _zoneMapMutex("zoneMaps")
     {
         // MUST CALL initialize directly after this.
         // We can't call initialize here because it depends on virtual functions
@@ -2697,7 +2928,8 @@ namespace mongo {
            CollectionData(serialized),
            _options(serialized["options"].Obj().getOwned()),
            _ordering(Ordering::make(BSONObj())), // dummy for now, we create it properly below
-           _shardKeyPattern(_pk)
+           _shardKeyPattern(_pk),
+           _zoneMapMutex("zoneMaps")
     {
     }
 
@@ -2756,7 +2988,8 @@ namespace mongo {
         CollectionData(serialized),
         _options(serialized["options"].Obj().getOwned()),
         _ordering(Ordering::make(BSONObj())), // dummy for now, we create it properly below
-        _shardKeyPattern(_pk)
+        _shardKeyPattern(_pk),
+        _zoneMapMutex("zoneMaps")
     {
         // MUST CALL initialize directly after this.
         // We can't call initialize here because it depends on virtual functions
@@ -2780,6 +3013,7 @@ namespace mongo {
             // extract the pivot
             _partitionPivots.push_back(curr["max"].Obj().copy());
             _partitionIDs.push_back(currID);
+            _partitionZoneMaps.push_back(curr.getObjectField("zoneMaps").copy());
         }
         // create the index details
         createIndexDetails();
@@ -2860,6 +3094,12 @@ namespace mongo {
                 )
             );
         _indexDetailsVector.push_back(details);
+        if (info["zoneMap"].trueValue()) {
+            // the last partition has no zone maps, see getZoneMaps()
+            for (uint64_t i = 0; i + 1 < numPartitions(); i++) {
+                refreshZoneMaps(i);
+            }
+        }
         return true;
     }
 
@@ -3012,6 +3252,7 @@ namespace mongo {
     void PartitionedCollection::sanityCheck() {
         verify(numPartitions() == _partitionPivots.size());
         verify(numPartitions() == _partitionIDs.size());
+        verify(numPartitions() == _partitionZoneMaps.size());
         // verify that pivots are increasing in order
         for (uint64_t i = 1; i < numPartitions(); i++) {
             BSONObj bigger = _partitionPivots[i];
@@ -3141,6 +3382,7 @@ namespace mongo {
         // add data to internal vectors
         _partitionPivots.push_back(partitionInfo["max"].Obj().copy());
         _partitionIDs.push_back(id);
+        _partitionZoneMaps.push_back(partitionInfo.getObjectField("zoneMaps").copy());
 
         // some sanity checks
         verify(_partitions[numPartitions()-1].get() == newPartition.get());    
@@ -3234,6 +3476,128 @@ namespace mongo {
         verify(!indexBitChanged);
     }
 
+    bool PartitionedCollection::hasZoneMapIndex() const {
+        for (int i = 0; i < nIndexes(); i++) {
+            if (idx(i).info()["zoneMap"].trueValue()) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void PartitionedCollection::getZoneMaps(vector<BSONObj> *zoneMaps) const {
+        SimpleMutex::scoped_lock lk(_zoneMapMutex);
+        *zoneMaps = _partitionZoneMaps;
+    }
+
+    void PartitionedCollection::writeZoneMaps(uint64_t i, const BSONObj &zoneMaps) {
+        {
+            SimpleMutex::scoped_lock lk(_zoneMapMutex);
+            _partitionZoneMaps[i] = zoneMaps.getOwned();
+        }
+        BSONObj meta = getPartitionMetadata(i);
+        updatePartitionMetadata(i, cloneBSONWithFieldChanged(meta, "zoneMaps", zoneMaps));
+    }
+
+    void PartitionedCollection::refreshZoneMaps(uint64_t i) {
+        Lock::assertWriteLocked(_ns);
+        if (!hasZoneMapIndex()) {
+            return;
+        }
+        CollectionData *partition = _partitions[i].get();
+        BSONObjBuilder b;
+        for (int j = 0; j < nIndexes(); j++) {
+            const BSONObj info = idx(j).info();
+            if (!info["zoneMap"].trueValue()) {
+                continue;
+            }
+            // the first field of the index's first and last keys bound it,
+            // which way round depends on the field's direction
+            IndexDetails &index = partition->idx(j);
+            shared_ptr<Cursor> first(Cursor::make(partition, index, 1, true));
+            BSONObjBuilder zb(b.subobjStart(index.indexName()));
+            if (first->ok()) {
+                shared_ptr<Cursor> last(Cursor::make(partition, index, -1, true));
+                verify(last->ok());
+                const bool ascending = index.keyPattern().firstElement().number() >= 0;
+                zb.appendAs((ascending ? first : last)->currKey().firstElement(), "min");
+                zb.appendAs((ascending ? last : first)->currKey().firstElement(), "max");
+            }
+            zb.doneFast();
+        }
+        writeZoneMaps(i, b.obj());
+    }
+
+    // Widens zoneMaps so they cover the first field of each of obj's keys in partition,
+    // for the indexes zoneMaps has entries for. Returns false if they already did.
+    static bool widenZoneMapsFor(CollectionData *partition, const BSONObj &zoneMaps,
+                                 const BSONObj &obj, BSONObj *result) {
+        bool widened = false;
+        BSONObjBuilder b;
+        for (BSONObjIterator it(zoneMaps); it.more(); ) {
+            BSONElement e = it.next();
+            const int j = partition->findIndexByName(e.fieldName());
+            if (j < 0) {
+                // the index was dropped, the next refresh forgets it
+                b.append(e);
+                continue;
+            }
+            BSONObj zoneMap = e.Obj();
+            BSONElement min = zoneMap["min"];
+            BSONElement max = zoneMap["max"];
+            BSONObjSet keys;
+            // partitions are CollectionBases, whose indexes are IndexDetailsBases
+            dynamic_cast<IndexDetailsBase &>(partition->idx(j)).getKeysFromObject(obj, keys);
+            bool changed = false;
+            for (BSONObjSet::const_iterator k = keys.begin(); k != keys.end(); ++k) {
+                BSONElement v = k->firstElement();
+                if (min.eoo() || v.woCompare(min, false) < 0) {
+                    min = v;
+                    changed = true;
+                }
+                if (max.eoo() || v.woCompare(max, false) > 0) {
+                    max = v;
+                    changed = true;
+                }
+            }
+            if (changed) {
+                BSONObjBuilder zb(b.subobjStart(e.fieldName()));
+                zb.appendAs(min, "min");
+                zb.appendAs(max, "max");
+                zb.doneFast();
+                widened = true;
+            }
+            else {
+                b.append(e);
+            }
+        }
+        if (widened) {
+            *result = b.obj();
+        }
+        return widened;
+    }
+
+    void PartitionedCollection::widenZoneMaps(uint64_t i, const BSONObj &obj) {
+        CollectionData *partition = _partitions[i].get();
+        {
+            SimpleMutex::scoped_lock lk(_zoneMapMutex);
+            BSONObj widened;
+            if (!widenZoneMapsFor(partition, _partitionZoneMaps[i], obj, &widened)) {
+                // nearly always, inserts stay within a capped partition's ranges
+                return;
+            }
+            _partitionZoneMaps[i] = widened;
+        }
+        // Widen what is stored rather than what we have in memory, so that two
+        // transactions widening the same partition at once conflict on its
+        // metadata instead of one losing the other's widening.
+        BSONObj meta = getPartitionMetadata(i);
+        BSONObj stored;
+        if (widenZoneMapsFor(partition, meta.getObjectField("zoneMaps"), obj, &stored)) {
+            updatePartitionMetadata(i, cloneBSONWithFieldChanged(meta, "zoneMaps", stored));
+        }
+    }
+
     void PartitionedCollection::prepareAddPartition() {
         Lock::assertWriteLocked(_ns);
         sanityCheck();
@@ -3254,6 +3618,7 @@ namespace mongo {
     void PartitionedCollection::addPartition() {
         prepareAddPartition();
         capLastPartition();
+        refreshZoneMaps(numPartitions() - 1);
         appendNewPartition();
         sanityCheck();
     }
@@ -3261,6 +3626,7 @@ namespace mongo {
     void PartitionedCollection::manuallyAddPartition(const BSONObj& newPivot) {
         prepareAddPartition();
         manuallyCapLastPartition(getValidatedPKFromObject(newPivot));
+        refreshZoneMaps(numPartitions() - 1);
         appendNewPartition();
         sanityCheck();
     }
@@ -3268,6 +3634,7 @@ namespace mongo {
     void PartitionedCollection::addPartitionFromOplog(const BSONObj& newPivot, const BSONObj &partitionInfo) {
         prepareAddPartition();
         manuallyCapLastPartition(newPivot);
+        refreshZoneMaps(numPartitions() - 1);
         appendPartition(partitionInfo);
         sanityCheck();
     }
@@ -3347,6 +3714,7 @@ namespace mongo {
         // now that we have index, clean up in-memory data structures
         _partitionPivots.erase(_partitionPivots.begin() + index);
         _partitionIDs.erase(_partitionIDs.begin() + index);
+        _partitionZoneMaps.erase(_partitionZoneMaps.begin() + index);
         // ugly way to "drop" a collection. Perhaps we need
         // a CollectionData method for this.
         while (_partitions[index]->nIndexes() > 0) {
@@ -3467,8 +3835,11 @@ namespace mongo {
     void PartitionedCollection::updateObject(const BSONObj &pk, const BSONObj &oldObj, BSONObj &newObj,
                                              const bool fromMigrate,
                                              uint64_t flags, bool* indexBitChanged) {
-        int whichPartition = partitionWithPK(pk);
+        uint64_t whichPartition = partitionWithPK(pk);
         _partitions[whichPartition]->updateObject(pk, oldObj, newObj, fromMigrate, flags, indexBitChanged);
+        if (whichPartition < numPartitions() - 1) {
+            widenZoneMaps(whichPartition, newObj);
+        }
     }
 
     BSONObj PartitionedCollection::getUpperBound() {
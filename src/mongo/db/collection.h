@@ -24,6 +24,7 @@
 #include "mongo/db/jsobj.h"
 #include "mongo/db/index.h"
 #include "mongo/db/index_set.h"
+#include "mongo/db/loader_key_generator.h"
 #include "mongo/db/namespacestring.h"
 #include "mongo/db/querypattern.h"
 #include "mongo/db/storage/builder.h"
@@ -38,8 +39,13 @@ namespace mongo {
     class Collection;
     class CollectionMap;
     class MultiKeyTracker;
+    class HotIndexKeyGenerator;
     class QueryPattern;
 
+    namespace storage {
+        class DBTArrays;
+    }
+
     // Gets a collection - opens it if necessary, but does not create.
     Collection *getCollection(const StringData& ns);
 
@@ -190,6 +196,14 @@ namespace mongo {
         // inserts an object into this namespace, taking care of secondary indexes if they exist
         virtual void insertObject(BSONObj &obj, uint64_t flags, bool* indexBitChanged) = 0;
 
+        // inserts a batch of objects into this namespace. on return, objs holds
+        // the objects that were inserted, in the order they were given.
+        //
+        // if keepGoing, an object that fails to insert is skipped, unless it is
+        // the last one, otherwise the first failure is thrown. the default just
+        // calls insertObject for each object.
+        virtual void insertObjects(vector<BSONObj> &objs, uint64_t flags, bool keepGoing, bool* indexBitChanged);
+
         // deletes an object from this namespace, taking care of secondary indexes if they exist
         virtual void deleteObject(const BSONObj &pk, const BSONObj &obj, uint64_t flags) = 0;
 
@@ -346,6 +360,7 @@ namespace mongo {
         static const uint64_t NO_UNIQUE_CHECKS = 2; // skip uniqueness checks on all keys
         static const uint64_t KEYS_UNAFFECTED_HINT = 4; // an update did not update secondary indexes
         static const uint64_t NO_PK_UNIQUE_CHECKS = 8; // skip uniqueness checks only on the primary key
+        static const uint64_t NO_VALIDATION = 16; // insertObjects: documents were validated and given an _id already
 
         // Creates the appropriate Collection implementation based on options.
         //
@@ -489,6 +504,11 @@ namespace mongo {
             return _cd->findIndexByKeyPattern(keyPattern);
         }
 
+        // @return offset in indexes[], -1 if not found
+        int findIndexByName(const StringData& name) const {
+            return _cd->findIndexByName(name);
+        }
+
         /* Returns the index entry for the first index whose prefix contains
          * 'keyPattern'. If 'requireSingleKey' is true, skip indices that contain
          * array attributes. Otherwise, returns NULL.
@@ -541,6 +561,13 @@ namespace mongo {
         // inserts an object into this namespace, taking care of secondary indexes if they exist
         void insertObject(BSONObj &obj, uint64_t flags = 0);
 
+        // inserts a batch of objects into this namespace. every object is
+        // validated and given an _id, if it needs one, before any is inserted,
+        // unless flags has NO_VALIDATION.
+        // on return, objs holds the objects that were inserted, in the order
+        // they were given. see CollectionData::insertObjects for keepGoing.
+        void insertObjects(vector<BSONObj> &objs, uint64_t flags = 0, bool keepGoing = false);
+
         // deletes an object from this namespace, taking care of secondary indexes if they exist
         void deleteObject(const BSONObj &pk, const BSONObj &obj, uint64_t flags = 0) {
             _cd->deleteObject(pk, obj, flags);
@@ -607,6 +634,15 @@ namespace mongo {
             return _cd->isPartitioned();
         }
 
+        // The partitionPolicy option of a partitioned collection, see partition_rollover.h.
+        // EOO if it has none.
+        BSONElement partitionPolicy() const {
+            return _options["partitionPolicy"];
+        }
+
+        // Replace the partitionPolicy option, or remove it if policy is empty.
+        void setPartitionPolicy(const BSONObj &policy);
+
         // optional to implement, populate the obj builder with collection specific stats
         void fillSpecificStats(BSONObjBuilder &result, int scale) const {
             _cd->fillSpecificStats(result, scale);
@@ -857,13 +893,16 @@ namespace mongo {
         class HotIndexer : public IndexerBase {
         public:
             HotIndexer(CollectionBase *cl, const BSONObj &info);
-            virtual ~HotIndexer() { }
+            virtual ~HotIndexer();
 
             void build();
 
         private:
             void _prepare();
             void _commit();
+            void stopKeyGenerator();
+            // Destroyed after the tracker that points to it.
+            scoped_ptr<HotIndexKeyGenerator> _keyGenerator;
             scoped_ptr<MultiKeyTracker> _multiKeyTracker;
             scoped_ptr<storage::Indexer> _indexer;
         };
@@ -879,6 +918,11 @@ namespace mongo {
             virtual ~ColdIndexer() { }
 
             void build();
+
+        private:
+            void insertKeys(IndexDetailsBase::Builder &builder,
+                            const BSONObj &pk, const BSONObj &obj, const BSONObjSet &keys);
+            void insertBatch(IndexDetailsBase::Builder &builder, LoaderKeyGenerator::Batch &batch);
         };
 
         shared_ptr<CollectionIndexer> newIndexer(const BSONObj &info, const bool background);
@@ -965,6 +1009,11 @@ namespace mongo {
         void checkIndexUniqueness(const IndexDetailsBase &idx);
 
         void insertIntoIndexes(const BSONObj &pk, const BSONObj &obj, uint64_t flags, bool* indexBitChanged);
+        // Same, but with key and val arrays that a batch of inserts shares, so
+        // their memory is reused from row to row. Each array must have room for
+        // nIndexesBeingBuilt() keys.
+        void insertIntoIndexes(const BSONObj &pk, const BSONObj &obj, uint64_t flags, bool* indexBitChanged,
+                               storage::DBTArrays &keyArrays, storage::DBTArrays &valArrays);
         void deleteFromIndexes(const BSONObj &pk, const BSONObj &obj, uint64_t flags);
 
         // uassert on duplicate key
@@ -1014,6 +1063,11 @@ namespace mongo {
         // inserts an object into this namespace, taking care of secondary indexes if they exist
         void insertObject(BSONObj &obj, uint64_t flags, bool* indexBitChanged);
 
+        // inserts a batch of objects in primary key order, so each put lands
+        // near the last one in the fractal tree, with key memory shared by the batch.
+        // with unique checks on a secondary index, the given order is kept instead.
+        void insertObjects(vector<BSONObj> &objs, uint64_t flags, bool keepGoing, bool* indexBitChanged);
+
         void updateObject(const BSONObj &pk, const BSONObj &oldObj, BSONObj &newObj,
                           const bool fromMigrate,
                           uint64_t flags, bool* indexBitChanged);
@@ -1096,6 +1150,10 @@ namespace mongo {
         SystemUsersCollection(const StringData &ns, const BSONObj &options);
         SystemUsersCollection(const BSONObj &serialized, bool* reserializeNeeded);
         void insertObject(BSONObj &obj, uint64_t flags, bool* indexBitChanged);
+        // each privilege document is checked by insertObject
+        void insertObjects(vector<BSONObj> &objs, uint64_t flags, bool keepGoing, bool* indexBitChanged) {
+            CollectionData::insertObjects(objs, flags, keepGoing, indexBitChanged);
+        }
         void updateObject(const BSONObj &pk, const BSONObj &oldObj, BSONObj &newObj,
                           const bool fromMigrate,
                           uint64_t flags, bool* indexBitChanged);
@@ -1255,6 +1313,11 @@ namespace mongo {
 
         void insertObject(BSONObj &obj, uint64_t flags, bool* indexBitChanged);
 
+        // rows go to the loader one at a time, it does its own sorting
+        void insertObjects(vector<BSONObj> &objs, uint64_t flags, bool keepGoing, bool* indexBitChanged) {
+            CollectionData::insertObjects(objs, flags, keepGoing, indexBitChanged);
+        }
+
         void deleteObject(const BSONObj &pk, const BSONObj &obj, uint64_t flags);
 
         void updateObject(const BSONObj &pk, const BSONObj &oldObj, BSONObj &newObj,
@@ -1281,12 +1344,17 @@ namespace mongo {
 
         void createIndex(const BSONObj &info);
 
+        void put(const BSONObj &pk, const BSONObj &obj);
+        void putBatch(const LoaderKeyGenerator::Batch &batch);
+
         // The connection that started the bulk load is the only one that can
         // do anything with the namespace until the load is complete and this
         // namespace has been closed / re-opened.
         ConnectionId _bulkLoadConnectionId;
         scoped_array<DB *> _dbs;
         scoped_array< scoped_ptr<MultiKeyTracker> > _multiKeyTrackers;
+        // Non-null if secondary keys are generated in parallel.
+        scoped_ptr<LoaderKeyGenerator> _keyGenerator;
         scoped_ptr<storage::Loader> _loader;
     };
 
@@ -1391,6 +1459,9 @@ namespace mongo {
         virtual void insertObject(BSONObj &obj, uint64_t flags, bool* indexBitChanged) {
             uint64_t whichPartition = partitionWithRow(obj);
             _partitions[whichPartition]->insertObject(obj, flags, indexBitChanged);
+            if (whichPartition < numPartitions() - 1) {
+                widenZoneMaps(whichPartition, obj);
+            }
         }
 
         virtual void deleteObject(const BSONObj &pk, const BSONObj &obj, uint64_t flags) {
@@ -1544,6 +1615,13 @@ namespace mongo {
         BSONObj getPartitionMetadata(uint64_t index);
         void updatePartitionMetadata(uint64_t index, BSONObj newMetadata, bool checkCreateTime = true);
 
+        // Copies the zone maps of every partition into zoneMaps, one object per partition of
+        // the form { <index name>: { min: <value>, max: <value> } }, where min and max bound the
+        // first field of each zoneMap index's keys in that partition. An index with no entry
+        // is not known about, an index with an empty entry has no keys in that partition.
+        // The last partition's zone maps are never kept up to date, as it takes the inserts.
+        void getZoneMaps(vector<BSONObj> *zoneMaps) const;
+
         // helper functions
         uint64_t numPartitions() const{
             return _partitions.size();;
@@ -1612,6 +1690,15 @@ namespace mongo {
         // according to this id
         uint64_t findInMemoryPartition(uint64_t id);
 
+        // zone maps, see getZoneMaps()
+        // recompute the zone maps of the ith partition from the ends of its zoneMap
+        // indexes, and store them in its metadata
+        void refreshZoneMaps(uint64_t i);
+        // widen the zone maps of the ith partition so they cover obj's keys
+        void widenZoneMaps(uint64_t i, const BSONObj &obj);
+        void writeZoneMaps(uint64_t i, const BSONObj &zoneMaps);
+        bool hasZoneMapIndex() const;
+
         // return upper bound
         BSONObj getUpperBound();
 
@@ -1643,6 +1730,14 @@ namespace mongo {
 
         // for makeCursor, to determine what partitions we needto visit
         const ShardKeyPattern _shardKeyPattern;
+
+        // The zone maps of each partition, also stored in _metaCollection as
+        // zoneMaps. Inserts widen them under a shared lock, hence _zoneMapMutex.
+        // Like adding and dropping partitions, refreshing them is not seen
+        // through snapshots: a partition's zone maps only cover the keys it had
+        // when it was capped, and those inserted since.
+        std::vector<BSONObj> _partitionZoneMaps;
+        mutable SimpleMutex _zoneMapMutex;
     };
 
     // for legacy oplogs that were not partitioned. So we can open them just long enough
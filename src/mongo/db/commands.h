@@ -338,6 +338,6 @@ namespace mongo {
         bool shutdownHelper();
     };
 
-    bool _runCommands(const char *ns, const BSONObj &cmdObj, BufBuilder &b, BSONObjBuilder& anObjBuilder, bool fromRepl, int queryOptions);
+    bool _runCommands(const char *ns, const BSONObj &cmdObj, BSONObjBuilder& anObjBuilder, bool fromRepl, int queryOptions);
 
 } // namespace mongo
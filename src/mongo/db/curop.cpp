@@ -152,6 +152,8 @@ namespace mongo {
                 b.appendNumber( "connectionId" , _client->_connectionId );
             b.appendNumber( "rootTxnid" , _client->rootTransactionId() );
             _client->_ls.reportState(b);
+            if ( _client->port() )
+                _client->port()->appendCompressionStats( b );
         }
         
         if ( ! _message.empty() ) {
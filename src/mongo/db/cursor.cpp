@@ -17,6 +17,8 @@
 
 #include "mongo/pch.h"
 
+#include "mongo/base/counter.h"
+#include "mongo/db/commands/server_status.h"
 #include "mongo/db/curop.h"
 #include "mongo/db/cursor.h"
 #include "mongo/db/kill_current_op.h"
@@ -137,7 +139,7 @@ namespace mongo {
         IndexCursor(cl, idx, startKey, endKey, endKeyInclusive, 1, 0),
         _bufferedRowCount(0),
         _exhausted(false),
-        _endSKeyPrefix(_endKey, NULL) {
+        _endSKeyPrefix(_endKey, NULL, idx.keyFormat()) {
         TOKULOG(3) << toString() << ": constructor: bounds " << prettyIndexBounds() << endl;
         checkAssumptionsAndInit();
     }
@@ -149,7 +151,7 @@ namespace mongo {
         IndexCursor(cl, idx, bounds, false, 1, 0),
         _bufferedRowCount(0),
         _exhausted(false),
-        _endSKeyPrefix(_endKey, NULL) {
+        _endSKeyPrefix(_endKey, NULL, idx.keyFormat()) {
         TOKULOG(3) << toString() << ": constructor: bounds " << prettyIndexBounds() << endl;
         dassert(_startKey == bounds->startKey());
         dassert(_endKey == bounds->endKey());
@@ -245,15 +247,38 @@ namespace mongo {
         _subPartitionIDGenerator(subPartitionIDGenerator),
         _multiKey(multiKey),
         _prevNScanned(0),
-        _tailable(false)
+        _tailable(false),
+        _laterPos(0),
+        _scanPos(0)
     {
         initializeSubCursor();
+        // begin the other partitions' transactions now, with the cursor,
+        // though we only read them once the current partition runs out
+        if (ParallelPartitionScan::enabled() && !_subPartitionIDGenerator->lastIndex()) {
+            while (!_subPartitionIDGenerator->lastIndex()) {
+                _subPartitionIDGenerator->advanceIndex();
+                _laterPartitions.push_back(_subPartitionIDGenerator->getCurrentPartitionIndex());
+            }
+            _pendingScan.reset(new ParallelPartitionScan(_subCursorGenerator, _laterPartitions, _matcher, _keyFieldsOnly));
+        }
     }
 
-    void PartitionedCursor::getNextSubCursor() {
+    bool PartitionedCursor::lastPartition() {
+        return _subPartitionIDGenerator->lastIndex() && _laterPos == _laterPartitions.size();
+    }
+
+    uint64_t PartitionedCursor::nextPartition() {
+        if (_laterPos < _laterPartitions.size()) {
+            return _laterPartitions[_laterPos++];
+        }
         _subPartitionIDGenerator->advanceIndex();
+        return _subPartitionIDGenerator->getCurrentPartitionIndex();
+    }
+
+    void PartitionedCursor::getNextSubCursor() {
+        const uint64_t partition = nextPartition();
         shared_ptr<Cursor> oldCursor = _currentCursor;
-        _currentCursor = _subCursorGenerator->makeSubCursor(_subPartitionIDGenerator->getCurrentPartitionIndex());
+        _currentCursor = _subCursorGenerator->makeSubCursor(partition);
         if (oldCursor) {
             if (_matcher) {
                 _currentCursor->setMatcher(_matcher);
@@ -274,9 +299,53 @@ namespace mongo {
         }
     }
 
+    BSONObj PartitionedCursor::current() {
+        if (_scan) {
+            return _scan->current(_scanPos);
+        }
+        return _currentCursor->current();
+    }
+
+    bool PartitionedCursor::startScan() {
+        if (!_pendingScan) {
+            return false;
+        }
+        _scan.swap(_pendingScan);
+        _scanPos = 0;
+        settleScan();
+        return true;
+    }
+
+    void PartitionedCursor::settleScan() {
+        while (_scanPos < _scan->size() && !_scan->hasEntry(_scanPos)) {
+            if (_scan->exhausted(_scanPos)) {
+                _scanPos++;
+                continue;
+            }
+            // read this partition, and the ones after it that are
+            // running low, at the same time
+            vector<size_t> toFill;
+            for (size_t i = _scanPos; i < _scan->size() && toFill.size() < ParallelPartitionScan::parallelism(); i++) {
+                if (_scan->wantsFill(i)) {
+                    toFill.push_back(i);
+                }
+            }
+            _scan->fill(toFill);
+        }
+    }
+
     bool PartitionedCursor::advance(){
+        if (_scan) {
+            _scan->pop(_scanPos);
+            settleScan();
+            return ok();
+        }
         bool ret = _currentCursor->advance();
-        while (!_currentCursor->ok() && !_subPartitionIDGenerator->lastIndex()) {
+        // the first partition was read here, read the rest in parallel if we may
+        if (!_currentCursor->ok() && startScan()) {
+            return ok();
+        }
+        while (!_currentCursor->ok() && !lastPartition()) {
             dassert(!ret);
             getNextSubCursor();
             // if we are iterating over the last partition and we are tailable,
@@ -284,7 +353,7 @@ namespace mongo {
             // invalidate cursors, so we don't need to worry about
             // partitions being added or dropped in the lifetime of
             // a cursor
-            if (_tailable && _subPartitionIDGenerator->lastIndex()) {
+            if (_tailable && lastPartition()) {
                 _currentCursor->setTailable();
             }
             ret = _currentCursor->ok();
@@ -294,7 +363,11 @@ namespace mongo {
 
     void PartitionedCursor::setTailable() {
         _tailable = true;
-        if (_subPartitionIDGenerator->lastIndex()) {
+        // a tailable cursor needs to see the last partition in our
+        // transaction, as it grows, so it reads _laterPartitions
+        // one at a time instead
+        _pendingScan.reset();
+        if (lastPartition()) {
             _currentCursor->setTailable();
         }
     }
@@ -354,6 +427,11 @@ namespace mongo {
         _subPartitionIDGenerator(subPartitionIDGenerator),
         _multiKey(multiKey)
     {
+        if (ParallelPartitionScan::enabled() && !_subPartitionIDGenerator->lastIndex()) {
+            startScan();
+            return;
+        }
+
         // create each sub cursor in _cursors
         SPCComparator comparator(_direction, &_ordering);
 
@@ -371,7 +449,87 @@ namespace mongo {
         std::make_heap(_cursors.begin(), _cursors.end(), comparator);
     }
     
+    // orders positions in a ParallelPartitionScan by their next
+    // entries, the way SPCComparator orders sub cursors
+    class SPCScanComparator {
+    public:
+        SPCScanComparator(const int direction, const Ordering* ordering, const ParallelPartitionScan* scan) :
+            _direction(direction), _ordering(ordering), _scan(scan) {
+        }
+        bool operator()(const size_t left, const size_t right) const {
+            const BSONObj &leftKey = _scan->front(left).key;
+            const BSONObj &rightKey = _scan->front(right).key;
+            const uint64_t leftID = _scan->partitionIndex(left);
+            const uint64_t rightID = _scan->partitionIndex(right);
+            const int c = leftKey.woCompare(rightKey, *_ordering);
+            if (c == 0) {
+                return _direction > 0 ? (rightID < leftID) : (leftID < rightID);
+            }
+            return _direction > 0 ? (c > 0) : (c < 0);
+        }
+    private:
+        const int _direction;
+        const Ordering* _ordering;
+        const ParallelPartitionScan* _scan;
+    };
+
+    void SortedPartitionedCursor::startScan() {
+        vector<uint64_t> partitions;
+        partitions.push_back(_subPartitionIDGenerator->getCurrentPartitionIndex());
+        while (!_subPartitionIDGenerator->lastIndex()) {
+            _subPartitionIDGenerator->advanceIndex();
+            partitions.push_back(_subPartitionIDGenerator->getCurrentPartitionIndex());
+        }
+        _scan.reset(new ParallelPartitionScan(_subCursorGenerator, partitions, _matcher, _keyFieldsOnly));
+
+        // every partition needs an entry before we can merge
+        for (size_t i = 0; i < _scan->size(); ) {
+            vector<size_t> toFill;
+            for (; i < _scan->size() && toFill.size() < ParallelPartitionScan::parallelism(); i++) {
+                toFill.push_back(i);
+            }
+            _scan->fill(toFill);
+        }
+        for (size_t i = 0; i < _scan->size(); i++) {
+            fillScanEntry(i);
+            if (_scan->hasEntry(i)) {
+                _scanHeap.push_back(i);
+            }
+        }
+        SPCScanComparator comparator(_direction, &_ordering, _scan.get());
+        std::make_heap(_scanHeap.begin(), _scanHeap.end(), comparator);
+    }
+
+    void SortedPartitionedCursor::fillScanEntry(const size_t i) {
+        while (!_scan->hasEntry(i) && !_scan->exhausted(i)) {
+            // refill this partition, and others in the heap that
+            // are running low while we're at it
+            vector<size_t> toFill(1, i);
+            for (size_t j = 0; j < _scanHeap.size() && toFill.size() < ParallelPartitionScan::parallelism(); j++) {
+                if (_scan->wantsFill(_scanHeap[j])) {
+                    toFill.push_back(_scanHeap[j]);
+                }
+            }
+            _scan->fill(toFill);
+        }
+    }
+
     bool SortedPartitionedCursor::advance() {
+        if (_scan) {
+            // refilling other partitions only appends to their
+            // buffers, so the heap stays valid while this one is out
+            SPCScanComparator comparator(_direction, &_ordering, _scan.get());
+            std::pop_heap(_scanHeap.begin(), _scanHeap.end(), comparator);
+            const size_t i = _scanHeap.back();
+            _scanHeap.pop_back();
+            _scan->pop(i);
+            fillScanEntry(i);
+            if (_scan->hasEntry(i)) {
+                _scanHeap.push_back(i);
+                std::push_heap(_scanHeap.begin(), _scanHeap.end(), comparator);
+            }
+            return ok();
+        }
         SPCComparator comparator(_direction, &_ordering);
         std::pop_heap(
             _cursors.begin(),
@@ -505,6 +663,31 @@ namespace mongo {
             return (_currPartition == _endPartition);
     }
 
+    static Counter64 zoneMapPartitionsSkipped;
+    static ServerStatusMetricField<Counter64> displayZoneMapPartitionsSkipped(
+            "queryExecutor.zoneMaps.partitionsSkipped", &zoneMapPartitionsSkipped );
+
+    namespace {
+
+        // @return true if some interval of range reaches into [min, max]
+        bool rangeOverlaps(const FieldRange &range, const BSONElement &min, const BSONElement &max) {
+            const vector<FieldInterval> &intervals = range.intervals();
+            for (vector<FieldInterval>::const_iterator it = intervals.begin(); it != intervals.end(); ++it) {
+                const int upperCmp = it->_upper._bound.woCompare(min, false);
+                if (upperCmp < 0 || (upperCmp == 0 && !it->_upper._inclusive)) {
+                    continue;
+                }
+                const int lowerCmp = it->_lower._bound.woCompare(max, false);
+                if (lowerCmp > 0 || (lowerCmp == 0 && !it->_lower._inclusive)) {
+                    continue;
+                }
+                return true;
+            }
+            return false;
+        }
+
+    } // namespace
+
     FilteredPartitionIDGeneratorImpl::FilteredPartitionIDGeneratorImpl(
         PartitionedCollection* pc,
         const char* ns,
@@ -520,26 +703,38 @@ namespace mongo {
         for (uint64_t i = 0; i < numPartitions; i++) {
             _partitionsToRead.push_back(false);
         }
+
+        // the indexes whose zone maps can rule out partitions, see
+        // PartitionedCollection::getZoneMaps
+        vector<int> zoneMapIndexes;
+        for (int j = 0; j < pc->nIndexes(); j++) {
+            if (pc->idx(j).info()["zoneMap"].trueValue()) {
+                zoneMapIndexes.push_back(j);
+            }
+        }
+        vector<BSONObj> zoneMaps;
+        Collection *cl = NULL;
+        if (!zoneMapIndexes.empty() && numPartitions > 1) {
+            pc->getZoneMaps(&zoneMaps);
+            cl = getCollection(ns);
+        }
+
         // This code was pattern-matched/taken from sharding code
         // Specifically, from ChunkManager::getShardsForQuery
         OrRangeGenerator org(ns, cc().querySettings().getQuery(), false);
         do {
             boost::scoped_ptr<FieldRangeSetPair> frsp (org.topFrsp());
+            // the partitions this clause may need
+            vector<bool> clausePartitions(numPartitions, false);
 
             // special case if most-significant field isn't in query
             // only have this because ChunkManager::getShardsForQuery
             // has it as well
             FieldRange range = frsp->shardKeyRange(key.key().firstElementFieldName());
             if ( range.universal() ) {
-                for (uint64_t i = 0; i < numPartitions; i++) {
-                    _partitionsToRead[i] = true;
-                }
-                minPartitionToRead = 0;
-                maxPartitionToRead = numPartitions-1;
-                break;
+                clausePartitions.assign(numPartitions, true);
             }
-            
-            if ( frsp->matchPossibleForSingleKeyFRS( key.key() ) ) {
+            else if ( frsp->matchPossibleForSingleKeyFRS( key.key() ) ) {
                 BoundList ranges = key.keyBounds( frsp->getSingleKeyFRS() );
                 for ( BoundList::const_iterator it=ranges.begin(); it != ranges.end(); ++it ){
                     TOKULOG(3) << "Bounds for partitions: first: " << it->first << " second " << it->second << endl;
@@ -549,13 +744,48 @@ namespace mongo {
                     uint64_t max = first < second ? second : first;
                     TOKULOG(3) << "Setting partitions " << min << " through " << max << " to be read" <<endl;
                     for (uint64_t i = min; i <= max; i++) {
-                        _partitionsToRead[i] = true;
-                        if (i < minPartitionToRead) {
-                            minPartitionToRead = i;
-                        }
-                        if (i > maxPartitionToRead) {
-                            maxPartitionToRead = i;
-                        }
+                        clausePartitions[i] = true;
+                    }
+                }
+            }
+
+            // Now rule out partitions none of whose keys in a zoneMap index fall in
+            // the clause's range for the index's first field. An index scan over
+            // such a partition would find nothing, so neither can any other plan.
+            // The last partition has no zone maps to go by.
+            for (vector<int>::const_iterator j = zoneMapIndexes.begin(); cl != NULL && j != zoneMapIndexes.end(); ++j) {
+                const IndexDetails &index = pc->idx(*j);
+                const FieldRange &zoneRange = frsp->frsForIndex(cl, *j).range(index.keyPattern().firstElementFieldName());
+                if (zoneRange.universal()) {
+                    continue;
+                }
+                const string name = index.indexName();
+                for (uint64_t i = 0; i + 1 < numPartitions; i++) {
+                    if (!clausePartitions[i]) {
+                        continue;
+                    }
+                    BSONElement zoneMap = zoneMaps[i][name];
+                    if (!zoneMap.isABSONObj()) {
+                        // not known for this partition
+                        continue;
+                    }
+                    BSONObj bounds = zoneMap.Obj();
+                    if (bounds.isEmpty() || !rangeOverlaps(zoneRange, bounds["min"], bounds["max"])) {
+                        TOKULOG(3) << "Zone map of " << name << " rules out partition " << i << endl;
+                        clausePartitions[i] = false;
+                        zoneMapPartitionsSkipped.increment();
+                    }
+                }
+            }
+
+            for (uint64_t i = 0; i < numPartitions; i++) {
+                if (clausePartitions[i]) {
+                    _partitionsToRead[i] = true;
+                    if (i < minPartitionToRead) {
+                        minPartitionToRead = i;
+                    }
+                    if (i > maxPartitionToRead) {
+                        maxPartitionToRead = i;
                     }
                 }
             }
@@ -563,6 +793,12 @@ namespace mongo {
                 org.popOrClauseSingleKey();
             }
         }while (!org.orRangesExhausted());
+        if (minPartitionToRead == numPartitions) {
+            // every partition was ruled out, but a cursor needs one to read,
+            // so read the last, which is as good as any
+            _partitionsToRead[numPartitions - 1] = true;
+            minPartitionToRead = maxPartitionToRead = numPartitions - 1;
+        }
         // at this point, we have set all of the appropriate
         // entries in _partitionsToRead to true
         // Now we need to set up _currPartition
@@ -26,6 +26,7 @@
 #include "mongo/db/index.h"
 #include "mongo/db/storage/key.h"
 #include "mongo/db/collection.h"
+#include "mongo/db/parallel_partition_scan.h"
 
 namespace mongo {
 
@@ -197,6 +198,7 @@ namespace mongo {
     class FieldRangeVector;
     class FieldRangeVectorIterator;
     struct FieldInterval;
+    class IndexPrefetcher;
     
     /** Helper class for deduping primary keys (_id keys) */
     class PKDupSet {
@@ -235,6 +237,9 @@ namespace mongo {
         // only reset it fields if there is something in the buffer.
         void empty();
 
+        // the number of bytes past which the buffer considers itself gorged
+        static size_t preferredSize() { return _BUF_SIZE_PREFERRED; }
+
     private:
         class HeaderBits {
         public:
@@ -286,6 +291,8 @@ namespace mongo {
 
         BSONObj currPK() const { return _currPK; }
         BSONObj currKey() const { return _currKey; }
+        // The document comes from the row buffer when the index is clustering and the
+        // scan isn't covered. Otherwise it is looked up by pk on the first call per row.
         BSONObj current();
         BSONObj indexKeyPattern() const { return _idx.keyPattern(); }
 
@@ -302,6 +309,8 @@ namespace mongo {
         
         long long nscanned() const { return _nscanned; }
 
+        virtual void explainDetails( BSONObjBuilder &b ) const;
+
     protected:
         bool forward() const;
 
@@ -336,10 +345,19 @@ namespace mongo {
 
         /** Initialize the internal DBC */
         void initializeDBC();
-        void _prelockCompoundBounds(const int currentRange, vector<const FieldInterval *> &combo,
-                                    BufBuilder &startKeyBuilder, BufBuilder &endKeyBuilder);
+        /**
+         * Append the (start, end) keys of every interval combination in _bounds to ranges,
+         * in iteration order. Gives up and returns false once there are more than maxRanges,
+         * if maxRanges is non-zero.
+         */
+        bool _boundsRanges(vector<pair<BSONObj, BSONObj> > &ranges, const size_t maxRanges) const;
+        bool _compoundBoundsRanges(const int currentRange, vector<const FieldInterval *> &combo,
+                                   vector<pair<BSONObj, BSONObj> > &ranges,
+                                   const size_t maxRanges) const;
         void _prelockBounds();
         void _prelockRange(const BSONObj &startKey, const BSONObj &endKey);
+        /** Start warming the intervals of a multi-interval scan in the background, if worth it. */
+        void startPrefetching();
 
         /** Get the current key/pk/obj from the row buffer and set _currKey/PK/Obj */
         void getCurrentFromBuffer();
@@ -351,13 +369,20 @@ namespace mongo {
             RowBuffer *buffer;
             int rows_fetched;
             int rows_to_fetch;
-            cursor_getf_extra(RowBuffer *buf, int n_to_fetch) :
-                buffer(buf), rows_fetched(0), rows_to_fetch(n_to_fetch) {
+            size_t bytes_fetched;
+            bool key_only;
+            cursor_getf_extra(RowBuffer *buf, int n_to_fetch, bool keyOnly) :
+                buffer(buf), rows_fetched(0), rows_to_fetch(n_to_fetch),
+                bytes_fetched(0), key_only(keyOnly) {
             }
         };
         static int cursor_getf(const DBT *key, const DBT *val, void *extra);
         /** determine how many rows the next getf should bulk fetch */
         int getf_fetch_count();
+        /** true if rows may be buffered without their document (covered secondary index scans) */
+        bool getf_key_only() const;
+        /** account for the rows a getf put into the RowBuffer */
+        void noteRowsFetched(const cursor_getf_extra &extra);
         /** pull more rows from the DBC into the RowBuffer */
         bool fetchMoreRows();
         /** find by key where the PK used for search is determined by _direction */
@@ -424,6 +449,8 @@ namespace mongo {
         // The current key, pk, and obj for this cursor. Keys are stored
         // in a compacted format and built into bson format, so we reuse
         // a BufBuilder to prevent a malloc/free on each row read.
+        // _currObj is empty until current() is called unless the row
+        // buffer held the document.
         BSONObj _currKey;
         BSONObj _currPK;
         BSONObj _currObj;
@@ -434,6 +461,20 @@ namespace mongo {
         RowBuffer _buffer;
         int _getf_iteration;
 
+        // How many rows the caller expects to consume (skip + limit or batch size),
+        // 0 if unknown. Taken from cc().opSettings() at construction time.
+        const int _getf_rows_wanted;
+
+        // Totals over the life of the cursor. The bytes/rows ratio is our estimate
+        // of the size of a buffered row, and all three are reported in explain.
+        long long _getf_calls;
+        long long _getf_rows;
+        long long _getf_bytes;
+
+        // Warms upcoming intervals of a multi-interval scan, if non-null.
+        // Told about each reposition in setPosition().
+        scoped_ptr<IndexPrefetcher> _prefetcher;
+
         // for interrupt checking
         ExceptionSaver _interrupt_extra;
 
@@ -566,7 +607,6 @@ namespace mongo {
         virtual bool isMultiKey() const { return false; }
         virtual bool modifiedKeys() const { return false; }
         virtual BSONObj prettyIndexBounds() const { return BSONArray(); }
-        virtual void explainDetails( BSONObjBuilder& b ) const { return; }
 
     private:
         BasicCursor(CollectionData *cl, int direction);
@@ -613,6 +653,8 @@ namespace mongo {
         // generate a cursor on partition with index of partitionIndex
         virtual shared_ptr<Cursor> makeSubCursor(uint64_t partitionIndex) = 0;
         virtual ~SubPartitionCursorGenerator() { }
+        PartitionedCollection* collection() const { return _pc; }
+        bool countCursor() const { return _countCursor; }
     protected:
         SubPartitionCursorGenerator(
             PartitionedCollection* pc,
@@ -663,24 +705,36 @@ namespace mongo {
     // that is not the partition/primary key (as of this writing, they
     // are one and the same), then results may come out of order.
     // If results must be in order, the caller should use a SortedPartitionedCursor
+    //
+    // If ParallelPartitionScan::enabled() when the cursor is made,
+    // the partitions after the first are read several at a time by a
+    // ParallelPartitionScan once the first is done, and still returned
+    // in partition order.  The scan's transactions begin with the cursor.
     class PartitionedCursor : public Cursor {
     public:
 
         virtual bool ok() {
+            if (_scan) {
+                return _scanPos < _scan->size();
+            }
             return _currentCursor->ok();
         }
 
-        virtual BSONObj current() {
-            return _currentCursor->current();
-        }
+        virtual BSONObj current();
 
         virtual bool advance();
 
         virtual BSONObj currKey() const {
+            if (_scan) {
+                return _scan->front(_scanPos).key;
+            }
             return _currentCursor->currKey();
         }
 
         virtual BSONObj currPK() const {
+            if (_scan) {
+                return _scan->front(_scanPos).pk;
+            }
             return _currentCursor->currPK();
         }
 
@@ -715,7 +769,7 @@ namespace mongo {
         }
 
         virtual long long nscanned() const {
-            return _prevNScanned + _currentCursor->nscanned();
+            return _prevNScanned + _currentCursor->nscanned() + (_scan ? _scan->nscanned() : 0);
         }
 
         virtual CoveredIndexMatcher *matcher() const {
@@ -723,12 +777,21 @@ namespace mongo {
         }
 
         virtual bool currentMatches( MatchDetails *details = 0 ) {
+            if (_scan) {
+                return _scan->currentMatches(_scanPos, this, _matcher.get(), details);
+            }
             return _currentCursor->currentMatches(details);
         }
 
         virtual void setMatcher( shared_ptr< CoveredIndexMatcher > matcher ) {
             _matcher = matcher;
             _currentCursor->setMatcher(matcher);
+            if (_pendingScan) {
+                _pendingScan->setMatcher(matcher);
+            }
+            if (_scan) {
+                _scan->setMatcher(matcher);
+            }
         }
 
         const Projection::KeyOnly *keyFieldsOnly() const { return _keyFieldsOnly.get(); }
@@ -736,6 +799,12 @@ namespace mongo {
             _keyFieldsOnly = keyFieldsOnly;
             // unsure if this is necessary
             _currentCursor->setKeyFieldsOnly(keyFieldsOnly);
+            if (_pendingScan) {
+                _pendingScan->setKeyFieldsOnly(keyFieldsOnly);
+            }
+            if (_scan) {
+                _scan->setKeyFieldsOnly(keyFieldsOnly);
+            }
         }
         bool tailable() const { return _tailable; }
         void setTailable();
@@ -749,6 +818,15 @@ namespace mongo {
             );
         void getNextSubCursor();
         void initializeSubCursor();
+        // whether the current partition is the last one
+        bool lastPartition();
+        // the index of the partition after the current one
+        uint64_t nextPartition();
+        // start reading the partitions after the current one with
+        // _pendingScan, if we made one. returns true if it did
+        bool startScan();
+        // move _scanPos to the next partition with an entry buffered, reading more as needed
+        void settleScan();
 
         const bool _distributed;
         shared_ptr<SubPartitionCursorGenerator> _subCursorGenerator;
@@ -765,6 +843,21 @@ namespace mongo {
         bool _tailable;
         PKDupSet _dups;
 
+        // the partitions after the one initializeSubCursor() found, taken from
+        // the generator when the cursor is made, and how many of them we've read
+        // one at a time
+        vector<uint64_t> _laterPartitions;
+        size_t _laterPos;
+
+        // reads _laterPartitions in parallel, with transactions begun when the
+        // cursor was made, once _currentCursor runs out
+        shared_ptr<ParallelPartitionScan> _pendingScan;
+
+        // reads the partitions after _currentCursor's, if we're scanning in parallel
+        shared_ptr<ParallelPartitionScan> _scan;
+        // position in _scan of the partition we are returning results from
+        size_t _scanPos;
+
         friend class PartitionedCollection;
     };
 
@@ -777,28 +870,47 @@ namespace mongo {
     // elements in sorted order (ove the key we are querying)
     // That means we run cursors over all the necessary partitions
     // simultaneously
+    //
+    // If ParallelPartitionScan::enabled(), the partitions are read
+    // several at a time by a ParallelPartitionScan, and we merge
+    // what it buffers instead.
     class SortedPartitionedCursor : public Cursor {
     public:
 
         virtual bool ok() {
+            if (_scan) {
+                return !_scanHeap.empty();
+            }
             return (_cursors.front().first)->ok();
         }
 
         virtual BSONObj current() {
+            if (_scan) {
+                return _scan->current(_scanHeap.front());
+            }
             return _cursors.front().first->current();
         }
 
         virtual bool advance();
 
         virtual BSONObj currKey() const {
+            if (_scan) {
+                return _scan->front(_scanHeap.front()).key;
+            }
             return _cursors.front().first->currKey();
         }
 
         virtual BSONObj currPK() const {
+            if (_scan) {
+                return _scan->front(_scanHeap.front()).pk;
+            }
             return _cursors.front().first->currPK();
         }
 
         virtual BSONObj indexKeyPattern() const {
+            if (_scan) {
+                return _scan->indexKeyPattern();
+            }
             return _cursors.front().first->indexKeyPattern();
         }
 
@@ -822,6 +934,9 @@ namespace mongo {
         }
 
         virtual BSONObj prettyIndexBounds() const {
+            if (_scan) {
+                return _scan->prettyIndexBounds();
+            }
             return _cursors.front().first->prettyIndexBounds();
         }
 
@@ -830,6 +945,9 @@ namespace mongo {
             for (uint32_t i = 0; i < _cursors.size(); i++) {
                 ret += _cursors[i].first->nscanned();
             }
+            if (_scan) {
+                ret += _scan->nscanned();
+            }
             return ret;
         }
 
@@ -838,6 +956,9 @@ namespace mongo {
         }
 
         virtual bool currentMatches( MatchDetails *details = 0 ) {
+            if (_scan) {
+                return _scan->currentMatches(_scanHeap.front(), this, _matcher.get(), details);
+            }
             return _cursors.front().first->currentMatches(details);
         }
 
@@ -846,6 +967,9 @@ namespace mongo {
             for (uint32_t i = 0; i < _cursors.size(); i++) {
                 _cursors[i].first->setMatcher(matcher);
             }
+            if (_scan) {
+                _scan->setMatcher(matcher);
+            }
         }
 
         const Projection::KeyOnly *keyFieldsOnly() const { return _keyFieldsOnly.get(); }
@@ -855,6 +979,9 @@ namespace mongo {
             for (uint32_t i = 0; i < _cursors.size(); i++) {
                 _cursors[i].first->setKeyFieldsOnly(keyFieldsOnly);
             }
+            if (_scan) {
+                _scan->setKeyFieldsOnly(keyFieldsOnly);
+            }
         }
         bool tailable() const { return false; }
         void setTailable() {
@@ -869,6 +996,12 @@ namespace mongo {
             shared_ptr<SubPartitionIDGenerator> subPartitionIDGenerator,
             const bool multiKey
             );
+        // read all the partitions with a ParallelPartitionScan, and
+        // build _scanHeap from the first entries
+        void startScan();
+        // make sure the i'th partition in _scan has an entry
+        // buffered, unless it's exhausted
+        void fillScanEntry(const size_t i);
         const int _direction;
         const Ordering _ordering;
         shared_ptr<SubPartitionCursorGenerator> _subCursorGenerator;
@@ -883,6 +1016,12 @@ namespace mongo {
         // cursors organized in a heap
         vector< SPCSubCursor > _cursors;
 
+        // if we're scanning in parallel, _scan reads the partitions
+        // and _scanHeap holds the positions in _scan of those with
+        // an entry buffered, organized in a heap instead of _cursors
+        shared_ptr<ParallelPartitionScan> _scan;
+        vector<size_t> _scanHeap;
+
         PKDupSet _dups;
 
         friend class PartitionedCollection;
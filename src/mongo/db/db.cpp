@@ -38,6 +38,7 @@
 #include "mongo/db/database.h"
 #include "mongo/db/dbmessage.h"
 #include "mongo/db/dbwebserver.h"
+#include "mongo/db/index_rewrite.h"
 #include "mongo/db/initialize_server_global_state.h"
 #include "mongo/db/instance.h"
 #include "mongo/db/introspect.h"
@@ -46,6 +47,7 @@
 #include "mongo/db/module.h"
 #include "mongo/db/ops/delete.h"
 #include "mongo/db/ops/update.h"
+#include "mongo/db/partition_rollover.h"
 #include "mongo/db/repl.h"
 #include "mongo/db/repl/rs.h"
 #include "mongo/db/restapi.h"
@@ -666,6 +668,8 @@ namespace mongo {
         }
         else {
             startTTLBackgroundJob();
+            startIndexRewriteBackgroundJob();
+            startPartitionRolloverBackgroundJob();
         }
 
 #ifndef _WIN32
@@ -169,7 +169,7 @@ namespace mongo {
                     // if there's a non-zero log flush period, transactions
                     // do not fsync on commit and so we must do it here.
                     if (cmdLine.logFlushPeriod != 0) {
-                        storage::log_flush();
+                        storage::group_log_flush();
                     }
                 }
 
@@ -1462,6 +1462,38 @@ namespace mongo {
         }
     } cmdCollectionStats;
 
+    class PlanCacheStats : public QueryCommand {
+    public:
+        PlanCacheStats() : QueryCommand( "planCacheStats" ) {}
+        virtual void help( stringstream &help ) const {
+            help << "{ planCacheStats:\"blog.posts\" }\n"
+                    "the cached query plan of each query pattern, with how often it was used (hits),\n"
+                    "how often plans had to be raced (misses) and how often a cached plan was\n"
+                    "abandoned for scanning much more than recorded (replans)";
+        }
+        virtual void addRequiredPrivileges(const std::string& dbname,
+                                           const BSONObj& cmdObj,
+                                           std::vector<Privilege>* out) {
+            ActionSet actions;
+            actions.addAction(ActionType::collStats);
+            out->push_back(Privilege(parseNs(dbname, cmdObj), actions));
+        }
+        bool run(const string& dbname, BSONObj& jsobj, int, string& errmsg, BSONObjBuilder& result, bool fromRepl ) {
+            string ns = dbname + "." + jsobj.firstElement().valuestr();
+            Client::Context cx( ns );
+
+            Collection *cl = getCollection( ns );
+            if ( ! cl ) {
+                errmsg = "ns not found";
+                return false;
+            }
+
+            result.append( "ns" , ns.c_str() );
+            cl->getQueryCache().appendStats( result );
+            return true;
+        }
+    } cmdPlanCacheStats;
+
     class DBStats : public QueryCommand {
     public:
         DBStats() : QueryCommand( "dbStats", false, "dbstats" ) {}
@@ -1840,6 +1872,46 @@ namespace mongo {
         }
     } cmdAddPartition;
 
+    class CmdSetPartitionPolicy : public FileopsCommand {
+    public:
+        CmdSetPartitionPolicy() : FileopsCommand("setPartitionPolicy") { }
+        virtual bool logTheOp() { return true; }
+        virtual bool slaveOk() const { return false; }
+        virtual void help( stringstream& help ) const {
+            help << "set when partitions are added to and dropped from a partitioned collection\n" <<
+                "in the background, an empty policy removes it.\n" <<
+                "Example: {setPartitionPolicy: \"foo\", policy: {rolloverHours: 24, expireDays: 30}}\n" <<
+                "policy fields: rolloverHours, rolloverBytes, keepPartitions, expireDays, expireHours";
+        }
+        virtual void addRequiredPrivileges(const std::string& dbname,
+                                           const BSONObj& cmdObj,
+                                           std::vector<Privilege>* out) {
+            ActionSet actions;
+            actions.addAction(ActionType::addPartition);
+            actions.addAction(ActionType::dropPartition);
+            out->push_back(Privilege(parseNs(dbname, cmdObj), actions));
+        }
+        bool run(const string& dbname, BSONObj& cmdObj, int, string& errmsg, BSONObjBuilder& anObjBuilder, bool /*fromRepl*/) {
+            string coll = cmdObj[ "setPartitionPolicy" ].valuestrsafe();
+            uassert( 17376, "setPartitionPolicy must specify a collection", !coll.empty() );
+            string ns = dbname + "." + coll;
+            bool isOplogNS = (strcmp(ns.c_str(), rsoplog) == 0) || (strcmp(ns.c_str(), rsOplogRefs) == 0);
+            uassert( 17377, "cannot set a partition policy on oplog or oplog.refs, use expireOplogDays", !isOplogNS);
+            Collection *cl = getCollection( ns );
+            uassert( 17378, "setPartitionPolicy no such collection", cl );
+            uassert( 17379, "collection must be partitioned", cl->isPartitioned() );
+            BSONElement e = cmdObj["policy"];
+            uassert( 17380, "setPartitionPolicy must specify a policy object", e.type() == Object );
+
+            BSONElement was = cl->partitionPolicy();
+            if (was.ok()) {
+                anObjBuilder.append("was", was);
+            }
+            cl->setPartitionPolicy(e.Obj());
+            return true;
+        }
+    } cmdSetPartitionPolicy;
+
     class CmdConvertToPartitioned : public FileopsCommand {
     public:
         CmdConvertToPartitioned() : FileopsCommand("convertToPartitioned") { }
@@ -2137,7 +2209,7 @@ namespace mongo {
 
        returns true if ran a cmd
     */
-    bool _runCommands(const char *ns, const BSONObj &cmdobj, BufBuilder &b, BSONObjBuilder& anObjBuilder, bool fromRepl, int queryOptions) {
+    bool _runCommands(const char *ns, const BSONObj &cmdobj, BSONObjBuilder& anObjBuilder, bool fromRepl, int queryOptions) {
         string dbname = nsToDatabase( ns );
 
         if( logLevel >= 1 )
@@ -2183,9 +2255,7 @@ namespace mongo {
             anObjBuilder.append("bad cmd" , cmdobj );
         }
 
-        BSONObj x = anObjBuilder.done();
-        b.appendBuf((void*) x.objdata(), x.objsize());
-
+        anObjBuilder.done();
         return true;
     }
 
@@ -33,6 +33,7 @@
 #include "mongo/db/repl_block.h"
 #include "mongo/db/replutil.h"
 #include "mongo/db/commands.h"
+#include "mongo/db/server_parameters.h"
 #include "mongo/db/instance.h"
 #include "mongo/db/lasterror.h"
 #include "mongo/db/repl/multicmd.h"
@@ -41,6 +42,8 @@
 #include "mongo/scripting/engine.h"
 #include "mongo/util/lruishmap.h"
 #include "mongo/util/md5.hpp"
+#include "mongo/util/net/message_compressor.h"
+#include "mongo/util/net/message_port.h"
 #include "mongo/util/processinfo.h"
 #include "mongo/util/version.h"
 #include "mongo/util/ramlog.h"
@@ -86,6 +89,49 @@ namespace mongo {
         }
     } pingCmd;
 
+    // Whether to agree to compress connections that ask for it with _negotiateCompression.
+    MONGO_EXPORT_SERVER_PARAMETER(networkCompression, bool, true);
+
+    class NegotiateCompressionCommand : public InformationCommand {
+    public:
+        NegotiateCompressionCommand() : InformationCommand("_negotiateCompression") {}
+        virtual void help( stringstream &help ) const {
+            help << "internal\n"
+                 << "{ _negotiateCompression : 1, compressors : [ \"zlib\" ] }\n"
+                 << "picks the first compressor in the list this server supports and compresses "
+                 << "everything it sends on this connection after the reply with it";
+        }
+        virtual bool requiresAuth() { return false; }
+        virtual void addRequiredPrivileges(const std::string& dbname,
+                                           const BSONObj& cmdObj,
+                                           std::vector<Privilege>* out) {} // No auth required
+        virtual bool run(const string&, BSONObj& cmdObj, int, string& errmsg, BSONObjBuilder& result, bool) {
+            MessageCompressor::Id id = MessageCompressor::None;
+            if (networkCompression) {
+                BSONForEach(e, cmdObj.getObjectField("compressors")) {
+                    if (e.type() == String) {
+                        id = MessageCompressor::fromName(e.valuestr());
+                        if (id != MessageCompressor::None) {
+                            break;
+                        }
+                    }
+                }
+            }
+            ClientBasic* c = ClientBasic::getCurrent();
+            MessagingPort* p = c ? dynamic_cast<MessagingPort*>(c->port()) : NULL;
+            if (p == NULL) {
+                // DBDirectClient, nothing to compress
+                id = MessageCompressor::None;
+            }
+            else if (id != MessageCompressor::None) {
+                // The client can't decompress anything until it has the reply.
+                p->setCompressor(id, true);
+            }
+            result.append("compressor", MessageCompressor::name(id));
+            return true;
+        }
+    } negotiateCompressionCmd;
+
     class FeaturesCmd : public WebInformationCommand {
     public:
         FeaturesCmd() : WebInformationCommand("features") {}
@@ -77,14 +77,14 @@ namespace mongo {
     void replyToQuery(int queryResultFlags,
                       AbstractMessagingPort* p, Message& requestMsg,
                       const BSONObj& responseObj) {
-        replyToQuery(queryResultFlags,
-                     p, requestMsg,
-                     (void *) responseObj.objdata(), responseObj.objsize(), 1);
+        Message resp;
+        replyToQueryHoldingObj(queryResultFlags, resp, responseObj);
+        p->reply(requestMsg, resp, requestMsg.header()->id);
     }
 
     void replyToQuery( int queryResultFlags, Message &m, DbResponse &dbresponse, BSONObj obj ) {
         Message *resp = new Message();
-        replyToQuery( queryResultFlags, *resp, obj );
+        replyToQueryHoldingObj( queryResultFlags, *resp, obj );
         dbresponse.response = resp;
         dbresponse.responseTo = m.header()->id;
     }
@@ -108,4 +108,23 @@ namespace mongo {
         response.setData( queryResult, true ); // transport will free
     }
 
+    void replyToQueryHoldingObj( int queryResultFlags, Message& response, const BSONObj& resultObj ) {
+        if ( !resultObj.isOwned() ) {
+            replyToQuery( queryResultFlags, response, resultObj );
+            return;
+        }
+
+        QueryResult* queryResult = reinterpret_cast< QueryResult* >( malloc( sizeof( QueryResult ) ) );
+        verify( queryResult );
+        queryResult->_resultFlags() = queryResultFlags;
+        queryResult->len = sizeof( QueryResult );
+        queryResult->setOperation( opReply );
+        queryResult->cursorId = 0;
+        queryResult->startingFrom = 0;
+        queryResult->nReturned = 1;
+
+        response.setData( queryResult, true ); // transport will free
+        response.appendObj( resultObj ); // updates len
+    }
+
 }
@@ -290,4 +290,11 @@ namespace mongo {
      * @param resultObj The bson object that contains the reply data.
      */
     void replyToQuery( int queryResultFlags, Message& response, const BSONObj& resultObj );
+
+    /**
+     * Like replyToQuery( int, Message&, const BSONObj& ), except that an owned resultObj isn't
+     * copied, the response holds on to it and sends it from its own buffer.  Such a response
+     * isn't a single buffer, so it has to be concat()ed before singleData() can be used.
+     */
+    void replyToQueryHoldingObj( int queryResultFlags, Message& response, const BSONObj& resultObj );
 } // namespace mongo
@@ -26,13 +26,16 @@ namespace mongo {
                            const bool hashed,
                            const int hashSeed,
                            const bool sparse,
-                           const bool clustering) :
-        _data(NULL), _size(serializedSize(keyPattern)), _dataOwned(new char[_size]) {
+                           const bool clustering,
+                           const storage::KeyFormat::Encoding keyFormat) :
+        _data(NULL), _size(serializedSize(keyPattern, keyFormat != storage::KeyFormat::V1)),
+        _dataOwned(new char[_size]) {
         _data = _dataOwned.get();
 
         // Create a header and write it first.
         Header h(Ordering::make(keyPattern),
-                 hashed, sparse, clustering, hashSeed, keyPattern.nFields());
+                 hashed, sparse, clustering, hashSeed, keyPattern.nFields(),
+                 keyFormat != storage::KeyFormat::V1);
         memcpy(_dataOwned.get(), &h, sizeof(Header));
 
         // The offsets array is based after the header. It is an array of
@@ -52,6 +55,9 @@ namespace mongo {
             offset += len;
             verify((char*) &offsetsBase[i] < fieldsBase);
         }
+        if (h.hasKeyFormat()) {
+            fieldsBase[offset++] = (char) keyFormat;
+        }
         verify(fieldsBase + offset == _data + _size);
     }
 
@@ -62,8 +68,8 @@ namespace mongo {
         verify(_size > (size_t) FixedSize);
     }
 
-    size_t Descriptor::serializedSize(const BSONObj &keyPattern) {
-        size_t size = FixedSize;
+    size_t Descriptor::serializedSize(const BSONObj &keyPattern, const bool hasKeyFormat) {
+        size_t size = FixedSize + (hasKeyFormat ? 1 : 0);
         for (BSONObjIterator o(keyPattern); o.more(); ++o) {
             const BSONElement &e = *o;
             // Each field will take up 4 bytes in the offset array
@@ -89,6 +95,14 @@ namespace mongo {
         return h.ordering;
     }
 
+    storage::KeyFormat Descriptor::keyFormat() const {
+        const Header &h(*reinterpret_cast<const Header *>(_data));
+        const storage::KeyFormat::Encoding encoding = h.hasKeyFormat()
+                ? (storage::KeyFormat::Encoding) _data[_size - 1]
+                : storage::KeyFormat::V1;
+        return storage::KeyFormat(encoding, h.ordering);
+    }
+
     void Descriptor::fieldNames(vector<const char *> &fields) const {
         const Header &h(*reinterpret_cast<const Header *>(_data));
         const uint32_t *const offsetsBase = reinterpret_cast<const uint32_t *>(_data + sizeof(Header));
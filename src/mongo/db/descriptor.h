@@ -39,7 +39,8 @@ namespace mongo {
                    const bool hashed = false,
                    const int hashSeed = 0,
                    const bool sparse = false,
-                   const bool clustering = false);
+                   const bool clustering = false,
+                   const storage::KeyFormat::Encoding keyFormat = storage::KeyFormat::V1);
         // For interpretting a memory buffer as a descriptor.
         Descriptor(const char *data, const size_t size);
 
@@ -64,7 +65,10 @@ namespace mongo {
             return h.clustering;
         }
 
-        static size_t serializedSize(const BSONObj &keyPattern);
+        // How keys are encoded in this dictionary.
+        storage::KeyFormat keyFormat() const;
+
+        static size_t serializedSize(const BSONObj &keyPattern, const bool hasKeyFormat = false);
 
     private:
         void fieldNames(vector<const char *> &fields) const;
@@ -81,23 +85,32 @@ namespace mongo {
         //     4 bytes: integer number of fields
         //     integer array: array of offsets into subsequent byte array for each field string
         //     byte array: array of null terminated field strings
+        //     (version 2 only) 1 byte: key format, see storage::KeyFormat
         //   ]
+        //
+        // Only indexes that use a key format other than v1 get a version 2 descriptor,
+        // so that every other index can still be opened by versions that don't know
+        // about key formats.
         struct Header {
         private:
             enum Version {
                 // Version 0 is kind of a fake version.
                 VERSION_0 = 0,
                 VERSION_1 = 1,
-                NEXT_VERSION = 2
+                VERSION_2 = 2,
+                NEXT_VERSION = 3
             };
-            static const int CURRENT_VERSION = (int) NEXT_VERSION - 1;
 
         public:
-            Header(const Ordering &o, char h, char s, char c, int hs, uint32_t n)
-                : ordering(o), version((char) CURRENT_VERSION), hashed(h), sparse(s), clustering(c),
+            Header(const Ordering &o, char h, char s, char c, int hs, uint32_t n, bool kf)
+                : ordering(o), version((char) (kf ? VERSION_2 : VERSION_1)), hashed(h), sparse(s), clustering(c),
                   hashSeed(hs), numFields(n) {
             }
 
+            bool hasKeyFormat() const {
+                return version >= VERSION_2;
+            }
+
             Ordering ordering;
             char version;
             char hashed;
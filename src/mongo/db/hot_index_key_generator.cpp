@@ -0,0 +1,345 @@
+// hot_index_key_generator.cpp
+
+/**
+*    Copyright (C) 2013 Tokutek Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "mongo/pch.h"
+
+#include "mongo/db/hot_index_key_generator.h"
+
+#include <db.h>
+
+#include "mongo/db/client.h"
+#include "mongo/db/collection.h"
+#include "mongo/db/d_concurrency.h"
+#include "mongo/db/descriptor.h"
+#include "mongo/db/index.h"
+#include "mongo/db/server_parameters.h"
+#include "mongo/db/storage/cursor.h"
+#include "mongo/db/storage/key.h"
+#include "mongo/util/timer.h"
+
+namespace mongo {
+
+    // Number of threads generating keys ahead of each hot index build.
+    // Zero leaves all key generation to the indexer's own thread.
+    MONGO_EXPORT_SERVER_PARAMETER(hotIndexerThreads, int, 4);
+
+    // Primary key bytes per partition. Small enough that a worker doesn't
+    // fall behind the indexer in the middle of one, big enough that the
+    // per-partition lock and transaction are noise.
+    static const uint64_t partitionBytes = 4 * 1024 * 1024;
+
+    // How many partitions per worker may be claimed and not yet passed by the indexer.
+    static const size_t partitionsPerWorker = 2;
+
+    // Workers check for the indexer passing them this often, in rows.
+    static const size_t rowsPerCheck = 256;
+
+    struct HotIndexKeyGenerator::Row {
+        Row(const BSONObj &p, const BSONObj &o) : pk(p), obj(o) { }
+        BSONObj pk;
+        BSONObj obj;
+        BSONObjSet keys;
+    };
+
+    struct HotIndexKeyGenerator::Partition : boost::noncopyable {
+        Partition(int n, const BSONObj &s, const BSONObj &e) :
+            number(n), start(s), end(e), elapsedMillis(0), generated(0), next(0),
+            done(false), abandoned(false) {
+        }
+        const int number;
+        const BSONObj start;    // inclusive
+        const BSONObj end;      // exclusive, empty for the last partition
+        Timer timer;
+        int elapsedMillis;      // time to generate the partition, once done
+        // Filled by the worker, read by the indexer once done is set.
+        vector<Row> rows;
+        size_t generated;       // rows with keys so far, for status()
+        size_t next;            // first row the indexer may still ask for
+        bool done;
+        bool abandoned;
+    };
+
+    bool HotIndexKeyGenerator::enabled() {
+        return hotIndexerThreads > 0;
+    }
+
+    // Where a forward scan of the primary key starts and ends, as in ScanCursor.
+    static const BSONObj &firstKey(const Ordering &ordering) {
+        return ordering.descending(1) ? maxKey : minKey;
+    }
+    static const BSONObj &lastKey(const Ordering &ordering) {
+        return ordering.descending(1) ? minKey : maxKey;
+    }
+
+    static string descriptorData(const Descriptor &descriptor) {
+        const DBT dbt = descriptor.dbt();
+        return string(static_cast<const char *>(dbt.data), dbt.size);
+    }
+
+    HotIndexKeyGenerator::HotIndexKeyGenerator(const string &ns, const IndexDetailsBase &pkIdx,
+                                               const Descriptor &descriptor) :
+        _ns(ns), _pkIdx(pkIdx), _pkPattern(pkIdx.keyPattern().getOwned()), _pkOrdering(Ordering::make(_pkPattern)),
+        _descriptorData(descriptorData(descriptor)),
+        _mutex("hotIndexKeyGenerator"),
+        _nextStart(firstKey(_pkOrdering)), _nextPartition(0),
+        _exhausted(false), _stopped(false),
+        _hits(0), _misses(0) {
+    }
+
+    HotIndexKeyGenerator::~HotIndexKeyGenerator() {
+        // Workers read an index our owner may close, they must be gone already.
+        mongo::mutex::scoped_lock lk(_mutex);
+        verify(_stopped || _workers.size() == 0);
+    }
+
+    void HotIndexKeyGenerator::stop() {
+        {
+            mongo::mutex::scoped_lock lk(_mutex);
+            _stopped = true;
+            _roomAvailable.notify_all();
+        }
+        _workers.join_all();
+    }
+
+    void HotIndexKeyGenerator::start() {
+        _indexerThread = boost::this_thread::get_id();
+        const int n = hotIndexerThreads;
+        for (int i = 0; i < n; i++) {
+            _workers.create_thread(boost::bind(&HotIndexKeyGenerator::run, this));
+        }
+        LOG(1) << "hot index build on " << _ns << " generating keys on " << n << " threads" << endl;
+    }
+
+    bool HotIndexKeyGenerator::takeKeys(const BSONObj &pk, const BSONObj &obj, BSONObjSet &keys) {
+        // Only the indexer's scan visits rows in primary key order. Writes
+        // by other clients generate their own keys.
+        if (boost::this_thread::get_id() != _indexerThread) {
+            return false;
+        }
+
+        mongo::mutex::scoped_lock lk(_mutex);
+        while (!_partitions.empty()) {
+            Partition &p = *_partitions.front();
+            if (!p.end.isEmpty() && pk.woCompare(p.end, _pkOrdering, false) >= 0) {
+                // The indexer is done with this partition, make room for another.
+                p.abandoned = true;
+                _partitions.pop_front();
+                _roomAvailable.notify_all();
+                continue;
+            }
+            if (!p.done) {
+                break;
+            }
+            while (p.next < p.rows.size() &&
+                   p.rows[p.next].pk.woCompare(pk, _pkOrdering, false) < 0) {
+                p.next++;
+            }
+            if (p.next < p.rows.size()) {
+                // The indexer may call us more than once for a row with several
+                // versions, only the version the worker read can use its keys.
+                Row &row = p.rows[p.next];
+                if (row.pk.woCompare(pk, _pkOrdering, false) == 0 && row.obj.binaryEqual(obj)) {
+                    keys.swap(row.keys);
+                    p.next++;
+                    _hits++;
+                    return true;
+                }
+            }
+            break;
+        }
+        _misses++;
+        return false;
+    }
+
+    std::string HotIndexKeyGenerator::status() {
+        mongo::mutex::scoped_lock lk(_mutex);
+        StringBuilder s;
+        s << "key generation:";
+        for (std::deque<shared_ptr<Partition> >::const_iterator it = _partitions.begin();
+             it != _partitions.end(); ++it) {
+            const Partition &p = **it;
+            const long long millis = std::max(p.done ? p.elapsedMillis : p.timer.millis(), 1);
+            s << (it == _partitions.begin() ? " " : ", ")
+              << "partition " << p.number << " " << (long long) (p.generated * 1000 / millis) << "/s"
+              << (p.done ? "" : " (running)");
+        }
+        const long long total = _hits + _misses;
+        if (total > 0) {
+            s << ", " << (_hits * 100 / total) << "% of rows pre-generated";
+        }
+        return s.str();
+    }
+
+    void HotIndexKeyGenerator::run() {
+        Client::initThread("hotIndexKeyGenerator");
+        try {
+            while (true) {
+                if (!waitForRoom()) {
+                    break;
+                }
+                shared_ptr<Partition> p;
+                {
+                    // No lock, see the class comment.
+                    Client::Transaction transaction(DB_READ_UNCOMMITTED | DB_TXN_READ_ONLY);
+                    p = claimPartition();
+                    if (!p) {
+                        break;
+                    }
+                    readPartition(*p);
+                    transaction.commit();
+                }
+                generateKeys(*p);
+            }
+        } catch (const DBException &e) {
+            // Generating keys early is only an optimization, the indexer
+            // generates whatever we didn't.
+            LOG(1) << "hot index key generation for " << _ns << " stopped: " << e.what() << endl;
+        }
+        cc().shutdown();
+    }
+
+    class PartitionEndCallback {
+    public:
+        PartitionEndCallback(BSONObj &end) : _end(end) { }
+        void operator()(const storage::KeyV1 *endKey, const BSONObj *endPK, uint64_t skipped) {
+            _end = endKey != NULL ? endKey->toBson() : BSONObj();
+        }
+    private:
+        BSONObj &_end;
+    };
+
+    bool HotIndexKeyGenerator::waitForRoom() {
+        mongo::mutex::scoped_lock lk(_mutex);
+        while (!_stopped && !_exhausted && !inShutdown() &&
+               _partitions.size() >= partitionsPerWorker * std::max(hotIndexerThreads, 1)) {
+            _roomAvailable.timed_wait(lk.boost(), boost::posix_time::milliseconds(100));
+        }
+        return !_stopped && !_exhausted && !inShutdown();
+    }
+
+    shared_ptr<HotIndexKeyGenerator::Partition> HotIndexKeyGenerator::claimPartition() {
+        while (true) {
+            BSONObj start;
+            int number;
+            {
+                mongo::mutex::scoped_lock lk(_mutex);
+                if (_stopped || _exhausted || inShutdown()) {
+                    return shared_ptr<Partition>();
+                }
+                start = _nextStart;
+                number = _nextPartition;
+            }
+
+            // Finding the end reads the primary key, so it's done without the
+            // mutex, which the indexer takes for every row.
+            BSONObj end;
+            PartitionEndCallback cb(end);
+            _pkIdx.getKeyAfterBytes(storage::Key(start, NULL), partitionBytes, cb);
+            if (!end.isEmpty() && end.woCompare(start, _pkOrdering, false) <= 0) {
+                end = BSONObj();
+            }
+
+            mongo::mutex::scoped_lock lk(_mutex);
+            if (_nextPartition != number) {
+                // Another worker claimed this partition first, try the next one.
+                continue;
+            }
+            shared_ptr<Partition> p(new Partition(_nextPartition++, start, end));
+            _partitions.push_back(p);
+            _nextStart = end;
+            _exhausted = end.isEmpty();
+            return p;
+        }
+    }
+
+    struct ReadPartitionExtra {
+        ReadPartitionExtra(vector<HotIndexKeyGenerator::Row> &r, const storage::Key *e,
+                           const Ordering &o) :
+            rows(r), end(e), ordering(o), passedEnd(false) {
+        }
+        vector<HotIndexKeyGenerator::Row> &rows;
+        const storage::Key *end;
+        const Ordering &ordering;
+        bool passedEnd;
+    };
+
+    static int readPartitionGetf(const DBT *key, const DBT *val, void *extra) {
+        ReadPartitionExtra *info = static_cast<ReadPartitionExtra *>(extra);
+        if (key == NULL) {
+            return 0;
+        }
+        const storage::Key sKey(key);
+        if (info->end != NULL && storage::Key::woCompare(sKey, *info->end, info->ordering) >= 0) {
+            info->passedEnd = true;
+            return 0;
+        }
+        const BSONObj obj(static_cast<const char *>(val->data));
+        info->rows.push_back(HotIndexKeyGenerator::Row(sKey.key(), obj.getOwned()));
+        return info->rows.size() % rowsPerCheck == 0 ? 0 : TOKUDB_CURSOR_CONTINUE;
+    }
+
+    void HotIndexKeyGenerator::readPartition(Partition &p) {
+        storage::Key startKey(p.start, NULL);
+        scoped_ptr<storage::Key> endKey(p.end.isEmpty() ? NULL : new storage::Key(p.end, NULL));
+        storage::Key maxPKKey(lastKey(_pkOrdering), NULL);
+        DBT left = startKey.dbt();
+        DBT right = endKey ? endKey->dbt() : maxPKKey.dbt();
+
+        // Prefetch within the partition, without locks: nobody else cares
+        // that we read it.
+        shared_ptr<storage::Cursor> c = _pkIdx.getCursor(0);
+        DBC *cursor = c->dbc();
+        int r = cursor->c_set_bounds(cursor, &left, &right, false, DB_NOTFOUND);
+        if (r != 0) {
+            storage::handle_ydb_error(r);
+        }
+
+        ReadPartitionExtra extra(p.rows, endKey.get(), _pkOrdering);
+        r = cursor->c_getf_set_range(cursor, 0, &left, readPartitionGetf, &extra);
+        while (r == 0 && !extra.passedEnd && !abandoned(p)) {
+            r = cursor->c_getf_next(cursor, 0, readPartitionGetf, &extra);
+        }
+        if (r != 0 && r != DB_NOTFOUND) {
+            storage::handle_ydb_error(r);
+        }
+    }
+
+    void HotIndexKeyGenerator::generateKeys(Partition &p) {
+        Descriptor descriptor(_descriptorData.data(), _descriptorData.size());
+        for (size_t i = 0; i < p.rows.size(); i++) {
+            descriptor.generateKeys(p.rows[i].obj, p.rows[i].keys);
+            if ((i + 1) % rowsPerCheck == 0) {
+                if (abandoned(p)) {
+                    return;
+                }
+                mongo::mutex::scoped_lock lk(_mutex);
+                p.generated = i + 1;
+            }
+        }
+        mongo::mutex::scoped_lock lk(_mutex);
+        p.generated = p.rows.size();
+        p.elapsedMillis = p.timer.millis();
+        p.done = true;
+    }
+
+    bool HotIndexKeyGenerator::abandoned(const Partition &p) {
+        mongo::mutex::scoped_lock lk(_mutex);
+        return p.abandoned || _stopped || inShutdown();
+    }
+
+} // namespace mongo
@@ -0,0 +1,127 @@
+// hot_index_key_generator.h
+
+/**
+*    Copyright (C) 2013 Tokutek Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "mongo/pch.h"
+
+#include <deque>
+#include <boost/thread/condition.hpp>
+#include <boost/thread/thread.hpp>
+
+#include "mongo/db/jsobj.h"
+#include "mongo/db/storage/env.h"
+#include "mongo/util/concurrency/mutex.h"
+
+namespace mongo {
+
+    class Descriptor;
+    class IndexDetailsBase;
+
+    /**
+     * Generates the keys of a hot index build on several threads, ahead of the ydb indexer.
+     *
+     * The DB_INDEXER scans the primary key on the thread that calls build(), and calls
+     * storage::generate_keys() for each row it visits, as well as for each row other
+     * clients write during the build. That scan can't be split up, so instead we split
+     * the primary key into partitions and have hotIndexerThreads threads read the
+     * partitions ahead of the indexer and generate their keys. When the indexer gets to
+     * a row, takeKeys() gives it the keys generated for it, provided the row is still
+     * byte for byte what the worker read.
+     *
+     * Everything else (rows changed since, partitions nobody got to in time, and every
+     * write made by other clients) gets its keys generated by generate_keys() as before,
+     * so the indexer's handling of concurrent writes is untouched.
+     *
+     * Workers read with read uncommitted transactions and stay a bounded number of
+     * partitions ahead of the indexer, to bound the memory used by generated keys.
+     *
+     * Workers never take the DB lock. The thread running the indexer may hold it while it
+     * waits for them in stop(), and a writer queued on the lock would otherwise block them
+     * behind it. Instead they read the primary key index they are given, which stays open
+     * as long as the indexer does.
+     */
+    class HotIndexKeyGenerator : public storage::KeySource {
+    public:
+        /** @return true if hotIndexerThreads allows helper threads at all */
+        static bool enabled();
+
+        /**
+         * @param ns the collection being indexed
+         * @param pkIdx its primary key index, which must outlive the workers
+         * @param descriptor the descriptor of the index being built
+         */
+        HotIndexKeyGenerator(const string &ns, const IndexDetailsBase &pkIdx,
+                             const Descriptor &descriptor);
+
+        virtual ~HotIndexKeyGenerator();
+
+        /** Start the workers. The calling thread must be the one that runs the indexer. */
+        void start();
+
+        /**
+         * Stop and join the workers. Must be called before the generator is
+         * destroyed. takeKeys() may still be called afterwards.
+         */
+        void stop();
+
+        virtual bool takeKeys(const BSONObj &pk, const BSONObj &obj, BSONObjSet &keys);
+
+        /** Generation rate of each outstanding partition, for CurOp. */
+        std::string status();
+
+        // A row read by a worker, and its keys.
+        struct Row;
+
+    private:
+        struct Partition;
+
+        void run();
+        // Wait until the workers may claim another partition.
+        // @return false if there is nothing left to do
+        bool waitForRoom();
+        // Claim the next partition of the primary key, or return an empty pointer if
+        // there are no partitions left. Caller is in a transaction.
+        shared_ptr<Partition> claimPartition();
+        void readPartition(Partition &p);
+        void generateKeys(Partition &p);
+        // true if the indexer went past p or we're shutting down
+        bool abandoned(const Partition &p);
+
+        const string _ns;
+        const IndexDetailsBase &_pkIdx;
+        const BSONObj _pkPattern;
+        const Ordering _pkOrdering;
+        const string _descriptorData;
+        boost::thread::id _indexerThread;
+
+        mongo::mutex _mutex;
+        boost::condition _roomAvailable;
+        // Claimed partitions the indexer hasn't gone past yet, in primary key order.
+        std::deque<shared_ptr<Partition> > _partitions;
+        BSONObj _nextStart;     // start of the next partition to claim
+        int _nextPartition;     // number of the next partition to claim
+        bool _exhausted;        // every partition is claimed
+        bool _stopped;
+        long long _hits;
+        long long _misses;
+
+        boost::thread_group _workers;
+    };
+
+} // namespace mongo
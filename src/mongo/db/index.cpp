@@ -75,6 +75,8 @@ namespace mongo {
                             _keyPattern.nFields() == 1 );
             uassert( 16242, "Currently hashed indexes cannot guarantee uniqueness. Use a regular index.",
                             !unique() );
+            uassert( 17351, "hashed indexes cannot use the binary key format",
+                            !_keyFormat.binary() );
 
             // Create a descriptor with hashed = true and the appropriate hash seed.
             _descriptor.reset(new Descriptor(_keyPattern, true, _seed, _sparse, _clustering));
@@ -217,14 +219,15 @@ namespace mongo {
         _keyPattern(info["key"].Obj().copy()),
         _unique(info["unique"].trueValue()),
         _sparse(info["sparse"].trueValue()),
-        _clustering(info["clustering"].trueValue()) {
+        _clustering(info["clustering"].trueValue()),
+        _keyFormat(storage::KeyFormat::parse(info["keyFormat"]), Ordering::make(_keyPattern)) {
         verify(!_info.isEmpty());
         verify(!_keyPattern.isEmpty());
     }
 
     IndexDetailsBase::IndexDetailsBase(const BSONObj& info) :
         IndexDetails(info),
-        _descriptor(new Descriptor(_keyPattern, false, 0, _sparse, _clustering)) {
+        _descriptor(new Descriptor(_keyPattern, false, 0, _sparse, _clustering, _keyFormat.encoding())) {
     }
 
 
@@ -383,8 +386,8 @@ namespace mongo {
         // lock just the range of the index that may contain that secondary key,
         // if it exists. That range is { key, minKey } -> { key, maxKey }, where
         // the second part of the compound key is the appended primary key.
-        storage::Key leftSKey(key, &minKey);
-        storage::Key rightSKey(key, &maxKey);
+        storage::Key leftSKey(key, &minKey, _keyFormat);
+        storage::Key rightSKey(key, &maxKey, _keyFormat);
         DBT start = leftSKey.dbt();
         DBT end = rightSKey.dbt();
         int r = cursor->c_set_bounds(cursor, &start, &end, true, 0);
@@ -420,7 +423,7 @@ namespace mongo {
     }
 
     void IndexDetailsBase::updatePair(const BSONObj &key, const BSONObj *pk, const BSONObj &msg, uint64_t flags) {
-        storage::Key skey(key, pk);
+        storage::Key skey(key, pk, _keyFormat);
         DBT kdbt = skey.dbt();
         DBT vdbt = storage::dbt_make(msg.objdata(), msg.objsize());
 
@@ -604,7 +607,7 @@ namespace mongo {
                                     << idx.keyPattern()) {}
 
     void IndexDetailsBase::Builder::insertPair(const BSONObj &key, const BSONObj *pk, const BSONObj &val) {
-        storage::Key skey(key, pk);
+        storage::Key skey(key, pk, _idx.keyFormat());
         DBT kdbt = skey.dbt();
         DBT vdbt = storage::dbt_make(NULL, 0);
         if (_idx.clustering()) {
@@ -161,6 +161,11 @@ namespace mongo {
             return _clustering;
         }
 
+        /** @return how this index's keys are encoded, from the keyFormat option */
+        const storage::KeyFormat &keyFormat() const {
+            return _keyFormat;
+        }
+
         string toString() const {
             return _info.toString();
         }
@@ -250,6 +255,7 @@ namespace mongo {
         const bool _unique;
         const bool _sparse;
         const bool _clustering;
+        const storage::KeyFormat _keyFormat;
 
     private:
         mutable AccessStats _accessStats;
@@ -413,8 +419,8 @@ namespace mongo {
         }
     }    
 
-    // Sets db->app_private to a bool that gets set
-    // if storage::generate_keys() generates multikeys.
+    // Sets db->app_private to a storage::BuildState whose multiKey bool gets
+    // set if storage::generate_keys() generates multikeys.
     // On destruction, safely unsets db->app_private.
     //
     // Used by the hot indexer and loader to track
@@ -422,19 +428,24 @@ namespace mongo {
     class MultiKeyTracker : boost::noncopyable {
     public:
         MultiKeyTracker(DB *db) :
-            _db(db), _multiKey(false) {
-            _db->app_private = &_multiKey;
+            _db(db) {
+            _db->app_private = &_state;
         }
         ~MultiKeyTracker() {
             _db->app_private = NULL;
         }
         bool isMultiKey() const {
-            return _multiKey;
+            return _state.multiKey;
+        }
+        // Have storage::generate_keys() try keySource before generating keys itself.
+        // The caller must reset it to NULL before keySource goes away.
+        void setKeySource(storage::KeySource *keySource) {
+            _state.keySource = keySource;
         }
 
     private:
         DB *_db;
-        bool _multiKey;
+        storage::BuildState _state;
     };
 
     // IndexDetails class for PartitionedCollections
@@ -0,0 +1,277 @@
+// index_prefetcher.cpp
+
+/**
+*    Copyright (C) 2013 Tokutek Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "mongo/pch.h"
+
+#include "mongo/db/index_prefetcher.h"
+
+#include <db.h>
+#include <boost/thread/condition.hpp>
+
+#include "mongo/base/counter.h"
+#include "mongo/db/client.h"
+#include "mongo/db/collection.h"
+#include "mongo/db/commands/server_status.h"
+#include "mongo/db/d_concurrency.h"
+#include "mongo/db/index.h"
+#include "mongo/db/server_parameters.h"
+#include "mongo/db/storage/cursor.h"
+#include "mongo/db/storage/key.h"
+#include "mongo/util/concurrency/mutex.h"
+#include "mongo/util/concurrency/thread_pool.h"
+
+namespace mongo {
+
+    // Number of background threads warming index ranges for multi-interval scans.
+    // Zero disables prefetching.
+    MONGO_EXPORT_STARTUP_SERVER_PARAMETER(indexPrefetchThreads, int, 2);
+
+    // How many intervals ahead of its cursor a prefetcher may read.
+    MONGO_EXPORT_SERVER_PARAMETER(indexPrefetchLookahead, int, 4);
+
+    static Counter64 prefetchRanges;
+    static ServerStatusMetricField<Counter64> displayPrefetchRanges(
+            "queryExecutor.prefetch.ranges", &prefetchRanges );
+    static Counter64 prefetchBytes;
+    static ServerStatusMetricField<Counter64> displayPrefetchBytes(
+            "queryExecutor.prefetch.bytes", &prefetchBytes );
+    static Counter64 prefetchSkipped;
+    static ServerStatusMetricField<Counter64> displayPrefetchSkipped(
+            "queryExecutor.prefetch.skipped", &prefetchSkipped );
+
+    // Stop reading an interval after this many bytes. By then the cursor
+    // reading it is as likely to be ahead of us as behind.
+    static const size_t prefetchBytesPerRange = 4 * 1024 * 1024;
+
+    // A prefetch task that waits this long for its cursor to move gives its
+    // thread back. The next noteCurrentKey() schedules a new one.
+    static const int prefetchIdleMillis = 100;
+
+    static SimpleMutex prefetchPoolMutex("indexPrefetchPool");
+    static ThreadPool *prefetchPool = NULL;
+
+    static ThreadPool &getPrefetchPool() {
+        SimpleMutex::scoped_lock lk(prefetchPoolMutex);
+        if (prefetchPool == NULL) {
+            prefetchPool = new ThreadPool(indexPrefetchThreads);
+        }
+        return *prefetchPool;
+    }
+
+    bool IndexPrefetcher::enabled() {
+        return indexPrefetchThreads > 0;
+    }
+
+    struct IndexPrefetcher::State : boost::noncopyable {
+        State(const string &n, const BSONObj &kp, bool secondary,
+              const Ordering &o, int d, const Ranges &r) :
+            ns(n), keyPattern(kp.getOwned()), isSecondary(secondary),
+            ordering(o), direction(d), ranges(r),
+            mutex("indexPrefetcher"),
+            currentRange(0), nextRange(1),
+            running(false), cancelled(false) {
+        }
+
+        // Advance currentRange past every range that ends before currentKey,
+        // in the direction of iteration. Caller holds the mutex.
+        void noteProgress() {
+            if (currentKey.isEmpty()) {
+                return;
+            }
+            while (currentRange < ranges.size()) {
+                const int c = currentKey.woCompare(ranges[currentRange].second, ordering);
+                if (c * direction <= 0) {
+                    break;
+                }
+                currentRange++;
+            }
+        }
+
+        const string ns;
+        const BSONObj keyPattern;
+        const bool isSecondary;
+        const Ordering ordering;
+        const int direction;
+        const Ranges ranges;
+
+        mongo::mutex mutex;
+        boost::condition cond;
+        BSONObj currentKey;  // where the owning cursor was last positioned
+        size_t currentRange; // the range containing (or following) currentKey
+        size_t nextRange;    // the next range to warm
+        bool running;        // a task is scheduled or running for this state
+        bool cancelled;
+    };
+
+    IndexPrefetcher::IndexPrefetcher(const string &ns, const BSONObj &keyPattern, bool isSecondary,
+                                     const Ordering &ordering, int direction, const Ranges &ranges) :
+        _state(new State(ns, keyPattern, isSecondary, ordering, direction, ranges)) {
+    }
+
+    IndexPrefetcher::~IndexPrefetcher() {
+        mongo::mutex::scoped_lock lk(_state->mutex);
+        _state->cancelled = true;
+        _state->cond.notify_all();
+    }
+
+    void IndexPrefetcher::noteCurrentKey(const BSONObj &key) {
+        mongo::mutex::scoped_lock lk(_state->mutex);
+        _state->currentKey = key.getOwned();
+        _state->cond.notify_all();
+        if (_state->running || _state->nextRange >= _state->ranges.size()) {
+            return;
+        }
+
+        // Don't let prefetch work queue up behind a busy pool, it would
+        // only be done after the cursors that wanted it are gone.
+        ThreadPool &pool = getPrefetchPool();
+        if (pool.tasks_remaining() >= indexPrefetchThreads) {
+            prefetchSkipped.increment();
+            return;
+        }
+        _state->running = true;
+        pool.schedule(&IndexPrefetcher::run, _state);
+    }
+
+    void IndexPrefetcher::run(shared_ptr<State> state) {
+        Client::initThreadIfNotAlready("indexPrefetcher");
+
+        while (true) {
+            size_t i;
+            {
+                mongo::mutex::scoped_lock lk(state->mutex);
+                while (true) {
+                    if (state->cancelled || inShutdown()) {
+                        state->running = false;
+                        return;
+                    }
+                    // Skip ranges the cursor has already reached, and wait
+                    // if we're far enough ahead of it.
+                    state->noteProgress();
+                    if (state->nextRange <= state->currentRange) {
+                        state->nextRange = state->currentRange + 1;
+                    }
+                    if (state->nextRange >= state->ranges.size()) {
+                        state->running = false;
+                        return;
+                    }
+                    if (state->nextRange <= state->currentRange + std::max(indexPrefetchLookahead, 1)) {
+                        break;
+                    }
+                    if (!state->cond.timed_wait(lk.boost(), boost::posix_time::milliseconds(prefetchIdleMillis))) {
+                        state->running = false;
+                        return;
+                    }
+                }
+                i = state->nextRange++;
+            }
+
+            try {
+                warmRange(*state, i);
+            } catch (const DBException &e) {
+                // Prefetching is only an optimization, the cursor will find
+                // out about whatever went wrong on its own.
+                LOG(1) << "index prefetch for " << state->ns << " " << state->keyPattern
+                       << " stopped: " << e.what() << endl;
+                mongo::mutex::scoped_lock lk(state->mutex);
+                state->cancelled = true;
+                state->running = false;
+                return;
+            }
+        }
+    }
+
+    struct PrefetchGetfExtra {
+        size_t bytes;
+        PrefetchGetfExtra() : bytes(0) { }
+    };
+
+    static int prefetchGetf(const DBT *key, const DBT *val, void *extra) {
+        PrefetchGetfExtra *info = static_cast<PrefetchGetfExtra *>(extra);
+        if (key != NULL) {
+            info->bytes += key->size + val->size;
+        }
+        // The rows are thrown away, reading them is what brings their nodes into
+        // memory. Keep taking them until the range has used up its
+        // prefetchBytesPerRange budget, then return to warmRange, which stops too.
+        return info->bytes < prefetchBytesPerRange ? TOKUDB_CURSOR_CONTINUE : 0;
+    }
+
+    void IndexPrefetcher::warmRange(State &state, size_t i) {
+        const bool forward = state.direction > 0;
+        const BSONObj &startKey = state.ranges[i].first;
+        const BSONObj &endKey = state.ranges[i].second;
+        const BSONObj &leftKey = forward ? startKey : endKey;
+        const BSONObj &rightKey = forward ? endKey : startKey;
+
+        LOCK_REASON(lockReason, "index prefetch");
+        Client::ReadContext ctx(state.ns, lockReason);
+        Client::Transaction transaction(DB_READ_UNCOMMITTED | DB_TXN_READ_ONLY);
+        Collection *cl = getCollection(state.ns);
+        if (cl == NULL || cl->isPartitioned()) {
+            return;
+        }
+        const int idxNo = cl->findIndexByKeyPattern(state.keyPattern);
+        if (idxNo < 0) {
+            return;
+        }
+        IndexDetails &idx = cl->idx(idxNo);
+
+        storage::Key sKey(leftKey, state.isSecondary ? &minKey : NULL, idx.keyFormat());
+        storage::Key eKey(rightKey, state.isSecondary ? &maxKey : NULL, idx.keyFormat());
+        DBT left = sKey.dbt();
+        DBT right = eKey.dbt();
+
+        // Set bounds so the ydb prefetches basement nodes within this range,
+        // but don't pre-acquire: we're not the one who needs the locks.
+        shared_ptr<storage::Cursor> c = idx.getCursor(0);
+        DBC *cursor = c->dbc();
+        int r = cursor->c_set_bounds(cursor, &left, &right, false, DB_NOTFOUND);
+        if (r != 0) {
+            storage::handle_ydb_error(r);
+        }
+
+        PrefetchGetfExtra extra;
+        if (forward) {
+            r = cursor->c_getf_set_range(cursor, 0, &left, prefetchGetf, &extra);
+        } else {
+            r = cursor->c_getf_set_range_reverse(cursor, 0, &right, prefetchGetf, &extra);
+        }
+        while (r == 0 && extra.bytes < prefetchBytesPerRange) {
+            {
+                mongo::mutex::scoped_lock lk(state.mutex);
+                if (state.cancelled) {
+                    break;
+                }
+            }
+            if (forward) {
+                r = cursor->c_getf_next(cursor, 0, prefetchGetf, &extra);
+            } else {
+                r = cursor->c_getf_prev(cursor, 0, prefetchGetf, &extra);
+            }
+        }
+        if (r != 0 && r != DB_NOTFOUND) {
+            storage::handle_ydb_error(r);
+        }
+        transaction.commit();
+
+        prefetchRanges.increment();
+        prefetchBytes.increment(extra.bytes);
+    }
+
+} // namespace mongo
@@ -0,0 +1,72 @@
+// index_prefetcher.h
+
+/**
+*    Copyright (C) 2013 Tokutek Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "mongo/pch.h"
+
+#include "mongo/db/jsobj.h"
+
+namespace mongo {
+
+    /**
+     * Warms the cachetable for the key ranges an IndexCursor is going to visit next.
+     *
+     * The ydb only prefetches within the bounds most recently given to c_set_bounds,
+     * and IndexCursor only sets bounds when it prelocks, so a scan over many intervals
+     * ($in, $or on equality) reads cold basement nodes one interval at a time.
+     *
+     * An IndexPrefetcher reads the upcoming intervals on a background thread, with its
+     * own read uncommitted cursor that sets bounds without acquiring range locks. It
+     * stays at most indexPrefetchLookahead intervals ahead of the position its owner
+     * reports through noteCurrentKey(), and gives its thread back to the pool if the
+     * owner stops making progress (e.g. a client cursor between getMores).
+     *
+     * Destroying the prefetcher cancels whatever it hasn't read yet.
+     */
+    class IndexPrefetcher : boost::noncopyable {
+    public:
+        // (first key visited, last key visited) for each interval, in iteration order.
+        typedef vector<pair<BSONObj, BSONObj> > Ranges;
+
+        /** @return true if indexPrefetchThreads allows prefetching at all */
+        static bool enabled();
+
+        /** the most ranges a cursor should hand to a prefetcher */
+        static const size_t maxRanges = 1000;
+
+        IndexPrefetcher(const string &ns, const BSONObj &keyPattern, bool isSecondary,
+                        const Ordering &ordering, int direction, const Ranges &ranges);
+        ~IndexPrefetcher();
+
+        /**
+         * Tell the prefetcher that the owning cursor was just positioned at key.
+         * Starts (or restarts) the background work if there are ranges left to warm.
+         */
+        void noteCurrentKey(const BSONObj &key);
+
+    private:
+        struct State;
+
+        static void run(shared_ptr<State> state);
+        static void warmRange(State &state, size_t i);
+
+        shared_ptr<State> _state;
+    };
+
+} // namespace mongo
@@ -0,0 +1,352 @@
+// index_rewrite.cpp
+
+/**
+*    Copyright (C) 2013 Tokutek Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "mongo/pch.h"
+
+#include "mongo/db/index_rewrite.h"
+
+#include <boost/thread/condition.hpp>
+
+#include "mongo/base/counter.h"
+#include "mongo/db/client.h"
+#include "mongo/db/collection.h"
+#include "mongo/db/commands/server_status.h"
+#include "mongo/db/cursor.h"
+#include "mongo/db/d_concurrency.h"
+#include "mongo/db/index.h"
+#include "mongo/db/ops/delete.h"
+#include "mongo/db/ops/update.h"
+#include "mongo/db/repl/rs.h"
+#include "mongo/db/server_parameters.h"
+#include "mongo/db/storage/key.h"
+#include "mongo/util/background.h"
+#include "mongo/util/concurrency/mutex.h"
+#include "mongo/util/timer.h"
+
+namespace mongo {
+
+    // Rewrite at most this many MB of index data per second. Zero pauses rewrites.
+    MONGO_EXPORT_SERVER_PARAMETER(indexRewriteMBPerSecond, int, 10);
+
+    // Rewrite at most this many nodes per second, each counted as a read and
+    // a write. Zero means no limit besides indexRewriteMBPerSecond.
+    MONGO_EXPORT_SERVER_PARAMETER(indexRewriteIOPS, int, 100);
+
+    static const char rewritesNs[] = "local.indexRewrites";
+
+    static Counter64 rewritesCompleted;
+    static Counter64 rewriteBytes;
+    static Counter64 rewriteBytesReclaimed;
+
+    // Rewrites requested but not yet in local.indexRewrites, and what the
+    // job is working on, for serverStatus.
+    static mongo::mutex rewriteMutex("indexRewrite");
+    static boost::condition rewriteScheduled;
+    static vector<pair<string, string> > scheduledRewrites;
+    static BSONObj currentRewrite;
+    static long long pendingRewrites = 0;
+
+    void scheduleIndexRewrite(const string &ns, const string &indexName) {
+        mongo::mutex::scoped_lock lk(rewriteMutex);
+        scheduledRewrites.push_back(make_pair(ns, indexName));
+        rewriteScheduled.notify_all();
+    }
+
+    class IndexRewriteServerStatus : public ServerStatusSection {
+    public:
+        IndexRewriteServerStatus() : ServerStatusSection("indexRewrite") { }
+        virtual bool includeByDefault() const { return true; }
+
+        BSONObj generateSection(const BSONElement &configElement) const {
+            BSONObjBuilder b;
+            mongo::mutex::scoped_lock lk(rewriteMutex);
+            b.appendNumber("pending", pendingRewrites + (long long) scheduledRewrites.size());
+            b.appendNumber("completed", (long long) rewritesCompleted.get());
+            b.appendNumber("bytesRewritten", (long long) rewriteBytes.get());
+            b.appendNumber("bytesReclaimed", (long long) rewriteBytesReclaimed.get());
+            if (!currentRewrite.isEmpty()) {
+                b.append("current", currentRewrite);
+            }
+            return b.obj();
+        }
+    } indexRewriteServerStatus;
+
+    class IndexRewriteJob : public BackgroundJob {
+    public:
+        virtual string name() const { return "IndexRewrite"; }
+
+        virtual void run() {
+            Client::initThread(name().c_str());
+            while (!inShutdown()) {
+                try {
+                    saveScheduled();
+                    if (!rewriteNext()) {
+                        mongo::mutex::scoped_lock lk(rewriteMutex);
+                        if (scheduledRewrites.empty()) {
+                            rewriteScheduled.timed_wait(lk.boost(), boost::posix_time::seconds(10));
+                        }
+                    }
+                } catch (const DBException &e) {
+                    error() << "index rewrite: " << e << endl;
+                    sleepsecs(10);
+                }
+            }
+            cc().shutdown();
+        }
+
+    private:
+        // Where a rewrite of this index starts, or resumes from resume.
+        static void startKey(const IndexDetails &idx, const bool isPK, const BSONObj &resume,
+                             BSONObj &key, BSONObj &pk) {
+            if (!resume.isEmpty()) {
+                key = resume["key"].Obj();
+                pk = resume["pk"].isABSONObj() ? resume["pk"].Obj() : BSONObj();
+            } else {
+                const bool ascending = !Ordering::make(idx.keyPattern()).descending(1);
+                key = ascending ? minKey : maxKey;
+                pk = isPK ? BSONObj() : minKey;
+            }
+        }
+
+        // Move rewrites requested since we last looked into local.indexRewrites,
+        // starting each from the beginning of its index.
+        void saveScheduled() {
+            vector<pair<string, string> > scheduled;
+            {
+                mongo::mutex::scoped_lock lk(rewriteMutex);
+                scheduled.swap(scheduledRewrites);
+            }
+            for (vector<pair<string, string> >::const_iterator it = scheduled.begin();
+                 it != scheduled.end(); ++it) {
+                long long storageSize = 0;
+                {
+                    LOCK_REASON(lockReason, "index rewrite: measuring index");
+                    Client::ReadContext ctx(it->first, lockReason);
+                    Client::Transaction transaction(DB_TXN_SNAPSHOT | DB_TXN_READ_ONLY);
+                    Collection *cl = getCollection(it->first);
+                    const int i = cl != NULL ? cl->findIndexByName(it->second) : -1;
+                    if (i < 0) {
+                        continue;
+                    }
+                    storageSize = cl->idx(i).getStats().storageSize;
+                    transaction.commit();
+                }
+
+                const string id = IndexDetails::indexNamespace(it->first, it->second);
+                LOCK_REASON(lockReason, "index rewrite: saving new rewrite");
+                Client::WriteContext ctx(rewritesNs, lockReason);
+                Client::Transaction transaction(DB_SERIALIZABLE);
+                BSONObj record = BSON("_id" << id <<
+                                      "ns" << it->first <<
+                                      "index" << it->second <<
+                                      "bytesRewritten" << 0LL <<
+                                      "storageSizeBefore" << storageSize <<
+                                      "started" << jsTime());
+                updateObjects(rewritesNs, record, BSON("_id" << id), true, false);
+                transaction.commit();
+                LOG(1) << "index rewrite: scheduled " << id << endl;
+            }
+        }
+
+        // Find the oldest rewrite in local.indexRewrites.
+        static BSONObj nextRecord(long long &nPending) {
+            LOCK_REASON(lockReason, "index rewrite: looking for work");
+            Client::ReadContext ctx(rewritesNs, lockReason);
+            Client::Transaction transaction(DB_TXN_SNAPSHOT | DB_TXN_READ_ONLY);
+            Collection *cl = getCollection(rewritesNs);
+            nPending = 0;
+            BSONObj oldest;
+            if (cl != NULL) {
+                for (shared_ptr<Cursor> c(Cursor::make(cl, 1)); c->ok(); c->advance()) {
+                    BSONObj record = c->current();
+                    if (oldest.isEmpty() || record["started"].date() < oldest["started"].date()) {
+                        oldest = record.getOwned();
+                    }
+                    nPending++;
+                }
+            }
+            transaction.commit();
+            return oldest;
+        }
+
+        static void removeRecord(const BSONObj &record) {
+            LOCK_REASON(lockReason, "index rewrite: removing rewrite");
+            Client::WriteContext ctx(rewritesNs, lockReason);
+            Client::Transaction transaction(DB_SERIALIZABLE);
+            _deleteObjects(rewritesNs, BSON("_id" << record["_id"]), true, false);
+            transaction.commit();
+        }
+
+        static void finish(const BSONObj &record, const long long storageSize) {
+            const long long reclaimed = record["storageSizeBefore"].numberLong() - storageSize;
+            if (reclaimed > 0) {
+                rewriteBytesReclaimed.increment(reclaimed);
+            }
+            rewritesCompleted.increment();
+            LOG(0) << "index rewrite: finished " << record["_id"].String()
+                   << ", storage size " << record["storageSizeBefore"].numberLong()
+                   << " -> " << storageSize << endl;
+            removeRecord(record);
+        }
+
+        static void saveProgress(const BSONObj &record, const BSONObj &endKey, const BSONObj &endPK,
+                                 const long long bytes) {
+            BSONObjBuilder resume;
+            resume.append("key", endKey);
+            if (!endPK.isEmpty()) {
+                resume.append("pk", endPK);
+            }
+            LOCK_REASON(lockReason, "index rewrite: saving progress");
+            Client::WriteContext ctx(rewritesNs, lockReason);
+            Client::Transaction transaction(DB_SERIALIZABLE);
+            updateObjects(rewritesNs,
+                          BSON("$set" << BSON("resume" << resume.obj()) <<
+                               "$inc" << BSON("bytesRewritten" << bytes)),
+                          BSON("_id" << record["_id"]), false, false);
+            transaction.commit();
+        }
+
+        class RangeEndCallback {
+        public:
+            RangeEndCallback(BSONObj &key, BSONObj &pk, uint64_t &skipped, bool &found) :
+                _key(key), _pk(pk), _skipped(skipped), _found(found) { }
+            void operator()(const storage::KeyV1 *endKey, const BSONObj *endPK, uint64_t skipped) {
+                _found = endKey != NULL;
+                if (endKey != NULL) {
+                    _key = endKey->toBson();
+                    _pk = endPK != NULL ? endPK->getOwned() : BSONObj();
+                }
+                _skipped = skipped;
+            }
+        private:
+            BSONObj &_key;
+            BSONObj &_pk;
+            uint64_t &_skipped;
+            bool &_found;
+        };
+
+        // Rewrite the next range of the oldest pending rewrite, then sleep long
+        // enough to stay within budget. @return false if there was nothing to do.
+        bool rewriteNext() {
+            const int mbPerSecond = indexRewriteMBPerSecond;
+            if (mbPerSecond <= 0) {
+                return false;
+            }
+            // Initial sync may drop databases out from under us.
+            if (theReplSet && !theReplSet->state().readable()) {
+                return false;
+            }
+
+            long long nPending;
+            const BSONObj record = nextRecord(nPending);
+            {
+                mongo::mutex::scoped_lock lk(rewriteMutex);
+                pendingRewrites = nPending;
+                if (record.isEmpty()) {
+                    currentRewrite = BSONObj();
+                }
+            }
+            if (record.isEmpty()) {
+                return false;
+            }
+
+            const string ns = record["ns"].String();
+            const uint64_t rangeBytes = (uint64_t) mbPerSecond * 1024 * 1024;
+            Timer timer;
+            uint64_t skipped = 0;
+            bool more = false;
+            BSONObj endKey, endPK;
+            long long storageSize = 0;
+            uint32_t pageSize = 0;
+            bool gone = false;
+            {
+                LOCK_REASON(lockReason, "index rewrite: rewriting a range");
+                Client::ReadContext ctx(ns, lockReason);
+                Client::Transaction transaction(DB_READ_UNCOMMITTED | DB_TXN_READ_ONLY);
+                Collection *cl = getCollection(ns);
+                const int i = cl != NULL ? cl->findIndexByName(record["index"].String()) : -1;
+                IndexDetailsBase *idx = i >= 0 ? dynamic_cast<IndexDetailsBase *>(&cl->idx(i)) : NULL;
+                if (idx == NULL) {
+                    // Dropped, or partitioned: each partition has its own dictionaries.
+                    LOG(1) << "index rewrite: can't rewrite " << record["_id"].String() << endl;
+                    gone = true;
+                } else {
+                    const bool isPK = cl->isPKIndex(*idx);
+                    BSONObj startK, startPK;
+                    startKey(*idx, isPK, record["resume"].isABSONObj() ? record["resume"].Obj() : BSONObj(),
+                             startK, startPK);
+                    storage::Key leftSKey(startK, isPK ? NULL : &startPK, idx->keyFormat());
+
+                    RangeEndCallback cb(endKey, endPK, skipped, more);
+                    idx->getKeyAfterBytes(leftSKey, rangeBytes, cb);
+
+                    const bool ascending = !Ordering::make(idx->keyPattern()).descending(1);
+                    const BSONObj &lastKey = ascending ? maxKey : minKey;
+                    storage::Key rightSKey(more ? endKey : lastKey,
+                                           isPK ? NULL : (more ? &endPK : &maxKey), idx->keyFormat());
+                    // The optimize message makes the hot optimize flush every buffered
+                    // message down to the leaves, so the rewritten nodes are final. It
+                    // covers the whole index, so it's only sent with the first range.
+                    const bool first = !record["resume"].isABSONObj();
+                    uint64_t loops_run;
+                    idx->optimize(leftSKey, rightSKey, first, 0, &loops_run);
+
+                    IndexDetails::Stats stats = idx->getStats();
+                    storageSize = stats.storageSize;
+                    pageSize = std::max(stats.pageSize, 1U);
+                    transaction.commit();
+
+                    mongo::mutex::scoped_lock lk(rewriteMutex);
+                    currentRewrite = BSON("ns" << ns <<
+                                          "index" << record["index"].String() <<
+                                          "bytesRewritten" << (long long) (record["bytesRewritten"].numberLong() + skipped) <<
+                                          "dataSize" << (long long) stats.dataSize);
+                }
+            }
+
+            if (gone) {
+                removeRecord(record);
+                return true;
+            }
+            rewriteBytes.increment(skipped);
+            if (more) {
+                saveProgress(record, endKey, endPK, skipped);
+            } else {
+                finish(record, storageSize);
+                mongo::mutex::scoped_lock lk(rewriteMutex);
+                currentRewrite = BSONObj();
+            }
+
+            // Each node in the range is read and written once.
+            const long long byteMillis = (long long) (skipped * 1000 / rangeBytes);
+            const int iops = indexRewriteIOPS;
+            const long long ioMillis = iops > 0 ? (long long) (2 * (skipped / pageSize + 1) * 1000 / iops) : 0;
+            const long long sleepMillis = std::max(byteMillis, ioMillis) - timer.millis();
+            if (sleepMillis > 0) {
+                sleepmillis(sleepMillis);
+            }
+            return true;
+        }
+    };
+
+    void startIndexRewriteBackgroundJob() {
+        IndexRewriteJob *job = new IndexRewriteJob();
+        job->go();
+    }
+
+} // namespace mongo
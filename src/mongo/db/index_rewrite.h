@@ -0,0 +1,41 @@
+// index_rewrite.h
+
+/**
+*    Copyright (C) 2013 Tokutek Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "mongo/pch.h"
+
+namespace mongo {
+
+    /**
+     * Changing an index's compression, pageSize, readPageSize or fanout with reIndex
+     * only affects nodes written afterwards. The index rewrite job walks each such
+     * index in key ranges, hot optimizing one range at a time so every existing node
+     * gets rewritten with the new attributes. It stays under indexRewriteMBPerSecond
+     * and indexRewriteIOPS.
+     *
+     * Pending rewrites and how far each one got are kept in local.indexRewrites, so a
+     * rewrite picks up where it left off after a restart. Progress and the space
+     * reclaimed are reported in serverStatus.indexRewrite.
+     */
+    void startIndexRewriteBackgroundJob();
+
+    /** Rewrite the existing nodes of ns's index indexName, from the start. */
+    void scheduleIndexRewrite(const string &ns, const string &indexName);
+
+} // namespace mongo
@@ -20,6 +20,7 @@
 #include "mongo/pch.h"
 #include "mongo/db/curop.h"
 #include "mongo/db/cursor.h"
+#include "mongo/db/index_prefetcher.h"
 #include "mongo/db/jsobj.h"
 #include "mongo/db/queryutil.h"
 #include "mongo/db/collection.h"
@@ -170,7 +171,11 @@ namespace mongo {
         _prelock(!cc().opSettings().getJustOne() && numWanted == 0),
         _tailable(false),
         _ok(false),
-        _getf_iteration(0)
+        _getf_iteration(0),
+        _getf_rows_wanted(cc().opSettings().getBulkFetchRowsWanted()),
+        _getf_calls(0),
+        _getf_rows(0),
+        _getf_bytes(0)
     {
         verify( _cl != NULL );
         TOKULOG(3) << toString() << ": constructor: bounds " << prettyIndexBounds() << endl;
@@ -198,7 +203,11 @@ namespace mongo {
         _prelock(!cc().opSettings().getJustOne() && numWanted == 0),
         _tailable(false),
         _ok(false),
-        _getf_iteration(0)
+        _getf_iteration(0),
+        _getf_rows_wanted(cc().opSettings().getBulkFetchRowsWanted()),
+        _getf_calls(0),
+        _getf_rows(0),
+        _getf_bytes(0)
     {
         verify( _cl != NULL );
         _boundsIterator.reset( new FieldRangeVectorIterator( *_bounds , singleIntervalLimit ) );
@@ -261,8 +270,10 @@ namespace mongo {
             if (key != NULL) {
                 RowBuffer *buffer = info->buffer;
                 storage::Key sKey(key);
-                buffer->append(sKey, val->size > 0 ?
-                        BSONObj(static_cast<const char *>(val->data)) : BSONObj());
+                const BSONObj obj = val->size > 0 && !info->key_only ?
+                        BSONObj(static_cast<const char *>(val->data)) : BSONObj();
+                buffer->append(sKey, obj);
+                info->bytes_fetched += 1 + sKey.size() + (obj.isEmpty() ? 0 : obj.objsize());
 
                 // request more bulk fetching if we are allowed to fetch more rows
                 // and the row buffer is not too full.
@@ -314,8 +325,8 @@ namespace mongo {
         const BSONObj &rightKey = forward() ? endKey : startKey; 
         dassert(leftKey.woCompare(rightKey, _ordering) <= 0);
 
-        storage::Key sKey(leftKey, isSecondary ? &minKey : NULL);
-        storage::Key eKey(rightKey, isSecondary ? &maxKey : NULL);
+        storage::Key sKey(leftKey, isSecondary ? &minKey : NULL, _idx.keyFormat());
+        storage::Key eKey(rightKey, isSecondary ? &maxKey : NULL, _idx.keyFormat());
         DBT start = sKey.dbt();
         DBT end = eKey.dbt();
 
@@ -326,65 +337,97 @@ namespace mongo {
         }
     }
 
-    void IndexCursor::_prelockCompoundBounds(const int currentRange,
-                                             vector<const FieldInterval *> &combo,
-                                             BufBuilder &startKeyBuilder,
-                                             BufBuilder &endKeyBuilder) {
-        const vector<FieldRange> &ranges = _bounds->ranges();
-        if ( currentRange == (int) ranges.size() ) {
-            startKeyBuilder.reset(512);
-            endKeyBuilder.reset(512);
-            BSONObjBuilder startKey(startKeyBuilder);
-            BSONObjBuilder endKey(endKeyBuilder);
-
+    bool IndexCursor::_compoundBoundsRanges(const int currentRange,
+                                            vector<const FieldInterval *> &combo,
+                                            vector<pair<BSONObj, BSONObj> > &ranges,
+                                            const size_t maxRanges) const {
+        const vector<FieldRange> &fieldRanges = _bounds->ranges();
+        if ( currentRange == (int) fieldRanges.size() ) {
+            if ( maxRanges > 0 && ranges.size() >= maxRanges ) {
+                return false;
+            }
+            BSONObjBuilder startKey;
+            BSONObjBuilder endKey;
             for ( vector<const FieldInterval *>::const_iterator i = combo.begin();
                   i != combo.end(); i++ ) {
                 startKey.appendAs( (*i)->_lower._bound, "" );
                 endKey.appendAs( (*i)->_upper._bound, "" );
             }
-            _prelockRange( startKey.done(), endKey.done() );
+            ranges.push_back( make_pair( startKey.obj(), endKey.obj() ) );
         } else {
-            const vector<FieldInterval> &intervals = ranges[currentRange].intervals();
+            const vector<FieldInterval> &intervals = fieldRanges[currentRange].intervals();
             for ( vector<FieldInterval>::const_iterator i = intervals.begin();
                   i != intervals.end(); i++ ) {
                 const FieldInterval &interval = *i;
                 combo.push_back( &interval );
-                _prelockCompoundBounds( currentRange + 1, combo, startKeyBuilder, endKeyBuilder );
+                const bool ok = _compoundBoundsRanges( currentRange + 1, combo, ranges, maxRanges );
                 combo.pop_back();
+                if ( !ok ) {
+                    return false;
+                }
             }
         }
+        return true;
     }
 
-    void IndexCursor::_prelockBounds() {
-        BufBuilder startKeyBuilder(512);
-        BufBuilder endKeyBuilder(512);
-
-        const vector<FieldRange> &ranges = _bounds->ranges();
-        const int n = ranges.size();
+    bool IndexCursor::_boundsRanges(vector<pair<BSONObj, BSONObj> > &ranges,
+                                    const size_t maxRanges) const {
+        const vector<FieldRange> &fieldRanges = _bounds->ranges();
+        const int n = fieldRanges.size();
         dassert( n == _idx.keyPattern().nFields() );
         if ( n == 1 ) {
-            // When there's only one field range, we can just prelock each interval.
+            // When there's only one field range, each interval is a range.
             // Single field indexes are common so we handle this case manually for
-            // performance (instead of using the recursive _prelockCompoundBounds())
-            BSONObjBuilder startKey(startKeyBuilder);
-            BSONObjBuilder endKey(endKeyBuilder);
-            const vector<FieldInterval> &intervals = ranges[0].intervals();
+            // performance (instead of using the recursive _compoundBoundsRanges())
+            const vector<FieldInterval> &intervals = fieldRanges[0].intervals();
+            if ( maxRanges > 0 && intervals.size() > maxRanges ) {
+                return false;
+            }
+            ranges.reserve( ranges.size() + intervals.size() );
             for ( vector<FieldInterval>::const_iterator i = intervals.begin();
                   i != intervals.end(); i++ ) {
-                startKey.appendAs( i->_lower._bound, "" );
-                endKey.appendAs( i->_upper._bound, "" );
-                _prelockRange( startKey.done(), endKey.done() );
+                ranges.push_back( make_pair( i->_lower._bound.wrap( "" ),
+                                             i->_upper._bound.wrap( "" ) ) );
             }
+            return true;
         } else {
-            // When there's more than one field range, we need to prelock combinations
+            // When there's more than one field range, the ranges are combinations
             // of intervals in the compound key space.
             verify( n > 1 );
             vector<const FieldInterval *> combo;
             combo.reserve( n );
-            _prelockCompoundBounds( 0, combo, startKeyBuilder, endKeyBuilder );
+            return _compoundBoundsRanges( 0, combo, ranges, maxRanges );
         }
     }
 
+    void IndexCursor::_prelockBounds() {
+        vector<pair<BSONObj, BSONObj> > ranges;
+        _boundsRanges( ranges, 0 );
+        for ( vector<pair<BSONObj, BSONObj> >::const_iterator it = ranges.begin();
+              it != ranges.end(); ++it ) {
+            _prelockRange( it->first, it->second );
+        }
+    }
+
+    // Prelocking only prefetches within the last range given to c_set_bounds
+    // (see the comment above prelock()), so scans over several intervals get
+    // their later intervals warmed by an IndexPrefetcher on a background thread,
+    // which reads them without taking any locks. Only read-only cursors (the
+    // ones that bulk fetch) bother, and only when the intervals are few enough
+    // to enumerate cheaply.
+    void IndexCursor::startPrefetching() {
+        if ( _bounds == NULL || _bounds->isSingleInterval() ||
+             !cc().opSettings().shouldBulkFetch() || !IndexPrefetcher::enabled() ) {
+            return;
+        }
+        IndexPrefetcher::Ranges ranges;
+        if ( !_boundsRanges( ranges, IndexPrefetcher::maxRanges ) || ranges.size() < 2 ) {
+            return;
+        }
+        _prefetcher.reset( new IndexPrefetcher( _cl->ns(), _idx.keyPattern(), !_cl->isPKIndex(_idx),
+                                                _ordering, _direction, ranges ) );
+    }
+
     // The ydb prelocking API serves two purposes: to enable prefetching
     // and acquire row locks. Row locks are acquired by serializable
     // transactions, serializable cursors, and RMW (write) cursors.
@@ -398,7 +441,9 @@ namespace mongo {
     // ydb APIs for prefetching and locking, which means we could take row locks
     // here if necessary and enable prefetching as we advance.
     //
-    // Until that happens, we'll only enable prefetching if we think its worth it.
+    // Multi-interval scans get the intervals after the first one warmed by
+    // an IndexPrefetcher instead (see startPrefetching()), so here we only
+    // enable prefetching if we think its worth it.
     // For simple start/end key cursors, it's always worth it, because it's
     // just one call to prelock. For bounds-based cursors, it is _probably_
     // worth it as long as the bounds vector isn't prefixed by a point
@@ -424,6 +469,7 @@ namespace mongo {
             // We need to prelock first, then position the cursor.
             prelock();
         }
+        startPrefetching();
 
         if ( _bounds != NULL ) {
             const int r = skipToNextKey( _startKey );
@@ -466,22 +512,64 @@ namespace mongo {
 
     int IndexCursor::getf_fetch_count() {
         bool shouldBulkFetch = cc().opSettings().shouldBulkFetch();
-        if ( shouldBulkFetch ) {
-            // Read-only cursor may bulk fetch rows into a buffer, for speed.
-            // The number of rows fetched is proportional to the number of
-            // times we've called getf.
-            switch ( _getf_iteration ) {
-                case 0:
-                case 1:
-                    // The first and second iterations should only fetch
-                    // 1 row, to optimize point queries.
-                    return 1;
-                default:
-                    return 2 << (_getf_iteration < 20 ? _getf_iteration : 20);
-            }
-        } else {
+        if ( !shouldBulkFetch ) {
+            return 1;
+        }
+
+        // Read-only cursor may bulk fetch rows into a buffer, for speed.
+        //
+        // If the query told us how many rows it wants (skip + limit or batch size)
+        // and we haven't scanned that many yet, fetch exactly what's left. A
+        // limit(10) query then does one getf for 10 rows instead of ramping up
+        // through several getfs, and doesn't buffer rows it would throw away.
+        // Multi-interval scans reposition for each interval, and the rows they
+        // want are spread over all of them, so they don't use the hint.
+        const long long rowsStillWanted = _getf_rows_wanted - _nscanned;
+        if ( rowsStillWanted > 0 && (_bounds == NULL || _bounds->isSingleInterval()) ) {
+            return (int) rowsStillWanted;
+        }
+
+        // The first and second iterations should only fetch
+        // 1 row, to optimize point queries.
+        if ( _getf_iteration < 2 ) {
             return 1;
         }
+
+        // After that, each getf should fill a target number of bytes, starting
+        // at 8k and quadrupling per iteration until it reaches the row buffer's
+        // preferred size (at which point the buffer stops the getf anyway).
+        // The target is converted to a row count using the average size of the
+        // rows this cursor has buffered so far.
+        const size_t minTargetBytes = 8 * 1024;
+        const int shift = 2 * (_getf_iteration - 2);
+        const size_t targetBytes = std::min(minTargetBytes << std::min(shift, 8),
+                                            RowBuffer::preferredSize());
+        const long long bytesPerRow = _getf_rows > 0 ? std::max(1LL, _getf_bytes / _getf_rows) : 1;
+        return std::max(1LL, std::min((long long) targetBytes / bytesPerRow,
+                                      (long long) numeric_limits<int>::max()));
+    }
+
+    bool IndexCursor::getf_key_only() const {
+        // A covered query never looks at the document, so for a secondary
+        // index there's no point copying it into the row buffer. current()
+        // still works, it just has to go back to the primary key for it.
+        return _keyFieldsOnly && !_cl->isPKIndex(_idx);
+    }
+
+    void IndexCursor::noteRowsFetched(const cursor_getf_extra &extra) {
+        _getf_iteration++;
+        _getf_calls++;
+        _getf_rows += extra.rows_fetched;
+        _getf_bytes += extra.bytes_fetched;
+    }
+
+    void IndexCursor::explainDetails( BSONObjBuilder &b ) const {
+        BSONObjBuilder bulkFetch( b.subobjStart( "bulkFetch" ) );
+        bulkFetch.append( "rowsWanted", _getf_rows_wanted );
+        bulkFetch.appendNumber( "getfCalls", _getf_calls );
+        bulkFetch.appendNumber( "rowsFetched", _getf_rows );
+        bulkFetch.appendNumber( "bytesFetched", _getf_bytes );
+        bulkFetch.done();
     }
 
     void IndexCursor::findKey(const BSONObj &key) {
@@ -509,12 +597,12 @@ namespace mongo {
         _buffer.empty();
         _getf_iteration = 0;
 
-        storage::Key sKey( key, !pk.isEmpty() ? &pk : NULL );
+        storage::Key sKey( key, !pk.isEmpty() ? &pk : NULL, _idx.keyFormat() );
         DBT key_dbt = sKey.dbt();;
 
         int r;
         const int rows_to_fetch = getf_fetch_count();
-        struct cursor_getf_extra extra(&_buffer, rows_to_fetch);
+        struct cursor_getf_extra extra(&_buffer, rows_to_fetch, getf_key_only());
         DBC *cursor = _cursor->dbc();
         if ( forward() ) {
             r = cursor->c_getf_set_range(cursor, getf_flags(), &key_dbt, cursor_getf, &extra);
@@ -533,10 +621,13 @@ namespace mongo {
             storage::handle_ydb_error(r);
         }
 
-        _getf_iteration++;
+        noteRowsFetched(extra);
         _ok = extra.rows_fetched > 0 ? true : false;
         if ( ok() ) {
             getCurrentFromBuffer();
+            if ( _prefetcher ) {
+                _prefetcher->noteCurrentKey( _currKey );
+            }
         }
 
         TOKULOG(3) << "setPosition hit K, PK, Obj " << _currKey << _currPK << _currObj << endl;
@@ -713,7 +804,7 @@ again:      while ( !allInclusive && ok() ) {
 
         int r;
         const int rows_to_fetch = getf_fetch_count();
-        struct cursor_getf_extra extra(&_buffer, rows_to_fetch);
+        struct cursor_getf_extra extra(&_buffer, rows_to_fetch, getf_key_only());
         DBC *cursor = _cursor->dbc();
         if ( forward() ) {
             r = cursor->c_getf_next(cursor, getf_flags(), cursor_getf, &extra);
@@ -732,7 +823,7 @@ again:      while ( !allInclusive && ok() ) {
             storage::handle_ydb_error(r);
         }
 
-        _getf_iteration++;
+        noteRowsFetched(extra);
         return extra.rows_fetched > 0 ? true : false;
     }
 
@@ -790,9 +881,9 @@ again:      while ( !allInclusive && ok() ) {
     }
 
     BSONObj IndexCursor::current() {
-        // If the index is clustering, the full documenet is always stored in _currObj.
-        // If the index is not clustering, _currObj starts as empty and gets filled
-        // with the full document on the first call to current().
+        // _currObj holds the full document if the row buffer had it: the index is
+        // clustering and the scan isn't covered (see getf_key_only()). Otherwise it
+        // starts empty and is filled from the primary key on the first call to current().
         if ( _currObj.isEmpty() ) {
             _nscannedObjects++;
             bool found = _cl->findByPK( _currPK, _currObj );
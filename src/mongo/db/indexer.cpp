@@ -23,12 +23,15 @@
 #include "mongo/db/curop.h"
 #include "mongo/db/cursor.h"
 #include "mongo/db/d_concurrency.h"
+#include "mongo/db/hot_index_key_generator.h"
 #include "mongo/db/index.h"
 #include "mongo/db/jsobj.h"
+#include "mongo/db/loader_key_generator.h"
 #include "mongo/db/collection.h"
 #include "mongo/db/collection_map.h"
 #include "mongo/util/assert_util.h"
 #include "mongo/util/progress_meter.h"
+#include "mongo/util/scopeguard.h"
 #include "mongo/util/stringutils.h"
 
 namespace mongo {
@@ -108,6 +111,9 @@ namespace mongo {
         CollectionBase::IndexerBase(cl, info) {
     }
 
+    CollectionBase::HotIndexer::~HotIndexer() {
+    }
+
     void CollectionBase::HotIndexer::_prepare() {
         verify(_idx.get() != NULL);
         // The primary key doesn't need to be built - there's no data.
@@ -125,6 +131,21 @@ namespace mongo {
 
     void CollectionBase::HotIndexer::build() {
         if (_indexer.get() != NULL) {
+            if (HotIndexKeyGenerator::enabled()) {
+                // Generate keys on other threads, ahead of the indexer's scan over
+                // the primary key. It stays around until we're destroyed because
+                // writes by other clients may look at it until then.
+                const DBT *desc = &_idx->db()->cmp_descriptor->dbt;
+                _keyGenerator.reset(new HotIndexKeyGenerator(_cl->_ns, _cl->getPKIndexBase(),
+                                                             Descriptor(reinterpret_cast<const char *>(desc->data), desc->size)));
+                _keyGenerator->start();
+                _multiKeyTracker->setKeySource(_keyGenerator.get());
+                _indexer->setStatusFunction(boost::bind(&HotIndexKeyGenerator::status, _keyGenerator.get()));
+            }
+            // The workers read the primary key, so they must be stopped before
+            // we're committed or aborted, which may close it.
+            ON_BLOCK_EXIT_OBJ(*this, &CollectionBase::HotIndexer::stopKeyGenerator);
+
             const int r = _indexer->build();
             if (r != 0) {
                 storage::handle_ydb_error(r);
@@ -137,6 +158,12 @@ namespace mongo {
         } 
     }
 
+    void CollectionBase::HotIndexer::stopKeyGenerator() {
+        if (_keyGenerator.get() != NULL) {
+            _keyGenerator->stop();
+        }
+    }
+
     void CollectionBase::HotIndexer::_commit() {
         if (_indexer.get() != NULL) {
             const int r = _indexer->close();
@@ -165,18 +192,27 @@ namespace mongo {
                                                        << _cl->_ns << ", key "
                                                        << _idx->keyPattern());
 
+            // Generate keys on other threads if we can, and insert them here in order.
+            scoped_ptr<LoaderKeyGenerator> keyGenerator;
+            if (LoaderKeyGenerator::enabled()) {
+                const DBT *desc = &_idx->db()->cmp_descriptor->dbt;
+                const Descriptor descriptor(reinterpret_cast<const char *>(desc->data), desc->size);
+                keyGenerator.reset(new LoaderKeyGenerator(vector<const Descriptor *>(1, &descriptor), false));
+            }
+
             for (shared_ptr<Cursor> cursor(Cursor::make(_cl, 1, false));
                  cursor->ok(); cursor->advance()) {
                 BSONObj pk = cursor->currPK();
                 BSONObj obj = cursor->current();
-                BSONObjSet keys;
-                _idx->getKeysFromObject(obj, keys);
-                if (keys.size() > 1) {
-                    bool indexBitChanged;
-                    _cl->setIndexIsMultikey(_cl->idxNo(*_idx.get()), &indexBitChanged);
-                }
-                for (BSONObjSet::const_iterator ki = keys.begin(); ki != keys.end(); ++ki) {
-                    builder.insertPair(*ki, &pk, obj);
+                if (keyGenerator) {
+                    shared_ptr<LoaderKeyGenerator::Batch> batch = keyGenerator->add(pk, obj);
+                    if (batch) {
+                        insertBatch(builder, *batch);
+                    }
+                } else {
+                    BSONObjSet keys;
+                    _idx->getKeysFromObject(obj, keys);
+                    insertKeys(builder, pk, obj, keys);
                 }
                 if (pm.hit() && cc().curop()) {
                     std::string status = pm.toString();
@@ -184,6 +220,12 @@ namespace mongo {
                 }
                 killCurrentOp.checkForInterrupt(); // uasserts if we should stop
             }
+            if (keyGenerator) {
+                for (shared_ptr<LoaderKeyGenerator::Batch> batch = keyGenerator->finish();
+                     batch; batch = keyGenerator->finish()) {
+                    insertBatch(builder, *batch);
+                }
+            }
 
             pm.finished();
             builder.done();
@@ -195,4 +237,27 @@ namespace mongo {
         }
     }
 
+    void CollectionBase::ColdIndexer::insertKeys(IndexDetailsBase::Builder &builder,
+                                                 const BSONObj &pk, const BSONObj &obj,
+                                                 const BSONObjSet &keys) {
+        if (keys.size() > 1) {
+            bool indexBitChanged;
+            _cl->setIndexIsMultikey(_cl->idxNo(*_idx.get()), &indexBitChanged);
+        }
+        for (BSONObjSet::const_iterator ki = keys.begin(); ki != keys.end(); ++ki) {
+            builder.insertPair(*ki, &pk, obj);
+        }
+    }
+
+    void CollectionBase::ColdIndexer::insertBatch(IndexDetailsBase::Builder &builder,
+                                                  LoaderKeyGenerator::Batch &batch) {
+        for (size_t i = 0; i < batch.objs.size(); i++) {
+            if (!batch.generated[0][i]) {
+                // Get the error the key generator swallowed.
+                _idx->getKeysFromObject(batch.objs[i], batch.keys[0][i]);
+            }
+            insertKeys(builder, batch.pks[i], batch.objs[i], batch.keys[0][i]);
+        }
+    }
+
 } // namespace mongo
@@ -67,6 +67,7 @@
 
 #include "mongo/plugins/loader.h"
 
+#include "mongo/s/d_chunk_heat.h"
 #include "mongo/s/d_logic.h"
 #include "mongo/s/stale_exception.h" // for SendStaleConfigException
 #include "mongo/util/fail_point_service.h"
@@ -228,6 +229,9 @@ namespace mongo {
             }
             dbresponse.exhaustNS = runQuery(m, q, op, *resp);
             verify( !resp->empty() );
+            if (!NamespaceString::isCommand(d.getns())) {
+                chunkHeat.noteRead(d.getns(), q.query, resp->size());
+            }
         }
         catch ( SendStaleConfigException& e ){
             ex.reset( new SendStaleConfigException( e.getns(), e.getInfo().msg, e.getVersionReceived(), e.getVersionWanted() ) );
@@ -569,6 +573,7 @@ namespace mongo {
         if (!broadcast && sc.handlePossibleShardedMessage(m, 0)) {
             return;
         }
+        chunkHeat.noteWrite(ns, query, updateobj.objsize());
 
         LOCK_REASON(lockReason, "update");
         try {
@@ -608,6 +613,7 @@ namespace mongo {
         if (!broadcast && sc.handlePossibleShardedMessage(m, 0)) {
             return;
         }
+        chunkHeat.noteWrite(ns, pattern, pattern.objsize());
 
         LOCK_REASON(lockReason, "delete");
         Lock::DBRead lk(ns, lockReason);
@@ -956,6 +962,7 @@ namespace mongo {
             if (scp->handlePossibleShardedMessage(m, 0)) {
                 return;
             }
+            chunkHeat.noteInserts(ns, objs);
         }
 
         LOCK_REASON(lockReason, "insert");
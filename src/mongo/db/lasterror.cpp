@@ -18,6 +18,8 @@
 
 #include "pch.h"
 
+#include "mongo/base/init.h"
+#include "mongo/util/concurrency/connection_thread_locals.h"
 #include "mongo/util/net/message.h"
 
 #include "lasterror.h"
@@ -129,6 +131,15 @@ namespace mongo {
         _tl.reset( le );
     }
 
+    void LastErrorHolder::registerConnectionThreadLocal() {
+        ConnectionThreadLocals::add( _tl );
+    }
+
+    MONGO_INITIALIZER(LastErrorConnectionThreadLocal)(InitializerContext* context) {
+        lastError.registerConnectionThreadLocal();
+        return Status::OK();
+    }
+
     void prepareErrForNewRequest( Message &m, LastError * err ) {
         // a killCursors message shouldn't affect last error
         verify( err );
@@ -135,6 +135,9 @@ namespace mongo {
         
         void release();
 
+        /** Register the LastError as belonging to the thread's connection. */
+        void registerConnectionThreadLocal();
+
         /** when db receives a message/request, call this */
         LastError * startRequest( Message& m , LastError * connectionOwned );
 
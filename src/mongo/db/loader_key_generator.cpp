@@ -0,0 +1,229 @@
+// loader_key_generator.cpp
+
+/**
+*    Copyright (C) 2013 Tokutek Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "mongo/pch.h"
+
+#include "mongo/db/loader_key_generator.h"
+
+#include <db.h>
+#include <boost/thread/condition.hpp>
+
+#include "mongo/db/descriptor.h"
+#include "mongo/db/server_parameters.h"
+#include "mongo/util/concurrency/mutex.h"
+#include "mongo/util/concurrency/thread_pool.h"
+
+namespace mongo {
+
+    // Number of threads generating keys for bulk loads and foreground index
+    // builds, shared by all of them. Zero generates keys on the loading thread.
+    MONGO_EXPORT_STARTUP_SERVER_PARAMETER(loaderKeyGeneratorThreads, int, 4);
+
+    // Fraction of loaderMaxMemory (1 / n) held by batches waiting for or
+    // holding keys. The rest is left to the ydb loader's sort buffers.
+    static const uint64_t loaderMemoryShareDivisor = 4;
+
+    // Each thread gets two batches: one it generates keys for while the
+    // loader consumes the other.
+    static const size_t batchesPerThread = 2;
+
+    static const size_t minBatchBytes = 64 * 1024;
+
+    static SimpleMutex keyGeneratorPoolMutex("loaderKeyGeneratorPool");
+    static ThreadPool *keyGeneratorPool = NULL;
+
+    static ThreadPool &getKeyGeneratorPool() {
+        SimpleMutex::scoped_lock lk(keyGeneratorPoolMutex);
+        if (keyGeneratorPool == NULL) {
+            keyGeneratorPool = new ThreadPool(loaderKeyGeneratorThreads);
+        }
+        return *keyGeneratorPool;
+    }
+
+    bool LoaderKeyGenerator::enabled() {
+        return loaderKeyGeneratorThreads > 0;
+    }
+
+    uint64_t LoaderKeyGenerator::memoryShare(uint64_t loaderMemory) {
+        return enabled() ? loaderMemory / loaderMemoryShareDivisor : 0;
+    }
+
+    // Each thread's share of the memory, split between its batches.
+    static size_t batchBytes() {
+        const uint64_t share = LoaderKeyGenerator::memoryShare(storage::loader_max_memory());
+        const uint64_t perThread = share / loaderKeyGeneratorThreads;
+        return std::max((size_t) (perThread / batchesPerThread), minBatchBytes);
+    }
+
+    LoaderKeyGenerator::Batch::Batch(size_t nIndexes) :
+        keys(nIndexes), generated(nIndexes), bytes(0), tasksLeft(0) {
+    }
+
+    struct LoaderKeyGenerator::State : boost::noncopyable {
+        State() : mutex("loaderKeyGenerator") { }
+        // Copies of the descriptors, the tasks may outlive the caller's.
+        vector<string> descriptors;
+        mongo::mutex mutex;
+        boost::condition batchDone;
+    };
+
+    // Keys of one index, in the order the loader asks for them.
+    class LoaderKeyGenerator::KeyQueue : public storage::KeySource {
+    public:
+        KeyQueue(size_t i) : _i(i), _mutex("loaderKeyQueue"), _next(0) { }
+
+        void push(const shared_ptr<Batch> &batch) {
+            SimpleMutex::scoped_lock lk(_mutex);
+            _batches.push_back(batch);
+        }
+
+        bool takeKeys(const BSONObj &pk, const BSONObj &obj, BSONObjSet &keys) {
+            SimpleMutex::scoped_lock lk(_mutex);
+            while (!_batches.empty()) {
+                Batch &b = *_batches.front();
+                if (_next >= b.objs.size()) {
+                    _batches.pop_front();
+                    _next = 0;
+                    continue;
+                }
+                if (!b.objs[_next].binaryEqual(obj)) {
+                    return false;
+                }
+                const bool generated = b.generated[_i][_next];
+                if (generated) {
+                    keys.swap(b.keys[_i][_next]);
+                }
+                _next++;
+                return generated;
+            }
+            return false;
+        }
+
+    private:
+        const size_t _i;
+        SimpleMutex _mutex;
+        std::deque<shared_ptr<Batch> > _batches;
+        size_t _next;   // next row of the oldest batch
+    };
+
+    LoaderKeyGenerator::LoaderKeyGenerator(const vector<const Descriptor *> &descriptors,
+                                           const bool queueKeys) :
+        _state(new State()),
+        _batchBytes(batchBytes()),
+        _maxBatches(batchesPerThread * loaderKeyGeneratorThreads) {
+        verify(enabled());
+        for (size_t i = 0; i < descriptors.size(); i++) {
+            const DBT dbt = descriptors[i]->dbt();
+            _state->descriptors.push_back(string(static_cast<const char *>(dbt.data), dbt.size));
+            if (queueKeys) {
+                _queues.push_back(shared_ptr<KeyQueue>(new KeyQueue(i)));
+            }
+        }
+    }
+
+    LoaderKeyGenerator::~LoaderKeyGenerator() {
+        // Tasks still running hold their own references to the state and their batch.
+    }
+
+    storage::KeySource *LoaderKeyGenerator::keySource(size_t i) {
+        verify(i < _queues.size());
+        return _queues[i].get();
+    }
+
+    shared_ptr<LoaderKeyGenerator::Batch> LoaderKeyGenerator::add(const BSONObj &pk, const BSONObj &obj) {
+        if (!_current) {
+            _current.reset(new Batch(_state->descriptors.size()));
+        }
+        _current->pks.push_back(pk.getOwned());
+        _current->objs.push_back(obj.getOwned());
+        _current->bytes += pk.objsize() + obj.objsize();
+        if (_current->bytes >= _batchBytes) {
+            submitCurrent();
+        }
+        // Wait for the oldest batch if there are too many, otherwise
+        // only take it if it's ready.
+        return popOldest(_inFlight.size() > _maxBatches);
+    }
+
+    shared_ptr<LoaderKeyGenerator::Batch> LoaderKeyGenerator::finish() {
+        submitCurrent();
+        return popOldest(true);
+    }
+
+    void LoaderKeyGenerator::submitCurrent() {
+        if (!_current) {
+            return;
+        }
+        const size_t n = _current->objs.size();
+        for (size_t i = 0; i < _state->descriptors.size(); i++) {
+            _current->keys[i].resize(n);
+            _current->generated[i].resize(n, false);
+        }
+        {
+            mongo::mutex::scoped_lock lk(_state->mutex);
+            _current->tasksLeft = _state->descriptors.size();
+        }
+        ThreadPool &pool = getKeyGeneratorPool();
+        for (size_t i = 0; i < _state->descriptors.size(); i++) {
+            pool.schedule(&LoaderKeyGenerator::generate, _state, _current, i);
+        }
+        _inFlight.push_back(_current);
+        _current.reset();
+    }
+
+    shared_ptr<LoaderKeyGenerator::Batch> LoaderKeyGenerator::popOldest(const bool wait) {
+        if (_inFlight.empty()) {
+            return shared_ptr<Batch>();
+        }
+        shared_ptr<Batch> oldest = _inFlight.front();
+        {
+            mongo::mutex::scoped_lock lk(_state->mutex);
+            if (oldest->tasksLeft > 0 && !wait) {
+                return shared_ptr<Batch>();
+            }
+            while (oldest->tasksLeft > 0) {
+                _state->batchDone.wait(lk.boost());
+            }
+        }
+        _inFlight.pop_front();
+        // Queue before the caller puts the batch, the loader may ask for
+        // the keys as soon as it has the rows.
+        for (vector<shared_ptr<KeyQueue> >::iterator it = _queues.begin(); it != _queues.end(); ++it) {
+            (*it)->push(oldest);
+        }
+        return oldest;
+    }
+
+    void LoaderKeyGenerator::generate(shared_ptr<State> state, shared_ptr<Batch> batch, size_t i) {
+        const string &data = state->descriptors[i];
+        Descriptor descriptor(data.data(), data.size());
+        for (size_t j = 0; j < batch->objs.size(); j++) {
+            try {
+                descriptor.generateKeys(batch->objs[j], batch->keys[i][j]);
+                batch->generated[i][j] = true;
+            } catch (const DBException &) {
+                // The caller gets this error when it tries the row itself.
+                batch->keys[i][j].clear();
+            }
+        }
+        mongo::mutex::scoped_lock lk(state->mutex);
+        batch->tasksLeft--;
+        state->batchDone.notify_all();
+    }
+
+} // namespace mongo
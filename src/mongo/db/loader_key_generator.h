@@ -0,0 +1,117 @@
+// loader_key_generator.h
+
+/**
+*    Copyright (C) 2013 Tokutek Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "mongo/pch.h"
+
+#include <deque>
+
+#include "mongo/db/jsobj.h"
+#include "mongo/db/storage/env.h"
+
+namespace mongo {
+
+    class Descriptor;
+
+    /**
+     * Generates secondary keys for rows headed into a bulk loader, on a pool of
+     * loaderKeyGeneratorThreads threads shared by every loader.
+     *
+     * The caller adds rows one at a time. Rows are grouped into batches, and each batch
+     * gets one key generation task per index, so a batch is spread over as many threads
+     * as there are indexes and consecutive batches run concurrently. add() and finish()
+     * hand batches back in the order their rows were added, once all their keys exist,
+     * and the caller feeds them to its loader on its own thread.
+     *
+     * Keys go to the loader one of two ways:
+     * - a ColdIndexer puts them into its single dictionary loader itself.
+     * - a BulkLoadedCollection puts documents into a loader that generates keys for
+     *   every index through storage::generate_keys(). Constructed with queueKeys, the
+     *   generator also queues each batch it hands back on a storage::KeySource per
+     *   index, where generate_keys() finds the keys when the loader gets to each row.
+     *
+     * The memory held by batches in flight is a fixed share of loaderMaxMemory, split
+     * evenly between the threads. See memoryShare().
+     */
+    class LoaderKeyGenerator : boost::noncopyable {
+    public:
+        /** @return true if loaderKeyGeneratorThreads allows parallel key generation */
+        static bool enabled();
+
+        /** @return how much of a loader's memory is used for keys generated in parallel */
+        static uint64_t memoryShare(uint64_t loaderMemory);
+
+        struct Batch : boost::noncopyable {
+            Batch(size_t nIndexes);
+
+            vector<BSONObj> pks;
+            vector<BSONObj> objs;
+            // keys[i][j] are the keys of objs[j] for the i'th index, if generated[i][j]
+            // is set. Rows whose keys couldn't be generated are left to the caller,
+            // which will get the same error generating them itself.
+            vector<vector<BSONObjSet> > keys;
+            vector<vector<char> > generated;
+            size_t bytes;
+            int tasksLeft;
+        };
+
+        /**
+         * @param descriptors one per index to generate keys for
+         * @param queueKeys see keySource()
+         */
+        LoaderKeyGenerator(const vector<const Descriptor *> &descriptors, const bool queueKeys);
+        ~LoaderKeyGenerator();
+
+        /**
+         * Add a row, copying it.
+         * @return the oldest batch, if its keys are generated or we had to wait for it
+         *         to bound memory, or an empty pointer.
+         */
+        shared_ptr<Batch> add(const BSONObj &pk, const BSONObj &obj);
+
+        /**
+         * Stop batching, call until it returns an empty pointer.
+         * @return the oldest remaining batch, waiting for its keys.
+         */
+        shared_ptr<Batch> finish();
+
+        /**
+         * Where storage::generate_keys() finds the keys of the i'th index for the
+         * batches handed back so far. Only for generators constructed with queueKeys.
+         */
+        storage::KeySource *keySource(size_t i);
+
+    private:
+        struct State;
+        class KeyQueue;
+
+        static void generate(shared_ptr<State> state, shared_ptr<Batch> batch, size_t i);
+        void submitCurrent();
+        shared_ptr<Batch> popOldest(const bool wait);
+
+        shared_ptr<State> _state;
+        vector<shared_ptr<KeyQueue> > _queues;
+        const size_t _batchBytes;
+        const size_t _maxBatches;
+        shared_ptr<Batch> _current;
+        // Submitted batches, oldest first.
+        std::deque<shared_ptr<Batch> > _inFlight;
+    };
+
+} // namespace mongo
@@ -21,6 +21,8 @@
 
 #include "mongo/pch.h"
 #include "mongo/db/matcher.h"
+#include "mongo/db/matcher_program.h"
+#include "mongo/db/server_parameters.h"
 #include "mongo/util/goodies.h"
 #include "mongo/util/startup_test.h"
 #include "mongo/scripting/engine.h"
@@ -55,6 +57,8 @@ namespace mongo {
 
     extern BSONObj staticNull;
 
+    MONGO_EXPORT_SERVER_PARAMETER(useCompiledMatcher, bool, true);
+
     class Where : boost::noncopyable {
     public:
 
@@ -578,6 +582,10 @@ namespace mongo {
         while ( i.more() ) {
             parseMatchExpressionElement( i.next(), nested );
         }
+
+        if ( useCompiledMatcher ) {
+            _program.reset( MatcherProgram::compile( _basics, _compiledBasics ) );
+        }
     }
 
     Matcher::Matcher( const Matcher &docMatcher, const BSONObj &key ) :
@@ -952,8 +960,20 @@ namespace mongo {
         /* assuming there is usually only one thing to match.  if more this
            could be slow sometimes. */
 
+        // The compiled predicates only need the generic matcher if the program found arrays.
+        MatcherProgram::Result compiled = MatcherProgram::Undecided;
+        if ( _program ) {
+            compiled = _program->run( jsobj );
+            if ( compiled == MatcherProgram::NoMatch ) {
+                return false;
+            }
+        }
+
         // check normal non-regex cases:
         for ( unsigned i = 0; i < _basics.size(); i++ ) {
+            if ( compiled == MatcherProgram::Match && _compiledBasics[i] ) {
+                continue;
+            }
             const ElementMatcher& bm = _basics[i];
             const BSONElement& m = bm._toMatch;
             // -1=mismatch. 0=missing element. 1=match
@@ -1224,6 +1244,21 @@ namespace mongo {
         visitList( visitor, _norMatchers );
     }
     
+    static bool listHasWhere( const list< shared_ptr< Matcher > > &matchers ) {
+        for( list< shared_ptr< Matcher > >::const_iterator i = matchers.begin();
+                i != matchers.end(); ++i ) {
+            if ( (*i)->hasWhere() ) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool Matcher::hasWhere() const {
+        return _where || listHasWhere( _andMatchers ) || listHasWhere( _orMatchers ) ||
+                listHasWhere( _norMatchers );
+    }
+
     bool Matcher::keyMatch( const Matcher &docMatcher ) const {
         // Quick check certain non key match cases.
         if ( docMatcher._all
@@ -32,6 +32,10 @@ namespace mongo {
     class ElementMatcher;
     class Matcher;
     class FieldRangeVector;
+    class MatcherProgram;
+
+    /** Whether new Matchers compile their simple predicates into a MatcherProgram. */
+    extern bool useCompiledMatcher;
 
     class RegexMatcher {
     public:
@@ -307,6 +311,12 @@ namespace mongo {
          * value as the provided doc matcher.
          */
         bool keyMatch( const Matcher &docMatcher ) const;
+
+        /**
+         * @return true if this matcher or a nested one runs $where, whose javascript scope may
+         * only be used by one thread at a time.
+         */
+        bool hasWhere() const;
         
         bool singleSimpleCriterion() const {
             return false; // TODO SERVER-958
@@ -347,6 +357,9 @@ namespace mongo {
         BSONObj _jsobj;                  // the query pattern.  e.g., { name: "joe" }
         BSONObj _constrainIndexKey;
         vector<ElementMatcher> _basics;
+        // The _basics that could be compiled, and which ones they were.
+        scoped_ptr<MatcherProgram> _program;
+        vector<bool> _compiledBasics;
         bool _haveSize;
         bool _all;
         bool _hasArray;
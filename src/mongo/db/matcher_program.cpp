@@ -0,0 +1,288 @@
+// matcher_program.cpp
+
+/**
+*    Copyright (C) 2013 Tokutek Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "mongo/pch.h"
+
+#include "mongo/db/matcher_program.h"
+
+#include "mongo/db/matcher.h"
+#include "mongo/util/stringutils.h"
+
+namespace mongo {
+
+    namespace {
+
+        // Whether comparison result c satisfies op, the same way Matcher::valuesMatch() does.
+        inline bool opMatches(int op, int c) {
+            if (op == BSONObj::Equality) {
+                return c == 0;
+            }
+            if (c < -1) c = -1;
+            if (c > 1) c = 1;
+            return op & (1 << (c + 1));
+        }
+
+        template<typename T>
+        inline int compareValues(T l, T r) {
+            return l < r ? -1 : (l == r ? 0 : 1);
+        }
+
+        // compareElementValues() for two numbers of which at least one isn't an integer of the
+        // other's type.
+        inline int compareDoubles(double l, double r) {
+            if (l < r) {
+                return -1;
+            }
+            if (l == r) {
+                return 0;
+            }
+            if (isNaN(l)) {
+                return isNaN(r) ? 0 : -1;
+            }
+            return 1;
+        }
+
+        bool compilable(const ElementMatcher &em) {
+            if (em._isNot) {
+                return false;
+            }
+            switch (em._compareOp) {
+            case BSONObj::Equality:
+            case BSONObj::LT:
+            case BSONObj::LTE:
+            case BSONObj::GT:
+            case BSONObj::GTE:
+                break;
+            default:
+                return false;
+            }
+            // Null, arrays and objects have their own rules for missing fields and arrays.
+            switch (em._toMatch.type()) {
+            case NumberInt:
+            case NumberLong:
+            case NumberDouble:
+            case String:
+            case Bool:
+            case Date:
+            case Timestamp:
+            case jstOID:
+                break;
+            default:
+                return false;
+            }
+            // Every component of the path must be a field name.
+            const StringData path(em._toMatch.fieldName());
+            return !path.empty() && path[0] != '.' && path[path.size() - 1] != '.' &&
+                   path.find("..") == string::npos;
+        }
+
+    } // namespace
+
+    MatcherProgram *MatcherProgram::compile(const vector<ElementMatcher> &basics,
+                                            vector<bool> &compiled) {
+        auto_ptr<MatcherProgram> program(new MatcherProgram());
+        compiled.assign(basics.size(), false);
+        bool any = false;
+        for (size_t i = 0; i < basics.size(); ++i) {
+            const ElementMatcher &em = basics[i];
+            if (!compilable(em)) {
+                continue;
+            }
+            Predicate predicate;
+            predicate.op = em._compareOp;
+            predicate.toMatch = em._toMatch;
+            switch (em._toMatch.type()) {
+            case NumberInt: predicate.kernel = IntKernel; break;
+            case NumberLong: predicate.kernel = LongKernel; break;
+            case NumberDouble: predicate.kernel = DoubleKernel; break;
+            case String: predicate.kernel = StringKernel; break;
+            default: predicate.kernel = GenericKernel; break;
+            }
+            if (program->add(em._toMatch.fieldName(), predicate)) {
+                compiled[i] = true;
+                any = true;
+            }
+        }
+        return any ? program.release() : NULL;
+    }
+
+    int MatcherProgram::findField(const Node &node, const char *name) const {
+        int lo = 0;
+        int hi = node.fields.size();
+        while (lo < hi) {
+            const int mid = (lo + hi) / 2;
+            const int c = strcmp(node.fields[mid].name.c_str(), name);
+            if (c == 0) {
+                return mid;
+            }
+            if (c < 0) {
+                lo = mid + 1;
+            }
+            else {
+                hi = mid;
+            }
+        }
+        return -1;
+    }
+
+    bool MatcherProgram::add(const StringData &path, const Predicate &predicate) {
+        vector<string> components;
+        splitStringDelim(path.toString(), &components, '.');
+
+        // Check there's room for the path before changing anything, so a path that doesn't fit
+        // doesn't leave fields without predicates behind.
+        for (size_t i = 0, node = 0; i < components.size(); ++i) {
+            const int f = findField(_nodes[node], components[i].c_str());
+            if (f < 0) {
+                if (_nodes[node].fields.size() >= maxFieldsPerNode) {
+                    return false;
+                }
+                break;
+            }
+            if (i + 1 == components.size() || _nodes[node].fields[f].node < 0) {
+                break;
+            }
+            node = _nodes[node].fields[f].node;
+        }
+
+        int node = 0;
+        for (size_t i = 0; i < components.size(); ++i) {
+            int f = findField(_nodes[node], components[i].c_str());
+            if (f < 0) {
+                Field field;
+                field.name = components[i];
+                field.node = -1;
+                vector<Field> &fields = _nodes[node].fields;
+                vector<Field>::iterator it = fields.begin();
+                while (it != fields.end() && it->name < field.name) {
+                    ++it;
+                }
+                f = fields.insert(it, field) - fields.begin();
+            }
+            if (i + 1 == components.size()) {
+                _nodes[node].fields[f].predicates.push_back(predicate);
+                break;
+            }
+            if (_nodes[node].fields[f].node < 0) {
+                // push_back may move the nodes, so don't hold on to references across it.
+                _nodes.push_back(Node());
+                _nodes[node].fields[f].node = _nodes.size() - 1;
+            }
+            node = _nodes[node].fields[f].node;
+        }
+        return true;
+    }
+
+    bool MatcherProgram::matches(const Predicate &predicate, const BSONElement &e) {
+        const BSONElement &toMatch = predicate.toMatch;
+        switch (predicate.kernel) {
+        case IntKernel:
+            if (e.type() == NumberInt) {
+                return opMatches(predicate.op, compareValues(e._numberInt(), toMatch._numberInt()));
+            }
+            break;
+        case LongKernel:
+            if (e.type() == NumberLong) {
+                return opMatches(predicate.op, compareValues(e._numberLong(), toMatch._numberLong()));
+            }
+            break;
+        case DoubleKernel:
+            if (e.type() == NumberDouble) {
+                return opMatches(predicate.op, compareDoubles(e._numberDouble(), toMatch._numberDouble()));
+            }
+            break;
+        case StringKernel:
+            if (e.type() == String || e.type() == Symbol) {
+                return opMatches(predicate.op, compareElementValues(e, toMatch));
+            }
+            return false;
+        case GenericKernel:
+            break;
+        }
+        // Numbers of other types compare as doubles, and values of other types never match.
+        if (e.canonicalType() != toMatch.canonicalType()) {
+            return false;
+        }
+        return opMatches(predicate.op, compareElementValues(e, toMatch));
+    }
+
+    MatcherProgram::Result MatcherProgram::runNode(int nodeIndex, const BSONObj &obj) const {
+        const Node &node = _nodes[nodeIndex];
+        // Like getField(), only the first of several fields with the same name counts.
+        unsigned long long seen = 0;
+        size_t nSeen = 0;
+        BSONObjIterator i(obj);
+        while (i.more()) {
+            const BSONElement e = i.next();
+            const int f = findField(node, e.fieldName());
+            if (f < 0 || (seen & (1ULL << f))) {
+                continue;
+            }
+            seen |= 1ULL << f;
+            nSeen++;
+
+            if (e.type() == Array) {
+                return Undecided;
+            }
+            const Field &field = node.fields[f];
+            for (vector<Predicate>::const_iterator p = field.predicates.begin();
+                 p != field.predicates.end(); ++p) {
+                if (!matches(*p, e)) {
+                    return NoMatch;
+                }
+            }
+            if (field.node >= 0) {
+                if (e.type() != Object) {
+                    // The rest of the path is missing.
+                    return NoMatch;
+                }
+                const Result r = runNode(field.node, e.embeddedObject());
+                if (r != Match) {
+                    return r;
+                }
+            }
+            if (nSeen == node.fields.size()) {
+                return Match;
+            }
+        }
+        // A tested field is missing, and none of the compiled predicates match missing fields.
+        return NoMatch;
+    }
+
+    void MatcherProgram::appendNode(int nodeIndex, const string &prefix, stringstream &ss) const {
+        const Node &node = _nodes[nodeIndex];
+        for (vector<Field>::const_iterator f = node.fields.begin(); f != node.fields.end(); ++f) {
+            const string path = prefix + f->name;
+            for (vector<Predicate>::const_iterator p = f->predicates.begin();
+                 p != f->predicates.end(); ++p) {
+                ss << path << " op:" << p->op << " kernel:" << p->kernel << " "
+                   << p->toMatch.toString(false) << "\n";
+            }
+            if (f->node >= 0) {
+                appendNode(f->node, path + ".", ss);
+            }
+        }
+    }
+
+    string MatcherProgram::toString() const {
+        stringstream ss;
+        appendNode(0, "", ss);
+        return ss.str();
+    }
+
+} // namespace mongo
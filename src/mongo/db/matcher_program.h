@@ -0,0 +1,107 @@
+// matcher_program.h
+
+/**
+*    Copyright (C) 2013 Tokutek Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "mongo/pch.h"
+
+#include "mongo/db/jsobj.h"
+
+namespace mongo {
+
+    class ElementMatcher;
+
+    /**
+     * The basic predicates of a Matcher that compare a field with a scalar ($gt, $lt etc. and
+     * equality), compiled once so that documents don't have to be walked per predicate.
+     *
+     * Predicates are grouped by field path into a tree with a node per embedded object, so each
+     * document is scanned once for all the fields tested at its top level, and once more for each
+     * embedded object tested.  Each predicate picks a comparison for the type it compares with
+     * at compile time, so matching a field of that type doesn't dispatch on the operator.
+     *
+     * Arrays are where the matcher's rules get complicated, so the program gives up on any
+     * document with an array along a compiled path and leaves it to the generic matcher.
+     */
+    class MatcherProgram : boost::noncopyable {
+    public:
+        enum Result {
+            Undecided = -1,
+            NoMatch = 0,
+            Match = 1
+        };
+
+        /**
+         * Compile those of basics that can be compiled.
+         * @param compiled set to whether each of basics was compiled
+         * @return NULL if none could be compiled
+         */
+        static MatcherProgram *compile(const vector<ElementMatcher> &basics,
+                                       vector<bool> &compiled);
+
+        /**
+         * @return whether obj matches all the compiled predicates, or Undecided if an array was
+         * found where one of them looks.
+         */
+        Result run(const BSONObj &obj) const { return runNode(0, obj); }
+
+        string toString() const;
+
+    private:
+        enum Kernel {
+            IntKernel,      // NumberInt
+            LongKernel,     // NumberLong
+            DoubleKernel,   // NumberDouble
+            StringKernel,   // String
+            GenericKernel   // other scalars, via compareElementValues()
+        };
+
+        struct Predicate {
+            int op;
+            Kernel kernel;
+            BSONElement toMatch;
+        };
+
+        struct Field {
+            string name;
+            vector<Predicate> predicates;
+            // Node of the embedded object's fields that are tested, or -1.
+            int node;
+        };
+
+        struct Node {
+            // Sorted by name.
+            vector<Field> fields;
+        };
+
+        // Documents with more fields than this tested at one level aren't worth compiling.
+        static const size_t maxFieldsPerNode = 64;
+
+        MatcherProgram() { _nodes.push_back(Node()); }
+
+        // @return false if the node for path already has too many fields
+        bool add(const StringData &path, const Predicate &predicate);
+        int findField(const Node &node, const char *name) const;
+        Result runNode(int node, const BSONObj &obj) const;
+        static bool matches(const Predicate &predicate, const BSONElement &e);
+        void appendNode(int node, const string &prefix, stringstream &ss) const;
+
+        vector<Node> _nodes;
+    };
+
+} // namespace mongo
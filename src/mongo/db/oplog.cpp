@@ -248,6 +248,17 @@ namespace mongo {
         return found;
     }
 
+    bool getOplogEntryForGTID(GTID gtid, BSONObj& entry) {
+        LOCK_REASON(lockReason, "repl: reading oplog entry for GTID");
+        Client::ReadContext ctx(rsoplog, lockReason);
+        Client::Transaction transaction(DB_TXN_SNAPSHOT | DB_TXN_READ_ONLY);
+        BSONObjBuilder q;
+        addGTIDToBSON("_id", gtid, q);
+        const bool found = Collection::findOne(rsoplog, q.done(), entry, true);
+        transaction.commit();
+        return found;
+    }
+
     static void _writeEntryToOplog(BSONObj entry) {
         Collection* rsOplogDetails = getCollection(rsoplog);
         verify(rsOplogDetails);
@@ -402,6 +413,27 @@ namespace mongo {
         }
     }
     
+    bool getNamespacesForApplyConflicts(const BSONObj& entry, set<string>& namespaces) {
+        if (entry.hasElement("ref")) {
+            // the operations live in oplog.refs and may be numerous,
+            // we don't read them all up front just to schedule the transaction
+            return false;
+        }
+        if (!entry["a"].trueValue()) {
+            vector<BSONElement> ops = entry["ops"].Array();
+            for (vector<BSONElement>::const_iterator it = ops.begin(); it != ops.end(); ++it) {
+                string ns;
+                if (!OplogHelpers::namespaceForApplyConflicts(it->Obj(), ns)) {
+                    return false;
+                }
+                if (!ns.empty()) {
+                    namespaces.insert(ns);
+                }
+            }
+        }
+        return true;
+    }
+
     // apply all operations in the array
     void rollbackOps(std::vector<BSONElement> ops) {
         const size_t numOps = ops.size();
@@ -44,10 +44,14 @@ namespace mongo {
     GTID getGTIDFromOplogEntry(BSONObj o);
     bool getLastGTIDinOplog(GTID* gtid);
     bool gtidExistsInOplog(GTID gtid);
+    bool getOplogEntryForGTID(GTID gtid, BSONObj& entry);
     void writeEntryToOplog(BSONObj entry, bool recordStats);
     void writeEntryToOplogRefs(BSONObj entry);
     void replicateFullTransactionToOplog(BSONObj& o, OplogReader& r, bool* bigTxn);
     void applyTransactionFromOplog(BSONObj entry);
+    // Fills namespaces with the collections applyTransactionFromOplog(entry) will write to.
+    // Returns false if the transaction must not be applied concurrently with any other.
+    bool getNamespacesForApplyConflicts(const BSONObj& entry, set<string>& namespaces);
     void rollbackTransactionFromOplog(BSONObj entry, bool purgeEntry);
     void purgeEntryFromOplog(BSONObj entry);
 
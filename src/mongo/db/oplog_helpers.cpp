@@ -27,6 +27,7 @@
 #include "mongo/db/repl/rs.h"
 #include "mongo/db/stats/counters.h"
 #include "mongo/db/relock.h"
+#include "mongo/db/server_parameters.h"
 
 // BSON fields for oplog entries
 static const char *KEY_STR_OP_NAME = "op";
@@ -44,6 +45,7 @@ static const char *KEY_STR_NEW_PARTITION_INFO = "pi";
 
 // values for types of operations in oplog
 static const char OP_STR_INSERT[] = "i"; // normal insert
+static const char OP_STR_INSERT_BATCH[] = "ib"; // batch of normal inserts, an array of rows
 static const char OP_STR_CAPPED_INSERT[] = "ci"; // insert into capped collection
 static const char OP_STR_UPDATE[] = "u"; // normal update with full pre-image and full post-image
 static const char OP_STR_UPDATE_ROW_WITH_MOD[] = "ur"; // update with full pre-image and mods to generate post-image
@@ -117,6 +119,70 @@ namespace mongo {
             }
         }
 
+        // Secondaries older than this code cannot apply batched insert
+        // entries, so this is off until every member of the set can and
+        // it's turned on.
+        MONGO_EXPORT_SERVER_PARAMETER(logBatchedInserts, bool, false);
+
+        void logInserts(const char *ns, const vector<BSONObj> &rows, bool fromMigrate) {
+            if (isLocalNs(ns)) {
+                return;
+            }
+            if (rows.size() == 1 || !logBatchedInserts) {
+                for (vector<BSONObj>::const_iterator it = rows.begin(); it != rows.end(); ++it) {
+                    logInsert(ns, *it, fromMigrate);
+                }
+                return;
+            }
+
+            // A migration only wants the rows in the chunk it is moving, so
+            // those are still logged for sharding one by one.
+            if (!fromMigrate) {
+                for (vector<BSONObj>::const_iterator it = rows.begin(); it != rows.end(); ++it) {
+                    if (shouldLogTxnOpForSharding(OP_STR_INSERT, ns, *it)) {
+                        BSONObjBuilder b;
+                        appendOpType(OP_STR_INSERT, &b);
+                        appendNsStr(ns, &b);
+                        b.append(KEY_STR_ROW, *it);
+                        cc().txn().logOpForSharding(b.obj());
+                    }
+                }
+            }
+
+            if (logTxnOpsForReplication()) {
+                // Cut the batch so that no entry is bigger than what a
+                // transaction keeps in memory before spilling to oplog.refs,
+                // a single entry can't be split across spilled documents.
+                const size_t maxBytes = cmdLine.txnMemLimit;
+                vector<BSONObj>::const_iterator it = rows.begin();
+                while (it != rows.end()) {
+                    vector<BSONObj>::const_iterator end = it;
+                    size_t bytes = 0;
+                    do {
+                        bytes += end->objsize();
+                        ++end;
+                    } while (end != rows.end() && bytes + end->objsize() <= maxBytes);
+
+                    BSONObjBuilder b;
+                    if (end - it == 1) {
+                        appendOpType(OP_STR_INSERT, &b);
+                        appendNsStr(ns, &b);
+                        b.append(KEY_STR_ROW, *it);
+                    } else {
+                        appendOpType(OP_STR_INSERT_BATCH, &b);
+                        appendNsStr(ns, &b);
+                        BSONArrayBuilder rowsBuilder(b.subarrayStart(KEY_STR_ROW));
+                        for (; it != end; ++it) {
+                            rowsBuilder.append(*it);
+                        }
+                        rowsBuilder.done();
+                    }
+                    cc().txn().logOpForReplication(b.obj());
+                    it = end;
+                }
+            }
+        }
+
         void logInsertForCapped(const char *ns, const BSONObj &pk, const BSONObj &row) {
             if (logTxnOpsForReplication()) {
                 BSONObjBuilder b;
@@ -404,6 +470,31 @@ namespace mongo {
             }
         }
 
+        static void runInsertBatchFromOplogWithLock(const char *ns, const BSONObj &op) {
+            Collection *cl = getCollection(ns);
+
+            vector<BSONObj> rows;
+            for (BSONObjIterator it(op[KEY_STR_ROW].Obj()); it.more(); ) {
+                rows.push_back(it.next().Obj());
+            }
+            // overwrite set to true because we are running on a secondary
+            const uint64_t flags = Collection::NO_UNIQUE_CHECKS | Collection::NO_LOCKTREE;
+            insertManyObjects(cl, rows, false, flags);
+        }
+
+        static void runInsertBatchFromOplog(const char *ns, const BSONObj &op) {
+            try {
+                LOCK_REASON(lockReason, "repl: applying batched insert");
+                Client::ReadContext ctx(ns, lockReason);
+                runInsertBatchFromOplogWithLock(ns, op);
+            }
+            catch (RetryWithWriteLock &e) {
+                LOCK_REASON(lockReason, "repl: applying batched insert with write lock");
+                Client::WriteContext ctx(ns, lockReason);
+                runInsertBatchFromOplogWithLock(ns, op);
+            }
+        }
+
         static void runCappedInsertFromOplogWithLock(
             const char* ns,
             const BSONObj& pk,
@@ -460,6 +551,16 @@ namespace mongo {
             runDeleteFromOplogWithLock(ns, op);
         }
         
+        // the rollback of a batched insert is to delete each row
+        static void runRollbackInsertBatchFromOplog(const char *ns, const BSONObj &op) {
+            LOCK_REASON(lockReason, "repl: rolling back batched insert");
+            Client::ReadContext ctx(ns, lockReason);
+            Collection *cl = getCollection(ns);
+            for (BSONObjIterator it(op[KEY_STR_ROW].Obj()); it.more(); ) {
+                runRowDelete(it.next().Obj(), cl);
+            }
+        }
+
         static void runCappedDeleteFromOplog(const char *ns, const BSONObj &op) {
             LOCK_REASON(lockReason, "repl: applying capped delete");
             Client::ReadContext ctx(ns, lockReason);
@@ -602,12 +703,11 @@ namespace mongo {
         }
 
         static void runCommandFromOplog(const char *ns, const BSONObj &op) {
-            BufBuilder bb;
             BSONObjBuilder ob;
 
             // Locking and context are handled in _runCommands
             const BSONObj command = op[KEY_STR_ROW].embeddedObject();
-            bool ret = _runCommands(ns, command, bb, ob, true, 0);
+            bool ret = _runCommands(ns, command, ob, true, 0);
             massert(17220, str::stream() << "Command " << op.str() << " failed under runCommandFromOplog: " << ob.done(), ret);
         }
 
@@ -681,6 +781,10 @@ namespace mongo {
                 opCounters->gotInsert();
                 runInsertFromOplog(ns, op);
             }
+            else if (strcmp(opType, OP_STR_INSERT_BATCH) == 0) {
+                opCounters->gotInsert(op[KEY_STR_ROW].Obj().nFields());
+                runInsertBatchFromOplog(ns, op);
+            }
             else if (strcmp(opType, OP_STR_UPDATE) == 0) {
                 opCounters->gotUpdate();
                 runUpdateFromOplog(ns, op, false);
@@ -722,6 +826,33 @@ namespace mongo {
             }
         }
 
+        bool namespaceForApplyConflicts(const BSONObj& op, string& ns) {
+            const char *names[] = {
+                KEY_STR_NS,
+                KEY_STR_OP_NAME
+                };
+            BSONElement fields[2];
+            op.getFields(2, names, fields);
+            const char *opType = fields[1].valuestrsafe();
+            if (strcmp(opType, OP_STR_COMMENT) == 0) {
+                ns = "";
+                return true;
+            }
+            if (strcmp(opType, OP_STR_COMMAND) == 0) {
+                // commands may touch any collection in the database (drop,
+                // renameCollection, ...), so they cannot overlap with anything
+                return false;
+            }
+            const StringData opNs = fields[0].valuestrsafe();
+            if (opNs.empty() || NamespaceString::isSystem(opNs)) {
+                // an insert into system.indexes builds an index on another
+                // collection, be conservative with all system collections
+                return false;
+            }
+            ns = opNs.toString();
+            return true;
+        }
+
         static void runRollbackInsertFromOplog(const char *ns, const BSONObj &op) {
             // handle add index case
             if (nsToCollectionSubstring(ns) == "system.indexes") {
@@ -746,6 +877,9 @@ namespace mongo {
             if (strcmp(opType, OP_STR_INSERT) == 0) {
                 runRollbackInsertFromOplog(ns, op);
             }
+            else if (strcmp(opType, OP_STR_INSERT_BATCH) == 0) {
+                runRollbackInsertBatchFromOplog(ns, op);
+            }
             else if (strcmp(opType, OP_STR_UPDATE) == 0) {
                 runUpdateFromOplog(ns, op, true);
             }
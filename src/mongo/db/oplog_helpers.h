@@ -33,6 +33,9 @@ namespace mongo {
 
         void logInsert(const char *ns, const BSONObj &row, bool fromMigrate);
 
+        // Logs a batch of inserts as one entry, or a few if the rows are large.
+        void logInserts(const char *ns, const vector<BSONObj> &rows, bool fromMigrate);
+
         void logInsertForCapped(const char *ns, const BSONObj &pk, const BSONObj &row);
 
         void logUpdate(const char *ns, const BSONObj &pk, const BSONObj &oldObj, const BSONObj &newObj, bool fromMigrate);
@@ -58,6 +61,12 @@ namespace mongo {
 
         void rollbackOperationFromOplog(const BSONObj& op);
 
+        // Used by secondaries to decide which transactions may be applied concurrently.
+        // Returns false if op must be applied in isolation from every other transaction
+        // (commands, index builds, writes to system collections). Otherwise, sets ns to
+        // the collection op writes to, or to the empty string if op writes nothing.
+        bool namespaceForApplyConflicts(const BSONObj& op, string& ns);
+
     }
 
 } // namespace mongo
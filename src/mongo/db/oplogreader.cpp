@@ -22,6 +22,8 @@
 #include "mongo/db/ops/update.h"
 
 namespace mongo {
+    extern bool networkCompression;
+
     const BSONObj reverseIDObj = BSON( "_id" << -1 );
 
     BSONObj userReplQuery = fromjson("{\"user\":\"repl\"}");
@@ -160,6 +162,9 @@ namespace mongo {
                 log() << "repl: " << errmsg << endl;
                 return false;
             }
+            if (networkCompression) {
+                _conn->negotiateCompression();
+            }
         }
         return true;
     }
@@ -54,40 +54,35 @@ namespace mongo {
         cl->notifyOfWriteOp();
     }
 
-    // Does not check magic system collection inserts.
-    void _insertObjects(const char *ns, const vector<BSONObj> &objs, bool keepGoing, uint64_t flags, bool logop, bool fromMigrate ) {
-        Collection *cl = getOrCreateCollection(ns, logop);
+    void insertManyObjects(Collection *cl, vector<BSONObj> &objs, bool keepGoing, uint64_t flags) {
+        cl->insertObjects(objs, flags, keepGoing);
+        cl->notifyOfWriteOp();
+    }
+
+    static void insertCappedObjects(Collection *cl, const vector<BSONObj> &objs, bool keepGoing, uint64_t flags, bool logop) {
         for (size_t i = 0; i < objs.size(); i++) {
             const BSONObj &obj = objs[i];
             try {
                 BSONObj objModified = obj;
                 BSONElementManipulator::lookForTimestamps(objModified);
-                if (cl->isCapped()) {
-                    if (cc().txnStackSize() > 1) {
-                        // This is a nightmare to maintain transactionally correct.
-                        // Capped collections will be deprecated one day anyway.
-                        // They are an anathma.
-                        uasserted(17228, "Cannot insert into a capped collection in a multi-statement transaction.");
-                    }
-                    if (logop) {
-                        // special case capped colletions until all oplog writing
-                        // for inserts is handled in the collection class, not here.
-                        validateInsert(obj);
-                        CappedCollection *cappedCl = cl->as<CappedCollection>();
-                        bool indexBitChanged = false; // need to initialize this
-                        cappedCl->insertObjectAndLogOps(objModified, flags, &indexBitChanged);
-                        // Hack copied from Collection::insertObject. TODO: find a better way to do this                        
-                        if (indexBitChanged) {
-                            cl->noteMultiKeyChanged();
-                        }
-                        cl->notifyOfWriteOp();
-                    }
+                if (cc().txnStackSize() > 1) {
+                    // This is a nightmare to maintain transactionally correct.
+                    // Capped collections will be deprecated one day anyway.
+                    // They are an anathma.
+                    uasserted(17228, "Cannot insert into a capped collection in a multi-statement transaction.");
                 }
-                else {
-                    insertOneObject(cl, objModified, flags); // may add _id field
-                    if (logop) {
-                        OplogHelpers::logInsert(ns, objModified, fromMigrate);
+                if (logop) {
+                    // special case capped colletions until all oplog writing
+                    // for inserts is handled in the collection class, not here.
+                    validateInsert(obj);
+                    CappedCollection *cappedCl = cl->as<CappedCollection>();
+                    bool indexBitChanged = false; // need to initialize this
+                    cappedCl->insertObjectAndLogOps(objModified, flags, &indexBitChanged);
+                    // Hack copied from Collection::insertObject. TODO: find a better way to do this                        
+                    if (indexBitChanged) {
+                        cl->noteMultiKeyChanged();
                     }
+                    cl->notifyOfWriteOp();
                 }
             } catch (const UserException &) {
                 if (!keepGoing || i == objs.size() - 1) {
@@ -97,6 +92,26 @@ namespace mongo {
         }
     }
 
+    // Does not check magic system collection inserts.
+    void _insertObjects(const char *ns, const vector<BSONObj> &objs, bool keepGoing, uint64_t flags, bool logop, bool fromMigrate ) {
+        Collection *cl = getOrCreateCollection(ns, logop);
+        if (cl->isCapped()) {
+            insertCappedObjects(cl, objs, keepGoing, flags, logop);
+            return;
+        }
+
+        // The whole batch goes into the collection at once, and into the oplog
+        // as one entry (see OplogHelpers::logInserts).
+        vector<BSONObj> batch(objs);
+        for (vector<BSONObj>::iterator it = batch.begin(); it != batch.end(); ++it) {
+            BSONElementManipulator::lookForTimestamps(*it);
+        }
+        insertManyObjects(cl, batch, keepGoing, flags); // may add _id fields
+        if (logop) {
+            OplogHelpers::logInserts(ns, batch, fromMigrate);
+        }
+    }
+
     static BSONObj stripDropDups(const BSONObj &obj) {
         BSONObjBuilder b;
         for (BSONObjIterator it(obj); it.more(); ) {
@@ -31,10 +31,14 @@ namespace mongo {
     // Insert an object into the given namespace. May modify the object (ie: maybe add _id field). Does not log.
     void insertOneObject(Collection *cl, BSONObj &obj, uint64_t flags = 0);
 
+    // Insert a batch of objects into the given namespace in one pass. On return, objs holds
+    // the objects that were inserted (maybe with an added _id field), in order. Does not log.
+    void insertManyObjects(Collection *cl, vector<BSONObj> &objs, bool keepGoing, uint64_t flags = 0);
+
     // Internal-use only: Does not check magic system collection inserts.
     void _insertObjects(const char *ns, const vector<BSONObj> &objs, bool keepGoing, uint64_t flags, bool logop, bool fromMigrate = false);
 
-    // Insert a vector of objects into the given namespace, logging each operation individually.
+    // Insert a vector of objects into the given namespace, logging them as one batch.
     void insertObjects(const char *ns, const vector<BSONObj> &objs, bool keepGoing, uint64_t flags, bool logop, bool fromMigrate = false);
 
     // Insert an object into the given namespace. Logs the operation.
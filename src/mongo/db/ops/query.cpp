@@ -43,9 +43,9 @@ namespace mongo {
     */
     const int32_t MaxBytesToReturnToClientAtOnce = 4 * 1024 * 1024;
 
-    bool runCommands(const char *ns, BSONObj& jsobj, CurOp& curop, BufBuilder &b, BSONObjBuilder& anObjBuilder, bool fromRepl, int queryOptions) {
+    bool runCommands(const char *ns, BSONObj& jsobj, CurOp& curop, BSONObjBuilder& anObjBuilder, bool fromRepl, int queryOptions) {
         try {
-            return _runCommands(ns, jsobj, b, anObjBuilder, fromRepl, queryOptions);
+            return _runCommands(ns, jsobj, anObjBuilder, fromRepl, queryOptions);
         }
         catch( SendStaleConfigException& ){
             throw;
@@ -58,8 +58,7 @@ namespace mongo {
         }
         anObjBuilder.append("errmsg", "db assertion failure");
         anObjBuilder.append("ok", 0.0);
-        BSONObj x = anObjBuilder.done();
-        b.appendBuf((void*) x.objdata(), x.objsize());
+        anObjBuilder.done();
         return true;
     }
 
@@ -409,17 +408,21 @@ namespace mongo {
     ReorderBuildStrategy* ReorderBuildStrategy::make( const ParsedQuery& parsedQuery,
                                                       const shared_ptr<Cursor>& cursor,
                                                       BufBuilder& buf,
-                                                      const QueryPlanSummary& queryPlan ) {
-        auto_ptr<ReorderBuildStrategy> ret( new ReorderBuildStrategy( parsedQuery, cursor, buf ) );
+                                                      const QueryPlanSummary& queryPlan,
+                                                      const bool inHybrid ) {
+        auto_ptr<ReorderBuildStrategy> ret( new ReorderBuildStrategy( parsedQuery, cursor, buf,
+                                                                      inHybrid ) );
         ret->init( queryPlan );
         return ret.release();
     }
 
     ReorderBuildStrategy::ReorderBuildStrategy( const ParsedQuery &parsedQuery,
                                                const shared_ptr<Cursor> &cursor,
-                                               BufBuilder &buf ) :
+                                               BufBuilder &buf,
+                                               const bool inHybrid ) :
     ResponseBuildStrategy( parsedQuery, cursor, buf ),
-    _bufferedMatches() {
+    _bufferedMatches(),
+    _inHybrid( inHybrid ) {
     }
     
     void ReorderBuildStrategy::init( const QueryPlanSummary &queryPlan ) {
@@ -436,16 +439,35 @@ namespace mongo {
     }
     
     void ReorderBuildStrategy::_handleMatchNoDedup( ResultDetails* resultDetails ) {
-        _scanAndOrder->add( current( false, resultDetails ) );
+        _scanAndOrder->add( current( false, resultDetails ), _cursor->currPK() );
     }
 
     int ReorderBuildStrategy::rewriteMatches() {
         cc().curop()->debug().scanAndOrder = true;
         int ret = 0;
         _scanAndOrder->fill( _buf, &_parsedQuery, ret );
+        uassert( ScanAndOrderMemoryLimitExceededAssertionCode,
+                 "too much data for sort() with no index.  add an index or specify a smaller limit",
+                 !_scanAndOrder->more() || _canStream() );
         _bufferedMatches = ret;
         return ret;
     }
+
+    bool ReorderBuildStrategy::_canStream() const {
+        // The rest of the results are left to getMore, which can't redo a positional
+        // projection's match, and explain and single batch queries have no getMore.
+        const Projection *fields = _parsedQuery.getFields();
+        return !_inHybrid && !_parsedQuery.isExplain() && _parsedQuery.wantMore() &&
+               _parsedQuery.getNumToReturn() != 1 &&
+               !( fields && fields->getArrayOpType() == Projection::ARRAY_OP_POSITIONAL );
+    }
+
+    shared_ptr<Cursor> ReorderBuildStrategy::remainingResults() {
+        if ( !_scanAndOrder->more() ) {
+            return shared_ptr<Cursor>();
+        }
+        return shared_ptr<Cursor>( new ScanAndOrderCursor( _scanAndOrder, _cursor->nscanned() ) );
+    }
     
     ScanAndOrder *
     ReorderBuildStrategy::newScanAndOrder( const QueryPlanSummary &queryPlan ) const {
@@ -460,10 +482,16 @@ namespace mongo {
             fieldRangeSet = _queryOptimizerCursor->initialFieldRangeSet();
         }
         verify( fieldRangeSet );
+        // returnKey results aren't documents, they can't be fetched again
+        const Collection *cl = NULL;
+        if ( !_inHybrid && !_parsedQuery.returnKey() ) {
+            cl = getCollection( _parsedQuery.ns() );
+        }
         return new ScanAndOrder( _parsedQuery.getSkip(),
                                 _parsedQuery.getNumToReturn(),
                                 _parsedQuery.getOrder(),
-                                *fieldRangeSet );
+                                *fieldRangeSet,
+                                cl );
     }
 
     HybridBuildStrategy* HybridBuildStrategy::make( const ParsedQuery& parsedQuery,
@@ -484,7 +512,7 @@ namespace mongo {
 
     void HybridBuildStrategy::init() {
         _reorderBuild.reset( ReorderBuildStrategy::make( _parsedQuery, _cursor, _buf,
-                                                         QueryPlanSummary() ) );
+                                                         QueryPlanSummary(), true ) );
     }
 
     bool HybridBuildStrategy::handleMatch( ResultDetails* resultDetails ) {
@@ -804,6 +832,13 @@ namespace mongo {
         
         int nReturned = queryResponseBuilder->handoff( result );
 
+        // Sorted results that didn't fit in the first batch are left to getMore.
+        shared_ptr<Cursor> remainingResults = queryResponseBuilder->remainingResults();
+        if ( remainingResults ) {
+            cursor = remainingResults;
+            saveClientCursor = true;
+        }
+
         ccPointer.reset();
         long long cursorid = 0;
         if ( saveClientCursor ) {
@@ -882,6 +917,13 @@ namespace mongo {
             }
         }
 
+        if ( found && !pq.getFields() ) {
+            // The document found is owned, so it's sent as is without copying it.
+            replyToQueryHoldingObj( ResultFlag_AwaitCapable, result, resObject );
+            curop.debug().responseLength = result.header()->len;
+            return true;
+        }
+
         BufBuilder bb(sizeof(QueryResult)+resObject.objsize()+32);
         bb.skip(sizeof(QueryResult));
 
@@ -933,24 +975,14 @@ namespace mongo {
         
         if ( pq.couldBeCommand() ) {
             curop.markCommand();
-            BufBuilder bb;
-            bb.skip(sizeof(QueryResult));
             BSONObjBuilder cmdResBuf;
-            if ( runCommands(ns, jsobj, curop, bb, cmdResBuf, false, queryOptions) ) {
+            if ( runCommands(ns, jsobj, curop, cmdResBuf, false, queryOptions) ) {
                 curop.debug().iscommand = true;
                 curop.debug().query = jsobj;
 
-                auto_ptr< QueryResult > qr;
-                qr.reset( (QueryResult *) bb.buf() );
-                bb.decouple();
-                qr->setResultFlagsToOk();
-                qr->len = bb.len();
-                curop.debug().responseLength = bb.len();
-                qr->setOperation(opReply);
-                qr->cursorId = 0;
-                qr->startingFrom = 0;
-                qr->nReturned = 1;
-                result.setData( qr.release(), true );
+                // The result is sent from the builder's buffer, without copying it.
+                replyToQueryHoldingObj( ResultFlag_AwaitCapable, result, cmdResBuf.obj() );
+                curop.debug().responseLength = result.header()->len;
             }
             else {
                 uasserted(13530, "bad or malformed command request?");
@@ -980,6 +1012,13 @@ namespace mongo {
         OpSettings settings;
         settings.setQueryCursorMode(DEFAULT_LOCK_CURSOR);
         settings.setBulkFetch(true);
+        // A limit or batch size tells index cursors how many rows the first batch
+        // will consume, so they don't bulk fetch more than that up front.
+        if (pq.getNumToReturn() > 0) {
+            const long long rowsWanted = (long long) pq.getSkip() + pq.getNumToReturn();
+            settings.setBulkFetchRowsWanted(rowsWanted < numeric_limits<int>::max()
+                                            ? rowsWanted : numeric_limits<int>::max());
+        }
         settings.setCappedAppendPK(pq.hasOption(QueryOption_AddHiddenPK));
         cc().setOpSettings(settings);
 
@@ -173,6 +173,11 @@ namespace mongo {
          * to getMore.
          */
         virtual void finishedFirstBatch() {}
+        /**
+         * @return a cursor over the results rewriteMatches() left out of the buffer, for getMore,
+         * or an empty pointer if it left none.
+         */
+        virtual shared_ptr<Cursor> remainingResults() { return shared_ptr<Cursor>(); }
         /** Reset the buffer. */
         void resetBuf();
     protected:
@@ -205,23 +210,34 @@ namespace mongo {
     /** Build strategy for a cursor returning out of order results. */
     class ReorderBuildStrategy : public ResponseBuildStrategy {
     public:
+        /**
+         * @param inHybrid if set, the documents are kept in memory and exceeding the
+         * ScanAndOrder memory limit throws, so a HybridBuildStrategy can fall back on an in
+         * order plan. Otherwise only sort keys and pks are kept, and spilled to disk if needed.
+         */
         static ReorderBuildStrategy* make( const ParsedQuery& parsedQuery,
                                            const shared_ptr<Cursor>& cursor,
                                            BufBuilder& buf,
-                                           const QueryPlanSummary& queryPlan );
+                                           const QueryPlanSummary& queryPlan,
+                                           const bool inHybrid = false );
         virtual bool handleMatch( ResultDetails* resultDetails );
         /** Handle a match without performing deduping. */
         void _handleMatchNoDedup( ResultDetails* resultDetails );
         virtual int rewriteMatches();
         virtual int bufferedMatches() const { return _bufferedMatches; }
+        virtual shared_ptr<Cursor> remainingResults();
     private:
         ReorderBuildStrategy( const ParsedQuery& parsedQuery,
                               const shared_ptr<Cursor>& cursor,
-                              BufBuilder& buf );
+                              BufBuilder& buf,
+                              const bool inHybrid );
         void init( const QueryPlanSummary& queryPlan );
         ScanAndOrder *newScanAndOrder( const QueryPlanSummary &queryPlan ) const;
+        /** @return true if results that don't fit in the first batch can be left to getMore. */
+        bool _canStream() const;
         shared_ptr<ScanAndOrder> _scanAndOrder;
         int _bufferedMatches;
+        const bool _inHybrid;
     };
 
 
@@ -280,6 +296,11 @@ namespace mongo {
          * @return the number of results in the buffer.
          */
         int handoff( Message &result );
+        /**
+         * @return a cursor over the sorted results that didn't fit in the buffer handoff()
+         * returned, or an empty pointer if they all did.
+         */
+        shared_ptr<Cursor> remainingResults() { return _builder->remainingResults(); }
         /** A chunk manager found at the beginning of the query. */
         ShardChunkManagerPtr chunkManager() const { return _chunkManager; }
 
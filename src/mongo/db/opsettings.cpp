@@ -26,7 +26,8 @@ namespace mongo {
         _queryCursorMode(DEFAULT_LOCK_CURSOR),
         _shouldBulkFetch(false),
         _shouldAppendPKForCapped(false),
-        _justOne(false) {
+        _justOne(false),
+        _bulkFetchRowsWanted(0) {
     }
 
     OpSettings& OpSettings::setQueryCursorMode(QueryCursorMode mode) {
@@ -65,4 +66,13 @@ namespace mongo {
         return *this;
     }
 
+    int OpSettings::getBulkFetchRowsWanted() {
+        return _bulkFetchRowsWanted;
+    }
+
+    OpSettings &OpSettings::setBulkFetchRowsWanted(int val) {
+        _bulkFetchRowsWanted = val;
+        return *this;
+    }
+
 } // namespace mongo
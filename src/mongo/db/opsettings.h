@@ -31,6 +31,7 @@ namespace mongo {
         bool _shouldBulkFetch; // default false
         bool _shouldAppendPKForCapped; // if true, cursor->current should append the pk before returning the row
         bool _justOne; // if true, then the number of affected rows will be at most one.
+        int _bulkFetchRowsWanted; // how many rows the op expects to read, 0 if unknown
       public:
         OpSettings();
 
@@ -45,6 +46,9 @@ namespace mongo {
 
         bool getJustOne();
         OpSettings& setJustOne(bool val);
+
+        int getBulkFetchRowsWanted();
+        OpSettings& setBulkFetchRowsWanted(int val);
     };
 
 } // namespace mongo
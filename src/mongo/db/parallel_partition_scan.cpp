@@ -0,0 +1,358 @@
+// parallel_partition_scan.cpp
+
+/**
+*    Copyright (C) 2013 Tokutek Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "mongo/pch.h"
+
+#include "mongo/db/parallel_partition_scan.h"
+
+#include <boost/thread/condition.hpp>
+
+#include "mongo/base/counter.h"
+#include "mongo/db/client.h"
+#include "mongo/db/collection.h"
+#include "mongo/db/commands/server_status.h"
+#include "mongo/db/cursor.h"
+#include "mongo/db/kill_current_op.h"
+#include "mongo/db/matcher.h"
+#include "mongo/db/server_parameters.h"
+#include "mongo/util/concurrency/mutex.h"
+#include "mongo/util/concurrency/thread_pool.h"
+
+namespace mongo {
+
+    // Number of threads reading partitions for partitioned cursors, shared by all of them.
+    MONGO_EXPORT_STARTUP_SERVER_PARAMETER(partitionScanThreads, int, 8);
+
+    // How many partitions a partitioned cursor may read at once. Below two, partitions
+    // are read one at a time by the querying thread, in its own transaction.
+    MONGO_EXPORT_SERVER_PARAMETER(partitionScanParallelism, int, 0);
+
+    // How many entries each partition reads per fill.
+    MONGO_EXPORT_SERVER_PARAMETER(partitionScanBatchSize, int, 1000);
+
+    static Counter64 partitionScanFills;
+    static ServerStatusMetricField<Counter64> displayPartitionScanFills(
+            "queryExecutor.partitionScan.fills", &partitionScanFills );
+    static Counter64 partitionScanEntries;
+    static ServerStatusMetricField<Counter64> displayPartitionScanEntries(
+            "queryExecutor.partitionScan.entries", &partitionScanEntries );
+
+    // Stop filling a partition's buffer after this many bytes, whatever the batch size.
+    static const size_t maxBufferBytes = 4 * 1024 * 1024;
+
+    static SimpleMutex partitionScanPoolMutex("partitionScanPool");
+    static ThreadPool *partitionScanPool = NULL;
+
+    static ThreadPool &getPartitionScanPool() {
+        SimpleMutex::scoped_lock lk(partitionScanPoolMutex);
+        if (partitionScanPool == NULL) {
+            partitionScanPool = new ThreadPool(partitionScanThreads);
+        }
+        return *partitionScanPool;
+    }
+
+    static size_t batchSize() {
+        return std::max(partitionScanBatchSize, 2);
+    }
+
+    static size_t entryBytes(const ParallelPartitionScan::Entry &e) {
+        return e.key.objsize() + e.pk.objsize() + (e.obj.isEmpty() ? 0 : e.obj.objsize());
+    }
+
+    struct ParallelPartitionScan::Partition : boost::noncopyable {
+        Partition(uint64_t i) : index(i), bufferedBytes(0), done(false) { }
+
+        const uint64_t index;
+        // Declared before the cursor, so the cursor is closed before the
+        // transaction it was opened in is aborted.
+        shared_ptr<Client::TransactionStack> txnStack;
+        shared_ptr<Cursor> cursor;
+        std::deque<Entry> entries;
+        size_t bufferedBytes;
+        bool done; // the cursor has nothing more to read
+    };
+
+    struct ParallelPartitionScan::FillState : boost::noncopyable {
+        FillState(size_t n) : mutex("partitionScanFill"), pending(n), failed(false), code(0) { }
+
+        mongo::mutex mutex;
+        boost::condition cond;
+        size_t pending;
+        bool failed;
+        int code;
+        string errmsg;
+    };
+
+    bool ParallelPartitionScan::enabled() {
+        if (partitionScanThreads <= 0 || partitionScanParallelism < 2) {
+            return false;
+        }
+        // Multi-statement transactions are never read only, so this also
+        // keeps us from reading around one's own writes.
+        Client &c = cc();
+        if (c.txnStackSize() != 1) {
+            return false;
+        }
+        const TxnContext &txn = c.txn();
+        return txn.readOnly() && !txn.serializable();
+    }
+
+    size_t ParallelPartitionScan::parallelism() {
+        return std::max(partitionScanParallelism, 1);
+    }
+
+    ParallelPartitionScan::ParallelPartitionScan(const shared_ptr<SubPartitionCursorGenerator> &generator,
+                                                 const vector<uint64_t> &partitions,
+                                                 const shared_ptr<CoveredIndexMatcher> &matcher,
+                                                 const shared_ptr<Projection::KeyOnly> &keyFieldsOnly) :
+        _generator(generator),
+        _opSettings(cc().opSettings()),
+        _keyFieldsOnly(keyFieldsOnly) {
+        setMatcher(matcher);
+
+        // Begin every partition's transaction now, so their snapshots are
+        // taken together.
+        const int flags = cc().txn().flags();
+        for (vector<uint64_t>::const_iterator it = partitions.begin(); it != partitions.end(); ++it) {
+            shared_ptr<Partition> p(new Partition(*it));
+            Client::AlternateTransactionStack altStack;
+            cc().beginClientTxn(flags);
+            cc().swapTransactionStack(p->txnStack);
+            _partitions.push_back(p);
+        }
+    }
+
+    ParallelPartitionScan::~ParallelPartitionScan() {
+        // Aborting the partitions' transactions resets the client's root
+        // transaction id, put the caller's back afterwards.
+        if (haveClient()) {
+            Client::AlternateTransactionStack altStack;
+            _partitions.clear();
+        }
+    }
+
+    uint64_t ParallelPartitionScan::partitionIndex(size_t i) const {
+        return _partitions[i]->index;
+    }
+
+    bool ParallelPartitionScan::hasEntry(size_t i) const {
+        return !_partitions[i]->entries.empty();
+    }
+
+    const ParallelPartitionScan::Entry &ParallelPartitionScan::front(size_t i) const {
+        dassert(hasEntry(i));
+        return _partitions[i]->entries.front();
+    }
+
+    BSONObj ParallelPartitionScan::current(size_t i) {
+        Partition &p = *_partitions[i];
+        Entry &e = p.entries.front();
+        if (e.obj.isEmpty()) {
+            // No pool thread runs outside fill(), so we may use the
+            // partition's transaction here.
+            Client::AlternateTransactionStack altStack;
+            Client::WithTxnStack wts(p.txnStack);
+            shared_ptr<CollectionData> cd = _generator->collection()->getPartition(p.index);
+            BSONObj obj;
+            if (cd->findByPK(e.pk, obj)) {
+                e.obj = obj.getOwned();
+                p.bufferedBytes += e.obj.objsize();
+            }
+        }
+        return e.obj;
+    }
+
+    bool ParallelPartitionScan::currentMatches(size_t i, Cursor *cursor, CoveredIndexMatcher *matcher,
+                                               MatchDetails *details) {
+        const Entry &e = front(i);
+        if (matcher == NULL || (e.matcherApplied && details == NULL)) {
+            return true;
+        }
+        return matcher->matchesCurrent(cursor, details);
+    }
+
+    void ParallelPartitionScan::pop(size_t i) {
+        Partition &p = *_partitions[i];
+        dassert(!p.entries.empty());
+        p.bufferedBytes -= entryBytes(p.entries.front());
+        p.entries.pop_front();
+    }
+
+    bool ParallelPartitionScan::exhausted(size_t i) const {
+        const Partition &p = *_partitions[i];
+        return p.done && p.entries.empty();
+    }
+
+    bool ParallelPartitionScan::wantsFill(size_t i) const {
+        const Partition &p = *_partitions[i];
+        return !p.done && p.entries.size() <= batchSize() / 2 && p.bufferedBytes <= maxBufferBytes / 2;
+    }
+
+    void ParallelPartitionScan::fill(const vector<size_t> &which) {
+        vector<shared_ptr<Partition> > toRead;
+        for (vector<size_t>::const_iterator it = which.begin(); it != which.end(); ++it) {
+            if (!_partitions[*it]->done) {
+                toRead.push_back(_partitions[*it]);
+            }
+        }
+        if (toRead.empty()) {
+            return;
+        }
+
+        // The pool threads don't notice killOp, so check between fills.
+        killCurrentOp.checkForInterrupt();
+
+        shared_ptr<FillState> state(new FillState(toRead.size()));
+        ThreadPool &pool = getPartitionScanPool();
+        for (vector<shared_ptr<Partition> >::const_iterator it = toRead.begin(); it != toRead.end(); ++it) {
+            pool.schedule(&ParallelPartitionScan::run, this, state, *it);
+        }
+        {
+            mongo::mutex::scoped_lock lk(state->mutex);
+            while (state->pending > 0) {
+                state->cond.wait(lk.boost());
+            }
+        }
+        partitionScanFills.increment();
+        if (state->failed) {
+            uasserted(state->code, state->errmsg);
+        }
+    }
+
+    void ParallelPartitionScan::run(ParallelPartitionScan *scan, shared_ptr<FillState> state,
+                                    shared_ptr<Partition> partition) {
+        bool failed = false;
+        int code = 0;
+        string errmsg;
+        try {
+            scan->read(*partition);
+        } catch (const DBException &e) {
+            failed = true;
+            code = e.getCode();
+            errmsg = e.what();
+        } catch (const std::exception &e) {
+            failed = true;
+            code = 17367;
+            errmsg = str::stream() << "error reading partition " << partition->index << ": " << e.what();
+        }
+
+        mongo::mutex::scoped_lock lk(state->mutex);
+        if (failed && !state->failed) {
+            state->failed = true;
+            state->code = code;
+            state->errmsg = errmsg;
+        }
+        if (--state->pending == 0) {
+            state->cond.notify_all();
+        }
+    }
+
+    void ParallelPartitionScan::read(Partition &p) {
+        Client::initThreadIfNotAlready("partitionScan");
+        cc().setOpSettings(_opSettings);
+        Client::WithTxnStack wts(p.txnStack);
+
+        if (!p.cursor) {
+            p.cursor = _generator->makeSubCursor(p.index);
+            if (_matcher) {
+                p.cursor->setMatcher(_matcher);
+            }
+            p.cursor->setKeyFieldsOnly(_keyFieldsOnly);
+        }
+
+        // Entries the partition's cursor rules out are dropped here, but
+        // still count toward the batch so a fill doesn't run unbounded.
+        const bool countCursor = _generator->countCursor();
+        const bool matcherApplied = _matcher.get() != NULL;
+        size_t examined = 0;
+        size_t buffered = 0;
+        Cursor *c = p.cursor.get();
+        for (; c->ok() && examined < batchSize() && p.bufferedBytes < maxBufferBytes; c->advance()) {
+            examined++;
+            if (!c->currentMatches()) {
+                continue;
+            }
+            Entry e;
+            e.key = c->currKey().getOwned();
+            e.pk = c->currPK().getOwned();
+            if (!countCursor) {
+                e.obj = c->current().getOwned();
+            }
+            e.matcherApplied = matcherApplied;
+            p.bufferedBytes += entryBytes(e);
+            p.entries.push_back(e);
+            buffered++;
+        }
+        p.done = !c->ok();
+        partitionScanEntries.increment(buffered);
+    }
+
+    void ParallelPartitionScan::setMatcher(const shared_ptr<CoveredIndexMatcher> &matcher) {
+        // $where can't be run on the pool threads, so leave it for the caller.
+        if (matcher && matcher->docMatcher().hasWhere()) {
+            _matcher.reset();
+            return;
+        }
+        _matcher = matcher;
+        if (_matcher) {
+            for (vector<shared_ptr<Partition> >::const_iterator it = _partitions.begin(); it != _partitions.end(); ++it) {
+                if ((*it)->cursor) {
+                    (*it)->cursor->setMatcher(_matcher);
+                }
+            }
+        }
+    }
+
+    void ParallelPartitionScan::setKeyFieldsOnly(const shared_ptr<Projection::KeyOnly> &keyFieldsOnly) {
+        _keyFieldsOnly = keyFieldsOnly;
+        for (vector<shared_ptr<Partition> >::const_iterator it = _partitions.begin(); it != _partitions.end(); ++it) {
+            if ((*it)->cursor) {
+                (*it)->cursor->setKeyFieldsOnly(_keyFieldsOnly);
+            }
+        }
+    }
+
+    long long ParallelPartitionScan::nscanned() const {
+        long long n = 0;
+        for (vector<shared_ptr<Partition> >::const_iterator it = _partitions.begin(); it != _partitions.end(); ++it) {
+            if ((*it)->cursor) {
+                n += (*it)->cursor->nscanned();
+            }
+        }
+        return n;
+    }
+
+    BSONObj ParallelPartitionScan::indexKeyPattern() const {
+        for (vector<shared_ptr<Partition> >::const_iterator it = _partitions.begin(); it != _partitions.end(); ++it) {
+            if ((*it)->cursor) {
+                return (*it)->cursor->indexKeyPattern();
+            }
+        }
+        return BSONObj();
+    }
+
+    BSONObj ParallelPartitionScan::prettyIndexBounds() const {
+        for (vector<shared_ptr<Partition> >::const_iterator it = _partitions.begin(); it != _partitions.end(); ++it) {
+            if ((*it)->cursor) {
+                return (*it)->cursor->prettyIndexBounds();
+            }
+        }
+        return BSONObj();
+    }
+
+} // namespace mongo
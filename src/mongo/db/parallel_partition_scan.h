@@ -0,0 +1,147 @@
+// parallel_partition_scan.h
+
+/**
+*    Copyright (C) 2013 Tokutek Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "mongo/pch.h"
+
+#include <deque>
+
+#include "mongo/db/jsobj.h"
+#include "mongo/db/opsettings.h"
+#include "mongo/db/projection.h"
+
+namespace mongo {
+
+    class CoveredIndexMatcher;
+    class Cursor;
+    class MatchDetails;
+    class SubPartitionCursorGenerator;
+
+    /**
+     * Reads several partitions of a partitioned collection at once on a shared thread pool, for
+     * PartitionedCursor and SortedPartitionedCursor.
+     *
+     * Each partition gets its own read only transaction, with the isolation of the caller's,
+     * begun when the scan is created.  So each partition is read from its own snapshot, all of
+     * them taken together, rather than from the caller's.  The partition's cursor is made by the
+     * generator on the pool thread that first reads it.
+     *
+     * Pool threads only run inside fill(), which waits for them, so they never touch a partition
+     * while the caller isn't holding the lock it used to make the scan.
+     *
+     * Each fill reads up to partitionScanBatchSize entries of each partition it's asked to, and
+     * buffers the key, pk and, unless counting, the document of those the partition's cursor
+     * matches.
+     */
+    class ParallelPartitionScan : boost::noncopyable {
+    public:
+        struct Entry {
+            BSONObj key;
+            BSONObj pk;
+            BSONObj obj;         // empty for count cursors
+            // whether the partition's cursor had the caller's matcher when it matched
+            // this entry, or only checked its bounds
+            bool matcherApplied;
+        };
+
+        /**
+         * @return true if partitionScanParallelism allows reading partitions in parallel, and
+         *         the current transaction is a read only root transaction whose isolation the
+         *         scan can repeat
+         */
+        static bool enabled();
+
+        /**
+         * @param partitions the partitions to read, in the order the caller will consume them
+         * @param matcher the caller's matcher, if it has one yet
+         */
+        ParallelPartitionScan(const shared_ptr<SubPartitionCursorGenerator> &generator,
+                              const vector<uint64_t> &partitions,
+                              const shared_ptr<CoveredIndexMatcher> &matcher,
+                              const shared_ptr<Projection::KeyOnly> &keyFieldsOnly);
+        ~ParallelPartitionScan();
+
+        size_t size() const { return _partitions.size(); }
+
+        /** @return the partition index of the i'th partition read */
+        uint64_t partitionIndex(size_t i) const;
+
+        /** @return true if the i'th partition has an entry buffered */
+        bool hasEntry(size_t i) const;
+
+        /** @return the i'th partition's next entry, if hasEntry(i) */
+        const Entry &front(size_t i) const;
+
+        /**
+         * @return the i'th partition's next document, looking it up in the partition's
+         *         transaction if a count cursor didn't buffer it
+         */
+        BSONObj current(size_t i);
+
+        /**
+         * @return whether the i'th partition's next entry, which cursor is positioned at, matches
+         *         the caller's matcher.  Uses what the partition's cursor found if it can.
+         */
+        bool currentMatches(size_t i, Cursor *cursor, CoveredIndexMatcher *matcher,
+                            MatchDetails *details);
+
+        /** Drops the i'th partition's next entry. */
+        void pop(size_t i);
+
+        /** @return true if the i'th partition has nothing left to read, buffered or not */
+        bool exhausted(size_t i) const;
+
+        /** @return true if the i'th partition is worth reading more of now */
+        bool wantsFill(size_t i) const;
+
+        /**
+         * Tops up the buffers of each of the given partitions that has more to read, all at once
+         * on the pool, and waits until they're done.  Callers pass at most parallelism() of them.
+         * Rethrows the first error any of them hit.
+         */
+        void fill(const vector<size_t> &which);
+
+        /** @return how many partitions fill() should read at once */
+        static size_t parallelism();
+
+        void setMatcher(const shared_ptr<CoveredIndexMatcher> &matcher);
+        void setKeyFieldsOnly(const shared_ptr<Projection::KeyOnly> &keyFieldsOnly);
+
+        long long nscanned() const;
+
+        /** @return the key pattern and bounds of the first partition cursor made, if any */
+        BSONObj indexKeyPattern() const;
+        BSONObj prettyIndexBounds() const;
+
+    private:
+        struct Partition;
+        struct FillState;
+
+        static void run(ParallelPartitionScan *scan, shared_ptr<FillState> state,
+                        shared_ptr<Partition> partition);
+        void read(Partition &partition);
+
+        const shared_ptr<SubPartitionCursorGenerator> _generator;
+        const OpSettings _opSettings;
+        shared_ptr<CoveredIndexMatcher> _matcher;
+        shared_ptr<Projection::KeyOnly> _keyFieldsOnly;
+        vector<shared_ptr<Partition> > _partitions;
+    };
+
+} // namespace mongo
@@ -0,0 +1,278 @@
+// partition_rollover.cpp
+
+/**
+*    Copyright (C) 2013 Tokutek Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "mongo/pch.h"
+
+#include "mongo/db/partition_rollover.h"
+
+#include "mongo/base/counter.h"
+#include "mongo/db/collection.h"
+#include "mongo/db/commands/server_status.h"
+#include "mongo/db/databaseholder.h"
+#include "mongo/db/instance.h"
+#include "mongo/db/oplog_helpers.h"
+#include "mongo/db/replutil.h"
+#include "mongo/db/server_parameters.h"
+#include "mongo/util/background.h"
+#include "mongo/util/time_support.h"
+
+namespace mongo {
+
+    Counter64 partitionRolloverPasses;
+    Counter64 partitionRolloverAdded;
+    Counter64 partitionRolloverDropped;
+
+    ServerStatusMetricField<Counter64> partitionRolloverPassesDisplay("partitionRollover.passes", &partitionRolloverPasses);
+    ServerStatusMetricField<Counter64> partitionRolloverAddedDisplay("partitionRollover.partitionsAdded", &partitionRolloverAdded);
+    ServerStatusMetricField<Counter64> partitionRolloverDroppedDisplay("partitionRollover.partitionsDropped", &partitionRolloverDropped);
+
+    MONGO_EXPORT_SERVER_PARAMETER(partitionRolloverEnabled, bool, true);
+    MONGO_EXPORT_SERVER_PARAMETER(partitionRolloverIntervalSecs, int, 60);
+
+    PartitionPolicy::PartitionPolicy() :
+        rolloverHours(0),
+        rolloverBytes(0),
+        keepPartitions(0),
+        expireDays(0),
+        expireHours(0) {
+    }
+
+    PartitionPolicy PartitionPolicy::parse(const BSONObj &obj) {
+        PartitionPolicy policy;
+        for (BSONObjIterator it(obj); it.more(); ) {
+            BSONElement e = it.next();
+            const StringData name(e.fieldName());
+            long long *field = (name == "rolloverHours" ? &policy.rolloverHours :
+                                name == "rolloverBytes" ? &policy.rolloverBytes :
+                                name == "keepPartitions" ? &policy.keepPartitions :
+                                name == "expireDays" ? &policy.expireDays :
+                                name == "expireHours" ? &policy.expireHours :
+                                NULL);
+            uassert(17368, str::stream() << "unknown partitionPolicy field: " << name, field != NULL);
+            uassert(17369, str::stream() << "partitionPolicy field " << name << " must be a number", e.isNumber());
+            uassert(17370, str::stream() << "partitionPolicy field " << name << " must not be negative", e.numberLong() >= 0);
+            *field = e.numberLong();
+        }
+        return policy;
+    }
+
+    bool PartitionPolicy::empty() const {
+        return rolloverHours == 0 && rolloverBytes == 0 && keepPartitions == 0 && expireMillis() == 0;
+    }
+
+    uint64_t PartitionPolicy::expireMillis() const {
+        return (expireDays * 24 + expireHours) * 60 * 60 * 1000;
+    }
+
+    bool PartitionPolicy::shouldAddPartition(PartitionedCollection *pc, uint64_t now) const {
+        const uint64_t last = pc->numPartitions() - 1;
+        bool due = false;
+        if (rolloverHours > 0) {
+            BSONObj meta = pc->getPartitionMetadata(last);
+            BSONElement e = meta["createTime"];
+            massert(17371, "createTime mysteriously missing from partition metadata", e.ok());
+            const uint64_t createTime = e._numberLong();
+            due = now > createTime && now - createTime >= (uint64_t) rolloverHours * 60 * 60 * 1000;
+        }
+        if (!due && rolloverBytes > 0) {
+            CollectionData::Stats stats;
+            pc->getPartition(last)->fillCollectionStats(stats, NULL, 1);
+            due = stats.size >= (uint64_t) rolloverBytes;
+        }
+        if (!due) {
+            return false;
+        }
+        // an empty partition can't be capped without a pivot, and there would
+        // be nothing to gain from replacing it anyway
+        BSONObj maxPK;
+        return pc->getPartition(last)->getMaxPKForPartitionCap(maxPK);
+    }
+
+    bool PartitionPolicy::shouldDropPartition(PartitionedCollection *pc, uint64_t now) const {
+        const uint64_t numPartitions = pc->numPartitions();
+        if (numPartitions == 1) {
+            // the last partition is never dropped
+            return false;
+        }
+        if (keepPartitions > 0 && numPartitions > (uint64_t) keepPartitions) {
+            return true;
+        }
+        const uint64_t expire = expireMillis();
+        if (expire > 0 && now > expire) {
+            // as with the oplog, partition 0 may hold data up to the time
+            // partition 1 was created
+            BSONObj meta = pc->getPartitionMetadata(1);
+            return (uint64_t) meta["createTime"]._numberLong() <= now - expire;
+        }
+        return false;
+    }
+
+    class PartitionRolloverMonitor : public BackgroundJob {
+    public:
+        PartitionRolloverMonitor() {}
+        virtual ~PartitionRolloverMonitor() {}
+
+        virtual string name() const { return "PartitionRolloverMonitor"; }
+
+        static PartitionPolicy policyFor(Collection *cl) {
+            BSONElement e = cl->partitionPolicy();
+            return e.isABSONObj() ? PartitionPolicy::parse(e.Obj()) : PartitionPolicy();
+        }
+
+        void doRolloverForCollection(const string &ns) {
+            // check with a read lock first, so collections with nothing to do
+            // don't get write locked every pass
+            {
+                LOCK_REASON(lockReason, "partition rollover: checking partitions");
+                Client::ReadContext ctx(ns, lockReason);
+                Client::Transaction transaction(DB_TXN_SNAPSHOT);
+                Collection *cl = getCollection(ns);
+                if (cl == NULL || !cl->isPartitioned()) {
+                    // collection was dropped
+                    return;
+                }
+                PartitionPolicy policy = policyFor(cl);
+                PartitionedCollection *pc = cl->as<PartitionedCollection>();
+                const uint64_t now = curTimeMillis64();
+                const bool work = policy.shouldAddPartition(pc, now) || policy.shouldDropPartition(pc, now);
+                transaction.commit();
+                if (!work) {
+                    return;
+                }
+            }
+
+            LOCK_REASON(lockReason, "partition rollover: adding and dropping partitions");
+            Client::WriteContext ctx(ns, lockReason);
+            Client::Transaction transaction(DB_SERIALIZABLE);
+            Collection *cl = getCollection(ns);
+            if (cl == NULL || !cl->isPartitioned()) {
+                return;
+            }
+            // only add and drop partitions on the primary, secondaries get them from the oplog
+            if (!isMasterNs(ns.c_str())) {
+                return;
+            }
+            PartitionPolicy policy = policyFor(cl);
+            PartitionedCollection *pc = cl->as<PartitionedCollection>();
+            const uint64_t now = curTimeMillis64();
+
+            // add first, so keepPartitions counts the new partition
+            if (policy.shouldAddPartition(pc, now)) {
+                pc->addPartition();
+                const uint64_t numPartitions = pc->numPartitions();
+                massert(17372, str::stream() << "bad numPartitions after adding a partition " << numPartitions, numPartitions > 1);
+                BSONObj oldEnd = pc->getPartitionMetadata(numPartitions - 2);
+                BSONObj newEnd = pc->getPartitionMetadata(numPartitions - 1);
+                OplogHelpers::logAddPartition(ns.c_str(), oldEnd["max"].Obj(), newEnd);
+                partitionRolloverAdded.increment();
+                LOG(1) << "partition rollover: added partition " << newEnd["_id"] << " to " << ns << endl;
+            }
+            // we have this while loop instead of a conventional for-loop because
+            // as we drop partitions, the indexes of the partitions shift
+            while (policy.shouldDropPartition(pc, now)) {
+                const uint64_t id = pc->getPartitionMetadata(0)["_id"].numberLong();
+                pc->dropPartition(id);
+                OplogHelpers::logDropPartition(ns.c_str(), id);
+                partitionRolloverDropped.increment();
+                LOG(1) << "partition rollover: dropped partition " << id << " of " << ns << endl;
+            }
+            transaction.commit();
+        }
+
+        void doRolloverForDB(const string &dbName) {
+            if (!isMasterNs(dbName.c_str())) {
+                return;
+            }
+
+            Client::GodScope god;
+
+            vector<string> namespaces;
+            {
+                auto_ptr<DBClientCursor> cursor =
+                                db.query(getSisterNS(dbName, "system.namespaces"),
+                                         BSON("options.partitionPolicy" << BSON("$exists" << true)));
+                if (cursor.get()) {
+                    while (cursor->more()) {
+                        namespaces.push_back(cursor->next()["name"].String());
+                    }
+                }
+            }
+
+            for (vector<string>::const_iterator it = namespaces.begin(); it != namespaces.end(); ++it) {
+                try {
+                    doRolloverForCollection(*it);
+                }
+                catch (DBException &e) {
+                    error() << "error applying partition policy of " << *it << " " << e << endl;
+                }
+            }
+        }
+
+        virtual void run() {
+            Client::initThread(name().c_str());
+
+            long long lastPass = curTimeMillis64();
+            while (!inShutdown()) {
+                // wake up often, so a shorter partitionRolloverIntervalSecs takes effect promptly
+                sleepsecs(1);
+
+                if (!partitionRolloverEnabled || cmdLine.gdb) {
+                    continue;
+                }
+                const long long now = curTimeMillis64();
+                if (now - lastPass < std::max(partitionRolloverIntervalSecs, 1) * 1000LL) {
+                    continue;
+                }
+                lastPass = now;
+
+                LOG(3) << "PartitionRolloverMonitor thread awake" << endl;
+
+                // if part of replSet but not in a readable state (e.g. during initial sync), skip.
+                if (theReplSet && !theReplSet->state().readable()) {
+                    continue;
+                }
+
+                set<string> dbs;
+                {
+                    LOCK_REASON(lockReason, "partition rollover: getting list of dbs");
+                    Lock::DBRead lk("local", lockReason);
+                    dbHolder().getAllShortNames(dbs);
+                }
+
+                partitionRolloverPasses.increment();
+
+                for (set<string>::const_iterator i = dbs.begin(); i != dbs.end(); ++i) {
+                    try {
+                        doRolloverForDB(*i);
+                    }
+                    catch (DBException &e) {
+                        error() << "error processing partition rollover for db: " << *i << " " << e << endl;
+                    }
+                }
+            }
+        }
+
+        DBDirectClient db;
+    };
+
+    void startPartitionRolloverBackgroundJob() {
+        PartitionRolloverMonitor *monitor = new PartitionRolloverMonitor();
+        monitor->go();
+    }
+
+} // namespace mongo
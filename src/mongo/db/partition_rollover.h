@@ -0,0 +1,70 @@
+// partition_rollover.h
+
+/**
+*    Copyright (C) 2013 Tokutek Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "mongo/pch.h"
+
+#include "mongo/db/jsobj.h"
+
+namespace mongo {
+
+    class PartitionedCollection;
+
+    /**
+     * When to add and drop partitions of a partitioned collection, kept in the collection's
+     * options as partitionPolicy, e.g.
+     *
+     *   { rolloverHours: 24, rolloverBytes: 1 << 30, keepPartitions: 30, expireDays: 30 }
+     *
+     * A new partition is added once the last one is rolloverHours old or holds rolloverBytes,
+     * whichever comes first, provided it isn't empty.  The first partition is dropped while
+     * there are more than keepPartitions of them, or while everything in it is older than
+     * expireDays and expireHours, judging by the create time of the partition after it, as the
+     * oplog is trimmed.  A field left out or set to 0 is never reached.
+     */
+    struct PartitionPolicy {
+        long long rolloverHours;
+        long long rolloverBytes;
+        long long keepPartitions;
+        long long expireDays;
+        long long expireHours;
+
+        PartitionPolicy();
+
+        /** Parses and validates a partitionPolicy, uasserting if it is malformed. */
+        static PartitionPolicy parse(const BSONObj &obj);
+
+        bool empty() const;
+        uint64_t expireMillis() const;
+
+        /** @return true if the last partition of pc should be capped and a new one added */
+        bool shouldAddPartition(PartitionedCollection *pc, uint64_t now) const;
+
+        /** @return true if the first partition of pc should be dropped */
+        bool shouldDropPartition(PartitionedCollection *pc, uint64_t now) const;
+    };
+
+    /**
+     * Once every partitionRolloverIntervalSecs, applies the partitionPolicy of each partitioned
+     * collection that has one, on the primary.  The partitions it adds and drops are logged as
+     * addPartition and dropPartition would, so secondaries follow.
+     */
+    void startPartitionRolloverBackgroundJob();
+
+} // namespace mongo
@@ -29,6 +29,7 @@
 #include "db/pipeline/value.h"
 #include "util/string_writer.h"
 #include "mongo/db/projection.h"
+#include "mongo/db/spill_file.h"
 #include "mongo/db/client.h"
 #include "mongo/s/shard.h"
 
@@ -872,6 +873,18 @@ namespace mongo {
         void populateOne();  // limit == 1
         void populateTopK(); // limit > 1
 
+        /*
+          With allowDiskUse, populateAll() sorts the documents a memory
+          limit's worth at a time, writing each batch to a run in
+          spillFile. The runs are then merged as the documents are asked
+          for, with documents only holding the current one.
+         */
+        void spill();
+        void startMerge();
+        void mergeNext();
+        scoped_ptr<SpillFile> spillFile;
+        vector<shared_ptr<SpillFile::Reader> > runReaders;
+
         /* these two parallel each other */
         typedef vector<intrusive_ptr<ExpressionFieldPath> > SortPaths;
         SortPaths vSortKey;
@@ -903,6 +916,23 @@ namespace mongo {
 
         deque<KeyAndDoc> documents;
 
+        /* the next document of each run being merged, a heap on the sort key */
+        typedef pair<KeyAndDoc, size_t> RunDoc;
+        vector<RunDoc> mergeHeap;
+
+        /*
+          Orders the merge heap so that heap.front() is the best document.
+         */
+        class MergeComparator {
+        public:
+            explicit MergeComparator(const DocumentSourceSort& source): _source(source) {}
+            bool operator()(const RunDoc& lhs, const RunDoc& rhs) const {
+                return (_source.compare(lhs.first, rhs.first) > 0);
+            }
+        private:
+            const DocumentSourceSort& _source;
+        };
+
         intrusive_ptr<DocumentSourceLimit> limitSrc;
     };
     inline void swap(DocumentSourceSort::KeyAndDoc& l, DocumentSourceSort::KeyAndDoc& r) {
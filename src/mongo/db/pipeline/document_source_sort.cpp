@@ -25,10 +25,15 @@
 #include "db/pipeline/expression.h"
 #include "db/pipeline/expression_context.h"
 #include "db/pipeline/value.h"
+#include "mongo/db/server_parameters.h"
 
 namespace mongo {
     const char DocumentSourceSort::sortName[] = "$sort";
 
+    // How much memory (in MB) a $sort run with allowDiskUse may use for the
+    // documents it holds, before it writes them to disk.
+    MONGO_EXPORT_SERVER_PARAMETER(aggregationSortMemoryLimitMB, int, 100);
+
     DocumentSourceSort::~DocumentSourceSort() {
     }
 
@@ -52,6 +57,9 @@ namespace mongo {
         if (!documents.empty())
             documents.pop_front(); // this way we release memory as we go
 
+        if (documents.empty())
+            mergeNext();
+
         return !documents.empty();
     }
 
@@ -91,6 +99,9 @@ namespace mongo {
 
     void DocumentSourceSort::dispose() {
         documents.clear();
+        mergeHeap.clear();
+        runReaders.clear();
+        spillFile.reset();
         pSource->dispose();
     }
 
@@ -208,13 +219,37 @@ namespace mongo {
     }
 
     void DocumentSourceSort::populateAll() {
+        /*
+          Spilling is up to the shards, mongos only merges their sorted
+          results.
+        */
+        const bool mayUseDisk = pExpCtx->getExtSortAllowed() && !pExpCtx->getInRouter();
+        const size_t memoryLimit = (size_t) max(aggregationSortMemoryLimitMB, 1) << 20;
+        size_t memoryUsed = 0;
+
         /* track and warn about how much physical memory has been used */
         DocMemMonitor dmm(this);
 
         /* pull everything from the underlying source */
         for (bool hasNext = !pSource->eof(); hasNext; hasNext = pSource->advance()) {
             documents.push_back(KeyAndDoc(pSource->getCurrent(), vSortKey));
-            dmm.addToTotal(documents.back().doc.getApproximateSize());
+            const size_t size = documents.back().doc.getApproximateSize();
+            if (!mayUseDisk) {
+                dmm.addToTotal(size);
+                continue;
+            }
+
+            memoryUsed += size;
+            if (memoryUsed > memoryLimit) {
+                spill();
+                memoryUsed = 0;
+            }
+        }
+
+        if (spillFile) {
+            spill();
+            startMerge();
+            return;
         }
 
         /* sort the list */
@@ -222,6 +257,60 @@ namespace mongo {
         sort(documents.begin(), documents.end(), comparator);
     }
 
+    void DocumentSourceSort::spill() {
+        if (!spillFile) {
+            spillFile.reset(new SpillFile("aggregateSort"));
+        }
+
+        Comparator comparator(*this);
+        sort(documents.begin(), documents.end(), comparator);
+        for (deque<KeyAndDoc>::const_iterator it = documents.begin(); it != documents.end(); ++it) {
+            BSONObjBuilder builder;
+            it->doc.toBson(&builder);
+            spillFile->append(builder.done());
+        }
+        spillFile->endRun();
+        documents.clear();
+
+        pExpCtx->checkForInterrupt();
+    }
+
+    void DocumentSourceSort::startMerge() {
+        LOG(1) << "merging " << spillFile->nRuns() << " sorted runs ("
+               << spillFile->bytesWritten() << " bytes) for " << sortName << endl;
+
+        MergeComparator comparator(*this);
+        for (size_t i = 0; i < spillFile->nRuns(); i++) {
+            runReaders.push_back(spillFile->readRun(i));
+            if (runReaders[i]->more()) {
+                mergeHeap.push_back(RunDoc(KeyAndDoc(Document(runReaders[i]->next()), vSortKey), i));
+            }
+        }
+        make_heap(mergeHeap.begin(), mergeHeap.end(), comparator);
+        mergeNext();
+    }
+
+    void DocumentSourceSort::mergeNext() {
+        if (mergeHeap.empty())
+            return;
+
+        /* the best document goes out, and the next one of its run comes in */
+        MergeComparator comparator(*this);
+        pop_heap(mergeHeap.begin(), mergeHeap.end(), comparator);
+        RunDoc &best = mergeHeap.back();
+        documents.push_back(best.first);
+
+        const size_t run = best.second;
+        if (runReaders[run]->more()) {
+            KeyAndDoc next(Document(runReaders[run]->next()), vSortKey);
+            swap(best.first, next);
+            push_heap(mergeHeap.begin(), mergeHeap.end(), comparator);
+        }
+        else {
+            mergeHeap.pop_back();
+        }
+    }
+
     void DocumentSourceSort::populateOne() {
         if (pSource->eof())
             return;
@@ -33,10 +33,12 @@ namespace mongo {
         void setDoingMerge(bool b);
         void setInShard(bool b);
         void setInRouter(bool b);
+        void setExtSortAllowed(bool b);
 
         bool getDoingMerge() const;
         bool getInShard() const;
         bool getInRouter() const;
+        bool getExtSortAllowed() const;
 
         /**
            Used by a pipeline to check for interrupts so that killOp() works.
@@ -55,6 +57,7 @@ namespace mongo {
         bool doingMerge;
         bool inShard;
         bool inRouter;
+        bool extSortAllowed; // may spill sorts to disk, see DocumentSourceSort
         unsigned intCheckCounter; // interrupt check counter
         InterruptStatus *const pStatus;
     };
@@ -77,6 +80,10 @@ namespace mongo {
         inRouter = b;
     }
 
+    inline void ExpressionContext::setExtSortAllowed(bool b) {
+        extSortAllowed = b;
+    }
+
     inline bool ExpressionContext::getDoingMerge() const {
         return doingMerge;
     }
@@ -89,4 +96,8 @@ namespace mongo {
         return inRouter;
     }
 
+    inline bool ExpressionContext::getExtSortAllowed() const {
+        return extSortAllowed;
+    }
+
 };
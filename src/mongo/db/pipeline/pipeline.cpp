@@ -33,6 +33,7 @@ namespace mongo {
     const char Pipeline::explainName[] = "explain";
     const char Pipeline::fromRouterName[] = "fromRouter";
     const char Pipeline::splitMongodPipelineName[] = "splitMongodPipeline";
+    const char Pipeline::allowDiskUseName[] = "allowDiskUse";
     const char Pipeline::serverPipelineName[] = "serverPipeline";
     const char Pipeline::mongosPipelineName[] = "mongosPipeline";
 
@@ -130,6 +131,12 @@ namespace mongo {
                 continue;
             }
 
+            /* sorts too big for memory may be spilled to disk */
+            if (!strcmp(pFieldName, allowDiskUseName)) {
+                pCtx->setExtSortAllowed(cmdElement.trueValue());
+                continue;
+            }
+
             /* check for debug options */
             if (!strcmp(pFieldName, splitMongodPipelineName)) {
                 pPipeline->splitMongodPipeline = true;
@@ -379,6 +386,10 @@ namespace mongo {
         if ((btemp = pCtx->getInRouter())) {
             pBuilder->append(fromRouterName, btemp);
         }
+
+        if ((btemp = pCtx->getExtSortAllowed())) {
+            pBuilder->append(allowDiskUseName, btemp);
+        }
     }
 
     void Pipeline::stitch() {
@@ -169,6 +169,10 @@ namespace mongo {
         return _c ? _c->nscanned() : _matchCounter.nscanned();
     }
 
+    long long QueryPlanRunner::nMatches() const {
+        return countMatches() ? _matchCounter.count() : -1;
+    }
+
     bool QueryPlanRunner::currentMatches( MatchDetails* details ) {
         if ( !_c || !_c->ok() ) {
             _matchCounter.setMatch( false );
@@ -906,7 +910,11 @@ namespace mongo {
         if ( runner.complete() ) {
             if ( _plans.mayRecordPlan() && runner.mayRecordPlan() ) {
                 runner.queryPlan().registerSelf( runner.nscanned(),
-                                                 _plans.characterizeCandidatePlans() );
+                                                 _plans.characterizeCandidatePlans(),
+                                                 runner.nMatches() );
+            }
+            else if ( _plans.usingCachedPlan() && runner.mayRecordPlan() ) {
+                runner.queryPlan().checkCachedPlanDrift( runner.nscanned(), runner.nMatches() );
             }
             _done = true;
             return holder._runner;
@@ -917,6 +925,7 @@ namespace mongo {
         if ( _plans.hasPossiblyExcludedPlans() &&
             runner.nscanned() > _plans.oldNScanned() * 10 ) {
             verify( _plans.nPlans() == 1 && _plans.firstPlan()->special().empty() );
+            runner.queryPlan().noteReplan();
             holder._offset = -runner.nscanned();
             _plans.addFallbackPlans();
             QueryPlanSet::PlanVector::const_iterator i = _plans.plans().begin();
@@ -1421,9 +1430,8 @@ namespace mongo {
         if (cl != NULL) {
             QueryCache &qc = cl->getQueryCache();
             QueryCache::Lock::Exclusive lk(qc);
-            CachedQueryPlan noCachedPlan;
-            qc.registerCachedQueryPlanForPattern( frsp._singleKey.pattern( order ), noCachedPlan );
-            qc.registerCachedQueryPlanForPattern( frsp._multiKey.pattern( order ), noCachedPlan );
+            qc.invalidateCachedQueryPlanForPattern( frsp._singleKey.pattern( order ) );
+            qc.invalidateCachedQueryPlanForPattern( frsp._multiKey.pattern( order ) );
         }
     }
     
@@ -1434,10 +1442,11 @@ namespace mongo {
             QueryCache::Lock::Shared lk(qc);
             // TODO Maybe it would make sense to return the index with the lowest
             // nscanned if there are two possibilities.
+            QueryPattern singleKeyPattern = frsp._singleKey.pattern( order );
             {
-                QueryPattern pattern = frsp._singleKey.pattern( order );
-                CachedQueryPlan cachedQueryPlan = qc.cachedQueryPlanForPattern( pattern );
+                CachedQueryPlan cachedQueryPlan = qc.cachedQueryPlanForPattern( singleKeyPattern );
                 if ( !cachedQueryPlan.indexKey().isEmpty() ) {
+                    qc.noteLookup( singleKeyPattern, true );
                     return cachedQueryPlan;
                 }
             }
@@ -1445,9 +1454,11 @@ namespace mongo {
                 QueryPattern pattern = frsp._multiKey.pattern( order );
                 CachedQueryPlan cachedQueryPlan = qc.cachedQueryPlanForPattern( pattern );
                 if ( !cachedQueryPlan.indexKey().isEmpty() ) {
+                    qc.noteLookup( pattern, true );
                     return cachedQueryPlan;
                 }
             }
+            qc.noteLookup( singleKeyPattern, false );
         }
         return CachedQueryPlan();
     }
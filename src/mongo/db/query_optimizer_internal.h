@@ -142,6 +142,9 @@ namespace mongo {
          */
         long long nscanned() const;
 
+        /** @return the number of matches this runner has counted, or -1 if it isn't counting. */
+        long long nMatches() const;
+
         BSONObj currPK() const { return _c ? _c->currPK() : BSONObj(); }
         BSONObj currKey() const { return _c ? _c->currKey() : BSONObj(); }
         BSONObj current() const { return _c ? _c->current() : BSONObj(); }
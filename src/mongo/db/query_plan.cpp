@@ -295,7 +295,8 @@ doneCheckOrder:
     }
 
     void QueryPlan::registerSelf( long long nScanned,
-                                  CandidatePlanCharacter candidatePlans ) const {
+                                  CandidatePlanCharacter candidatePlans,
+                                  long long nReturned ) const {
         // Impossible query constraints can be detected before scanning and historically could not
         // generate a QueryPattern.
         if ( _utility == Impossible ) {
@@ -307,10 +308,26 @@ doneCheckOrder:
             QueryCache &qc = cl->getQueryCache();
             QueryCache::Lock::Exclusive lk(qc);
             QueryPattern queryPattern = _frs.pattern( _order );
-            CachedQueryPlan queryPlanToCache( indexKey(), nScanned, candidatePlans );
+            CachedQueryPlan queryPlanToCache( indexKey(), nScanned, candidatePlans, nReturned );
             qc.registerCachedQueryPlanForPattern( queryPattern, queryPlanToCache );
         }
     }
+
+    void QueryPlan::checkCachedPlanDrift( long long nScanned, long long nReturned ) const {
+        Collection *cl = getCollection(ns());
+        if (cl != NULL) {
+            QueryCache &qc = cl->getQueryCache();
+            QueryCache::Lock::Exclusive lk(qc);
+            qc.checkCachedQueryPlanDrift( _frs.pattern( _order ), nScanned, nReturned );
+        }
+    }
+
+    void QueryPlan::noteReplan() const {
+        Collection *cl = getCollection(ns());
+        if (cl != NULL) {
+            cl->getQueryCache().noteReplan( _frs.pattern( _order ) );
+        }
+    }
     
     void QueryPlan::checkTableScanAllowed() const {
         if ( likely( !cmdLine.noTableScan ) )
@@ -92,8 +92,21 @@ namespace mongo {
         /** @return a new cursor based on this QueryPlan's index and FieldRangeSet. */
         shared_ptr<Cursor> newCursor(const bool requestCountingCursor = false) const;
 
-        /** Register this plan as a winner for its QueryPattern, with specified 'nscanned'. */
-        void registerSelf( long long nScanned, CandidatePlanCharacter candidatePlans ) const;
+        /**
+         * Register this plan as a winner for its QueryPattern, with specified 'nscanned' and the
+         * 'nreturned' found while scanning them (-1 if unknown).
+         */
+        void registerSelf( long long nScanned, CandidatePlanCharacter candidatePlans,
+                           long long nReturned = -1 ) const;
+
+        /**
+         * This plan ran as the cached plan for its QueryPattern.  Drop it from the cache if it
+         * scanned much more per match than when it was registered.
+         */
+        void checkCachedPlanDrift( long long nScanned, long long nReturned ) const;
+
+        /** This plan ran as the cached plan but is now being raced against other plans. */
+        void noteReplan() const;
 
         int direction() const { return _direction; }
 
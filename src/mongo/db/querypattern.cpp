@@ -17,6 +17,7 @@
 
 #include "querypattern.h"
 #include "mongo/db/queryutil.h"
+#include "mongo/db/server_parameters.h"
 
 namespace mongo {
 
@@ -79,12 +80,16 @@ namespace mongo {
         return "";
     }
     
-    string QueryPattern::toString() const {
+    BSONObj QueryPattern::toBSON() const {
         BSONObjBuilder b;
         for( map<string,Type>::const_iterator i = _fieldTypes.begin(); i != _fieldTypes.end(); ++i ) {
             b << i->first << typeToString( i->second );
         }
-        return BSON( "query" << b.done() << "sort" << _sort ).toString();
+        return BSON( "query" << b.done() << "sort" << _sort );
+    }
+
+    string QueryPattern::toString() const {
+        return toBSON().toString();
     }
     
     void QueryPattern::setSort( const BSONObj sort ) {
@@ -106,40 +111,167 @@ namespace mongo {
         return b.obj();
     }
     
+    // A cached plan is dropped when it scans this many times more per match than when it was
+    // registered.  0 never drops plans this way.
+    MONGO_EXPORT_SERVER_PARAMETER(queryCacheReplanRatio, int, 10);
+
+    // A cached plan is ignored once the collection has seen this many writes since it was
+    // registered, in case the data changed in ways the replan ratio can't see.  0 keeps plans
+    // regardless of writes.
+    MONGO_EXPORT_SERVER_PARAMETER(queryCacheWritesPerPlan, int, 10000);
+
+    // Runs that scan less than this are too short to judge a plan by.
+    static const long long minNScannedForDrift = 100;
+
+    // The counters of this many patterns are kept per collection.  Every query shape gets its
+    // own, and they outlive the plans, so past this many the least recently counted pattern's
+    // are dropped, and a stream of one-off shapes doesn't cost the hot ones their counts.
+    static const size_t maxPatternStats = 1000;
+
     CachedQueryPlan::CachedQueryPlan( const BSONObj &indexKey, long long nScanned,
-                                     CandidatePlanCharacter planCharacter ) :
+                                     CandidatePlanCharacter planCharacter, long long nReturned ) :
     _indexKey( indexKey ),
     _nScanned( nScanned ),
-    _planCharacter( planCharacter ) {
+    _nReturned( nReturned ),
+    _planCharacter( planCharacter ),
+    _writeCount() {
     }
 
     QueryCache::QueryCache() :
-        _qcWriteCount(0) {
+        _statsMutex("QueryCache::_statsMutex") {
     }
 
     CachedQueryPlan QueryCache::cachedQueryPlanForPattern( const QueryPattern &pattern ) {
         map<QueryPattern, CachedQueryPlan>::const_iterator i = _qcCache.find(pattern);
-        return i != _qcCache.end() ? i->second : CachedQueryPlan();
+        if ( i == _qcCache.end() ) {
+            return CachedQueryPlan();
+        }
+        const int writesPerPlan = queryCacheWritesPerPlan;
+        if ( writesPerPlan > 0 &&
+             _writeCount.load() - i->second._writeCount > (unsigned long long) writesPerPlan ) {
+            return CachedQueryPlan();
+        }
+        return i->second;
     }
 
     void QueryCache::registerCachedQueryPlanForPattern( const QueryPattern &pattern,
                                             const CachedQueryPlan &cachedQueryPlan ) {
-        _qcCache[ pattern ] = cachedQueryPlan;
+        CachedQueryPlan &plan = _qcCache[ pattern ];
+        plan = cachedQueryPlan;
+        plan._writeCount = _writeCount.load();
+    }
+
+    QueryCache::PatternStats &QueryCache::_statsFor( const QueryPattern &pattern ) {
+        map<QueryPattern, PatternStats>::iterator i = _stats.find( pattern );
+        if ( i != _stats.end() ) {
+            _statsLru.splice( _statsLru.end(), _statsLru, i->second.lruPos );
+            return i->second;
+        }
+        if ( _stats.size() >= maxPatternStats ) {
+            LOG(2) << "query cache has counters for " << _stats.size()
+                   << " patterns, dropping those of " << _statsLru.front().toString() << endl;
+            _stats.erase( _statsLru.front() );
+            _statsLru.pop_front();
+        }
+        PatternStats &stats = _stats[ pattern ];
+        stats.lruPos = _statsLru.insert( _statsLru.end(), pattern );
+        return stats;
+    }
+
+    void QueryCache::noteLookup( const QueryPattern &pattern, bool hit ) {
+        SimpleMutex::scoped_lock lk(_statsMutex);
+        PatternStats &stats = _statsFor( pattern );
+        if ( hit ) {
+            stats.hits++;
+        }
+        else {
+            stats.misses++;
+        }
     }
 
-    void QueryCache::notifyOfWriteOp() {
-        if ( _qcCache.empty() ) {
+    void QueryCache::invalidateCachedQueryPlanForPattern( const QueryPattern &pattern ) {
+        map<QueryPattern, CachedQueryPlan>::iterator i = _qcCache.find(pattern);
+        if ( i == _qcCache.end() ) {
             return;
         }
-        if ( ++_qcWriteCount >= 100 ) {
-            clearQueryCache();
+        const bool hadPlan = !i->second.indexKey().isEmpty();
+        _qcCache.erase(i);
+        if ( hadPlan ) {
+            noteReplan( pattern );
+        }
+    }
+
+    void QueryCache::noteReplan( const QueryPattern &pattern ) {
+        SimpleMutex::scoped_lock lk(_statsMutex);
+        _statsFor( pattern ).replans++;
+    }
+
+    bool QueryCache::checkCachedQueryPlanDrift( const QueryPattern &pattern, long long nScanned,
+                                                long long nReturned ) {
+        const int ratio = queryCacheReplanRatio;
+        if ( ratio <= 0 || nReturned < 0 || nScanned < minNScannedForDrift ) {
+            return false;
+        }
+        map<QueryPattern, CachedQueryPlan>::const_iterator i = _qcCache.find(pattern);
+        if ( i == _qcCache.end() || i->second.nReturned() < 0 ) {
+            // Optimal plans and unordered plans are registered without a match count, there's
+            // nothing to compare against.
+            return false;
+        }
+        // nScanned / nReturned > ratio * oldNScanned / oldNReturned, without dividing by zero.
+        const long long oldNScanned = max( i->second.nScanned(), 1LL );
+        const long long oldNReturned = max( i->second.nReturned(), 1LL );
+        if ( (double) nScanned * oldNReturned <=
+             (double) ratio * oldNScanned * max( nReturned, 1LL ) ) {
+            return false;
         }
+        LOG(1) << "cached plan " << i->second.indexKey() << " for query pattern "
+               << pattern.toString() << " scanned " << nScanned << " for " << nReturned
+               << " matches, was " << i->second.nScanned() << " for " << i->second.nReturned()
+               << ", replanning" << endl;
+        invalidateCachedQueryPlanForPattern( pattern );
+        return true;
     }
 
     void QueryCache::clearQueryCache() {
         QueryCache::Lock::Exclusive lk(*this);
         _qcCache.clear();
-        _qcWriteCount = 0;
+    }
+
+    void QueryCache::appendStats( BSONObjBuilder &b ) {
+        QueryCache::Lock::Shared lk(*this);
+        SimpleMutex::scoped_lock statsLk(_statsMutex);
+        // Patterns with a cached plan but no lookups yet have no stats entry, and vice versa.
+        set<QueryPattern> patterns;
+        for ( map<QueryPattern, PatternStats>::const_iterator i = _stats.begin(); i != _stats.end(); ++i ) {
+            patterns.insert( i->first );
+        }
+        for ( map<QueryPattern, CachedQueryPlan>::const_iterator i = _qcCache.begin(); i != _qcCache.end(); ++i ) {
+            patterns.insert( i->first );
+        }
+
+        BSONArrayBuilder arr( b.subarrayStart( "patterns" ) );
+        for ( set<QueryPattern>::const_iterator i = patterns.begin(); i != patterns.end(); ++i ) {
+            BSONObjBuilder pb( arr.subobjStart() );
+            pb.append( "pattern", i->toBSON() );
+            CachedQueryPlan plan = cachedQueryPlanForPattern( *i );
+            if ( !plan.indexKey().isEmpty() ) {
+                BSONObjBuilder cb( pb.subobjStart( "cachedPlan" ) );
+                cb.append( "index", plan.indexKey() );
+                cb.append( "nscanned", plan.nScanned() );
+                if ( plan.nReturned() >= 0 ) {
+                    cb.append( "nreturned", plan.nReturned() );
+                }
+                cb.done();
+            }
+            map<QueryPattern, PatternStats>::const_iterator s = _stats.find( *i );
+            const PatternStats stats = s != _stats.end() ? s->second : PatternStats();
+            pb.append( "hits", stats.hits );
+            pb.append( "misses", stats.misses );
+            pb.append( "replans", stats.replans );
+            pb.done();
+        }
+        arr.done();
     }
     
 } // namespace mongo
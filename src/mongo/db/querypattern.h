@@ -18,6 +18,8 @@
 #pragma once
 
 #include "mongo/db/jsobj.h"
+#include "mongo/platform/atomic_word.h"
+#include "mongo/util/concurrency/mutex.h"
 #include "mongo/util/concurrency/rwlock.h"
 #include "mongo/util/concurrency/simplerwlock.h"
 
@@ -49,7 +51,8 @@ namespace mongo {
         bool operator==( const QueryPattern &other ) const;
         /** for testing only */
         bool operator!=( const QueryPattern &other ) const;
-        /** for development / debugging */
+        /** for development / debugging, and planCacheStats */
+        BSONObj toBSON() const;
         string toString() const;
     private:
         void setSort( const BSONObj sort );
@@ -82,17 +85,25 @@ namespace mongo {
     class CachedQueryPlan {
     public:
         CachedQueryPlan() :
-        _nScanned() {
+        _nScanned(),
+        _nReturned( -1 ),
+        _writeCount() {
         }
         CachedQueryPlan( const BSONObj &indexKey, long long nScanned,
-                        CandidatePlanCharacter planCharacter );
+                        CandidatePlanCharacter planCharacter, long long nReturned = -1 );
         BSONObj indexKey() const { return _indexKey; }
         long long nScanned() const { return _nScanned; }
+        /** @return the matches found while nScanned() were scanned, or -1 if unknown. */
+        long long nReturned() const { return _nReturned; }
         CandidatePlanCharacter planCharacter() const { return _planCharacter; }
     private:
+        friend class QueryCache;
         BSONObj _indexKey;
         long long _nScanned;
+        long long _nReturned;
         CandidatePlanCharacter _planCharacter;
+        // The QueryCache's write count when the plan was registered.
+        unsigned long long _writeCount;
     };
 
     /** A cache of query plans */
@@ -111,19 +122,72 @@ namespace mongo {
             };
         };
 
+        /**
+         * @return the cached plan for pattern, or an empty plan if there is none or it was
+         * registered more than queryCacheWritesPerPlan writes ago.
+         */
         CachedQueryPlan cachedQueryPlanForPattern(const QueryPattern &pattern);
 
         void registerCachedQueryPlanForPattern(const QueryPattern &pattern,
                                                const CachedQueryPlan &cachedQueryPlan) ;
 
-        void notifyOfWriteOp();
+        /** Count a lookup of pattern that did or did not find a cached plan. */
+        void noteLookup(const QueryPattern &pattern, bool hit);
+
+        /**
+         * Forget the cached plan for pattern because it performed worse than recorded, counting a
+         * replan if there was one.  Requires the exclusive lock.
+         */
+        void invalidateCachedQueryPlanForPattern(const QueryPattern &pattern);
+
+        /** Count a replan of pattern, whose cached plan is being raced against other plans. */
+        void noteReplan(const QueryPattern &pattern);
+
+        /**
+         * The cached plan for pattern ran again, scanning nScanned to find nReturned matches.  If
+         * that is more than queryCacheReplanRatio times the nscanned per match it was registered
+         * with, the plan is invalidated so the next query for pattern replans.  Requires the
+         * exclusive lock.
+         * @return true if the plan was invalidated.
+         */
+        bool checkCachedQueryPlanDrift(const QueryPattern &pattern, long long nScanned,
+                                       long long nReturned);
+
+        void notifyOfWriteOp() { _writeCount.fetchAndAdd(1); }
 
         void clearQueryCache();
 
+        /** Append the cached plan and the counters of each pattern, for planCacheStats. */
+        void appendStats(BSONObjBuilder &b);
+
     private:
+        struct PatternStats {
+            PatternStats() : hits(), misses(), replans() {}
+            // Lookups that found a cached plan.
+            long long hits;
+            // Lookups that found none, so candidate plans were raced.
+            long long misses;
+            // Cached plans that were dropped or raced against other plans again because they
+            // scanned much more than recorded.
+            long long replans;
+            // Position in _statsLru.
+            list<QueryPattern>::iterator lruPos;
+        };
+
+        /**
+         * @return pattern's counters, evicting the least recently counted pattern's to make
+         * room for them if needed.  Requires _statsMutex.
+         */
+        PatternStats &_statsFor(const QueryPattern &pattern);
+
         SimpleRWLock _rwlock;
-        int _qcWriteCount;
+        AtomicUInt64 _writeCount;
         map<QueryPattern, CachedQueryPlan> _qcCache;
+        // Lookups only take _rwlock shared, so the counters have their own mutex.
+        SimpleMutex _statsMutex;
+        map<QueryPattern, PatternStats> _stats;
+        // The patterns in _stats, least recently counted first.
+        list<QueryPattern> _statsLru;
     };
 
     inline bool QueryPattern::operator<( const QueryPattern &other ) const {
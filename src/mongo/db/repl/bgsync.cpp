@@ -20,7 +20,9 @@
 #include "mongo/db/client.h"
 #include "mongo/db/commands/fsync.h"
 #include "mongo/db/commands/server_status.h"
+#include "mongo/base/units.h"
 #include "mongo/db/crash.h"
+#include "mongo/db/server_parameters.h"
 #include "mongo/db/repl/bgsync.h"
 #include "mongo/db/repl/rs_sync.h"
 #include "mongo/base/counter.h"
@@ -53,6 +55,35 @@ namespace mongo {
     static Counter64 bufferSizeGauge;
     static ServerStatusMetricField<Counter64> displayBufferSize( "repl.buffer.sizeBytes",
                                                                 &bufferSizeGauge );
+    //The count of items in the buffer that were spilled and must be read back from the oplog
+    static Counter64 bufferSpilledGauge;
+    static ServerStatusMetricField<Counter64> displayBufferSpilled( "repl.buffer.spilled",
+                                                                &bufferSpilledGauge );
+    //The count of items ever spilled, including those since applied
+    static Counter64 bufferSpilledTotal;
+    static ServerStatusMetricField<Counter64> displayBufferSpilledTotal( "repl.buffer.spilledTotal",
+                                                                &bufferSpilledTotal );
+
+    // Bytes of oplog entries the buffer between the producer and the applier
+    // may hold in memory. Past that, transactions are only referenced by GTID
+    // and read back from the oplog when they are applied, so the producer never
+    // has to wait for the applier.
+    static BytesQuantity<uint64_t> replBufferMaxSize(256 << 20);
+    static ExportedServerParameter<BytesQuantity<uint64_t> > replBufferMaxSizeParameter(
+            ServerParameterSet::getGlobal(), "replBufferMaxSize", &replBufferMaxSize, true, true);
+
+    // Spilled transactions still take up a GTID in the buffer. Past this many,
+    // the producer waits for the applier rather than let them pile up without
+    // bound while the applier falls behind.
+    static const uint64_t maxSpilledTxns = 1 << 20;
+
+    class BufferMaxSizeSSM : public ServerStatusMetric {
+    public:
+        BufferMaxSizeSSM() : ServerStatusMetric("repl.buffer.maxSizeBytes") {}
+        virtual void appendAtLeaf( BSONObjBuilder& b ) const {
+            b.appendNumber( _leafName, (long long) replBufferMaxSize.value() );
+        }
+    } bufferMaxSizeSSM;
 
     // Number and time of each ApplyOps worker pool round
     static TimerStats applyBatchStats;
@@ -64,9 +95,34 @@ namespace mongo {
     static ServerStatusMetricField<Counter64> displayOpsApplied( "repl.apply.ops",
                                                                 &opsAppliedStats );
 
-    BackgroundSync::BackgroundSync() : _opSyncShouldRun(false),
+    // Number of threads applying transactions concurrently on a secondary.
+    // Transactions that write to the same collection are still applied
+    // serially, in oplog order.
+    class ReplApplierThreadsParameter : public ExportedServerParameter<uint32_t> {
+      public:
+        ReplApplierThreadsParameter(uint32_t *value)
+                : ExportedServerParameter<uint32_t>(ServerParameterSet::getGlobal(), "replApplierThreads",
+                                                    value, true, false) {}
+      protected:
+        virtual Status validate(const uint32_t& potentialNewValue) {
+            if (potentialNewValue < 1 || potentialNewValue > 64) {
+                return Status(ErrorCodes::BadValue, "replApplierThreads must be between 1 and 64");
+            }
+            return Status::OK();
+        }
+    };
+    static uint32_t replApplierThreads = 1;
+    static ReplApplierThreadsParameter replApplierThreadsParameter(&replApplierThreads);
+
+    BackgroundSync::BackgroundSync() : _numApplying(0),
+                                            _applyingIsolated(false),
+                                            _numApplierWorkers(0),
+                                            _applierWorkersShouldExit(false),
+                                            _opSyncShouldRun(false),
                                             _opSyncRunning(false),
                                             _currentSyncTarget(NULL),
+                                            _bufferBytes(0),
+                                            _spilledTxns(0),
                                             _opSyncShouldExit(false),
                                             _opSyncInProgress(false),
                                             _applierShouldExit(false),
@@ -123,6 +179,8 @@ namespace mongo {
         {
             boost::unique_lock<boost::mutex> lock(_mutex);
             _applierInProgress = true;
+            _applierWorkersShouldExit = false;
+            _numApplierWorkers = replApplierThreads;
         }
         Client::initThread("applier");
         replLocalAuth();
@@ -130,7 +188,17 @@ namespace mongo {
         // as it must finish work that it starts
         // done for github issues #770 and #771
         cc().setGloballyUninterruptible(true);
+        boost::thread_group workers;
+        for (uint32_t i = 0; i < _numApplierWorkers; i++) {
+            workers.create_thread(boost::bind(&BackgroundSync::applierWorkerThread, this));
+        }
         applyOpsFromOplog();
+        {
+            boost::unique_lock<boost::mutex> lock(_mutex);
+            _applierWorkersShouldExit = true;
+            _applierWorkCond.notify_all();
+        }
+        workers.join_all();
         cc().shutdown();
         {
             boost::unique_lock<boost::mutex> lock(_mutex);
@@ -138,69 +206,78 @@ namespace mongo {
         }
     }
 
+    bool BackgroundSync::applierIdle() const {
+        return _deque.size() == 0 && _numApplying == 0;
+    }
+
+    bool BackgroundSync::canApplyConcurrently(const ApplierWork& work) const {
+        if (_numApplying == 0) {
+            return true;
+        }
+        if (_numApplying >= _numApplierWorkers || _applyingIsolated || work.isolated) {
+            return false;
+        }
+        for (set<string>::const_iterator it = work.namespaces.begin(); it != work.namespaces.end(); ++it) {
+            if (_applyingNamespaces.count(*it) > 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // The applier thread takes transactions off of _deque in GTID order and
+    // hands them to the applier workers. A transaction is handed out only once
+    // it cannot conflict with any transaction still being applied, so
+    // transactions that write to the same collection are applied in the order
+    // they were committed on the primary. Because noteApplyingGTID is only
+    // called from here, GTIDs are noted as applying in order, and the
+    // GTIDManager keeps minUnappliedGTID correct as workers finish out of order.
     void BackgroundSync::applyOpsFromOplog() {
-        GTID lastLiveGTID;
-        GTID lastUnappliedGTID;
         while (1) {
             try {
-                BSONObj curr;
+                ApplierWork work;
+                GTID currEntry;
                 {
                     boost::unique_lock<boost::mutex> lck(_mutex);
                     // wait until we know an item has been produced
                     while (_deque.size() == 0 && !_applierShouldExit) {
-                        _queueDone.notify_all();
+                        if (applierIdle()) {
+                            _queueDone.notify_all();
+                        }
                         _queueCond.wait(lck);
                     }
                     if (_deque.size() == 0 && _applierShouldExit) {
                         return; 
                     }
-                    curr = _deque.front();
-                }
-                GTID currEntry = getGTIDFromOplogEntry(curr);
-                theReplSet->gtidManager->noteApplyingGTID(currEntry);
-                // we must do applyTransactionFromOplog in a loop
-                // because once we have called noteApplyingGTID, we must
-                // continue until we are successful in applying the transaction.
-                for (uint32_t numTries = 0; numTries <= 100; numTries++) {
-                    try {
-                        numTries++;
-                        TimerHolder timer(&applyBatchStats);
-                        applyTransactionFromOplog(curr);
-                        opsAppliedStats.increment();
-                        break;
-                    }
-                    catch (std::exception &e) {
-                        log() << "exception during applying transaction from oplog: " << e.what() << endl;
-                        log() << "oplog entry: " << curr.str() << endl;
-                        if (numTries == 100) {
-                            // something is really wrong if we fail 100 times, let's abort
-                            dumpCrashInfo("100 errors applying oplog entry");
-                            ::abort();
-                        }
-                        sleepsecs(1);
+                    const BufferedTxn& front = _deque.front();
+                    work.spilled = front.spilled();
+                    if (work.spilled) {
+                        work.entry = BSONObj();
+                    } else {
+                        work.entry = front.entry;
                     }
+                    currEntry = front.gtid;
+                }
+                if (work.spilled) {
+                    bool found = getOplogEntryForGTID(currEntry, work.entry);
+                    massert(17349, str::stream() << "spilled transaction " << currEntry.toString() << " not found in oplog", found);
                 }
-                LOG(3) << "applied " << curr.toString(false, true) << endl;
-                theReplSet->gtidManager->noteGTIDApplied(currEntry);
+                work.isolated = !getNamespacesForApplyConflicts(work.entry, work.namespaces);
 
-                {
-                    boost::unique_lock<boost::mutex> lck(_mutex);
-                    dassert(_deque.size() > 0);
-                    _deque.pop_front();
-                    bufferCountGauge.increment(-1);
-                    bufferSizeGauge.increment(-curr.objsize());
-                    
-                    // this is a flow control mechanism, with bad numbers
-                    // hard coded for now just to get something going.
-                    // If the opSync thread notices that we have over 20000
-                    // transactions in the queue, it waits until we get below
-                    // 10000. This is where we signal that we have gotten there
-                    // Once we have spilling of transactions working, this
-                    // logic will need to be redone
-                    if (_deque.size() == 10000) {
-                        _queueCond.notify_all();
-                    }
+                boost::unique_lock<boost::mutex> lck(_mutex);
+                while (!canApplyConcurrently(work)) {
+                    _applierDoneCond.wait(lck);
+                }
+                theReplSet->gtidManager->noteApplyingGTID(currEntry);
+                dassert(_deque.size() > 0);
+                _deque.pop_front();
+                _numApplying++;
+                _applyingIsolated = work.isolated;
+                for (set<string>::const_iterator it = work.namespaces.begin(); it != work.namespaces.end(); ++it) {
+                    _applyingNamespaces[*it]++;
                 }
+                _applierWork.push_back(work);
+                _applierWorkCond.notify_one();
             }
             catch (DBException& e) {
                 sethbmsg(str::stream() << "db exception in producer on applier thread: " << e.toString());
@@ -212,6 +289,87 @@ namespace mongo {
             }
         }
     }
+
+    void BackgroundSync::applyWithRetries(BSONObj& curr) {
+        // we must do applyTransactionFromOplog in a loop
+        // because once we have called noteApplyingGTID, we must
+        // continue until we are successful in applying the transaction.
+        for (uint32_t numTries = 0; numTries <= 100; numTries++) {
+            try {
+                numTries++;
+                TimerHolder timer(&applyBatchStats);
+                applyTransactionFromOplog(curr);
+                opsAppliedStats.increment();
+                break;
+            }
+            catch (std::exception &e) {
+                log() << "exception during applying transaction from oplog: " << e.what() << endl;
+                log() << "oplog entry: " << curr.str() << endl;
+                if (numTries == 100) {
+                    // something is really wrong if we fail 100 times, let's abort
+                    dumpCrashInfo("100 errors applying oplog entry");
+                    ::abort();
+                }
+                sleepsecs(1);
+            }
+        }
+        LOG(3) << "applied " << curr.toString(false, true) << endl;
+    }
+
+    void BackgroundSync::applierWorkerThread() {
+        Client::initThread("applierWorker");
+        replLocalAuth();
+        // same as the applier thread, work that is started must be finished
+        cc().setGloballyUninterruptible(true);
+        while (1) {
+            ApplierWork work;
+            {
+                boost::unique_lock<boost::mutex> lck(_mutex);
+                while (_applierWork.size() == 0 && !_applierWorkersShouldExit) {
+                    _applierWorkCond.wait(lck);
+                }
+                if (_applierWork.size() == 0) {
+                    break;
+                }
+                work = _applierWork.front();
+                _applierWork.pop_front();
+            }
+
+            applyWithRetries(work.entry);
+            theReplSet->gtidManager->noteGTIDApplied(getGTIDFromOplogEntry(work.entry));
+
+            {
+                boost::unique_lock<boost::mutex> lck(_mutex);
+                dassert(_numApplying > 0);
+                _numApplying--;
+                if (work.isolated) {
+                    _applyingIsolated = false;
+                }
+                for (set<string>::const_iterator it = work.namespaces.begin(); it != work.namespaces.end(); ++it) {
+                    std::map<string, uint32_t>::iterator nsIt = _applyingNamespaces.find(*it);
+                    dassert(nsIt != _applyingNamespaces.end());
+                    if (--nsIt->second == 0) {
+                        _applyingNamespaces.erase(nsIt);
+                    }
+                }
+                bufferCountGauge.increment(-1);
+                if (work.spilled) {
+                    dassert(_spilledTxns > 0);
+                    _spilledTxns--;
+                    bufferSpilledGauge.increment(-1);
+                } else {
+                    dassert(_bufferBytes >= (uint64_t) work.entry.objsize());
+                    _bufferBytes -= work.entry.objsize();
+                    bufferSizeGauge.increment(-work.entry.objsize());
+                }
+                _applierDoneCond.notify_all();
+                if (applierIdle()) {
+                    _queueDone.notify_all();
+                }
+            }
+        }
+        cc().shutdown();
+    }
     
     void BackgroundSync::producerThread() {
         {
@@ -442,24 +600,30 @@ namespace mongo {
                         if (_deque.size() == 0) {
                             _queueCond.notify_all();
                         }
-                        _deque.push_back(o);
-                        bufferCountGauge.increment();
-                        bufferSizeGauge.increment(o.objsize());
-                        // this is a flow control mechanism, with bad numbers
-                        // hard coded for now just to get something going.
-                        // If the opSync thread notices that we have over 20000
-                        // transactions in the queue, it waits until we get below
-                        // 10000. This is where we wait if we get too high
-                        // Once we have spilling of transactions working, this
-                        // logic will need to be redone
-                        if (_deque.size() > 20000) {
-                            _queueCond.wait(lock);
+                        BufferedTxn txn;
+                        txn.gtid = currEntry;
+                        txn.size = o.objsize();
+                        if (_bufferBytes + txn.size <= replBufferMaxSize.value()) {
+                            txn.entry = o;
+                            _bufferBytes += txn.size;
+                            bufferSizeGauge.increment(txn.size);
+                        } else {
+                            // o is already committed to the oplog, the applier
+                            // will read it back from there
+                            while (_spilledTxns >= maxSpilledTxns && !_opSyncShouldExit) {
+                                _applierDoneCond.wait(lock);
+                            }
+                            _spilledTxns++;
+                            bufferSpilledGauge.increment();
+                            bufferSpilledTotal.increment();
                         }
+                        _deque.push_back(txn);
+                        bufferCountGauge.increment();
                         if (bigTxn) {
                             // if we have a large transaction, we don't want
                             // to let it pile up. We want to process it immedietely
                             // before processing anything else.
-                            while (_deque.size() > 0) {
+                            while (!applierIdle()) {
                                 _queueDone.wait(lock);
                             }
                         }
@@ -614,7 +778,7 @@ namespace mongo {
         // the applier thread is applying it to the oplog
         {
             boost::unique_lock<boost::mutex> lock(_mutex);
-            while (_deque.size() > 0) {
+            while (!applierIdle()) {
                 log() << "waiting for applier to finish work before doing rollback " << rsLog;
                 _queueDone.wait(lock);
             }
@@ -735,7 +899,7 @@ namespace mongo {
         if (!_applierInProgress) {
             return;
         }
-        verify(_deque.size() == 0);
+        verify(applierIdle());
         // do a sanity check on the GTID Manager
         GTID lastLiveGTID;
         GTID lastUnappliedGTID;
@@ -770,7 +934,7 @@ namespace mongo {
         verify(!_opSyncShouldRun);
 
         // wait for all things to be applied
-        while (_deque.size() > 0) {
+        while (!applierIdle()) {
             _queueDone.wait(lock);
         }
 
@@ -18,6 +18,7 @@
 #pragma once
 
 #include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
 
 #include "mongo/util/queue.h"
 #include "mongo/db/oplogreader.h"
@@ -53,6 +54,37 @@ namespace mongo {
         // signals when the applier has nothing to do
         boost::condition_variable _queueDone;
 
+        // a transaction handed out by the applier thread to an applier worker,
+        // along with what it needs to not conflict with concurrent transactions
+        struct ApplierWork {
+            BSONObj entry;
+            set<string> namespaces;
+            bool isolated;
+            bool spilled;
+            ApplierWork() : isolated(false), spilled(false) {}
+        };
+
+        // signals that work was added to _applierWork, or that workers should exit
+        boost::condition_variable _applierWorkCond;
+        // signals that an applier worker finished applying a transaction
+        boost::condition_variable _applierDoneCond;
+        // transactions scheduled by the applier thread that no
+        // worker has picked up yet
+        std::deque<ApplierWork> _applierWork;
+        // number of transactions that have been taken off of _deque
+        // but have yet to be fully applied by an applier worker
+        uint32_t _numApplying;
+        // reference counts of namespaces written by the transactions
+        // being applied, two transactions that write to the same
+        // namespace are never applied concurrently
+        std::map<string, uint32_t> _applyingNamespaces;
+        // true if the transaction being applied must run by itself
+        bool _applyingIsolated;
+        // number of applier worker threads, read from replApplierThreads
+        // when the applier thread starts
+        uint32_t _numApplierWorkers;
+        bool _applierWorkersShouldExit;
+
         // boolean that states whether we should actively be 
         // trying to read data from another machine and apply it
         // to our opLog. When we are a secondary, this should be true.
@@ -64,12 +96,32 @@ namespace mongo {
 
         const Member* _currentSyncTarget;
 
+        // a transaction that has been written to the oplog but
+        // has yet to be applied to the collections.
+        //
+        // Once the buffered entries take up replBufferMaxSize bytes,
+        // newly produced transactions are spilled: only their GTID is
+        // kept, and the applier reads them back from the oplog, where
+        // the producer has already committed them.
+        struct BufferedTxn {
+            GTID gtid;
+            BSONObj entry; // empty if spilled
+            int size;
+            bool spilled() const { return entry.isEmpty(); }
+        };
+
         // double ended queue containing the ops
         // that have been written to the oplog but yet
         // to be applied to the collections.
         // Its size should always be equal
         // to _queueCounter.numElems
-        std::deque<BSONObj> _deque;
+        std::deque<BufferedTxn> _deque;
+        // bytes of the entries buffered in memory, both in _deque
+        // and handed to the applier workers
+        uint64_t _bufferBytes;
+        // number of spilled transactions, both in _deque and handed
+        // to the applier workers, at most maxSpilledTxns
+        uint64_t _spilledTxns;
 
         // these variables are relevant to shutdown
 
@@ -110,6 +162,14 @@ namespace mongo {
 
         bool hasCursor();
         void verifySettled();
+
+        // true if every transaction produced has been applied,
+        // called with _mutex held
+        bool applierIdle() const;
+        // called with _mutex held
+        bool canApplyConcurrently(const ApplierWork& work) const;
+        void applyWithRetries(BSONObj& curr);
+        void applierWorkerThread();
     public:
         static BackgroundSync* get();
         void shutdown();
@@ -21,6 +21,7 @@
 
 #include "mongo/pch.h"
 #include "mongo/db/scanandorder.h"
+#include "mongo/db/collection.h"
 #include "mongo/db/matcher.h"
 #include "mongo/db/storage/assert_ids.h"
 #include "mongo/db/parsed_query.h"
@@ -30,7 +31,14 @@ namespace mongo {
 
     const unsigned ScanAndOrder::MaxScanAndOrderBytes = 32 * 1024 * 1024;
 
-    void ScanAndOrder::add(const BSONObj& o) {
+    ScanAndOrder::ScanAndOrder(int startFrom, int limit, const BSONObj &order, const FieldRangeSet &frs,
+                               const Collection *cl) :
+        _startFrom(startFrom), _order(order, frs), _cl(cl),
+        _approxSize(0), _nAdded(0), _nSpilled(0), _nMerged(0), _nResults(0) {
+        _limit = limit > 0 ? limit + _startFrom : 0x7fffffff;
+    }
+
+    void ScanAndOrder::add(const BSONObj& o, const BSONObj& pk) {
         verify( o.isValid() );
         BSONObj k;
         try {
@@ -48,19 +56,75 @@ namespace mongo {
         if ( k.isEmpty() ) {
             return;   
         }
-        if ( (int) _best.size() < _limit ) {
-            _add(k, o);
+        if ( (int) _entries.size() < _limit ) {
+            _add(k, o, pk);
             return;
         }
-        BestMap::iterator i;
-        verify( _best.end() != _best.begin() );
-        i = _best.end();
-        i--;
-        _addIfBetter(k, o, i);
+        verify( !_entries.empty() );
+        const Entry &worst = _entries.front();
+        if ( worst.key.woCompare(k, _order._keyPattern) > 0 ) {
+            // k is better, 'upgrade'
+            _validateAndUpdateApproxSize( -_entrySize(worst) );
+            pop_heap(_entries.begin(), _entries.end(), EntryCmp(_order._keyPattern));
+            _entries.pop_back();
+            _add(k, o, pk);
+        }
+    }
+
+    void ScanAndOrder::_add(const BSONObj& k, const BSONObj& o, const BSONObj& pk) {
+        Entry e;
+        e.key = k;
+        if ( _cl != NULL && !pk.isEmpty() ) {
+            e.pk = pk;
+        }
+        else {
+            e.doc = o;
+        }
+        e.seq = _nAdded++;
+        const int size = _entrySize(e);
+        if ( _cl != NULL && !_entries.empty() &&
+             _approxSize + size >= MaxScanAndOrderBytes ) {
+            _spill();
+        }
+        _validateAndUpdateApproxSize( size );
+        e.key = e.key.getOwned();
+        e.pk = e.pk.getOwned();
+        e.doc = e.doc.getOwned();
+        _entries.push_back(e);
+        if ( _limited() ) {
+            push_heap(_entries.begin(), _entries.end(), EntryCmp(_order._keyPattern));
+        }
+    }
+
+    void ScanAndOrder::_spill() {
+        if ( !_spillFile ) {
+            _spillFile.reset( new SpillFile( "scanAndOrder" ) );
+        }
+        sort(_entries.begin(), _entries.end(), EntryCmp(_order._keyPattern));
+        for ( vector<Entry>::const_iterator i = _entries.begin(); i != _entries.end(); ++i ) {
+            _spillFile->append( BSON( "k" << i->key << "p" << i->pk << "d" << i->doc ) );
+        }
+        _spillFile->endRun();
+        _nSpilled += _entries.size();
+        _entries.clear();
+        _approxSize = 0;
     }
 
-    void ScanAndOrder::fill( BufBuilder& b, const ParsedQuery *parsedQuery, int& nout ) const {
-        int n = 0;
+    namespace {
+
+        template<class Cmp>
+        class PtrCmp {
+        public:
+            PtrCmp(const Cmp &cmp) : _cmp(cmp) { }
+            template<class T>
+            bool operator()(const T *l, const T *r) const { return _cmp(*l, *r); }
+        private:
+            Cmp _cmp;
+        };
+
+    } // namespace
+
+    void ScanAndOrder::fill( BufBuilder& b, const ParsedQuery *parsedQuery, int& nout ) {
         int nFilled = 0;
         Projection *projection = parsedQuery ? parsedQuery->getFields() : NULL;
         scoped_ptr<Matcher> arrayMatcher;
@@ -72,36 +136,118 @@ namespace mongo {
             details.reset( new MatchDetails );
             details->requestElemMatchKey();
         }
-        for ( BestMap::const_iterator i = _best.begin(); i != _best.end(); i++ ) {
-            n++;
-            if ( n <= _startFrom )
-                continue;
-            const BSONObj& o = i->second;
+
+        _startMerge();
+        BSONObj o, pk;
+        while ( _nextResult( o, pk ) ) {
+            // A projection never makes a document bigger, so if o itself fits, so does its
+            // projection.
+            if ( nFilled > 0 && (unsigned) ( b.len() + o.objsize() ) >= MaxScanAndOrderBytes ) {
+                _pendingDoc = o;
+                _pendingPK = pk;
+                break;
+            }
             massert( 16355, "positional operator specified, but no array match",
                      ! arrayMatcher || arrayMatcher->matches( o, details.get() ) );
             fillQueryResultFromObj( b, projection, o, details.get() );
             nFilled++;
-            if ( nFilled >= _limit )
-                break;
         }
         nout = nFilled;
     }
 
-    void ScanAndOrder::_add(const BSONObj& k, const BSONObj& o) {
-        BSONObj docToReturn = o;
-        _validateAndUpdateApproxSize( k.objsize() + docToReturn.objsize() );
-        _best.insert(make_pair(k.getOwned(),docToReturn.getOwned()));
+    bool ScanAndOrder::next( BSONObj &doc, BSONObj &pk ) {
+        if ( !_pendingDoc.isEmpty() ) {
+            doc = _pendingDoc;
+            pk = _pendingPK;
+            _pendingDoc = BSONObj();
+            _pendingPK = BSONObj();
+            return true;
+        }
+        return _nextResult( doc, pk );
     }
-    
-    void ScanAndOrder::_addIfBetter(const BSONObj& k, const BSONObj& o, const BestMap::iterator& i) {
-        const BSONObj& worstBestKey = i->first;
-        int cmp = worstBestKey.woCompare(k, _order._keyPattern);
-        if ( cmp > 0 ) {
-            // k is better, 'upgrade'
-            _validateAndUpdateApproxSize( -i->first.objsize() + -i->second.objsize() );
-            _best.erase(i);
-            _add(k, o);
+
+    void ScanAndOrder::_startMerge() {
+        // The entries in memory, best first.
+        _sorted.reserve( _entries.size() );
+        for ( vector<Entry>::const_iterator i = _entries.begin(); i != _entries.end(); ++i ) {
+            _sorted.push_back( &*i );
         }
+        sort( _sorted.begin(), _sorted.end(), PtrCmp<EntryCmp>( EntryCmp( _order._keyPattern ) ) );
+        _nextSorted = _sorted.begin();
+
+        // Merge them with the spilled runs, if any. The entries in memory are the last run.
+        const size_t nRuns = _spillFile ? _spillFile->nRuns() : 0;
+        for ( size_t run = 0; run <= nRuns; run++ ) {
+            if ( run < nRuns ) {
+                _readers.push_back( _spillFile->readRun( run ) );
+            }
+            _heads.push_back( RunHead() );
+            _heads.back().run = run;
+        }
+        for ( vector<RunHead>::iterator i = _heads.begin(); i != _heads.end(); ) {
+            if ( _nextHead( *i, _readers, _nextSorted, _sorted.end() ) ) {
+                ++i;
+            }
+            else {
+                i = _heads.erase( i );
+            }
+        }
+        make_heap( _heads.begin(), _heads.end(), RunHeadCmp( _order._keyPattern ) );
+        _nMerged = 0;
+        _nResults = 0;
+    }
+
+    bool ScanAndOrder::_nextResult( BSONObj &doc, BSONObj &pk ) {
+        RunHeadCmp headCmp( _order._keyPattern );
+        while ( !_heads.empty() && _nResults < _limit ) {
+            pop_heap( _heads.begin(), _heads.end(), headCmp );
+            RunHead &best = _heads.back();
+            bool found = false;
+            _nMerged++;
+            if ( _nMerged > _startFrom ) {
+                doc = best.doc;
+                pk = best.pk;
+                found = pk.isEmpty() || _cl->findByPK( pk, doc );
+                if ( !found ) {
+                    // can't happen in the same transaction, but don't count it
+                    _nMerged--;
+                }
+            }
+            if ( _nextHead( best, _readers, _nextSorted, _sorted.end() ) ) {
+                push_heap( _heads.begin(), _heads.end(), headCmp );
+            }
+            else {
+                _heads.pop_back();
+            }
+            if ( found ) {
+                _nResults++;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool ScanAndOrder::_nextHead(RunHead &head, const vector<shared_ptr<SpillFile::Reader> > &readers,
+                                 SortedIterator &nextSorted, const SortedIterator &endSorted) {
+        if ( head.run < readers.size() ) {
+            SpillFile::Reader &reader = *readers[head.run];
+            if ( !reader.more() ) {
+                return false;
+            }
+            BSONObj o = reader.next();
+            head.key = o["k"].Obj().getOwned();
+            head.pk = o["p"].Obj().getOwned();
+            head.doc = o["d"].Obj().getOwned();
+            return true;
+        }
+        if ( nextSorted == endSorted ) {
+            return false;
+        }
+        head.key = (*nextSorted)->key;
+        head.pk = (*nextSorted)->pk;
+        head.doc = (*nextSorted)->doc;
+        ++nextSorted;
+        return true;
     }
 
     void ScanAndOrder::_validateAndUpdateApproxSize( const int approxSizeDelta ) {
@@ -114,4 +260,18 @@ namespace mongo {
         _approxSize = newApproxSize;
     }
 
+    ScanAndOrderCursor::ScanAndOrderCursor( const shared_ptr<ScanAndOrder> &scanAndOrder,
+                                            long long nscanned ) :
+        _scanAndOrder( scanAndOrder ), _nscanned( nscanned ) {
+        advance();
+    }
+
+    bool ScanAndOrderCursor::advance() {
+        if ( !_scanAndOrder->next( _current, _currPK ) ) {
+            _current = BSONObj();
+            _currPK = BSONObj();
+        }
+        return ok();
+    }
+
 } // namespace mongo
@@ -21,9 +21,11 @@
 
 #pragma once
 
+#include "mongo/db/cursor.h"
 #include "mongo/db/jsobj.h"
 #include "mongo/db/queryutil.h"
 #include "mongo/db/projection.h"
+#include "mongo/db/spill_file.h"
 
 namespace mongo {
 
@@ -67,28 +69,52 @@ namespace mongo {
         }
     }
 
-    typedef multimap<BSONObj,BSONObj,BSONObjCmp> BestMap;
+    class Collection;
+
+    /**
+     * Sorts query results that don't come out of an index in order. With a limit, only the
+     * best skip+limit results are kept, in a heap.
+     *
+     * Constructed with a collection, results that come with a pk only keep their sort key and
+     * pk, and the documents are fetched again by fill(). When those outgrow
+     * MaxScanAndOrderBytes they are sorted and written to a SpillFile, and fill() merges the
+     * runs. Without a collection the documents themselves are kept and growing past
+     * MaxScanAndOrderBytes throws, which lets a query give up on an out of order plan.
+     *
+     * Either way, fill() won't produce more than MaxScanAndOrderBytes of results. What it
+     * leaves is returned by next(), so a ScanAndOrderCursor can stream it to getMore.
+     */
     class ScanAndOrder {
     public:
         static const unsigned MaxScanAndOrderBytes;
 
-        ScanAndOrder(int startFrom, int limit, const BSONObj &order, const FieldRangeSet &frs) :
-            _best( BSONObjCmp( order ) ),
-            _startFrom(startFrom), _order(order, frs) {
-            _limit = limit > 0 ? limit + _startFrom : 0x7fffffff;
-            _approxSize = 0;
-        }
+        ScanAndOrder(int startFrom, int limit, const BSONObj &order, const FieldRangeSet &frs,
+                     const Collection *cl = NULL);
 
-        int size() const { return _best.size(); }
+        int size() const { return _entries.size() + _nSpilled; }
 
         /**
+         * @param pk the pk of o, if known
          * @throw ScanAndOrderMemoryLimitExceededAssertionCode if adding would grow memory usage
-         * to ScanAndOrder::MaxScanAndOrderBytes.
+         * to ScanAndOrder::MaxScanAndOrderBytes and it can't be spilled.
+         */
+        void add(const BSONObj &o, const BSONObj &pk = BSONObj());
+
+        /**
+         * Scanning complete. Stick the query results in b, as many as fit in
+         * MaxScanAndOrderBytes, and set nout to their number. If that's not all of them, more()
+         * is true.
          */
-        void add(const BSONObj &o);
+        void fill(BufBuilder& b, const ParsedQuery *query, int& nout);
 
-        /* scanning complete. stick the query result in b for n objects. */
-        void fill(BufBuilder& b, const ParsedQuery *query, int& nout) const;
+        /** @return true if fill() left results for next(). */
+        bool more() const { return !_pendingDoc.isEmpty(); }
+
+        /**
+         * Get the next result after those fill() returned, and its pk if it has one.
+         * @return false if there are no more.
+         */
+        bool next(BSONObj &doc, BSONObj &pk);
 
     /** Functions for testing. */
     protected:
@@ -97,9 +123,65 @@ namespace mongo {
 
     private:
 
-        void _add(const BSONObj& k, const BSONObj& o);
+        struct Entry {
+            BSONObj key;
+            BSONObj pk;   // set if the document is to be fetched by pk
+            BSONObj doc;  // otherwise
+            long long seq; // ties are returned in the order they were added
+        };
+
+        /** Orders entries best first, for sort(), or worst first in a heap. */
+        class EntryCmp {
+        public:
+            EntryCmp(const BSONObj &keyPattern) : _keyPattern(keyPattern) { }
+            bool operator()(const Entry &l, const Entry &r) const {
+                const int c = l.key.woCompare(r.key, _keyPattern);
+                return c != 0 ? c < 0 : l.seq < r.seq;
+            }
+        private:
+            const BSONObj &_keyPattern;
+        };
+
+        /** The next result of a spilled run, or of the entries in memory, in fill(). */
+        struct RunHead {
+            BSONObj key;
+            BSONObj pk;
+            BSONObj doc;
+            size_t run; // later runs hold later entries, for ties
+        };
+
+        /** Orders run heads worst first, for a heap. */
+        class RunHeadCmp {
+        public:
+            RunHeadCmp(const BSONObj &keyPattern) : _keyPattern(keyPattern) { }
+            bool operator()(const RunHead &l, const RunHead &r) const {
+                const int c = l.key.woCompare(r.key, _keyPattern);
+                return c != 0 ? c > 0 : l.run > r.run;
+            }
+        private:
+            const BSONObj &_keyPattern;
+        };
+
+        typedef vector<const Entry *>::const_iterator SortedIterator;
+
+        /**
+         * Move head to the next result of its run: a spilled run if it has a reader, otherwise
+         * the entries in memory. @return false if the run is exhausted.
+         */
+        static bool _nextHead(RunHead &head, const vector<shared_ptr<SpillFile::Reader> > &readers,
+                              SortedIterator &nextSorted, const SortedIterator &endSorted);
+
+        /** Start merging the spilled runs and the entries in memory, for _nextResult(). */
+        void _startMerge();
 
-        void _addIfBetter(const BSONObj& k, const BSONObj& o, const BestMap::iterator& i);
+        /** Get the next result after skip and within limit. @return false if there is none. */
+        bool _nextResult(BSONObj &doc, BSONObj &pk);
+
+        void _add(const BSONObj& k, const BSONObj& o, const BSONObj& pk);
+
+        static int _entrySize(const Entry &e) {
+            return e.key.objsize() + e.pk.objsize() + e.doc.objsize();
+        }
 
         /**
          * @throw ScanAndOrderMemoryLimitExceededAssertionCode if approxSize would grow too high,
@@ -107,12 +189,58 @@ namespace mongo {
          */
         void _validateAndUpdateApproxSize( const int approxSizeDelta );
 
-        BestMap _best; // key -> full object
+        /** Sort the entries and move them to a new run in _spillFile. */
+        void _spill();
+
+        bool _limited() const { return _limit != 0x7fffffff; }
+
+        vector<Entry> _entries; // a heap with the worst entry first, if limited
         int _startFrom;
         int _limit;   // max to send back.
         KeyType _order;
+        const Collection *_cl;
         unsigned _approxSize;
+        long long _nAdded;
+        scoped_ptr<SpillFile> _spillFile;
+        int _nSpilled;
+
+        // The merge, from fill() on.
+        vector<const Entry *> _sorted; // the entries in memory, best first
+        SortedIterator _nextSorted;
+        vector<shared_ptr<SpillFile::Reader> > _readers;
+        vector<RunHead> _heads;        // a heap of the next result of each run, best first
+        int _nMerged;                  // results merged, including those skipped
+        int _nResults;                 // results returned
+        // The result that didn't fit in fill()'s buffer, if any.
+        BSONObj _pendingDoc;
+        BSONObj _pendingPK;
 
     };
 
+    /**
+     * Returns the results a ScanAndOrder's fill() left over, so they can be read with getMore
+     * instead of all fitting in the first batch.
+     */
+    class ScanAndOrderCursor : public Cursor {
+    public:
+        /** @param nscanned what it took to find the results, for the query's stats */
+        ScanAndOrderCursor(const shared_ptr<ScanAndOrder> &scanAndOrder, long long nscanned);
+
+        bool ok() { return !_current.isEmpty(); }
+        BSONObj current() { return _current; }
+        bool advance();
+        virtual BSONObj currPK() const { return _currPK; }
+        virtual string toString() const { return "ScanAndOrderCursor"; }
+        virtual bool getsetdup(const BSONObj &pk) { return false; }
+        virtual bool isMultiKey() const { return false; }
+        virtual bool modifiedKeys() const { return true; }
+        virtual long long nscanned() const { return _nscanned; }
+
+    private:
+        shared_ptr<ScanAndOrder> _scanAndOrder;
+        const long long _nscanned;
+        BSONObj _current;
+        BSONObj _currPK;
+    };
+
 } // namespace mongo
@@ -0,0 +1,144 @@
+// spill_file.cpp
+
+/**
+*    Copyright (C) 2013 Tokutek Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "mongo/pch.h"
+
+#include "mongo/db/spill_file.h"
+
+#include <zlib.h>
+#include <boost/filesystem/operations.hpp>
+
+#include "mongo/bson/util/atomic_int.h"
+#include "mongo/db/cmdline.h"
+#include "mongo/util/paths.h"
+
+namespace mongo {
+
+    // Uncompressed size of the blocks runs are written in.
+    static const int spillBlockSize = 64 * 1024;
+
+    // Each block is preceded by its uncompressed and compressed sizes.
+    struct SpillBlockHeader {
+        int rawLen;
+        int compressedLen;
+    };
+
+    static AtomicUInt spillFileCounter;
+
+    string SpillFile::directory() {
+        if (!cmdLine.tmpDir.empty()) {
+            return cmdLine.tmpDir;
+        }
+        return (boost::filesystem::path(dbpath) / "_tmp").string();
+    }
+
+    SpillFile::SpillFile(const StringData &purpose) :
+        _fileLen(0), _block(spillBlockSize), _runBegin(0) {
+        const string dir = directory();
+        boost::filesystem::create_directories(dir);
+        stringstream name;
+        name << purpose.toString() << "." << getpid() << "." << spillFileCounter++;
+        _path = (boost::filesystem::path(dir) / name.str()).string();
+        _file.open(_path.c_str());
+        uassert(17352, str::stream() << "couldn't create sort spill file " << _path,
+                       !_file.bad());
+        LOG(1) << "spilling sort data to " << _path << endl;
+    }
+
+    SpillFile::~SpillFile() {
+        try {
+            boost::filesystem::remove(_path);
+        } catch (const std::exception &e) {
+            warning() << "couldn't remove sort spill file " << _path << ": " << e.what() << endl;
+        }
+    }
+
+    void SpillFile::append(const BSONObj &obj) {
+        if (_block.len() > 0 && _block.len() + obj.objsize() > spillBlockSize) {
+            writeBlock();
+        }
+        _block.appendBuf(obj.objdata(), obj.objsize());
+    }
+
+    void SpillFile::endRun() {
+        if (_block.len() > 0) {
+            writeBlock();
+        }
+        _runs.push_back(make_pair(_runBegin, _fileLen));
+        _runBegin = _fileLen;
+    }
+
+    void SpillFile::writeBlock() {
+        uLongf compressedLen = compressBound(_block.len());
+        BufBuilder out(sizeof(SpillBlockHeader) + compressedLen);
+        out.skip(sizeof(SpillBlockHeader));
+        int r = compress2(reinterpret_cast<Bytef *>(out.buf() + sizeof(SpillBlockHeader)), &compressedLen,
+                          reinterpret_cast<const Bytef *>(_block.buf()), _block.len(), Z_BEST_SPEED);
+        massert(17353, str::stream() << "couldn't compress sort data, zlib error " << r, r == Z_OK);
+        SpillBlockHeader *header = reinterpret_cast<SpillBlockHeader *>(out.buf());
+        header->rawLen = _block.len();
+        header->compressedLen = compressedLen;
+
+        const unsigned len = sizeof(SpillBlockHeader) + compressedLen;
+        _file.write(_fileLen, out.buf(), len);
+        uassert(17354, str::stream() << "couldn't write to sort spill file " << _path,
+                       !_file.bad());
+        _fileLen += len;
+        _block.reset();
+    }
+
+    fileofs SpillFile::readBlock(fileofs pos, string &block) {
+        SpillBlockHeader header;
+        _file.read(pos, reinterpret_cast<char *>(&header), sizeof header);
+        uassert(17355, str::stream() << "couldn't read sort spill file " << _path,
+                       !_file.bad());
+        scoped_array<char> compressed(new char[header.compressedLen]);
+        _file.read(pos + sizeof header, compressed.get(), header.compressedLen);
+        uassert(17356, str::stream() << "couldn't read sort spill file " << _path,
+                       !_file.bad());
+
+        block.resize(header.rawLen);
+        uLongf rawLen = header.rawLen;
+        int r = uncompress(reinterpret_cast<Bytef *>(&block[0]), &rawLen,
+                           reinterpret_cast<const Bytef *>(compressed.get()), header.compressedLen);
+        massert(17357, str::stream() << "corrupt block in sort spill file " << _path << ", zlib error " << r,
+                       r == Z_OK && rawLen == (uLongf) header.rawLen);
+        return pos + sizeof header + header.compressedLen;
+    }
+
+    shared_ptr<SpillFile::Reader> SpillFile::readRun(size_t i) {
+        verify(i < _runs.size());
+        return shared_ptr<Reader>(new Reader(*this, _runs[i].first, _runs[i].second));
+    }
+
+    SpillFile::Reader::Reader(SpillFile &file, fileofs begin, fileofs end) :
+        _file(file), _pos(begin), _end(end), _blockPos(0) {
+    }
+
+    BSONObj SpillFile::Reader::next() {
+        if (_blockPos >= _block.size()) {
+            verify(_pos < _end);
+            _pos = _file.readBlock(_pos, _block);
+            _blockPos = 0;
+        }
+        BSONObj obj(_block.data() + _blockPos);
+        _blockPos += obj.objsize();
+        return obj;
+    }
+
+} // namespace mongo
@@ -0,0 +1,93 @@
+// spill_file.h
+
+/**
+*    Copyright (C) 2013 Tokutek Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "mongo/pch.h"
+
+#include "mongo/db/jsobj.h"
+#include "mongo/util/file.h"
+
+namespace mongo {
+
+    /**
+     * A temporary file holding sorted runs of objects, for sorts that don't fit
+     * in memory. It is created in --tmpDir, or in the _tmp directory of the
+     * dbpath, and removed when destroyed.
+     *
+     * Objects are appended to the current run, and written to the file in zlib
+     * compressed blocks. Finished runs are read back with a Reader each. Readers
+     * of different runs may be used together to merge the runs, each one only
+     * holds one block in memory.
+     */
+    class SpillFile : boost::noncopyable {
+    public:
+        /** @param purpose used to name the file */
+        explicit SpillFile(const StringData &purpose);
+        ~SpillFile();
+
+        /** Append obj to the current run. */
+        void append(const BSONObj &obj);
+
+        /** Finish the current run, the next append() starts a new one. */
+        void endRun();
+
+        size_t nRuns() const { return _runs.size(); }
+
+        /** @return the size of the (compressed) data written so far */
+        uint64_t bytesWritten() const { return _fileLen; }
+
+        class Reader : boost::noncopyable {
+        public:
+            bool more() const { return _blockPos < _block.size() || _pos < _end; }
+
+            /** @return the next object, valid until the following call to next() */
+            BSONObj next();
+
+        private:
+            friend class SpillFile;
+            Reader(SpillFile &file, fileofs begin, fileofs end);
+
+            SpillFile &_file;
+            fileofs _pos;
+            const fileofs _end;
+            string _block;
+            size_t _blockPos;
+        };
+
+        /** @return a Reader of the i'th finished run */
+        shared_ptr<Reader> readRun(size_t i);
+
+        /** @return the directory spill files are created in */
+        static string directory();
+
+    private:
+        void writeBlock();
+        // Read the block at pos into block, @return the offset of the next block.
+        fileofs readBlock(fileofs pos, string &block);
+
+        string _path;
+        File _file;
+        fileofs _fileLen;
+        BufBuilder _block;
+        fileofs _runBegin;
+        // [begin, end) of each finished run
+        vector<pair<fileofs, fileofs> > _runs;
+    };
+
+} // namespace mongo
@@ -17,6 +17,7 @@
 #pragma once
 
 #include <db.h>
+#include <boost/function.hpp>
 
 #include "mongo/pch.h"
 #include "mongo/db/client.h"
@@ -42,6 +43,8 @@ namespace mongo {
                 Client &c;
                 Timer timer;
                 PercentageProgressMeter pm;
+                // Appended to the progress message, if set.
+                boost::function<std::string ()> status;
             };
             static int poll_function(void *extra, float progress) {
                 poll_function_extra *info = static_cast<poll_function_extra *>(extra);
@@ -50,6 +53,9 @@ namespace mongo {
 
                     if (info->pm.report(progress) && info->c.curop()) {
                         std::string status = info->pm.toString();
+                        if (info->status) {
+                            status += ", " + info->status();
+                        }
                         info->c.curop()->setMessage(status.c_str());
                     }
                     return 0;
@@ -76,6 +82,12 @@ namespace mongo {
                 info->errmsg = errmsg;
             }
 
+            // Report more than the builder's own progress, e.g. the
+            // progress of threads helping it. Called from build().
+            void setStatusFunction(const boost::function<std::string ()> &status) {
+                _poll_extra.status = status;
+            }
+
         protected:
             poll_function_extra _poll_extra;
             error_callback_extra _error_extra;
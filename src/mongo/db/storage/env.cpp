@@ -35,12 +35,15 @@
 #endif
 #include <fcntl.h>
 
+#include "mongo/base/counter.h"
 #include "mongo/db/curop.h"
 #include "mongo/db/client.h"
 #include "mongo/db/cmdline.h"
 #include "mongo/db/commands/server_status.h"
 #include "mongo/db/descriptor.h"
+#include "mongo/db/loader_key_generator.h"
 #include "mongo/db/server_parameters.h"
+#include "mongo/db/stats/timer_stats.h"
 #include "mongo/db/storage/assert_ids.h"
 #include "mongo/db/storage/dbt.h"
 #include "mongo/db/storage/exception.h"
@@ -158,20 +161,24 @@ namespace mongo {
                 // because the one and only key is src_key
                 verify(dest_db != src_db);
 
-                // Generate keys for a secondary index.
+                // Generate keys for a secondary index, unless a helper of
+                // the indexer already has.
+                BuildState *state = reinterpret_cast<BuildState *>(dest_db->app_private);
                 BSONObjSet keys;
-                descriptor.generateKeys(obj, keys);
+                if (state == NULL || state->keySource == NULL ||
+                    !state->keySource->takeKeys(pk, obj, keys)) {
+                    descriptor.generateKeys(obj, keys);
+                }
                 dbt_array_clear_and_resize(dest_keys, keys.size());
                 for (BSONObjSet::const_iterator i = keys.begin(); i != keys.end(); i++) {
-                    const Key sKey(*i, &pk);
+                    const Key sKey(*i, &pk, descriptor.keyFormat());
                     dbt_array_push(dest_keys, sKey.buf(), sKey.size());
                 }
                 // Set the multiKey bool if it's provided and we generated multiple keys.
                 // See CollectionBase::IndexerBase::Indexer()
-                if (dest_db->app_private != NULL && keys.size() > 1) {
-                    bool *multiKey = reinterpret_cast<bool *>(dest_db->app_private);
-                    if (!*multiKey) {
-                        *multiKey = true;
+                if (state != NULL && keys.size() > 1) {
+                    if (!state->multiKey) {
+                        state->multiKey = true;
                     }
                 }
             } catch (const DBException &ex) {
@@ -241,11 +248,17 @@ namespace mongo {
             return cmdLine.lockTimeout;
         }
 
-        static uint64_t get_loader_memory_size_callback(void) {
+        uint64_t loader_max_memory() {
             return cmdLine.loaderMaxMemory > 0 ?
                 (uint64_t) cmdLine.loaderMaxMemory : 100 * 1024 * 1024;
         }
 
+        static uint64_t get_loader_memory_size_callback(void) {
+            // Keys generated in parallel for the loader come out of its budget.
+            const uint64_t bytes = loader_max_memory();
+            return bytes - LoaderKeyGenerator::memoryShare(bytes);
+        }
+
         static void lock_not_granted_callback(DB *db, uint64_t requesting_txnid,
                                               const DBT *left_key, const DBT *right_key,
                                               uint64_t blocking_txnid);
@@ -1037,6 +1050,74 @@ namespace mongo {
             }
         }
 
+        // How long the leader of a group commit waits for more committers
+        // to join its group before flushing the log.
+        MONGO_EXPORT_SERVER_PARAMETER(groupCommitWaitMicros, uint32_t, 0);
+
+        // Number of log flushes done by group commit leaders
+        static TimerStats groupCommitFlushStats;
+        static ServerStatusMetricField<TimerStats> displayGroupCommitFlushes("storage.groupCommit.flushes",
+                                                                             &groupCommitFlushStats);
+        // Number of commits made durable by group commit flushes,
+        // the average group size is commits / flushes.num
+        static Counter64 groupCommitCommitsStats;
+        static ServerStatusMetricField<Counter64> displayGroupCommitCommits("storage.groupCommit.commits",
+                                                                            &groupCommitCommitsStats);
+        // Time each committer spends waiting for its commit to be made durable
+        static TimerStats groupCommitWaitStats;
+        static ServerStatusMetricField<TimerStats> displayGroupCommitWaits("storage.groupCommit.waits",
+                                                                           &groupCommitWaitStats);
+
+        static boost::mutex _groupCommitMutex;
+        static boost::condition_variable _groupCommitCond;
+        // each caller of group_log_flush takes a ticket after its commit
+        // record is in the log, and returns once a flush that started after
+        // its ticket was taken has completed
+        static uint64_t _groupCommitTickets;
+        static uint64_t _groupCommitFlushed;
+        static bool _groupCommitFlushing;
+
+        void group_log_flush() {
+            TimerHolder waitTimer(&groupCommitWaitStats);
+            boost::unique_lock<boost::mutex> lk(_groupCommitMutex);
+            const uint64_t ticket = ++_groupCommitTickets;
+            while (_groupCommitFlushed < ticket && _groupCommitFlushing) {
+                _groupCommitCond.wait(lk);
+            }
+            if (_groupCommitFlushed >= ticket) {
+                // the leader of our group flushed for us
+                return;
+            }
+
+            // we are the leader of the next group
+            _groupCommitFlushing = true;
+            if (groupCommitWaitMicros > 0) {
+                lk.unlock();
+                sleepmicros(groupCommitWaitMicros);
+                lk.lock();
+            }
+            const uint64_t lastTicket = _groupCommitTickets;
+            lk.unlock();
+
+            int r;
+            {
+                TimerHolder flushTimer(&groupCommitFlushStats);
+                r = env->log_flush(env, NULL);
+            }
+
+            lk.lock();
+            if (r == 0) {
+                groupCommitCommitsStats.increment(lastTicket - _groupCommitFlushed);
+                _groupCommitFlushed = lastTicket;
+            }
+            _groupCommitFlushing = false;
+            _groupCommitCond.notify_all();
+            lk.unlock();
+            if (r != 0) {
+                handle_ydb_error(r);
+            }
+        }
+
         void checkpoint() {
             // Run a checkpoint. The zeros mean nothing (bdb-API artifacts).
             int r = env->txn_checkpoint(env, 0, 0, 0);
@@ -18,6 +18,7 @@
 
 #include "mongo/pch.h"
 #include "mongo/bson/bsonobj.h"
+#include "mongo/bson/bsonmisc.h"
 
 #include <db.h>
 
@@ -36,6 +37,25 @@ namespace mongo {
             }
         };
 
+        // Keys for rows of a dictionary being built, generated ahead of the builder.
+        class KeySource : boost::noncopyable {
+        public:
+            virtual ~KeySource() { }
+            // @return true if the keys for the row (pk, obj) were already
+            //         generated, in which case they are added to keys.
+            virtual bool takeKeys(const BSONObj &pk, const BSONObj &obj, BSONObjSet &keys) = 0;
+        };
+
+        // What generate_keys() finds in the app_private member of a dictionary
+        // being built by an indexer or loader. See MultiKeyTracker.
+        struct BuildState {
+            BuildState() : multiKey(false), keySource(NULL) { }
+            // Set if some row generated more than one key.
+            bool multiKey;
+            // If non-null, consulted before generating keys.
+            KeySource *keySource;
+        };
+
         extern DB_ENV *env;
 
         void startup(TxnCompleteHooks *hooks, UpdateCallback *updateCallback);
@@ -48,6 +68,9 @@ namespace mongo {
         void get_pending_lock_request_status(vector<BSONObj> &pendingLockRequests);
         void get_live_transaction_status(vector<BSONObj> &liveTransactions);
         void log_flush();
+        // Like log_flush(), but concurrent callers share a single flush of the log.
+        // Used to make transactions committed with DB_TXN_NOSYNC durable.
+        void group_log_flush();
         void checkpoint();
 
         void set_log_flush_interval(uint32_t period_ms);
@@ -56,6 +79,8 @@ namespace mongo {
         void set_cleaner_iterations(uint32_t num_iterations);
         void set_lock_timeout(uint64_t timeout_ms);
         void set_loader_max_memory(uint64_t bytes);
+        // The memory a single bulk load may use, see get_loader_memory_size_callback().
+        uint64_t loader_max_memory();
 
         void handle_ydb_error(int error);
         MONGO_COMPILER_NORETURN void handle_ydb_error_fatal(int error);
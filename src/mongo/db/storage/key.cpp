@@ -23,6 +23,7 @@
 #include "mongo/db/jsobj.h"
 #include "mongo/db/storage/key.h"
 #include "mongo/server.h"
+#include "mongo/util/mongoutils/str.h"
 
 namespace mongo {
 
@@ -93,8 +94,19 @@ namespace mongo {
             dassert( (*_keyData & cNOTUSED) == 0 );
         }
 
-        // fromBSON to KeyV1 format
         KeyV1Owned::KeyV1Owned(const BSONObj& obj) {
+            compact(obj);
+        }
+
+        KeyV1Owned::KeyV1Owned(const BSONObj& obj, const KeyFormat &format) {
+            if( format.binary() && binary(obj, format.ordering()) )
+                return;
+            b.reset();
+            compact(obj);
+        }
+
+        // fromBSON to KeyV1 format
+        void KeyV1Owned::compact(const BSONObj& obj) {
             BSONObj::iterator i(obj);
             unsigned char bits = 0;
             while( 1 ) { 
@@ -205,10 +217,274 @@ namespace mongo {
             dassert( (*_keyData & cNOTUSED) == 0 );
         }
 
+        KeyFormat::Encoding KeyFormat::parse(const BSONElement &e) {
+            if( e.eoo() || e.isNull() )
+                return V1;
+            uassert( 17350, mongoutils::str::stream() << "keyFormat must be \"v1\" or \"binary\", got " << e,
+                     e.type() == String && (e.str() == "v1" || e.str() == "binary") );
+            return e.str() == "binary" ? Binary : V1;
+        }
+
+        /* Binary format:
+
+             [IsBinary][2 byte big endian body length][body][1 byte n][n number types]
+
+           The body is each element's encoding, concatenated:
+
+             1 byte canonical type (the same values as the compact format), then
+             number:  8 byte big endian double, with the sign bit flipped if positive or
+                      every bit flipped if negative (-0 is stored as 0)
+             string:  the bytes with each 0x00 escaped as 0x00 0xff, then 0x00 0x00
+             bindata: 4 byte big endian length, subtype, data
+             oid:     12 bytes
+             date:    8 byte big endian with the sign bit flipped
+             minkey, null, false, true, maxkey: nothing more
+
+           and every byte of a descending field's encoding is inverted. Ascending type
+           bytes are all below 0x80, so decoding can tell which elements are inverted.
+
+           Two bodies compare the same way as the keys they encode under the index
+           Ordering, by memcmp and then length. The number types after the body aren't
+           compared, they remember whether each number was an int, long or double.
+
+           Longs that a double can't hold exactly, NaN, and every other BSON type don't
+           fit, and a key with any of them is stored in the compact format instead.
+        */
+
+        template <class Builder>
+        static void appendBigEndian(Builder &b, const unsigned long long x, const int bytes) {
+            for( int i = bytes - 1; i >= 0; i-- )
+                b.appendUChar( (unsigned char) (x >> (8 * i)) );
+        }
+
+        static unsigned long long readBigEndian(const unsigned char *p, const int bytes,
+                                                const unsigned char invert) {
+            unsigned long long x = 0;
+            for( int i = 0; i < bytes; i++ )
+                x = (x << 8) | (unsigned char) (p[i] ^ invert);
+            return x;
+        }
+
+        static const unsigned long long signBit = 1ULL << 63;
+
+        static unsigned long long orderedDouble(double d) {
+            if( d == 0 )
+                d = 0; // -0 == 0
+            unsigned long long x;
+            memcpy(&x, &d, sizeof(x));
+            return (x & signBit) ? ~x : x | signBit;
+        }
+
+        static double unorderedDouble(unsigned long long x) {
+            x = (x & signBit) ? x & ~signBit : ~x;
+            double d;
+            memcpy(&d, &x, sizeof(d));
+            return d;
+        }
+
+        // numbers up to this magnitude are stored exactly by a double
+        static const long long maxExactDouble = 1LL << 53;
+
+        // number types remembered after the body
+        enum { NegativeZero = 0x80 };
+
+        bool KeyV1Owned::binary(const BSONObj& obj, const Ordering &ordering) {
+            b.appendUChar(IsBinary);
+            b.appendUChar(0); // body length, filled in below
+            b.appendUChar(0);
+
+            unsigned char types[32];
+            unsigned n = 0;
+            unsigned mask = 1;
+            for( BSONObjIterator i(obj); i.more(); mask <<= 1 ) {
+                const BSONElement e = i.next();
+                const int start = b.len();
+                switch( e.type() ) {
+                case MinKey:
+                    b.appendUChar(cminkey);
+                    break;
+                case jstNULL:
+                    b.appendUChar(cnull);
+                    break;
+                case MaxKey:
+                    b.appendUChar(cmaxkey);
+                    break;
+                case Bool:
+                    b.appendUChar(e.boolean() ? ctrue : cfalse);
+                    break;
+                case jstOID:
+                    b.appendUChar(coid);
+                    b.appendBuf(&e.__oid(), sizeof(OID));
+                    break;
+                case Date:
+                    b.appendUChar(cdate);
+                    appendBigEndian(b, e.date().millis ^ signBit, 8);
+                    break;
+                case BinData:
+                    {
+                        int len;
+                        const char *d = e.binData(len);
+                        b.appendUChar(cbindata);
+                        appendBigEndian(b, len, 4);
+                        b.appendUChar(e.binDataType());
+                        b.appendBuf(d, len);
+                        break;
+                    }
+                case String:
+                    {
+                        b.appendUChar(cstring);
+                        const char *p = e.valuestr();
+                        const char *end = p + e.valuestrsize() - 1;
+                        for( ; p < end; p++ ) {
+                            b.appendChar(*p);
+                            if( *p == 0 )
+                                b.appendUChar(0xff);
+                        }
+                        b.appendUChar(0);
+                        b.appendUChar(0);
+                        break;
+                    }
+                case NumberInt:
+                case NumberLong:
+                case NumberDouble:
+                    {
+                        unsigned char type = e.type();
+                        if( e.type() == NumberLong ) {
+                            const long long x = e._numberLong();
+                            if( x >= maxExactDouble || x <= -maxExactDouble )
+                                return false;
+                        }
+                        else if( e.type() == NumberDouble ) {
+                            const double d = e._numberDouble();
+                            if( isNaN(d) )
+                                return false;
+                            unsigned long long bits;
+                            memcpy(&bits, &d, sizeof(bits));
+                            if( d == 0 && (bits & signBit) )
+                                type |= NegativeZero;
+                        }
+                        if( n == sizeof(types) )
+                            return false;
+                        types[n++] = type;
+                        b.appendUChar(cdouble);
+                        appendBigEndian(b, orderedDouble(e.number()), 8);
+                        break;
+                    }
+                default:
+                    return false;
+                }
+                if( ordering.descending(mask) ) {
+                    unsigned char *p = (unsigned char *) b.buf() + start;
+                    for( unsigned char *end = (unsigned char *) b.buf() + b.len(); p < end; p++ )
+                        *p = ~*p;
+                }
+            }
+
+            const int bodyLength = b.len() - 3;
+            if( bodyLength > 0xffff )
+                return false;
+            b.buf()[1] = (char) (bodyLength >> 8);
+            b.buf()[2] = (char) bodyLength;
+            b.appendUChar(n);
+            b.appendBuf(types, n);
+            _keyData = (const unsigned char *) b.buf();
+            dassert( b.len() == dataSize() );
+            return true;
+        }
+
+        static unsigned binaryBodyLength(const unsigned char *p) {
+            return (((unsigned) p[1]) << 8) | p[2];
+        }
+
+        BSONObj KeyV1::binaryToBson(BufBuilder &bb) const {
+            const unsigned char *p = _keyData + 3;
+            const unsigned char *const end = p + binaryBodyLength(_keyData);
+            const unsigned char *types = end + 1;
+
+            BSONObjBuilder b(bb);
+            while( p < end ) {
+                const unsigned char invert = (*p & 0x80) ? 0xff : 0;
+                const unsigned char type = *p++ ^ invert;
+                switch( type ) {
+                    case cminkey: b.appendMinKey(""); break;
+                    case cnull:   b.appendNull(""); break;
+                    case cfalse:  b.appendBool("", false); break;
+                    case ctrue:   b.appendBool("", true); break;
+                    case cmaxkey: b.appendMaxKey(""); break;
+                    case cdouble:
+                        {
+                            const double d = unorderedDouble(readBigEndian(p, 8, invert));
+                            p += 8;
+                            const unsigned char numberType = *types++;
+                            if( numberType == NumberInt )
+                                b.append("", (int) d);
+                            else if( numberType == NumberLong )
+                                b.append("", (long long) d);
+                            else if( numberType & NegativeZero )
+                                b.append("", -0.0);
+                            else
+                                b.append("", d);
+                            break;
+                        }
+                    case cstring:
+                        {
+                            // we build the element ourself as the string may contain nulls
+                            BufBuilder &sb = b.bb();
+                            sb.appendNum((char) String);
+                            sb.appendUChar(0); // fieldname ""
+                            const int sizeOffset = sb.len();
+                            sb.appendNum((int) 0);
+                            while( 1 ) {
+                                const unsigned char c = *p++ ^ invert;
+                                if( c == 0 && (*p++ ^ invert) == 0 )
+                                    break;
+                                sb.appendUChar(c);
+                            }
+                            sb.appendUChar(0); // null char at end of string
+                            const int size = sb.len() - sizeOffset - sizeof(int);
+                            memcpy(sb.buf() + sizeOffset, &size, sizeof(int));
+                            break;
+                        }
+                    case coid:
+                        {
+                            unsigned char oid[sizeof(OID)];
+                            for( size_t i = 0; i < sizeof(OID); i++ )
+                                oid[i] = p[i] ^ invert;
+                            b.appendOID("", (OID *) oid);
+                            p += sizeof(OID);
+                            break;
+                        }
+                    case cdate:
+                        b.appendDate("", Date_t(readBigEndian(p, 8, invert) ^ signBit));
+                        p += 8;
+                        break;
+                    case cbindata:
+                        {
+                            const int len = (int) readBigEndian(p, 4, invert);
+                            p += 4;
+                            BufBuilder &sb = b.bb();
+                            sb.appendNum((char) BinData);
+                            sb.appendUChar(0); // fieldname ""
+                            sb.appendNum(len);
+                            sb.appendUChar(*p++ ^ invert); // subtype
+                            for( int i = 0; i < len; i++ )
+                                sb.appendUChar(p[i] ^ invert);
+                            p += len;
+                            break;
+                        }
+                    default:
+                        verify(false);
+                }
+            }
+            return b.done();
+        }
+
         BSONObj KeyV1::toBson(BufBuilder &bb) const { 
             verify( _keyData != 0 );
             if( !isCompactFormat() )
                 return bson();
+            if( isBinaryFormat() )
+                return binaryToBson(bb);
 
             BSONObjBuilder b(bb);
             const unsigned char *p = _keyData;
@@ -281,6 +557,40 @@ namespace mongo {
             return b.done();
         }
 
+        static unsigned sizes[] = {
+            0,
+            1, //cminkey=1,
+            1, //cnull=2,
+            0,
+            9, //cdouble=4,
+            0,
+            0, //cstring=6,
+            0,
+            13, //coid=8,
+            0,
+            1, //cfalse=10,
+            1, //ctrue=11,
+            9, //cdate=12,
+            0,
+            1, //cmaxkey=14,
+            0
+        };
+
+        inline unsigned sizeOfElement(const unsigned char *p) { 
+            unsigned type = *p & cCANONTYPEMASK;
+            unsigned sz = sizes[type];
+            if( sz == 0 ) {
+                if( type == cstring ) { 
+                    sz = ((unsigned) p[1]) + 2;
+                }
+                else {
+                    verify( type == cbindata );
+                    sz = binDataCodeToLength(p[1]) + 2;
+                }
+            }
+            return sz;
+        }
+
         static int compare(const unsigned char *&l, const unsigned char *&r) {
             int lt_real = *l;
             int rt_real = *r;
@@ -399,14 +709,10 @@ namespace mongo {
             return L.woCompare(R, order, /*considerfieldname*/false);
         }
 
-        int KeyV1::woCompare(const KeyV1& right, const Ordering &order) const {
-            const unsigned char *l = _keyData;
-            const unsigned char *r = right._keyData;
-
-            if( (*l|*r) == IsBSON ) // only can do this if cNOTUSED maintained
-                return compareHybrid(right, order);
-
-            unsigned mask = 1;
+        // compare compact format keys element by element, starting at l and r,
+        // where mask is the Ordering bit of the elements at l and r.
+        static int compareFrom(const unsigned char *l, const unsigned char *r,
+                               const Ordering &order, unsigned mask) {
             while( 1 ) { 
                 char lval = *l; 
                 char rval = *r;
@@ -433,38 +739,31 @@ namespace mongo {
             return 0;
         }
 
-        static unsigned sizes[] = {
-            0,
-            1, //cminkey=1,
-            1, //cnull=2,
-            0,
-            9, //cdouble=4,
-            0,
-            0, //cstring=6,
-            0,
-            13, //coid=8,
-            0,
-            1, //cfalse=10,
-            1, //ctrue=11,
-            9, //cdate=12,
-            0,
-            1, //cmaxkey=14,
-            0
-        };
+        // both keys are in the binary format, which already accounts for the ordering,
+        // so one memcmp of the bodies is the whole comparison
+        static int compareBinary(const unsigned char *l, const unsigned char *r) {
+            const unsigned llen = binaryBodyLength(l);
+            const unsigned rlen = binaryBodyLength(r);
+            const int res = memcmp(l + 3, r + 3, min(llen, rlen));
+            if( res )
+                return res;
+            return (int) llen - (int) rlen;
+        }
 
-        inline unsigned sizeOfElement(const unsigned char *p) { 
-            unsigned type = *p & cCANONTYPEMASK;
-            unsigned sz = sizes[type];
-            if( sz == 0 ) {
-                if( type == cstring ) { 
-                    sz = ((unsigned) p[1]) + 2;
-                }
-                else {
-                    verify( type == cbindata );
-                    sz = binDataCodeToLength(p[1]) + 2;
-                }
+        int KeyV1::woCompare(const KeyV1& right, const Ordering &order) const {
+            const unsigned char *l = _keyData;
+            const unsigned char *r = right._keyData;
+
+            if( *l == IsBinary || *r == IsBinary ) { // before the IsBSON test, IsBinary|1 == IsBSON
+                if( *l == *r )
+                    return compareBinary(l, r);
+                return compareHybrid(right, order);
             }
-            return sz;
+
+            if( (*l|*r) == IsBSON ) // only can do this if cNOTUSED maintained
+                return compareHybrid(right, order);
+
+            return compareFrom(l, r, order, 1);
         }
 
         int KeyV1::dataSize() const { 
@@ -472,6 +771,10 @@ namespace mongo {
             if( !isCompactFormat() ) {
                 return bson().objsize() + 1;
             }
+            if( isBinaryFormat() ) {
+                const unsigned typesOffset = 3 + binaryBodyLength(p);
+                return typesOffset + 1 + p[typesOffset];
+            }
 
             bool more;
             do { 
@@ -486,7 +789,7 @@ namespace mongo {
             const unsigned char *l = _keyData;
             const unsigned char *r = right._keyData;
 
-            if( (*l|*r) == IsBSON ) {
+            if( *l == IsBinary || *r == IsBinary || (*l|*r) == IsBSON ) {
                 return toBson().equal(right.toBson());
             }
 
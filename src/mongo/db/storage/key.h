@@ -41,6 +41,40 @@ namespace mongo {
 
     namespace storage {
 
+        /**
+         * How the KeyV1 part of an index's keys is encoded, chosen per index with the
+         * keyFormat index option (stored in the index's Descriptor).
+         *
+         * - V1 ("v1", the default): the compact format, compared element by element.
+         * - Binary ("binary"): each value is encoded, along with its field's direction
+         *   from the index Ordering, into a string whose byte order is the index order,
+         *   so two keys compare with a memcmp. Keys with values the binary format can't
+         *   represent are stored as V1, and the two formats compare correctly against
+         *   each other.
+         */
+        class KeyFormat {
+        public:
+            enum Encoding {
+                V1 = 0,
+                Binary = 1
+            };
+
+            KeyFormat() : _encoding(V1), _ordering(Ordering::make(BSONObj())) { }
+            KeyFormat(const Encoding encoding, const Ordering &ordering) :
+                _encoding(encoding), _ordering(ordering) { }
+
+            Encoding encoding() const { return _encoding; }
+            bool binary() const { return _encoding == Binary; }
+            const Ordering &ordering() const { return _ordering; }
+
+            /** @return the encoding named by an index's keyFormat option, uasserts if unknown */
+            static Encoding parse(const BSONElement &e);
+
+        private:
+            Encoding _encoding;
+            Ordering _ordering;
+        };
+
         /** Key class for precomputing a small format index key that is denser than a traditional BSONObj. */
         class KeyV1Owned;
 
@@ -83,10 +117,11 @@ namespace mongo {
             /** only used by geo, which always has bson keys */
             BSONElement _firstElement() const { return bson().firstElement(); }
             bool isCompactFormat() const { return *_keyData != IsBSON; }
+            bool isBinaryFormat() const { return *_keyData == IsBinary; }
 
             bool isValid() const { return _keyData > (const unsigned char*)1; }
         protected:
-            enum { IsBSON = 0xff };
+            enum { IsBSON = 0xff, IsBinary = 0xfe };
             const unsigned char *_keyData;
             BSONObj bson() const {
                 dassert( !isCompactFormat() );
@@ -94,6 +129,7 @@ namespace mongo {
             }
         private:
             int compareHybrid(const KeyV1& right, const Ordering& order) const;
+            BSONObj binaryToBson(BufBuilder &bb) const;
         };
 
         class KeyV1Owned : public KeyV1 {
@@ -105,11 +141,16 @@ namespace mongo {
             */
             KeyV1Owned(const BSONObj& obj);
 
+            /** as above, but in the binary format if format asks for it and obj is representable */
+            KeyV1Owned(const BSONObj& obj, const KeyFormat &format);
+
             /** makes a copy (memcpy's the whole thing) */
             KeyV1Owned(const KeyV1& rhs);
 
         private:
             StackBufBuilder b;
+            void compact(const BSONObj& obj);
+            bool binary(const BSONObj& obj, const Ordering &ordering); // false if obj can't be stored as binary
             void traditional(const BSONObj& obj); // store as traditional bson not as compact format
         };
 
@@ -118,8 +159,8 @@ namespace mongo {
         class Key {
         public:
             // For serializing
-            Key(const BSONObj &key, const BSONObj *pk) {
-                KeyV1Owned keyOwned(key);
+            Key(const BSONObj &key, const BSONObj *pk, const KeyFormat &format = KeyFormat()) {
+                KeyV1Owned keyOwned(key, format);
                 _b.appendBuf(keyOwned.data(), keyOwned.dataSize());
                 if (pk != NULL) {
                     _b.appendBuf(pk->objdata(), pk->objsize());
@@ -210,9 +251,9 @@ namespace mongo {
                 _size = size;
             }
 
-            void reset(const BSONObj &other, const BSONObj *pk) {
+            void reset(const BSONObj &other, const BSONObj *pk, const KeyFormat &format = KeyFormat()) {
                 _b.reset();
-                KeyV1Owned otherOwned(other);
+                KeyV1Owned otherOwned(other, format);
                 _b.appendBuf(otherOwned.data(), otherOwned.dataSize());
                 if (pk != NULL) {
                     _b.appendBuf(pk->objdata(), pk->objsize());
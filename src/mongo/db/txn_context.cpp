@@ -222,7 +222,19 @@ namespace mongo {
 
             _clientCursorRollback.preComplete();
             try {
-                _txn.commit(flags);
+                if (gotGTID && !(flags & DB_TXN_NOSYNC)) {
+                    // Group commit: instead of each transaction that wrote to the
+                    // oplog paying for its own fsync of the recovery log, commit
+                    // without syncing and let concurrent committers share a single
+                    // log flush. We still wait for the flush before telling the
+                    // GTIDManager we are done, so secondaries never see an oplog
+                    // entry that is not durable on the primary.
+                    _txn.commit(flags | DB_TXN_NOSYNC);
+                    storage::group_log_flush();
+                }
+                else {
+                    _txn.commit(flags);
+                }
             }
             catch (std::exception &e) {
                 StackStringBuilder ssb;
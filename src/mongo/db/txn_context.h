@@ -215,6 +215,8 @@ namespace mongo {
         }
         /** @return true iff this transaction is live */
         bool isLive() const { return _txn.isLive(); }
+        /** @return the flags this transaction was begun with */
+        int flags() const { return _txn.flags(); }
         /** @return true iff this transaction is read only */
         bool readOnly() const { return (_txn.flags() & DB_TXN_READ_ONLY) != 0; }
         /** @return true iff this transaction has serializable isolation.
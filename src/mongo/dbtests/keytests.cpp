@@ -0,0 +1,309 @@
+/*
+ *    Copyright (C) 2013 Tokutek Inc.
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "pch.h"
+#include "dbtests.h"
+
+#include "mongo/db/jsobj.h"
+#include "mongo/db/storage/key.h"
+#include "mongo/util/timer.h"
+
+namespace KeyTests {
+
+    using storage::Key;
+    using storage::KeyV1;
+
+    static int sign(int x) {
+        return x < 0 ? -1 : (x > 0 ? 1 : 0);
+    }
+
+    // Keys covering every type the binary format encodes, with the
+    // edge cases of each encoding.
+    static void binaryKeyValues(vector<BSONObj> &values) {
+        values.push_back(BSON("" << MINKEY));
+        values.push_back(BSON("" << BSONNULL));
+        values.push_back(BSON("" << -numeric_limits<double>::infinity()));
+        values.push_back(BSON("" << -1.5));
+        values.push_back(BSON("" << -1));
+        values.push_back(BSON("" << -1LL));
+        values.push_back(BSON("" << -0.5));
+        values.push_back(BSON("" << 0));
+        values.push_back(BSON("" << -0.0));
+        values.push_back(BSON("" << 0.0));
+        values.push_back(BSON("" << numeric_limits<double>::denorm_min()));
+        values.push_back(BSON("" << 1));
+        values.push_back(BSON("" << 1.0));
+        values.push_back(BSON("" << 2LL));
+        values.push_back(BSON("" << ((1LL << 53) - 1)));
+        values.push_back(BSON("" << 1e300));
+        values.push_back(BSON("" << numeric_limits<double>::infinity()));
+        values.push_back(BSON("" << ""));
+        {
+            BSONObjBuilder b;
+            b.append("", "\0", 2);
+            values.push_back(b.obj());
+        }
+        values.push_back(BSON("" << "a"));
+        {
+            BSONObjBuilder b;
+            b.append("", "a\0", 3);
+            values.push_back(b.obj());
+        }
+        {
+            BSONObjBuilder b;
+            b.append("", "a\0b", 4);
+            values.push_back(b.obj());
+        }
+        values.push_back(BSON("" << "a\x01"));
+        values.push_back(BSON("" << "ab"));
+        values.push_back(BSON("" << "\xff"));
+        values.push_back(BSON("" << string(300, 'z')));
+        {
+            const char data[] = { 0, 1, (char) 0xff, 2 };
+            BSONObjBuilder b1, b2, b3, b4;
+            b1.appendBinData("", 0, BinDataGeneral, data);
+            b2.appendBinData("", 4, BinDataGeneral, data);
+            b3.appendBinData("", 4, bdtCustom, data);
+            b4.appendBinData("", 3, ByteArrayDeprecated, data);
+            values.push_back(b1.obj());
+            values.push_back(b2.obj());
+            values.push_back(b3.obj());
+            values.push_back(b4.obj());
+        }
+        values.push_back(BSON("" << OID("4f5e4d3c2b1a000000000001")));
+        values.push_back(BSON("" << OID("ff5e4d3c2b1a000000000001")));
+        values.push_back(BSON("" << false));
+        values.push_back(BSON("" << true));
+        values.push_back(BSON("" << Date_t((unsigned long long) -5LL)));
+        values.push_back(BSON("" << Date_t(0)));
+        values.push_back(BSON("" << Date_t(256)));
+        values.push_back(BSON("" << MAXKEY));
+    }
+
+    static void compoundKeys(const vector<BSONObj> &values, vector<BSONObj> &keys) {
+        for (vector<BSONObj>::const_iterator i = values.begin(); i != values.end(); ++i) {
+            keys.push_back(*i);
+            for (size_t j = 0; j < values.size(); j += 3) {
+                BSONObjBuilder b;
+                b.appendAs(i->firstElement(), "");
+                b.appendAs(values[j].firstElement(), "");
+                keys.push_back(b.obj());
+            }
+        }
+    }
+
+    static const Ordering binaryOrderings[] = { Ordering::make(BSON("a" << 1 << "b" << 1)),
+                                                Ordering::make(BSON("a" << 1 << "b" << -1)),
+                                                Ordering::make(BSON("a" << -1 << "b" << 1)),
+                                                Ordering::make(BSON("a" << -1 << "b" << -1)) };
+    static const size_t nBinaryOrderings = sizeof(binaryOrderings) / sizeof(binaryOrderings[0]);
+
+    /** Binary format keys decode to exactly the BSON they were made from, number types included. */
+    class BinaryRoundTrip {
+    public:
+        void run() {
+            vector<BSONObj> values;
+            binaryKeyValues(values);
+            vector<BSONObj> keys;
+            compoundKeys(values, keys);
+            const BSONObj pk = BSON("" << 7);
+            for (size_t o = 0; o < nBinaryOrderings; o++) {
+                const storage::KeyFormat format(storage::KeyFormat::Binary, binaryOrderings[o]);
+                for (vector<BSONObj>::const_iterator i = keys.begin(); i != keys.end(); ++i) {
+                    const Key k(*i, &pk, format);
+                    ASSERT(KeyV1(k.buf()).isBinaryFormat());
+                    ASSERT(i->binaryEqual(k.key()));
+                    ASSERT_EQUALS(pk, k.pk());
+                    ASSERT_EQUALS(k.size(), Key(k.buf(), true).size());
+                }
+            }
+        }
+    };
+
+    /** Values the binary format can't hold are stored in the compact (or BSON) format instead. */
+    class BinaryFallback {
+    public:
+        void run() {
+            const storage::KeyFormat format(storage::KeyFormat::Binary, binaryOrderings[0]);
+            BSONObjBuilder timestamp;
+            timestamp.appendTimestamp("", 1000, 2);
+            const BSONObj keys[] = { BSON("" << (1LL << 53)),
+                                     BSON("" << -(1LL << 60)),
+                                     BSON("" << numeric_limits<double>::quiet_NaN()),
+                                     BSON("" << 1 << "" << BSON_ARRAY(1 << 2)),
+                                     BSON("" << BSON("x" << 1)),
+                                     timestamp.obj(),
+                                     BSON("" << "a" << "" << BSONRegEx("^a", "")) };
+            for (size_t i = 0; i < sizeof(keys) / sizeof(keys[0]); i++) {
+                const Key k(keys[i], NULL, format);
+                ASSERT(!KeyV1(k.buf()).isBinaryFormat());
+                ASSERT(keys[i].binaryEqual(k.key()));
+            }
+            // V1 is the default
+            ASSERT(!KeyV1(Key(BSON("" << 1), NULL).buf()).isBinaryFormat());
+        }
+    };
+
+    /**
+     * Binary keys compare like the BSON they encode, with each other and with keys
+     * that had to fall back to the compact and BSON formats.
+     */
+    class BinaryCompareAgreesWithBSON {
+    public:
+        void run() {
+            vector<BSONObj> values;
+            binaryKeyValues(values);
+            // a few that fall back, to check comparisons between formats
+            values.push_back(BSON("" << numeric_limits<double>::quiet_NaN()));
+            values.push_back(BSON("" << BSON_ARRAY(1)));
+            values.push_back(BSON("" << "b"));
+            vector<BSONObj> keys;
+            compoundKeys(values, keys);
+
+            for (size_t o = 0; o < nBinaryOrderings; o++) {
+                const Ordering &ordering = binaryOrderings[o];
+                const storage::KeyFormat binary(storage::KeyFormat::Binary, ordering);
+                for (vector<BSONObj>::const_iterator i = keys.begin(); i != keys.end(); ++i) {
+                    const Key k1(*i, NULL, binary);
+                    const Key v1(*i, NULL);
+                    for (vector<BSONObj>::const_iterator j = keys.begin(); j != keys.end(); ++j) {
+                        const Key k2(*j, NULL, binary);
+                        const int expected = sign(i->woCompare(*j, ordering, false));
+                        ASSERT_EQUALS(expected, sign(k1.woCompare(k2, ordering)));
+                        ASSERT_EQUALS(expected, sign(v1.woCompare(k2, ordering)));
+                        ASSERT_EQUALS(expected, sign(k2.woCompare(v1, ordering)) * -1);
+                    }
+                }
+            }
+        }
+    };
+
+    /**
+     * The comparator as it was with a byte prefix scan in front: byte-identical keys
+     * compared equal without decoding, the rest were compared element by element as
+     * usual.  Kept here to show the scan didn't pay for itself.
+     */
+    static int prefixScanCompare(const Key &key1, const Key &key2, const Ordering &ordering) {
+        const size_t n = std::min(key1.size(), key2.size());
+        size_t i = 0;
+        for (; i + sizeof(uint64_t) <= n; i += sizeof(uint64_t)) {
+            uint64_t x, y;
+            memcpy(&x, key1.buf() + i, sizeof(uint64_t));
+            memcpy(&y, key2.buf() + i, sizeof(uint64_t));
+            if (x != y) {
+                break;
+            }
+        }
+        while (i < n && key1.buf()[i] == key2.buf()[i]) {
+            i++;
+        }
+        if (i == key1.size() && i == key2.size()) {
+            return 0;
+        }
+        return key1.woCompare(key2, ordering);
+    }
+
+    /**
+     * Microbenchmark for the comparator on the kinds of keys an insert
+     * workload compares: secondary keys with a shared prefix and appended
+     * pks, and ObjectId primary keys.
+     */
+    class CompareTiming {
+    public:
+        void run() {
+            const Ordering ordering = Ordering::make(BSON("a" << 1 << "b" << 1));
+            vector<shared_ptr<Key> > secondary;
+            vector<shared_ptr<Key> > primary;
+            for (int i = 0; i < 1000; i++) {
+                const BSONObj pk = BSON("" << OID::gen());
+                secondary.push_back(shared_ptr<Key>(new Key(BSON("" << "customer-00000042" << "" << i / 10), &pk)));
+                primary.push_back(shared_ptr<Key>(new Key(pk, NULL)));
+            }
+            cerr << "secondary keys: " << time(secondary, ordering, false) << "ms, "
+                 << time(secondary, ordering, true) << "ms with a prefix scan" << endl;
+            cerr << "ObjectId primary keys: " << time(primary, ordering, false) << "ms, "
+                 << time(primary, ordering, true) << "ms with a prefix scan" << endl;
+        }
+
+    private:
+        static long long time(const vector<shared_ptr<Key> > &keys, const Ordering &ordering, bool prefixScan) {
+            int n = 0;
+            Timer t;
+            for (int iter = 0; iter < 1000; iter++) {
+                for (size_t i = 1; i < keys.size(); i++) {
+                    const Key &k1 = *keys[i - 1];
+                    const Key &k2 = *keys[i];
+                    n += prefixScan ? prefixScanCompare(k1, k2, ordering) : k1.woCompare(k2, ordering);
+                }
+            }
+            // use n so the loop isn't optimized away
+            ASSERT(n != numeric_limits<int>::max());
+            return t.millis();
+        }
+    };
+
+    /**
+     * Microbenchmark for binary format keys against the same keys in the compact
+     * format: compound secondary keys that differ past a shared string, as an
+     * index on { customer, order number, date } would hold.
+     */
+    class BinaryCompareTiming {
+    public:
+        void run() {
+            const Ordering ordering = Ordering::make(BSON("a" << 1 << "b" << 1 << "c" << -1));
+            const storage::KeyFormat format(storage::KeyFormat::Binary, ordering);
+            vector<shared_ptr<Key> > v1;
+            vector<shared_ptr<Key> > binary;
+            for (int i = 0; i < 1000; i++) {
+                const BSONObj pk = BSON("" << OID::gen());
+                const BSONObj key = BSON("" << "customer-00000042" << "" << i << "" << Date_t(1000 * (i % 7)));
+                v1.push_back(shared_ptr<Key>(new Key(key, &pk)));
+                binary.push_back(shared_ptr<Key>(new Key(key, &pk, format)));
+            }
+            cerr << "compound secondary keys: " << time(v1, ordering) << "ms v1, "
+                 << time(binary, ordering) << "ms binary" << endl;
+        }
+
+    private:
+        static long long time(const vector<shared_ptr<Key> > &keys, const Ordering &ordering) {
+            int n = 0;
+            Timer t;
+            for (int iter = 0; iter < 1000; iter++) {
+                for (size_t i = 1; i < keys.size(); i++) {
+                    n += keys[i - 1]->woCompare(*keys[i], ordering);
+                }
+            }
+            // use n so the loop isn't optimized away
+            ASSERT(n != numeric_limits<int>::max());
+            return t.millis();
+        }
+    };
+
+    class All : public Suite {
+    public:
+        All() : Suite("key") {
+        }
+
+        void setupTests() {
+            add<BinaryRoundTrip>();
+            add<BinaryFallback>();
+            add<BinaryCompareAgreesWithBSON>();
+            add<CompareTiming>();
+            add<BinaryCompareTiming>();
+        }
+    } myall;
+
+} // namespace KeyTests
@@ -298,6 +298,143 @@ namespace MatcherTests {
         }
     };
 
+    /** Set useCompiledMatcher for the lifetime of this object. */
+    class CompiledMatcherSetting {
+    public:
+        CompiledMatcherSetting( bool use ) :
+            _old( useCompiledMatcher ) {
+            useCompiledMatcher = use;
+        }
+        ~CompiledMatcherSetting() {
+            useCompiledMatcher = _old;
+        }
+    private:
+        bool _old;
+    };
+
+    /**
+     * Compiled predicates give the same results as the generic matcher, including for arrays,
+     * missing fields, nested fields and mixed types.
+     */
+    class CompiledMatchesGeneric {
+    public:
+        void run() {
+            const char *queries[] = {
+                "{ a:1 }",
+                "{ a:1, b:'x' }",
+                "{ a:{ $gt:1, $lte:5 }, b:{ $lt:'y' } }",
+                "{ a:1.5 }",
+                "{ a:{ $gte:NumberLong( 2 ) } }",
+                "{ 'a.b':1, 'a.c':{ $gt:0 } }",
+                "{ a:true, c:{ $gt:'' } }",
+                "{ a:1, 'b.c':{ $lt:3 }, d:{ $ne:1 } }",
+                "{ a:{ $lt:NaN } }",
+                "{ a:{ $gte:NaN } }",
+            };
+            const char *docs[] = {
+                "{}",
+                "{ a:1 }",
+                "{ a:1, b:'x' }",
+                "{ a:1.0, b:'x' }",
+                "{ a:NumberLong( 1 ), b:'a' }",
+                "{ a:3, b:'xx' }",
+                "{ a:[ 1, 2 ], b:'x' }",
+                "{ a:1.5 }",
+                "{ a:'1' }",
+                "{ a:NumberLong( 5 ) }",
+                "{ a:{ b:1, c:2 } }",
+                "{ a:{ b:1, c:[ 1 ] } }",
+                "{ a:[ { b:1, c:2 } ] }",
+                "{ a:{ b:1 } }",
+                "{ a:true, c:'z' }",
+                "{ a:1, b:{ c:2 }, d:2 }",
+                "{ a:1, b:{ c:2 }, d:1 }",
+                "{ a:1, b:5, d:2 }",
+                "{ a:2, a:1, b:'x' }",
+                "{ a:NaN }",
+                "{ a:null, b:'x' }",
+            };
+            for( size_t i = 0; i < sizeof( queries ) / sizeof( queries[ 0 ] ); ++i ) {
+                BSONObj query = fromjson( queries[ i ] );
+                CompiledMatcherSetting useGeneric( false );
+                Matcher generic( query );
+                CompiledMatcherSetting useCompiled( true );
+                Matcher compiled( query );
+                for( size_t j = 0; j < sizeof( docs ) / sizeof( docs[ 0 ] ); ++j ) {
+                    BSONObj doc = fromjson( docs[ j ] );
+                    if ( generic.matches( doc ) != compiled.matches( doc ) ) {
+                        FAIL( str::stream() << "query " << query << " doc " << doc );
+                    }
+                }
+            }
+        }
+    };
+
+    /**
+     * Compare the compiled matcher with the generic one on collection scans testing 5 to 20
+     * fields.  All the predicates match so each one is evaluated for every document.
+     */
+    class CompiledTiming : public CollectionBase {
+    public:
+        void run() {
+            const int nFields = 25;
+            for( int i = 0; i < 10000; ++i ) {
+                BSONObjBuilder b;
+                for( int j = 0; j < nFields; ++j ) {
+                    string name = str::stream() << "f" << j;
+                    if ( j % 2 ) {
+                        b.append( name, str::stream() << "value" << i );
+                    }
+                    else {
+                        b.append( name, i + j );
+                    }
+                }
+                client().insert( ns(), b.obj() );
+            }
+
+            for( int nPredicates = 5; nPredicates <= 20; nPredicates += 5 ) {
+                BSONObjBuilder b;
+                for( int j = 0; j < nPredicates; ++j ) {
+                    string name = str::stream() << "f" << ( j * 7 ) % nFields;
+                    if ( ( j * 7 ) % nFields % 2 ) {
+                        b.append( name, BSON( "$gt" << "value" ) );
+                    }
+                    else {
+                        b.append( name, BSON( "$gte" << 0 << "$lt" << 1000000 ) );
+                    }
+                }
+                BSONObj query = b.obj();
+                long long genericMatches, compiledMatches;
+                long generic = scan( query, false, genericMatches );
+                long compiled = scan( query, true, compiledMatches );
+                ASSERT_EQUALS( 10000, genericMatches );
+                ASSERT_EQUALS( genericMatches, compiledMatches );
+                cerr << "predicates: " << nPredicates << " generic: " << generic
+                     << " compiled: " << compiled << endl;
+            }
+        }
+    private:
+        long scan( const BSONObj &query, bool useCompiled, long long &nMatches ) {
+            CompiledMatcherSetting setting( useCompiled );
+            Matcher matcher( query );
+            Client::Transaction transaction( DB_TXN_SNAPSHOT | DB_TXN_READ_ONLY );
+            Client::ReadContext context( ns(), mongo::unittest::EMPTY_STRING );
+            Timer t;
+            for( int pass = 0; pass < 5; ++pass ) {
+                nMatches = 0;
+                boost::shared_ptr<Cursor> cursor = getOptimizedCursor( ns(), BSONObj() );
+                for( ; cursor->ok(); cursor->advance() ) {
+                    if ( matcher.matches( cursor->current() ) ) {
+                        ++nMatches;
+                    }
+                }
+            }
+            long ret = t.millis();
+            transaction.commit();
+            return ret;
+        }
+    };
+
     /**
      * Helper class to extract the top level equality fields of a matcher, which can serve as a
      * useful way to identify the matcher.
@@ -419,6 +556,8 @@ namespace MatcherTests {
             add<Covered::ElemMatchKeyIndexed>();
             add<Covered::ElemMatchKeyIndexedSingleKey>();
             add<AllTiming>();
+            add<CompiledMatchesGeneric>();
+            add<CompiledTiming>();
             add<Visit>();
             add<WithinBox>();
             add<WithinCenter>();
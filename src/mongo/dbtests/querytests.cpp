@@ -1455,7 +1455,7 @@ namespace QueryTests {
         
         class Base {
         protected:
-            void assertNumFilled( int expected, const Testable &t ) {
+            void assertNumFilled( int expected, Testable &t ) {
                 ASSERT_EQUALS( expected, t.size() );
                 BufBuilder bb;
                 int nout;
@@ -455,6 +455,36 @@ namespace QueryUtilTests {
             }
         };
         
+        /** A pattern counted often keeps its counters while new patterns keep coming. */
+        class QueryCacheStatsEviction : public QueryPatternBase {
+        public:
+            void run() {
+                QueryCache qc;
+                const QueryPattern hot = p( BSON( "a" << 1 ) );
+                for ( int i = 0; i < 3000; ++i ) {
+                    qc.noteLookup( hot, true );
+                    qc.noteLookup( p( BSON( string( str::stream() << "f" << i ) << 1 ) ), false );
+                }
+                BSONObjBuilder b;
+                qc.appendStats( b );
+                vector<BSONElement> patterns = b.obj()[ "patterns" ].Array();
+                ASSERT( patterns.size() < 3000U );
+                BSONObj hotStats;
+                bool oldestKept = false;
+                for ( vector<BSONElement>::const_iterator i = patterns.begin(); i != patterns.end(); ++i ) {
+                    BSONObj pattern = i->Obj()[ "pattern" ][ "query" ].Obj();
+                    if ( pattern.hasField( "a" ) ) {
+                        hotStats = i->Obj().getOwned();
+                    }
+                    if ( pattern.hasField( "f0" ) ) {
+                        oldestKept = true;
+                    }
+                }
+                ASSERT_EQUALS( 3000, hotStats[ "hits" ].numberLong() );
+                ASSERT( !oldestKept );
+            }
+        };
+
         /** Check QueryPattern categories for optimized bounds. */
         class QueryPatternOptimizedBounds {
         public:
@@ -2633,6 +2663,7 @@ namespace QueryUtilTests {
             add<FieldRangeTests::QueryPatternTest>();
             add<FieldRangeTests::QueryPatternEmpty>();
             add<FieldRangeTests::QueryPatternNeConstraint>();
+            add<FieldRangeTests::QueryCacheStatsEviction>();
             add<FieldRangeTests::QueryPatternOptimizedBounds>();
             add<FieldRangeTests::NoWhere>();
             add<FieldRangeTests::Numeric>();
@@ -19,10 +19,16 @@
 
 #include "mongo/s/balance.h"
 
+#include <boost/thread/condition.hpp>
+#include <boost/thread/thread.hpp>
+#include <list>
+
 #include "mongo/client/dbclientcursor.h"
 #include "mongo/client/distlock.h"
 #include "mongo/db/cmdline.h"
+#include "mongo/db/commands/server_status.h"
 #include "mongo/db/jsobj.h"
+#include "mongo/db/server_parameters.h"
 #include "mongo/s/chunk.h"
 #include "mongo/s/config.h"
 #include "mongo/s/config_server_checker_service.h"
@@ -34,87 +40,341 @@
 #include "mongo/s/type_mongos.h"
 #include "mongo/s/type_settings.h"
 #include "mongo/s/type_tags.h"
+#include "mongo/util/timer.h"
 #include "mongo/util/version.h"
 
 namespace mongo {
 
     Balancer balancer;
 
-    Balancer::Balancer() : _balancedLastTime(0), _policy( new BalancerPolicy() ) {}
+    // Migrations the balancer runs at once, and that any one shard takes part in at once.
+    MONGO_EXPORT_SERVER_PARAMETER(balancerMaxConcurrentMigrations, int, 4);
+    MONGO_EXPORT_SERVER_PARAMETER(balancerMaxMigrationsPerShard, int, 1);
+
+    // A shard that took longer than this to catch up with its donor's writes during a migration
+    // gets no more chunks until the next round.
+    MONGO_EXPORT_SERVER_PARAMETER(balancerMaxRecipientLagMillis, int, 5000);
+
+    // Whether to move hot chunks off the shards doing the most ops, and how many more ops per
+    // second a shard has to be doing than another for that.
+    MONGO_EXPORT_SERVER_PARAMETER(balancerSpreadHotChunks, bool, true);
+    MONGO_EXPORT_SERVER_PARAMETER(balancerMinHeatImbalance, int, 100);
+
+    /**
+     * Hands out a round's migrations to the threads running them.
+     *
+     * A migration may start once no other migration of its collection is running, since moveChunk
+     * holds the collection's distributed lock, and once neither its donor nor its receiver is
+     * already in balancerMaxMigrationsPerShard migrations.  A shard donates at most one chunk and
+     * receives at most one chunk at a time regardless, as that is all mongod can do.  A receiver
+     * that lagged more than balancerMaxRecipientLagMillis behind its donor gets no more chunks.
+     */
+    class MigrationScheduler : boost::noncopyable {
+    public:
+        typedef shared_ptr<MigrateInfo> MigrateInfoPtr;
+
+        MigrationScheduler( const vector<MigrateInfoPtr>& migrations, int maxPerShard )
+            : _mutex( "MigrationScheduler" ),
+              _pending( migrations.begin(), migrations.end() ),
+              _maxPerShard( std::max( maxPerShard, 1 ) ),
+              _running( 0 ),
+              _moved( 0 ),
+              _failed( 0 ),
+              _skipped( 0 ),
+              _bytesMoved( 0 ) {
+        }
+
+        /**
+         * @return the next migration to run, once it may start, or an empty pointer if there are
+         *         none left
+         */
+        MigrateInfoPtr next() {
+            scoped_lock lk( _mutex );
+            while ( ! _pending.empty() ) {
+                for ( list<MigrateInfoPtr>::iterator i = _pending.begin(); i != _pending.end(); ) {
+                    const MigrateInfo& m = **i;
+                    if ( _throttled.count( m.to ) ) {
+                        log() << "not moving chunk " << m.chunk.toString() << " to " << m.to
+                              << " this round because it is lagging behind its migrations" << endl;
+                        _skipped++;
+                        i = _pending.erase( i );
+                        continue;
+                    }
+
+                    if ( _canStart( m ) ) {
+                        MigrateInfoPtr p = *i;
+                        _pending.erase( i );
+                        _running++;
+                        _activeNamespaces.insert( p->ns );
+                        _donors.insert( p->from );
+                        _receivers.insert( p->to );
+                        _shardMigrations[p->from]++;
+                        _shardMigrations[p->to]++;
+                        return p;
+                    }
+                    ++i;
+                }
+
+                if ( _pending.empty() || _running == 0 )
+                    break;
+
+                _changed.wait( lk.boost() );
+            }
+            return MigrateInfoPtr();
+        }
+
+        /**
+         * Marks m, returned by next(), as finished.
+         * @param moved number of chunks effectively moved
+         * @param res the moveChunk reply
+         */
+        void done( const MigrateInfo& m, int moved, const BSONObj& res ) {
+            scoped_lock lk( _mutex );
+            _running--;
+            _activeNamespaces.erase( m.ns );
+            _donors.erase( m.from );
+            _receivers.erase( m.to );
+            _shardMigrations[m.from]--;
+            _shardMigrations[m.to]--;
+
+            if ( moved ) {
+                _moved += moved;
+                _bytesMoved += res.getFieldDotted( "counts.clonedBytes" ).numberLong();
+            }
+            else {
+                _failed++;
+            }
+
+            const long long lag = res["recipientLagMillis"].numberLong();
+            if ( lag > balancerMaxRecipientLagMillis ) {
+                log() << "throttling migrations to " << m.to << ", it took " << lag
+                      << "ms to catch up with " << m.from << endl;
+                _throttled.insert( m.to );
+            }
+
+            _changed.notify_all();
+        }
+
+        int moved() const { return _moved; }
+        long long bytesMoved() const { return _bytesMoved; }
+
+        /** @return a description of the round, for the changelog */
+        BSONObj report( int concurrency, long long millis ) const {
+            scoped_lock lk( _mutex );
+            BSONObjBuilder b;
+            b.append( "concurrency" , concurrency );
+            b.append( "moved" , _moved );
+            b.append( "failed" , _failed );
+            b.append( "skipped" , _skipped );
+            b.append( "bytes" , _bytesMoved );
+            b.append( "millis" , millis );
+            b.append( "chunksPerMinute" , millis > 0 ? _moved * 60000.0 / millis : 0.0 );
+            b.append( "bytesPerSec" , millis > 0 ? _bytesMoved * 1000 / millis : 0LL );
+            BSONArrayBuilder throttled( b.subarrayStart( "throttled" ) );
+            for ( set<string>::const_iterator i = _throttled.begin(); i != _throttled.end(); ++i )
+                throttled.append( *i );
+            throttled.done();
+            return b.obj();
+        }
+
+    private:
+        bool _canStart( const MigrateInfo& m ) {
+            if ( _activeNamespaces.count( m.ns ) || _donors.count( m.from ) || _receivers.count( m.to ) )
+                return false;
+            return _shardMigrations[m.from] < _maxPerShard && _shardMigrations[m.to] < _maxPerShard;
+        }
+
+        mutable mongo::mutex _mutex;
+        boost::condition _changed;
+
+        list<MigrateInfoPtr> _pending;
+        const int _maxPerShard;
+        int _running;
+        set<string> _activeNamespaces;
+        set<string> _donors;
+        set<string> _receivers;
+        map<string,int> _shardMigrations;
+        set<string> _throttled;
+
+        int _moved;
+        int _failed;
+        int _skipped;
+        long long _bytesMoved;
+    };
+
+    class BalancerServerStatusSection : public ServerStatusSection {
+    public:
+        BalancerServerStatusSection() : ServerStatusSection( "balancer" ) {}
+        virtual bool includeByDefault() const { return true; }
+
+        BSONObj generateSection( const BSONElement& configElement ) const {
+            BSONObjBuilder b;
+            balancer.appendMigrationStats( b );
+            return b.obj();
+        }
+    } balancerServerStatusSection;
+
+    Balancer::Balancer() : _balancedLastTime(0), _policy( new BalancerPolicy() ),
+                           _statsMutex( "Balancer::stats" ), _totalMigrations(0), _totalMoved(0),
+                           _totalBytesMoved(0), _totalMigrationMillis(0),
+                           _receivedMutex( "Balancer::received" ) {}
 
     Balancer::~Balancer() {
     }
 
+    void Balancer::appendMigrationStats( BSONObjBuilder& b ) const {
+        scoped_lock lk( _statsMutex );
+        BSONObjBuilder migrations( b.subobjStart( "migrations" ) );
+        migrations.append( "attempted" , _totalMigrations );
+        migrations.append( "moved" , _totalMoved );
+        migrations.append( "bytes" , _totalBytesMoved );
+        migrations.append( "millis" , _totalMigrationMillis );
+        migrations.append( "chunksPerMinute" ,
+                           _totalMigrationMillis > 0 ? _totalMoved * 60000.0 / _totalMigrationMillis : 0.0 );
+        migrations.append( "bytesPerSec" ,
+                           _totalMigrationMillis > 0 ? _totalBytesMoved * 1000 / _totalMigrationMillis : 0LL );
+        migrations.done();
+        if ( ! _lastRound.isEmpty() )
+            b.append( "lastRound" , _lastRound );
+    }
+
     int Balancer::_moveChunks( const vector<CandidateChunkPtr>* candidateChunks ) {
-        int movedCount = 0;
+        MigrationScheduler scheduler( *candidateChunks, balancerMaxMigrationsPerShard );
+        Timer t;
+
+        // this thread runs migrations too
+        int concurrency = 1;
+        vector< shared_ptr<boost::thread> > threads;
+        const int wanted = std::min( balancerMaxConcurrentMigrations, (int) candidateChunks->size() );
+        for ( ; concurrency < wanted; concurrency++ ) {
+            try {
+                threads.push_back( shared_ptr<boost::thread>(
+                        new boost::thread( boost::bind( &Balancer::_migrationThread, this, &scheduler ) ) ) );
+            }
+            catch ( boost::thread_resource_error& ) {
+                warning() << "could not start a balancer migration thread, running "
+                          << concurrency << " migrations at a time" << endl;
+                break;
+            }
+        }
+
+        _runMigrations( &scheduler );
+        for ( unsigned i = 0; i < threads.size(); i++ ) {
+            threads[i]->join();
+        }
+
+        const long long millis = t.millis();
+        BSONObjBuilder round;
+        round.append( "candidates" , (int) candidateChunks->size() );
+        round.appendElements( scheduler.report( concurrency, millis ) );
+        BSONObj roundObj = round.obj();
+
+        log() << "balancing round: " << roundObj << endl;
+        configServer.logChange( "balancer.round" , "" , roundObj );
+
+        {
+            scoped_lock lk( _statsMutex );
+            _totalMigrations += candidateChunks->size();
+            _totalMoved += scheduler.moved();
+            _totalBytesMoved += scheduler.bytesMoved();
+            _totalMigrationMillis += millis;
+            _lastRound = roundObj;
+        }
+
+        return scheduler.moved();
+    }
+
+    void Balancer::_migrationThread( MigrationScheduler* scheduler ) {
+        setThreadName( "BalancerMigration" );
+        _runMigrations( scheduler );
+    }
 
-        for ( vector<CandidateChunkPtr>::const_iterator it = candidateChunks->begin(); it != candidateChunks->end(); ++it ) {
-            const CandidateChunk& chunkInfo = *it->get();
+    void Balancer::_runMigrations( MigrationScheduler* scheduler ) {
+        while ( true ) {
+            CandidateChunkPtr c = scheduler->next();
+            if ( ! c )
+                break;
 
-            // Changes to metadata, borked metadata, and connectivity problems should cause us to
-            // abort this chunk move, but shouldn't cause us to abort the entire round of chunks.
-            // TODO: Handle all these things more cleanly, since they're expected problems
+            BSONObj res;
+            int moved = 0;
             try {
+                moved = _moveChunk( *c, &res );
+            }
+            catch ( std::exception& e ) {
+                warning() << "could not move chunk " << c->chunk.toString()
+                          << ", continuing balancing round" << causedBy( e ) << endl;
+            }
 
-                DBConfigPtr cfg = grid.getDBConfig( chunkInfo.ns );
-                verify( cfg );
+            if ( moved ) {
+                scoped_lock lk( _receivedMutex );
+                _lastReceived[c->ns][c->to] = curTimeMillis64();
+            }
+            scheduler->done( *c, moved, res );
+        }
+    }
 
-                // NOTE: We purposely do not reload metadata here, since _doBalanceRound already
-                // tried to do so once.
-                ChunkManagerPtr cm = cfg->getChunkManager( chunkInfo.ns );
-                verify( cm );
+    int Balancer::_moveChunk( const CandidateChunk& chunkInfo, BSONObj* res ) {
+        // Changes to metadata, borked metadata, and connectivity problems should cause us to
+        // abort this chunk move, but shouldn't cause us to abort the entire round of chunks.
+        // TODO: Handle all these things more cleanly, since they're expected problems
+        try {
 
-                ChunkPtr c = cm->findIntersectingChunk( chunkInfo.chunk.min );
-                if ( c->getMin().woCompare( chunkInfo.chunk.min ) || c->getMax().woCompare( chunkInfo.chunk.max ) ) {
-                    // likely a split happened somewhere
-                    cm = cfg->getChunkManager( chunkInfo.ns , true /* reload */);
-                    verify( cm );
+            DBConfigPtr cfg = grid.getDBConfig( chunkInfo.ns );
+            verify( cfg );
 
-                    c = cm->findIntersectingChunk( chunkInfo.chunk.min );
-                    if ( c->getMin().woCompare( chunkInfo.chunk.min ) || c->getMax().woCompare( chunkInfo.chunk.max ) ) {
-                        log() << "chunk mismatch after reload, ignoring will retry issue " << chunkInfo.chunk.toString() << endl;
-                        continue;
-                    }
-                }
+            // NOTE: We purposely do not reload metadata here, since _doBalanceRound already
+            // tried to do so once.
+            ChunkManagerPtr cm = cfg->getChunkManager( chunkInfo.ns );
+            verify( cm );
 
-                BSONObj res;
-                if (c->moveAndCommit(Shard::make(chunkInfo.to), res)) {
-                    movedCount++;
-                    continue;
+            ChunkPtr c = cm->findIntersectingChunk( chunkInfo.chunk.min );
+            if ( c->getMin().woCompare( chunkInfo.chunk.min ) || c->getMax().woCompare( chunkInfo.chunk.max ) ) {
+                // likely a split happened somewhere
+                cm = cfg->getChunkManager( chunkInfo.ns , true /* reload */);
+                verify( cm );
+
+                c = cm->findIntersectingChunk( chunkInfo.chunk.min );
+                if ( c->getMin().woCompare( chunkInfo.chunk.min ) || c->getMax().woCompare( chunkInfo.chunk.max ) ) {
+                    log() << "chunk mismatch after reload, ignoring will retry issue " << chunkInfo.chunk.toString() << endl;
+                    return 0;
                 }
+            }
 
-                // the move requires acquiring the collection metadata's lock, which can fail
-                log() << "balancer move failed: " << res << " from: " << chunkInfo.from << " to: " << chunkInfo.to
-                      << " chunk: " << chunkInfo.chunk << endl;
+            if (c->moveAndCommit(Shard::make(chunkInfo.to), *res)) {
+                return 1;
+            }
 
-                if ( res["chunkTooBig"].trueValue() ) {
-                    // reload just to be safe
-                    cm = cfg->getChunkManager( chunkInfo.ns );
-                    verify( cm );
-                    c = cm->findIntersectingChunk( chunkInfo.chunk.min );
+            // the move requires acquiring the collection metadata's lock, which can fail
+            log() << "balancer move failed: " << *res << " from: " << chunkInfo.from << " to: " << chunkInfo.to
+                  << " chunk: " << chunkInfo.chunk << endl;
 
-                    log() << "forcing a split because migrate failed for size reasons" << endl;
+            if ( (*res)["chunkTooBig"].trueValue() ) {
+                // reload just to be safe
+                cm = cfg->getChunkManager( chunkInfo.ns );
+                verify( cm );
+                c = cm->findIntersectingChunk( chunkInfo.chunk.min );
 
-                    res = BSONObj();
-                    c->singleSplit( true , res );
-                    log() << "forced split results: " << res << endl;
+                log() << "forcing a split because migrate failed for size reasons" << endl;
 
-                    if ( ! res["ok"].trueValue() ) {
-                        log() << "marking chunk as jumbo: " << c->toString() << endl;
-                        c->markAsJumbo();
-                        // we increment moveCount so we do another round right away
-                        movedCount++;
-                    }
+                BSONObj splitRes;
+                c->singleSplit( true , splitRes );
+                log() << "forced split results: " << splitRes << endl;
 
+                if ( ! splitRes["ok"].trueValue() ) {
+                    log() << "marking chunk as jumbo: " << c->toString() << endl;
+                    c->markAsJumbo();
+                    // we count it as moved so we do another round right away
+                    return 1;
                 }
+
             }
-            catch( const DBException& ex ) {
-                warning() << "could not move chunk " << chunkInfo.chunk.toString()
-                          << ", continuing balancing round" << causedBy( ex ) << endl;
-            }
+        }
+        catch( const DBException& ex ) {
+            warning() << "could not move chunk " << chunkInfo.chunk.toString()
+                      << ", continuing balancing round" << causedBy( ex ) << endl;
         }
 
-        return movedCount;
+        return 0;
     }
 
     void Balancer::_ping( DBClientBase& conn, bool waiting ) {
@@ -183,6 +443,75 @@ namespace mongo {
         }        
     }
 
+    int Balancer::_addChunkHeat( const string& ns, ShardToChunksMap* shardToChunksMap ) {
+        int halfLifeSecs = 0;
+        for ( ShardToChunksMap::iterator i = shardToChunksMap->begin(); i != shardToChunksMap->end(); ++i ) {
+            vector<BSONObj>& chunks = i->second;
+            if ( chunks.empty() )
+                continue;
+
+            BSONObj res;
+            try {
+                Shard s = Shard::make( i->first );
+                scoped_ptr<ScopedDbConnection> conn(
+                        ScopedDbConnection::getInternalScopedDbConnection( s.getConnString() ) );
+                if ( ! conn->get()->runCommand( "admin" , BSON( "chunkHeat" << ns ) , res ) ) {
+                    LOG(1) << "no chunk heat for " << ns << " from " << i->first << causedBy( res.toString() ) << endl;
+                    conn->done();
+                    continue;
+                }
+                conn->done();
+            }
+            catch ( DBException& e ) {
+                warning() << "could not get chunk heat for " << ns << " from " << i->first << causedBy( e ) << endl;
+                continue;
+            }
+
+            halfLifeSecs = std::max( halfLifeSecs, res["halfLifeSecs"].numberInt() );
+
+            map<BSONObj,double> heat;
+            BSONForEach( e , res.getObjectField( "chunks" ) ) {
+                BSONObj chunk = e.Obj();
+                double opsPerSec = chunk["opsPerSec"].numberDouble();
+                if ( opsPerSec > 0 )
+                    heat[chunk["min"].Obj().getOwned()] = opsPerSec;
+            }
+            if ( heat.empty() )
+                continue;
+
+            for ( unsigned j = 0; j < chunks.size(); j++ ) {
+                map<BSONObj,double>::const_iterator h = heat.find( chunks[j][ChunkType::min()].Obj() );
+                if ( h == heat.end() )
+                    continue;
+                BSONObjBuilder b;
+                b.appendElements( chunks[j] );
+                b.append( DistributionStatus::heatField , h->second );
+                chunks[j] = b.obj();
+            }
+        }
+        return halfLifeSecs;
+    }
+
+    void Balancer::_markHeatStale( const string& ns, int halfLifeSecs, DistributionStatus* status ) {
+        const long long now = curTimeMillis64();
+        scoped_lock lk( _receivedMutex );
+        map<string, map<string,long long> >::iterator coll = _lastReceived.find( ns );
+        if ( coll == _lastReceived.end() )
+            return;
+
+        map<string,long long>& received = coll->second;
+        for ( map<string,long long>::iterator i = received.begin(); i != received.end(); ) {
+            if ( now - i->second >= halfLifeSecs * 1000LL ) {
+                received.erase( i++ );
+                continue;
+            }
+            status->markHeatStale( i->first );
+            ++i;
+        }
+        if ( received.empty() )
+            _lastReceived.erase( coll );
+    }
+
     void Balancer::_doBalanceRound( DBClientBase& conn, vector<CandidateChunkPtr>* candidateChunks ) {
         verify( candidateChunks );
 
@@ -276,7 +605,14 @@ namespace mongo {
                 shardToChunksMap[s.getName()].size();
             }
 
+            int halfLifeSecs = 0;
+            if ( balancerSpreadHotChunks ) {
+                halfLifeSecs = _addChunkHeat( ns, &shardToChunksMap );
+            }
+
             DistributionStatus status( shardInfo, shardToChunksMap );
+            status.setMinHeatImbalance( balancerMinHeatImbalance );
+            _markHeatStale( ns, halfLifeSecs, &status );
 
             // load tags
             conn.ensureIndex(TagsType::ConfigNS,
@@ -350,8 +686,13 @@ namespace mongo {
                 continue;
             }
 
-            CandidateChunk* p = _policy->balance( ns, status, _balancedLastTime );
-            if ( p ) candidateChunks->push_back( CandidateChunkPtr( p ) );
+            // keep asking for moves until the collection's balanced or its shards are all busy;
+            // every move gets a donor and receiver of its own
+            while ( CandidateChunk* p = _policy->balance( ns, status, _balancedLastTime ) ) {
+                candidateChunks->push_back( CandidateChunkPtr( p ) );
+                status.markBusy( p->from );
+                status.markBusy( p->to );
+            }
         }
     }
 
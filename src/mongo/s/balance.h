@@ -24,17 +24,20 @@
 #include "mongo/client/dbclientinterface.h"
 #include "mongo/s/balancer_policy.h"
 #include "mongo/util/background.h"
+#include "mongo/util/concurrency/mutex.h"
 
 namespace mongo {
 
+    class MigrationScheduler;
+
     /**
      * The balancer is a background task that tries to keep the number of chunks across all servers of the cluster even. Although
      * every mongos will have one balancer running, only one of them will be active at the any given point in time. The balancer
      * uses a 'DistributedLock' for that coordination.
      *
      * The balancer does act continuously but in "rounds". At a given round, it would decide if there is an imbalance by
-     * checking the difference in chunks between the most and least loaded shards. It would issue a request for a chunk
-     * migration per round, if it found so.
+     * checking the difference in chunks between the most and least loaded shards. If it found so, it would pick chunks to
+     * move between disjoint pairs of shards and run several of those migrations at once (see MigrationScheduler).
      */
     class Balancer : public BackgroundJob {
     public:
@@ -47,6 +50,9 @@ namespace mongo {
 
         virtual string name() const { return "Balancer"; }
 
+        /** Adds this balancer's migration counts and rates, for serverStatus. */
+        void appendMigrationStats( BSONObjBuilder& b ) const;
+
     private:
         typedef MigrateInfo CandidateChunk;
         typedef shared_ptr<CandidateChunk> CandidateChunkPtr;
@@ -62,6 +68,18 @@ namespace mongo {
 
         // decide which chunks to move; owned here.
         scoped_ptr<BalancerPolicy> _policy;
+
+        // migrations run by this balancer, over all rounds and in the last one
+        mutable mongo::mutex _statsMutex;
+        long long _totalMigrations;
+        long long _totalMoved;
+        long long _totalBytesMoved;
+        long long _totalMigrationMillis;
+        BSONObj _lastRound;
+
+        // when each shard last received a chunk of each collection from this balancer, by ns
+        mongo::mutex _receivedMutex;
+        map< string, map<string,long long> > _lastReceived;
         
         /**
          * Checks that the balancer can connect to all servers it needs to do its job.
@@ -77,18 +95,56 @@ namespace mongo {
          * be moved.
          *
          * @param conn is the connection with the config server(s)
-         * @param candidateChunks (IN/OUT) filled with candidate chunks, one per collection, that could possibly be moved
+         * @param candidateChunks (IN/OUT) filled with candidate chunks, at most one per shard per collection, that could
+         *        possibly be moved
          */
         void _doBalanceRound( DBClientBase& conn, vector<CandidateChunkPtr>* candidateChunks );
 
         /**
-         * Issues chunk migration request, one at a time.
+         * Asks the shards how many ops per second each of the collection's chunks is doing, and adds that to the
+         * chunks' documents as DistributionStatus::heatField.
+         *
+         * @param ns collection whose chunks these are
+         * @param shardToChunksMap (IN/OUT) the collection's chunks, by shard
+         * @return the longest half-life the shards' heat decays with, in seconds
+         */
+        int _addChunkHeat( const string& ns, ShardToChunksMap* shardToChunksMap );
+
+        /**
+         * Marks the shards that received a chunk of ns less than a half-life ago as having stale
+         * heat: the chunk's ops start over from nothing on its new shard, so until they catch up
+         * the shard looks cooler than it is and would be given hot chunks round after round.
+         *
+         * @param ns collection being balanced
+         * @param halfLifeSecs from _addChunkHeat
+         * @param status (IN/OUT) the collection's distribution
+         */
+        void _markHeatStale( const string& ns, int halfLifeSecs, DistributionStatus* status );
+
+        /**
+         * Issues chunk migration requests, up to balancerMaxConcurrentMigrations at a time, and logs the round's
+         * migration rate to the changelog.
          *
          * @param candidateChunks possible chunks to move
          * @return number of chunks effectively moved
          */
         int _moveChunks( const vector<CandidateChunkPtr>* candidateChunks );
 
+        /**
+         * Issues one chunk migration request.
+         *
+         * @param chunkInfo chunk to move
+         * @param res (OUT) the moveChunk reply, if it got that far
+         * @return number of chunks effectively moved
+         */
+        int _moveChunk( const CandidateChunk& chunkInfo, BSONObj* res );
+
+        /**
+         * Runs the scheduler's migrations until there are none left, on this thread or on a thread of its own.
+         */
+        void _runMigrations( MigrationScheduler* scheduler );
+        void _migrationThread( MigrationScheduler* scheduler );
+
         /**
          * Marks this balancer as being live on the config server(s).
          *
@@ -31,9 +31,11 @@ namespace mongo {
         return str::stream() << min << " -->> " << max << "  on  " << tag;
     }
 
+    const char* const DistributionStatus::heatField = "heat";
+
     DistributionStatus::DistributionStatus( const ShardInfoMap& shardInfo,
                                             const ShardToChunksMap& shardToChunksMap )
-        : _shardInfo( shardInfo ), _shardChunks( shardToChunksMap ) {
+        : _shardInfo( shardInfo ), _shardChunks( shardToChunksMap ), _minHeatImbalance( 100 ) {
         
         for ( ShardInfoMap::const_iterator i = _shardInfo.begin(); i != _shardInfo.end(); ++i ) {
             _shards.insert( i->first );
@@ -78,46 +80,109 @@ namespace mongo {
         unsigned minChunks = numeric_limits<unsigned>::max();
         
         for ( ShardInfoMap::const_iterator i = _shardInfo.begin(); i != _shardInfo.end(); ++i ) {
-            if ( i->second.isSizeMaxed() ) {
-                LOG(1) << i->first << " has already reached the maximum total chunk size." << endl;
+            if ( ! _canReceive( i->first, i->second, tag ) )
                 continue;
-            }
 
-            if ( i->second.isDraining() ) {
-                LOG(1) << i->first << " is currently draining." << endl;
+            unsigned myChunks = numberOfChunksInShard( i->first );
+            if ( myChunks >= minChunks ) {
+                LOG(1) << i->first << " has more chunks me:" << myChunks << " best: " << best << ":" << minChunks << endl;
                 continue;
             }
+            
+            best = i->first;
+            minChunks = myChunks;
+        }
+
+        return best;
+    }
 
-            if ( i->second.hasOpsQueued() ) {
-                LOG(1) << i->first << " has writebacks queued." << endl;
+    bool DistributionStatus::_canReceive( const string& shard , const ShardInfo& info , const string& tag ) const {
+        if ( isBusy( shard ) ) {
+            LOG(1) << shard << " is busy with another migration." << endl;
+            return false;
+        }
+
+        if ( info.isSizeMaxed() ) {
+            LOG(1) << shard << " has already reached the maximum total chunk size." << endl;
+            return false;
+        }
+
+        if ( info.isDraining() ) {
+            LOG(1) << shard << " is currently draining." << endl;
+            return false;
+        }
+
+        if ( info.hasOpsQueued() ) {
+            LOG(1) << shard << " has writebacks queued." << endl;
+            return false;
+        }
+
+        if ( ! info.hasTag( tag ) ) {
+            LOG(1) << shard << " doesn't have right tag" << endl;
+            return false;
+        }
+
+        return true;
+    }
+
+    string DistributionStatus::getCoolestReceiverShard( const string& tag ) const {
+        string best;
+        double minHeat = 0;
+
+        for ( ShardInfoMap::const_iterator i = _shardInfo.begin(); i != _shardInfo.end(); ++i ) {
+            if ( ! _canReceive( i->first, i->second, tag ) )
                 continue;
-            }
-            
-            if ( ! i->second.hasTag( tag ) ) {
-                LOG(1) << i->first << " doesn't have right tag" << endl;
+
+            if ( isHeatStale( i->first ) ) {
+                LOG(1) << i->first << " received a chunk too recently to take a hot one." << endl;
                 continue;
             }
 
-            unsigned myChunks = numberOfChunksInShard( i->first );
-            if ( myChunks >= minChunks ) {
-                LOG(1) << i->first << " has more chunks me:" << myChunks << " best: " << best << ":" << minChunks << endl;
+            double heat = shardHeat( i->first );
+            if ( best.size() && heat >= minHeat )
                 continue;
-            }
-            
+
             best = i->first;
-            minChunks = myChunks;
+            minHeat = heat;
         }
 
         return best;
     }
 
+    double DistributionStatus::chunkHeat( const BSONObj& chunk ) {
+        return chunk[heatField].numberDouble();
+    }
+
+    double DistributionStatus::shardHeat( const string& shard ) const {
+        ShardToChunksMap::const_iterator i = _shardChunks.find( shard );
+        if ( i == _shardChunks.end() )
+            return 0;
+
+        double total = 0;
+        for ( unsigned j = 0; j < i->second.size(); j++ )
+            total += chunkHeat( i->second[j] );
+        return total;
+    }
+
+    unsigned DistributionStatus::numberOfHotChunksInShard( const string& shard ) const {
+        ShardToChunksMap::const_iterator i = _shardChunks.find( shard );
+        if ( i == _shardChunks.end() )
+            return 0;
+
+        unsigned total = 0;
+        for ( unsigned j = 0; j < i->second.size(); j++ )
+            if ( chunkHeat( i->second[j] ) > 0 )
+                total++;
+        return total;
+    }
+
     string DistributionStatus::getMostOverloadedShard( const string& tag ) const {
         string worst;
         unsigned maxChunks = 0;
 
         for ( ShardInfoMap::const_iterator i = _shardInfo.begin(); i != _shardInfo.end(); ++i ) {
             
-            if ( i->second.hasOpsQueued() ) {
+            if ( i->second.hasOpsQueued() || isBusy( i->first ) ) {
                 // we can't move stuff off anyway
                 continue;
             }
@@ -229,7 +294,8 @@ namespace mongo {
         // 1) check for shards that policy require to us to move off of:
         //    draining only
         // 2) check tag policy violations
-        // 3) then we make sure chunks are balanced for each tag
+        // 3) spread hot chunks across shards
+        // 4) then we make sure chunks are balanced for each tag
         
         // ----
 
@@ -240,7 +306,7 @@ namespace mongo {
                 string shard = *z;
                 const ShardInfo& info = distribution.shardInfo( shard );
                 
-                if ( ! info.isDraining() )
+                if ( ! info.isDraining() || distribution.isBusy( shard ) )
                     continue;
                 
                 if ( distribution.numberOfChunksInShard( shard ) == 0 )
@@ -294,6 +360,9 @@ namespace mongo {
             for ( set<string>::const_iterator i = shards.begin(); i != shards.end(); ++i ) {
                 string shard = *i;
                 const ShardInfo& info = distribution.shardInfo( shard );
+
+                if ( distribution.isBusy( shard ) )
+                    continue;
                 
                 const vector<BSONObj>& chunks = distribution.getChunks( shard );
                 for ( unsigned j = 0; j < chunks.size(); j++ ) {
@@ -324,7 +393,70 @@ namespace mongo {
             }
         }
 
-        // 3) for each tag balance
+        // 3) spread the load: a shard with several hot chunks doing many more ops than another
+        //    shard gives it the hot chunk that evens them out best
+        {
+            string hottest;
+            double maxHeat = 0;
+            const set<string>& shards = distribution.shards();
+            for ( set<string>::const_iterator z = shards.begin(); z != shards.end(); ++z ) {
+                const string& shard = *z;
+                if ( distribution.isBusy( shard ) || distribution.shardInfo( shard ).hasOpsQueued() )
+                    continue;
+
+                // a single hot chunk has to be split before its load can be spread
+                if ( distribution.numberOfHotChunksInShard( shard ) < 2 )
+                    continue;
+
+                double heat = distribution.shardHeat( shard );
+                if ( heat > maxHeat ) {
+                    hottest = shard;
+                    maxHeat = heat;
+                }
+            }
+
+            if ( hottest.size() && maxHeat > distribution.minHeatImbalance() ) {
+                const vector<BSONObj>& chunks = distribution.getChunks( hottest );
+                map<string,string> receivers;
+                int best = -1;
+                string bestTo;
+                double bestDistance = 0;
+                for ( unsigned j = 0; j < chunks.size(); j++ ) {
+                    double heat = DistributionStatus::chunkHeat( chunks[j] );
+                    if ( heat <= 0 || _isJumbo( chunks[j] ) )
+                        continue;
+
+                    string tag = distribution.getTagForChunk( chunks[j] );
+                    if ( receivers.count( tag ) == 0 )
+                        receivers[tag] = distribution.getCoolestReceiverShard( tag );
+                    const string& to = receivers[tag];
+                    if ( to.size() == 0 || to == hottest )
+                        continue;
+
+                    // moving the chunk has to leave the two shards closer than they were
+                    double gap = maxHeat - distribution.shardHeat( to );
+                    if ( gap < distribution.minHeatImbalance() || heat >= gap )
+                        continue;
+
+                    double distance = fabs( gap / 2 - heat );
+                    if ( best < 0 || distance < bestDistance ) {
+                        best = j;
+                        bestTo = to;
+                        bestDistance = distance;
+                    }
+                }
+
+                if ( best >= 0 ) {
+                    log() << " ns: " << ns << " going to move hot chunk " << chunks[best]
+                          << " from: " << hottest << " (" << maxHeat << " ops/s)"
+                          << " to: " << bestTo << " (" << distribution.shardHeat( bestTo ) << " ops/s)"
+                          << endl;
+                    return new MigrateInfo( ns, bestTo, hottest, chunks[best].getOwned() );
+                }
+            }
+        }
+
+        // 4) for each tag balance
         
         int threshold = 8;
         if ( balancedLastTime || distribution.totalChunks() < 20 ) 
@@ -358,7 +490,7 @@ namespace mongo {
             string to = distribution.getBestReceieverShard( tag );
             if ( to.size() == 0 ) {
                 log() << "no available shards to take chunks for tag [" << tag << "]" << endl;
-                return NULL;
+                continue;
             }
             
 
@@ -376,6 +508,8 @@ namespace mongo {
 
             const vector<BSONObj>& chunks = distribution.getChunks( from );
             unsigned numJumboChunks = 0;
+            // hot chunks are left to 3) unless there's nothing else to move
+            int hotChunk = -1;
             for ( unsigned j = 0; j < chunks.size(); j++ ) {
                 if ( distribution.getTagForChunk( chunks[j] ) != tag )
                     continue;
@@ -385,12 +519,25 @@ namespace mongo {
                     continue;
                 }
 
+                if ( DistributionStatus::chunkHeat( chunks[j] ) > 0 ) {
+                    if ( hotChunk < 0 )
+                        hotChunk = j;
+                    continue;
+                }
+
                 log() << " ns: " << ns << " going to move " << chunks[j]
                       << " from: " << from << " to: " << to << " tag [" << tag << "]"
                       << endl;
                 return new MigrateInfo( ns, to, from, chunks[j] );
             }
 
+            if ( hotChunk >= 0 ) {
+                log() << " ns: " << ns << " going to move " << chunks[hotChunk]
+                      << " from: " << from << " to: " << to << " tag [" << tag << "]"
+                      << endl;
+                return new MigrateInfo( ns, to, from, chunks[hotChunk] );
+            }
+
             if ( numJumboChunks ) {
                 error() << "shard: " << from << "ns: " << ns
                         << "has too many chunks, but they are all jumbo "
@@ -142,6 +142,13 @@ namespace mongo {
          */
         string getMostOverloadedShard( const string& forTag ) const;
 
+        /**
+         * @param forTag "" if you don't care, or a tag
+         * @return shard able to receive a chunk that is doing the fewest ops per second, leaving
+         *         out shards whose heat is stale
+         */
+        string getCoolestReceiverShard( const string& forTag ) const;
+
 
         // ---- basic accessors, counters, etc...
 
@@ -157,6 +164,26 @@ namespace mongo {
         /** @return chunks for the shard */
         const vector<BSONObj>& getChunks( const string& shard ) const;
 
+        // ---- load, from the heatField the balancer adds to chunks
+
+        /** @return ops per second on the chunk, 0 if unknown */
+        static double chunkHeat( const BSONObj& chunk );
+
+        /** @return ops per second on all of the shard's chunks */
+        double shardHeat( const string& shard ) const;
+
+        /** @return number of chunks in this shard with any ops */
+        unsigned numberOfHotChunksInShard( const string& shard ) const;
+
+        /**
+         * Differences in ops per second between shards smaller than this aren't worth moving
+         * chunks for.
+         */
+        void setMinHeatImbalance( double opsPerSec ) { _minHeatImbalance = opsPerSec; }
+        double minHeatImbalance() const { return _minHeatImbalance; }
+
+        static const char* const heatField;
+
         /** @return all tags we know about, not include "" */
         const set<string>& tags() const { return _allTags; }
 
@@ -168,16 +195,41 @@ namespace mongo {
 
         /** @return the ShardInfo for the shard */
         const ShardInfo& shardInfo( const string& shard ) const;
+
+        /**
+         * Leaves shard out of any move suggested from now on, as donor or receiver.  Lets the
+         * balancer pick several moves for a collection, between disjoint pairs of shards.
+         */
+        void markBusy( const string& shard ) { _busyShards.insert( shard ); }
+
+        /** @return true if shard was marked busy */
+        bool isBusy( const string& shard ) const { return _busyShards.count( shard ) > 0; }
+
+        /**
+         * Marks shard as having received a chunk of this collection too recently for its heat to
+         * count the chunk's ops yet.  It gets no hot chunks until then, or it would look cool
+         * enough to keep taking them.
+         */
+        void markHeatStale( const string& shard ) { _heatStaleShards.insert( shard ); }
+
+        /** @return true if shard was marked as having stale heat */
+        bool isHeatStale( const string& shard ) const { return _heatStaleShards.count( shard ) > 0; }
         
         /** writes all state to log() */
         void dump() const;
         
     private:
+        /** @return true if the shard may receive a chunk with the given tag */
+        bool _canReceive( const string& shard , const ShardInfo& info , const string& forTag ) const;
+
         const ShardInfoMap& _shardInfo;
         const ShardToChunksMap& _shardChunks;
         map<BSONObj,TagRange> _tagRanges;
         set<string> _allTags;
         set<string> _shards;
+        set<string> _busyShards;
+        set<string> _heatStaleShards;
+        double _minHeatImbalance;
     };
 
     class BalancerPolicy {
@@ -185,13 +237,14 @@ namespace mongo {
 
         /**
          * Returns a suggested chunk to move whithin a collection's shards, given information about
-         * space usage and number of chunks for that collection. If the policy doesn't recommend
+         * space usage, number of chunks and ops per second for that collection. If the policy doesn't recommend
          * moving, it returns NULL.
          *
          * @param ns is the collections namepace.
          * @param DistributionStatus holds all the info about the current state of the cluster/namespace
          * @param balancedLastTime is the number of chunks effectively moved in the last round.
-         * @returns NULL or MigrateInfo of the best move to make towards balacing the collection.
+         * @returns NULL or MigrateInfo of the best move to make towards balacing the collection,
+         *          between shards that aren't busy in DistributionStatus.
          *          caller owns the MigrateInfo instance
          */
         static MigrateInfo* balance( const string& ns,
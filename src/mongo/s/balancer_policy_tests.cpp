@@ -355,6 +355,130 @@ namespace mongo {
 
         }
 
+        /**
+         * Two overloaded shards and two empty ones: marking the shards of the first move busy
+         * gets a second move between the other two.
+         */
+        TEST( BalancerPolicyTests, BusyShards ) {
+            ShardToChunksMap chunks;
+            addShard( chunks, 10 , false );
+            addShard( chunks, 10 , false );
+            addShard( chunks, 0 , false );
+            addShard( chunks, 0 , true );
+
+            ShardInfoMap shards;
+            shards["shard0"] = ShardInfo( 0, 10, false, false );
+            shards["shard1"] = ShardInfo( 0, 10, false, false );
+            shards["shard2"] = ShardInfo( 0, 0, false, false );
+            shards["shard3"] = ShardInfo( 0, 0, false, false );
+
+            DistributionStatus d( shards, chunks );
+            MigrateInfo* m = BalancerPolicy::balance( "ns", d, 0 );
+            ASSERT( m );
+            d.markBusy( m->from );
+            d.markBusy( m->to );
+
+            MigrateInfo* m2 = BalancerPolicy::balance( "ns", d, 0 );
+            ASSERT( m2 );
+            ASSERT( m2->from != m->from && m2->from != m->to );
+            ASSERT( m2->to != m->from && m2->to != m->to );
+            d.markBusy( m2->from );
+            d.markBusy( m2->to );
+
+            ASSERT( ! BalancerPolicy::balance( "ns", d, 0 ) );
+        }
+
+        void setHeat( ShardToChunksMap& map, const string& shard, unsigned chunk, double heat ) {
+            BSONObjBuilder b;
+            b.appendElements( map[shard][chunk] );
+            b.append( DistributionStatus::heatField, heat );
+            map[shard][chunk] = b.obj();
+        }
+
+        TEST( BalancerPolicyTests, SpreadHotChunks ) {
+            ShardToChunksMap chunks;
+            addShard( chunks, 4 , false );
+            addShard( chunks, 4 , true );
+            setHeat( chunks, "shard0", 0, 300 );
+            setHeat( chunks, "shard0", 1, 200 );
+            setHeat( chunks, "shard0", 2, 100 );
+
+            ShardInfoMap shards;
+            shards["shard0"] = ShardInfo( 0, 4, false, false );
+            shards["shard1"] = ShardInfo( 0, 4, false, false );
+
+            // balanced by count, so only the heat moves a chunk: the one closest to half the gap
+            DistributionStatus d( shards, chunks );
+            ASSERT_EQUALS( 600, d.shardHeat( "shard0" ) );
+            MigrateInfo* m = BalancerPolicy::balance( "ns", d, 0 );
+            ASSERT( m );
+            ASSERT_EQUALS( "shard0", m->from );
+            ASSERT_EQUALS( "shard1", m->to );
+            ASSERT_EQUALS( 0, chunks["shard0"][0][ChunkType::min()].Obj().woCompare( m->chunk.min ) );
+
+            // not hot enough to bother
+            d.setMinHeatImbalance( 1000 );
+            ASSERT( ! BalancerPolicy::balance( "ns", d, 0 ) );
+        }
+
+        TEST( BalancerPolicyTests, SpreadHotChunksTwoRounds ) {
+            ShardInfoMap shards;
+            shards["shard0"] = ShardInfo( 0, 4, false, false );
+            shards["shard1"] = ShardInfo( 0, 4, false, false );
+            shards["shard2"] = ShardInfo( 0, 4, false, false );
+
+            // first round: the hottest chunk goes to a cool shard
+            ShardToChunksMap chunks;
+            addShard( chunks, 4 , false );
+            addShard( chunks, 4 , false );
+            addShard( chunks, 4 , true );
+            setHeat( chunks, "shard0", 0, 300 );
+            setHeat( chunks, "shard0", 1, 200 );
+            setHeat( chunks, "shard0", 2, 100 );
+
+            DistributionStatus d( shards, chunks );
+            MigrateInfo* m = BalancerPolicy::balance( "ns", d, 0 );
+            ASSERT( m );
+            ASSERT_EQUALS( "shard0", m->from );
+            ASSERT_EQUALS( "shard1", m->to );
+            ASSERT_EQUALS( 0, chunks["shard0"][0][ChunkType::min()].Obj().woCompare( m->chunk.min ) );
+
+            // second round: shard1 took the chunk, but its heat starts again from nothing, so it
+            // still looks as cool as shard2
+            ShardToChunksMap chunks2;
+            addShard( chunks2, 4 , false );
+            addShard( chunks2, 4 , false );
+            addShard( chunks2, 4 , true );
+            setHeat( chunks2, "shard0", 0, 200 );
+            setHeat( chunks2, "shard0", 1, 100 );
+
+            DistributionStatus d2( shards, chunks2 );
+            d2.markHeatStale( "shard1" );
+            MigrateInfo* m2 = BalancerPolicy::balance( "ns", d2, 1 );
+            ASSERT( m2 );
+            ASSERT_EQUALS( "shard0", m2->from );
+            ASSERT_EQUALS( "shard2", m2->to );
+
+            // with no other cool shard, shard0 keeps the rest until shard1's heat catches up
+            d2.markHeatStale( "shard2" );
+            ASSERT( ! BalancerPolicy::balance( "ns", d2, 1 ) );
+        }
+
+        TEST( BalancerPolicyTests, SingleHotChunkNotMoved ) {
+            ShardToChunksMap chunks;
+            addShard( chunks, 4 , false );
+            addShard( chunks, 4 , true );
+            setHeat( chunks, "shard0", 0, 1000 );
+
+            ShardInfoMap shards;
+            shards["shard0"] = ShardInfo( 0, 4, false, false );
+            shards["shard1"] = ShardInfo( 0, 4, false, false );
+
+            // moving it would just make the other shard the hot one; it has to be split first
+            DistributionStatus d( shards, chunks );
+            ASSERT( ! BalancerPolicy::balance( "ns", d, 0 ) );
+        }
+
         /**
          * Here we check that being over the maxSize is *not* equivalent to draining, we don't want
          * to empty shards for no other reason than they are over this limit.
@@ -198,6 +198,36 @@ namespace mongo {
         conn->done();
     }
 
+    void Chunk::pickHotSplitKey( BSONObj& hotKey ) const {
+        scoped_ptr<ScopedDbConnection> conn(
+                ScopedDbConnection::getInternalScopedDbConnection( getShard().getConnString() ) );
+        BSONObj result;
+        BSONObjBuilder cmd;
+        cmd.append( "splitVector" , _manager->getns() );
+        cmd.append( "keyPattern" , _manager->getShardKey().key() );
+        cmd.append( "min" , getMin() );
+        cmd.append( "max" , getMax() );
+        cmd.appendBool( "hot" , true );
+        // older mongods don't know 'hot' and split by size
+        cmd.append( "maxChunkSizeBytes" , getManager()->getCurrentDesiredChunkSize() );
+        cmd.append( "maxSplitPoints" , 1 );
+        BSONObj cmdObj = cmd.obj();
+
+        if ( ! conn->get()->runCommand( nsToDatabase(_manager->getns()) , cmdObj , result )) {
+            conn->done();
+            ostringstream os;
+            os << "splitVector command (hot key) failed: " << result;
+            uassert( 17366 , os.str() , 0 );
+        }
+
+        BSONObjIterator it( result.getObjectField( "splitKeys" ) );
+        if ( result["hot"].trueValue() && it.more() ) {
+            hotKey = it.next().Obj().getOwned();
+        }
+
+        conn->done();
+    }
+
     BSONObj Chunk::singleSplit( bool force , BSONObj& res ) const {
         vector<BSONObj> splitPoint;
 
@@ -211,9 +241,20 @@ namespace mongo {
             if ( candidates.size() <= 1 ) {
                 // no split points means there isn't enough data to split on
                 // 1 split point means we have between half the chunk size to full chunk size
-                // so we shouldn't split
-                LOG(1) << "chunk not full enough to trigger auto-split " << ( candidates.size() == 0 ? "no split entry" : candidates[0].toString() ) << endl;
-                return BSONObj();
+                // so we shouldn't split, unless the chunk takes so many writes it's worth splitting
+                // where they land so the halves can go to different shards
+                BSONObj hotKey;
+                pickHotSplitKey( hotKey );
+                if ( hotKey.isEmpty() ) {
+                    LOG(1) << "chunk not full enough to trigger auto-split " << ( candidates.size() == 0 ? "no split entry" : candidates[0].toString() ) << endl;
+                    return BSONObj();
+                }
+
+                log() << "splitting hot chunk " << toString() << " on " << hotKey << endl;
+                splitPoint.push_back( hotKey );
+                if ( hotKey == _min || hotKey == _max || ! multiSplit( splitPoint , res ) )
+                    return BSONObj();
+                return hotKey;
             }
 
             splitPoint.push_back( candidates.front() );
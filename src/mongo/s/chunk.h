@@ -144,6 +144,14 @@ namespace mongo {
          */
         void pickSplitVector( vector<BSONObj>& splitPoints , int chunkSize , int maxPoints = 0) const;
 
+        /**
+         * Asks the mongod holding this chunk for the median of its recent writes, if it's written to often enough
+         * that it should be split for its load alone
+         *
+         * @param hotKey the key that divides this chunk's writes, if there is one, or empty
+         */
+        void pickHotSplitKey( BSONObj& hotKey ) const;
+
         //
         // migration support
         //
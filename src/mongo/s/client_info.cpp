@@ -19,6 +19,7 @@
 
 #include "pch.h"
 
+#include "mongo/base/init.h"
 #include "mongo/db/auth/authorization_manager.h"
 #include "mongo/db/auth/auth_external_state_s.h"
 #include "server.h"
@@ -38,6 +39,7 @@
 #include "cursors.h"
 #include "grid.h"
 #include "s/writeback_listener.h"
+#include "mongo/util/concurrency/connection_thread_locals.h"
 #include "mongo/util/mongoutils/str.h"
 
 namespace mongo {
@@ -441,4 +443,13 @@ namespace mongo {
 
     boost::thread_specific_ptr<ClientInfo> ClientInfo::_tlInfo;
 
+    void ClientInfo::registerConnectionThreadLocal() {
+        ConnectionThreadLocals::add( _tlInfo );
+    }
+
+    MONGO_INITIALIZER(ClientInfoThreadLocal)(InitializerContext* context) {
+        ClientInfo::registerConnectionThreadLocal();
+        return Status::OK();
+    }
+
 } // namespace mongo
@@ -105,6 +105,9 @@ namespace mongo {
         // yet for this thread, it creates one.
         static ClientInfo * get(AbstractMessagingPort* messagingPort = NULL);
 
+        /** Register the info as belonging to the thread's connection. */
+        static void registerConnectionThreadLocal();
+
         // Returns whether or not a ClientInfo for this thread has already been created and stored
         // in _tlInfo.
         static bool exists();
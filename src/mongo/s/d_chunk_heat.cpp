@@ -0,0 +1,268 @@
+// @file d_chunk_heat.cpp
+
+/**
+*    Copyright (C) 2013 Tokutek Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "mongo/pch.h"
+
+#include "mongo/s/d_chunk_heat.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "mongo/db/instance.h"
+#include "mongo/db/keypattern.h"
+#include "mongo/db/server_parameters.h"
+#include "mongo/s/d_logic.h"
+#include "mongo/util/time_support.h"
+
+namespace mongo {
+
+    MONGO_EXPORT_SERVER_PARAMETER(chunkHeatTracking, bool, true);
+    MONGO_EXPORT_SERVER_PARAMETER(chunkHeatHalfLifeSecs, int, 60);
+
+    // A chunk written to less often than this isn't worth splitting for its load alone.
+    MONGO_EXPORT_SERVER_PARAMETER(chunkHeatSplitWritesPerSec, int, 500);
+
+    ChunkHeatTracker chunkHeat;
+
+    namespace {
+
+        // how many of a chunk's latest write keys to keep, to find their median
+        const size_t maxWriteKeys = 128;
+
+        // fewer recent writes than this don't say where a chunk's load is
+        const size_t minWriteKeysToSplit = 16;
+
+        BSONObj unwrapQuery( const BSONObj& query ) {
+            BSONElement e = query["$query"];
+            if ( e.isABSONObj() )
+                return e.embeddedObject();
+            e = query["query"];
+            if ( e.isABSONObj() )
+                return e.embeddedObject();
+            return query;
+        }
+
+    } // namespace
+
+    ChunkHeatTracker::ChunkHeatTracker() {}
+
+    ChunkHeatTracker::Stripe& ChunkHeatTracker::_stripe( const StringData& ns ) {
+        size_t h = 0;
+        for ( size_t i = 0; i < ns.size(); i++ ) {
+            h = h * 31 + static_cast<unsigned char>( ns[i] );
+        }
+        return _stripes[h % numStripes];
+    }
+
+    ShardChunkManagerPtr ChunkHeatTracker::_manager( const StringData& ns ) {
+        if ( ! chunkHeatTracking || ! shardingState.enabled() )
+            return ShardChunkManagerPtr();
+        return shardingState.getShardChunkManager( ns.toString() );
+    }
+
+    void ChunkHeatTracker::noteWrite( const StringData& ns , const BSONObj& obj , long long bytes ) {
+        ShardChunkManagerPtr manager = _manager( ns );
+        if ( manager )
+            _note( ns , *manager , obj , bytes , true );
+    }
+
+    void ChunkHeatTracker::noteInserts( const StringData& ns , const vector<BSONObj>& objs ) {
+        ShardChunkManagerPtr manager = _manager( ns );
+        if ( ! manager )
+            return;
+
+        vector<Hit> hits;
+        hits.reserve( objs.size() );
+        for ( vector<BSONObj>::const_iterator i = objs.begin(); i != objs.end(); ++i ) {
+            Hit hit;
+            if ( _locate( *manager , *i , i->objsize() , &hit ) )
+                hits.push_back( hit );
+        }
+        if ( hits.empty() )
+            return;
+
+        // the whole batch under one lock, at one time
+        const long long now = curTimeMillis64();
+        Stripe& stripe = _stripe( ns );
+        scoped_lock lk( stripe.mutex );
+        ChunkHeatMap& heat = stripe.collections[ns.toString()];
+        for ( vector<Hit>::const_iterator i = hits.begin(); i != hits.end(); ++i ) {
+            _count( heat , *i , true , now );
+        }
+    }
+
+    void ChunkHeatTracker::noteRead( const StringData& ns , const BSONObj& query , long long bytes ) {
+        ShardChunkManagerPtr manager = _manager( ns );
+        if ( manager )
+            _note( ns , *manager , unwrapQuery( query ) , bytes , false );
+    }
+
+    bool ChunkHeatTracker::_locate( ShardChunkManager& manager , const BSONObj& obj , long long bytes ,
+                                    Hit* hit ) {
+        if ( ! manager.hasShardKey( obj ) )
+            return false;
+
+        hit->key = KeyPattern( manager.getKey() ).extractSingleKey( obj ).getOwned();
+        hit->bytes = bytes;
+        return manager.getChunkFor( hit->key , &hit->min , &hit->max );
+    }
+
+    void ChunkHeatTracker::_note( const StringData& ns , ShardChunkManager& manager , const BSONObj& obj ,
+                                  long long bytes , bool write ) {
+        Hit hit;
+        if ( ! _locate( manager , obj , bytes , &hit ) )
+            return;
+
+        const long long now = curTimeMillis64();
+        Stripe& stripe = _stripe( ns );
+        scoped_lock lk( stripe.mutex );
+        _count( stripe.collections[ns.toString()] , hit , write , now );
+    }
+
+    void ChunkHeatTracker::_count( ChunkHeatMap& heat , const Hit& hit , bool write , long long now ) {
+        ChunkHeat& c = heat[hit.min];
+        if ( c.max.isEmpty() || c.max.woCompare( hit.max ) != 0 ) {
+            // new, or the chunk was split since
+            c = ChunkHeat();
+            c.max = hit.max;
+            c.lastDecayMillis = now;
+        }
+        _decay( c , now );
+
+        Rate& r = write ? c.writes : c.reads;
+        r.ops += 1;
+        r.bytes += hit.bytes;
+
+        if ( write ) {
+            if ( c.writeKeys.size() < maxWriteKeys ) {
+                c.writeKeys.push_back( hit.key );
+            }
+            else {
+                c.writeKeys[c.nextWriteKey] = hit.key;
+                c.nextWriteKey = ( c.nextWriteKey + 1 ) % maxWriteKeys;
+            }
+        }
+    }
+
+    void ChunkHeatTracker::_decay( ChunkHeat& c , long long now ) {
+        if ( now <= c.lastDecayMillis )
+            return;
+
+        const double halfLifeMillis = std::max( chunkHeatHalfLifeSecs , 1 ) * 1000.0;
+        const double f = std::pow( 0.5 , ( now - c.lastDecayMillis ) / halfLifeMillis );
+        c.reads.ops *= f;
+        c.reads.bytes *= f;
+        c.writes.ops *= f;
+        c.writes.bytes *= f;
+        c.lastDecayMillis = now;
+    }
+
+    double ChunkHeatTracker::_perSec( double decayed ) {
+        // a steady rate r decays to a sum of r * halfLife / ln 2
+        return decayed * M_LN2 / std::max( chunkHeatHalfLifeSecs , 1 );
+    }
+
+    void ChunkHeatTracker::append( const string& ns , BSONObjBuilder& b ) {
+        ShardChunkManagerPtr manager = shardingState.getShardChunkManager( ns );
+        const long long now = curTimeMillis64();
+
+        // the balancer waits this long before giving hot chunks to a shard that just got one
+        b.append( "halfLifeSecs" , std::max( chunkHeatHalfLifeSecs , 1 ) );
+
+        Stripe& stripe = _stripe( ns );
+        scoped_lock lk( stripe.mutex );
+        BSONArrayBuilder chunks( b.subarrayStart( "chunks" ) );
+        map<string, ChunkHeatMap>::iterator coll = stripe.collections.find( ns );
+        if ( coll != stripe.collections.end() ) {
+            ChunkHeatMap& heat = coll->second;
+            for ( ChunkHeatMap::iterator i = heat.begin(); i != heat.end(); ) {
+                // forget chunks that moved away or were split since
+                BSONObj min;
+                BSONObj max;
+                if ( ! manager || ! manager->getChunkFor( i->first , &min , &max ) ||
+                     min.woCompare( i->first ) != 0 || max.woCompare( i->second.max ) != 0 ) {
+                    heat.erase( i++ );
+                    continue;
+                }
+
+                ChunkHeat& c = i->second;
+                _decay( c , now );
+                BSONObjBuilder chunk( chunks.subobjStart() );
+                chunk.append( "min" , i->first );
+                chunk.append( "max" , c.max );
+                chunk.append( "readsPerSec" , _perSec( c.reads.ops ) );
+                chunk.append( "readBytesPerSec" , _perSec( c.reads.bytes ) );
+                chunk.append( "writesPerSec" , _perSec( c.writes.ops ) );
+                chunk.append( "writeBytesPerSec" , _perSec( c.writes.bytes ) );
+                chunk.append( "opsPerSec" , _perSec( c.reads.ops + c.writes.ops ) );
+                chunk.done();
+                ++i;
+            }
+            if ( heat.empty() )
+                stripe.collections.erase( coll );
+        }
+        chunks.done();
+    }
+
+    bool ChunkHeatTracker::hotSplitKey( const string& ns , const BSONObj& min , const BSONObj& max ,
+                                        BSONObj* key ) {
+        const long long now = curTimeMillis64();
+
+        Stripe& stripe = _stripe( ns );
+        scoped_lock lk( stripe.mutex );
+        map<string, ChunkHeatMap>::iterator coll = stripe.collections.find( ns );
+        if ( coll == stripe.collections.end() )
+            return false;
+
+        // the range may cover several of our chunks if mongos is behind
+        double writes = 0;
+        vector<BSONObj> keys;
+        ChunkHeatMap& heat = coll->second;
+        for ( ChunkHeatMap::iterator i = heat.lower_bound( min ); i != heat.end(); ++i ) {
+            if ( ! max.isEmpty() && i->first.woCompare( max ) >= 0 )
+                break;
+            _decay( i->second , now );
+            writes += i->second.writes.ops;
+            keys.insert( keys.end() , i->second.writeKeys.begin() , i->second.writeKeys.end() );
+        }
+
+        if ( _perSec( writes ) < chunkHeatSplitWritesPerSec || keys.size() < minWriteKeysToSplit )
+            return false;
+
+        std::sort( keys.begin() , keys.end() , BSONObjCmp() );
+
+        // the median, or the next key up if that's the range's min, since we can't split there
+        for ( size_t i = keys.size() / 2; i < keys.size(); i++ ) {
+            if ( keys[i].woCompare( min ) <= 0 )
+                continue;
+            if ( ! max.isEmpty() && keys[i].woCompare( max ) >= 0 )
+                break;
+            *key = keys[i];
+            return true;
+        }
+        return false;
+    }
+
+    void ChunkHeatTracker::reset() {
+        for ( size_t i = 0; i < numStripes; i++ ) {
+            scoped_lock lk( _stripes[i].mutex );
+            _stripes[i].collections.clear();
+        }
+    }
+
+} // namespace mongo
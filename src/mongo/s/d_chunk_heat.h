@@ -0,0 +1,136 @@
+// @file d_chunk_heat.h
+
+/**
+*    Copyright (C) 2013 Tokutek Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "mongo/pch.h"
+
+#include "mongo/db/jsobj.h"
+#include "mongo/s/d_chunk_manager.h"
+#include "mongo/util/concurrency/mutex.h"
+
+namespace mongo {
+
+    /**
+     * Keeps track of how much each of this shard's chunks is read and written, so mongos can split
+     * and move chunks by load rather than only by size and count.
+     *
+     * Counts are of the operations that came through mongos and name a single shard key (inserts,
+     * and queries, updates and removes with an equality on the whole shard key), by the chunk in
+     * ShardingState holding that key.  They decay with a half-life of chunkHeatHalfLifeSecs, so
+     * they follow the recent load.  The shard keys of each chunk's latest writes are kept too, to
+     * split a hot chunk where its writes are.
+     */
+    class ChunkHeatTracker : boost::noncopyable {
+    public:
+        ChunkHeatTracker();
+
+        /**
+         * Counts a write to the document (or query on the shard key) obj, of size bytes.
+         * Does nothing if ns isn't sharded here or obj doesn't name a shard key.
+         */
+        void noteWrite( const StringData& ns , const BSONObj& obj , long long bytes );
+
+        /** Counts each of objs as a write, like noteWrite. */
+        void noteInserts( const StringData& ns , const vector<BSONObj>& objs );
+
+        /** Counts a read, like noteWrite. */
+        void noteRead( const StringData& ns , const BSONObj& query , long long bytes );
+
+        /**
+         * Appends an array "chunks" of the ns's chunks this shard has counted anything for, with
+         * their decayed rates per second:
+         *   { min, max, readsPerSec, readBytesPerSec, writesPerSec, writeBytesPerSec, opsPerSec }
+         */
+        void append( const string& ns , BSONObjBuilder& b );
+
+        /**
+         * Finds where to split [min, max) so each side takes about half its recent writes.
+         *
+         * @return false if the range isn't written to at chunkHeatSplitWritesPerSec or more, or
+         *         there's no key strictly inside it to split at
+         */
+        bool hotSplitKey( const string& ns , const BSONObj& min , const BSONObj& max , BSONObj* key );
+
+        /** Forgets everything, e.g. when the sharding state is reset. */
+        void reset();
+
+    private:
+        struct Rate {
+            Rate() : ops(0), bytes(0) {}
+            double ops;
+            double bytes;
+        };
+
+        struct ChunkHeat {
+            ChunkHeat() : lastDecayMillis(0), nextWriteKey(0) {}
+            BSONObj max;
+            Rate reads;
+            Rate writes;
+            long long lastDecayMillis;
+            vector<BSONObj> writeKeys;
+            size_t nextWriteKey;
+        };
+
+        // chunk min -> its counters
+        typedef map<BSONObj, ChunkHeat, BSONObjCmp> ChunkHeatMap;
+
+        // Collections are spread over stripes by namespace, each with its own mutex, so
+        // operations on different collections don't wait for each other.
+        struct Stripe {
+            Stripe() : mutex( "ChunkHeatTracker" ) {}
+            mongo::mutex mutex;
+            map<string, ChunkHeatMap> collections;
+        };
+        static const size_t numStripes = 16;
+
+        // An operation on a chunk, found before taking any lock.
+        struct Hit {
+            BSONObj key;
+            BSONObj min;
+            BSONObj max;
+            long long bytes;
+        };
+
+        Stripe& _stripe( const StringData& ns );
+
+        /** @return the ns's chunks, if it's sharded here and we're keeping track */
+        static ShardChunkManagerPtr _manager( const StringData& ns );
+
+        /** @return false if obj doesn't name a shard key in one of manager's chunks */
+        static bool _locate( ShardChunkManager& manager , const BSONObj& obj , long long bytes ,
+                             Hit* hit );
+
+        void _note( const StringData& ns , ShardChunkManager& manager , const BSONObj& obj ,
+                    long long bytes , bool write );
+
+        /** Counts hit in heat.  The caller holds heat's stripe's mutex. */
+        static void _count( ChunkHeatMap& heat , const Hit& hit , bool write , long long now );
+
+        /** Brings c's counters up to now. */
+        static void _decay( ChunkHeat& c , long long now );
+
+        /** @return a decayed count as a rate per second */
+        static double _perSec( double decayed );
+
+        Stripe _stripes[numStripes];
+    };
+
+    extern ChunkHeatTracker chunkHeat;
+
+} // namespace mongo
@@ -308,6 +308,24 @@ namespace mongo {
         return true;
     }
 
+    bool ShardChunkManager::getChunkFor( const BSONObj& key, BSONObj* foundMin , BSONObj* foundMax ) const {
+        verify( foundMin );
+        verify( foundMax );
+
+        RangeMap::const_iterator it = _chunksMap.upper_bound( key );
+        if ( it == _chunksMap.begin() ) {
+            return false;
+        }
+        it--;
+
+        if ( ! contains( it->first , it->second , key ) ) {
+            return false;
+        }
+        *foundMin = it->first;
+        *foundMax = it->second;
+        return true;
+    }
+
     bool ShardChunkManager::hasShardKey(const BSONObj &obj) {
         ShardKeyPattern shardKey(_key);
         return shardKey.hasShardKey(obj);
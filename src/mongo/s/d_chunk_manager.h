@@ -127,6 +127,16 @@ namespace mongo {
          */
         bool getNextChunk( const BSONObj& lookupKey, BSONObj* foundMin , BSONObj* foundMax ) const;
 
+        /**
+         * Finds the chunk holding a shard key.
+         *
+         * @param key shard key, as extracted from a document
+         * @param foundMin OUT min for the chunk holding key
+         * @param foundMax OUT max for the above chunk
+         * @return false if no chunk in this shard holds key
+         */
+        bool getChunkFor( const BSONObj& key, BSONObj* foundMin , BSONObj* foundMax ) const;
+
         /**
          * Given an object, determine if it contains the full shard key.
          */
@@ -223,6 +223,8 @@ namespace mongo {
 
         static ShardedConnectionInfo* get( bool create );
         static void reset();
+        /** Register the info as belonging to the thread's connection. */
+        static void registerConnectionThreadLocal();
         static void addHook();
 
         bool inForceVersionOkMode() const {
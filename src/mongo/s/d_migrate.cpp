@@ -92,6 +92,12 @@ namespace mongo {
 
     MONGO_EXPORT_SERVER_PARAMETER(migrateUniqueChecks, bool, true);
 
+    // Number of batches of cloned documents the recipient of a migration reads ahead of the ones
+    // it's inserting.
+    MONGO_EXPORT_SERVER_PARAMETER(migrateCloneBatchesInFlight, int, 4);
+
+    extern bool networkCompression;
+
     bool findShardKeyIndexPattern_locked( const string& ns,
                                           const BSONObj& shardKeyPattern,
                                           BSONObj* indexPattern ) {
@@ -469,7 +475,10 @@ namespace mongo {
             KeyPattern kp(idx->keyPattern());
             BSONObj min = KeyPattern::toKeyFormat(kp.extendRangeBound(cmdobj["min"].Obj(), false));
             BSONObj max = KeyPattern::toKeyFormat(kp.extendRangeBound(cmdobj["max"].Obj(), false));
-            ClientCursor::Holder ccPointer(new ClientCursor(0, IndexCursor::make(cl, *idx, min, max, false, 1), ns, cmdobj.getOwned()));
+            // With exhaust, the first getMore makes us stream the rest of the chunk without waiting
+            // for the recipient to ask for each batch.
+            const int queryOptions = cmdobj["exhaust"].trueValue() ? QueryOption_Exhaust : 0;
+            ClientCursor::Holder ccPointer(new ClientCursor(queryOptions, IndexCursor::make(cl, *idx, min, max, false, 1), ns, cmdobj.getOwned()));
             CursorId cursorid = ccPointer->cursorid();
             cc().swapTransactionStack(ccPointer->transactions);
             ccPointer.release();
@@ -715,6 +724,9 @@ namespace mongo {
                 BSONObjBuilder cursorObj(result.subobjStart("cursor"));
                 cursorObj.append("id", id);
                 cursorObj.append("ns", cmdObj["ns"].Stringdata());
+                if (cursor->queryOptions() & QueryOption_Exhaust) {
+                    cursorObj.appendBool("exhaust", true);
+                }
                 BSONArrayBuilder ab(cursorObj.subarrayStart("firstBatch"));
                 for (; cursor->ok(); cursor->advance()) {
                     BSONObj obj = cursor->current();
@@ -1083,6 +1095,10 @@ namespace mongo {
             timing.done( 3 );
 
             // 4.
+            // the longest the recipient fell behind our writes, and what it cloned, reported
+            // back so the balancer can pace its migrations
+            long long recipientLagMillis = 0;
+            BSONObj recipientCounts;
             for ( int i=0; i<86400; i++ ) { // don't want a single chunk move to take more than a day
                 verify( !Lock::isLocked() );
                 // Exponential sleep backoff, up to 1024ms. Don't sleep much on the first few
@@ -1113,11 +1129,18 @@ namespace mongo {
                     return false;
                 }
 
+                recipientLagMillis = std::max( recipientLagMillis ,
+                                               res.getFieldDotted( "lag.millis" ).numberLong() );
+                if ( res["counts"].isABSONObj() )
+                    recipientCounts = res["counts"].Obj().getOwned();
+
                 if ( res["state"].String() == "steady" )
                     break;
 
                 killCurrentOp.checkForInterrupt();
             }
+            result.append( "recipientLagMillis" , recipientLagMillis );
+            result.append( "counts" , recipientCounts );
             timing.done(4);
 
             // 5.
@@ -1436,6 +1459,83 @@ namespace mongo {
        commend to "commit"
     */
 
+    /**
+     * Reads the batches of the donor's clone cursor in a thread of its own, so the donor keeps
+     * sending while the recipient inserts what it already has.  With exhaust, the donor streams the
+     * whole chunk after the first getMore, instead of waiting for a getMore for each batch.
+     *
+     * conn is used by the fetching thread until this is destroyed.  If it's destroyed before the
+     * cursor is exhausted, there may be more of the stream on the way, so conn can't be reused.
+     */
+    class CloneBatchFetcher : boost::noncopyable {
+    public:
+        typedef shared_ptr< vector<BSONObj> > Batch;
+
+        CloneBatchFetcher(DBClientBase *conn, const string &ns, long long cursorId, bool exhaust) :
+            _cursor(conn, ns, cursorId, 0, exhaust ? QueryOption_Exhaust : 0),
+            _batches(std::max(migrateCloneBatchesInFlight, 1) + 1),
+            _stop(false) {
+            _thread.reset(new boost::thread(boost::bind(&CloneBatchFetcher::run, this)));
+        }
+
+        ~CloneBatchFetcher() {
+            _stop = true;
+            // Make room in case the fetching thread is waiting to queue a batch.
+            Batch b;
+            while (!_thread->timed_join(boost::posix_time::milliseconds(10))) {
+                _batches.tryPop(b);
+            }
+        }
+
+        /**
+         * @return the next batch of owned objects, or an empty Batch once there are no more.
+         * Throws if the fetching thread failed.
+         */
+        Batch next() {
+            Batch b = _batches.blockingPop();
+            if (!b) {
+                msgassertedNoTrace(17365, str::stream() << "clone cursor failed: " << _error);
+            }
+            if (b->empty()) {
+                return Batch();
+            }
+            return b;
+        }
+
+    private:
+        void run() {
+            setThreadName("migrateCloneFetcher");
+            try {
+                while (!_stop && _cursor.more()) {
+                    Batch b(new vector<BSONObj>());
+                    b->reserve(_cursor.objsLeftInBatch());
+                    while (_cursor.moreInCurrentBatch()) {
+                        b->push_back(_cursor.nextSafe().getOwned());
+                    }
+                    if (!b->empty()) {
+                        _batches.push(b);
+                    }
+                }
+                _batches.push(Batch(new vector<BSONObj>()));
+            }
+            catch (DBException &e) {
+                _error = e.toString();
+                _batches.push(Batch());
+            }
+            catch (std::exception &e) {
+                _error = e.what();
+                _batches.push(Batch());
+            }
+        }
+
+        DBClientCursor _cursor;
+        BlockingQueue<Batch> _batches;
+        volatile bool _stop;
+        // set before the thread queues its NULL Batch
+        string _error;
+        scoped_ptr<boost::thread> _thread;
+    };
+
     class MigrateStatus {
         long long _lastAppliedMigrateLogID;
 
@@ -1467,9 +1567,15 @@ namespace mongo {
 
             numCloned = 0;
             clonedBytes = 0;
+            numCloneBatches = 0;
             numCatchup = 0;
             numSteady = 0;
             _lastAppliedMigrateLogID = -1;
+            cloneStreaming = false;
+            cloneStartMillis = 0;
+            cloneEndMillis = 0;
+            lastModsRoundOps = 0;
+            caughtUpMillis = 0;
 
             active = true;
         }
@@ -1495,6 +1601,16 @@ namespace mongo {
          * that we can start one for each batch of the SpillableVectorIterator.
          */
         GTID transferMods(ScopedDbConnection &conn) {
+            const long long opsBefore = numCatchup + numSteady;
+            GTID lastGTID = _transferMods(conn);
+            lastModsRoundOps = numCatchup + numSteady - opsBefore;
+            if (lastModsRoundOps == 0) {
+                caughtUpMillis = curTimeMillis64();
+            }
+            return lastGTID;
+        }
+
+        GTID _transferMods(ScopedDbConnection &conn) {
             auto_ptr<DBClientCursor> mlogCursor(conn->query(MigrateFromStatus::MIGRATE_LOG_NS,
                                                             QUERY("_id" << GTE << _lastAppliedMigrateLogID).hint(BSON("_id" << 1)),
                                                             0, 0, 0, 0));
@@ -1650,35 +1766,46 @@ namespace mongo {
         }
 
         /**
+         * Insert a batch of cloned documents in one transaction.  They were validated when they
+         * were inserted on the donor, so they go straight into the collection, and into the
+         * oplog as one batch, and writers are notified once for the whole batch.
+         *
          * We may need to handle RetryWithWriteLock inside this code, so it is factored out of _go
          * below.
          */
-        void lockedMigrateInsertFirstBatch(const BSONObj &firstBatch, uint64_t insertFlags) {
+        void lockedMigrateInsertBatch(const vector<BSONObj> &batch, uint64_t insertFlags) {
             Client::Transaction txn(DB_SERIALIZABLE);
             Collection *cl = getCollection(ns);
-            massert(17318, "collection must exist during migration", cl);
-            for (BSONObjIterator it(firstBatch); it.more(); ++it) {
-                BSONObj obj = (*it).Obj();
-                insertOneObject(cl, obj, insertFlags);
-                OplogHelpers::logInsert(ns.c_str(), obj, true);
+            massert(17319, "collection must exist during migration", cl);
+            vector<BSONObj> objs(batch);
+            insertManyObjects(cl, objs, false, insertFlags | Collection::NO_VALIDATION);
+            OplogHelpers::logInserts(ns.c_str(), objs, true);
+            for (vector<BSONObj>::const_iterator it = objs.begin(); it != objs.end(); ++it) {
                 numCloned++;
-                clonedBytes += obj.objsize();
+                clonedBytes += it->objsize();
             }
+            numCloneBatches++;
             txn.commit();
         }
 
-        void lockedMigrateInsertBatch(DBClientCursorBatchIterator &iter, uint64_t insertFlags) {
-            Client::Transaction txn(DB_SERIALIZABLE);
-            Collection *cl = getCollection(ns);
-            massert(17319, "collection must exist during migration", cl);
-            while (iter.moreInCurrentBatch()) {
-                BSONObj obj = iter.nextSafe();
-                insertOneObject(cl, obj, insertFlags);
-                OplogHelpers::logInsert(ns.c_str(), obj, true);
-                numCloned++;
-                clonedBytes += obj.objsize();
+        void migrateInsertBatch(const vector<BSONObj> &batch, uint64_t insertFlags) {
+            LOCK_REASON(lockReason, "sharding: cloning documents on recipient for migrate");
+            try {
+                Client::ReadContext ctx(ns, lockReason);
+                CounterResetter<long long> numClonedResetter(numCloned);
+                CounterResetter<long long> clonedBytesResetter(clonedBytes);
+                CounterResetter<long long> numCloneBatchesResetter(numCloneBatches);
+
+                lockedMigrateInsertBatch(batch, insertFlags);
+
+                numClonedResetter.setDone();
+                clonedBytesResetter.setDone();
+                numCloneBatchesResetter.setDone();
+            } catch (RetryWithWriteLock) {
+                Client::WriteContext ctx(ns, lockReason);
+
+                lockedMigrateInsertBatch(batch, insertFlags);
             }
-            txn.commit();
         }
 
         bool lockedMigrateHandleLegacyBatch(const BSONObj &arr) {
@@ -1742,6 +1869,10 @@ namespace mongo {
                     ScopedDbConnection::getScopedDbConnection( from ) );
             ScopedDbConnection& conn = *connPtr;
             conn->getLastError(); // just test connection
+            if ( networkCompression ) {
+                // the clone moves the whole chunk over this connection
+                conn->negotiateCompression();
+            }
 
             {
                 // 0. copy system.namespaces entry if collection doesn't already exist
@@ -1845,6 +1976,7 @@ namespace mongo {
             {
                 // 3. initial bulk clone
                 state = CLONE;
+                cloneStartMillis = curTimeMillis64();
 
                 BSONObj res;
 
@@ -1859,11 +1991,20 @@ namespace mongo {
                 bool hasNewCloneCommands = cmds.hasField("_migrateStartCloneTransaction");
 
                 if (hasNewCloneCommands) {
+                    // The clone cursor lives on the donor's primary, so read it from there
+                    // directly.  Exhaust needs a plain connection to stream on.
+                    DBClientBase *cloneConn = conn.get();
+                    if (conn->type() == ConnectionString::SET) {
+                        cloneConn = &static_cast<DBClientReplicaSet *>(conn.get())->masterConn();
+                    }
+                    const bool askExhaust = dynamic_cast<DBClientConnection *>(cloneConn) != NULL;
+
                     if (!conn->runCommand("admin", BSON("_migrateStartCloneTransaction" << 1 <<
                                                         "ns" << ns <<
                                                         "keyPattern" << shardKeyPattern <<
                                                         "min" << min <<
-                                                        "max" << max), res)) {
+                                                        "max" << max <<
+                                                        "exhaust" << askExhaust), res)) {
                         state = FAIL;
                         errmsg = mongoutils::str::stream() << "_migrateStartCloneTransaction failed: " << res.toString();
                         error() << errmsg << migrateLog;
@@ -1880,42 +2021,19 @@ namespace mongo {
                         insertFlags |= Collection::NO_UNIQUE_CHECKS;
                     }
 
-                    LOCK_REASON(lockReason, "sharding: cloning documents on recipient for migrate");
-                    try {
-                        Client::ReadContext ctx(ns, lockReason);
-                        CounterResetter<long long> numClonedResetter(numCloned);
-                        CounterResetter<long long> clonedBytesResetter(clonedBytes);
-
-                        lockedMigrateInsertFirstBatch(cursorObj["firstBatch"].Obj(), insertFlags);
-
-                        numClonedResetter.setDone();
-                        clonedBytesResetter.setDone();
-                    } catch (RetryWithWriteLock) {
-                        Client::WriteContext ctx(ns, lockReason);
+                    // Older donors don't stream, and we getMore each batch instead.
+                    cloneStreaming = cursorObj["exhaust"].trueValue();
+                    // Start fetching the next batches before inserting the first one.
+                    CloneBatchFetcher fetcher(cloneConn, ns, cursorObj["id"].Long(), cloneStreaming);
 
-                        lockedMigrateInsertFirstBatch(cursorObj["firstBatch"].Obj(), insertFlags);
+                    vector<BSONObj> firstBatch;
+                    BSONForEach(e, cursorObj["firstBatch"].Obj()) {
+                        firstBatch.push_back(e.Obj());
                     }
+                    migrateInsertBatch(firstBatch, insertFlags);
 
-                    for (DBClientCursor cursor(conn.get(), ns, cursorObj["id"].Long(), 0, 0);
-                         cursor.more(); ) {
-                        try {
-                            Client::ReadContext ctx(ns, lockReason);
-                            CounterResetter<long long> numClonedResetter(numCloned);
-                            CounterResetter<long long> clonedBytesResetter(clonedBytes);
-                            DBClientCursor::BatchResetter br(cursor);
-                            DBClientCursorBatchIterator iter(cursor);
-
-                            lockedMigrateInsertBatch(iter, insertFlags);
-
-                            numClonedResetter.setDone();
-                            clonedBytesResetter.setDone();
-                            br.setDone();
-                        } catch (RetryWithWriteLock) {
-                            Client::WriteContext ctx(ns, lockReason);
-                            DBClientCursorBatchIterator iter(cursor);
-
-                            lockedMigrateInsertBatch(iter, insertFlags);
-                        }
+                    for (CloneBatchFetcher::Batch batch = fetcher.next(); batch; batch = fetcher.next()) {
+                        migrateInsertBatch(*batch, insertFlags);
                     }
                 } else {
                     // The old path, for compatibility with older TokuMX servers.
@@ -1955,6 +2073,8 @@ namespace mongo {
                     }
                 }
 
+                cloneEndMillis = curTimeMillis64();
+                caughtUpMillis = cloneEndMillis;
                 timing.done(3);
             }
 
@@ -2039,8 +2159,8 @@ namespace mongo {
                         }
                     }
 
-                    // Only sleep if we aren't committing
-                    if ( state == STEADY ) sleepmillis( 10 );
+                    // Only sleep if we aren't committing, and there was nothing to apply
+                    if ( state == STEADY && lastModsRoundOps == 0 ) sleepmillis( 10 );
                 }
 
                 if ( state == FAIL ) {
@@ -2075,7 +2195,25 @@ namespace mongo {
                 bb.append( "steady" , numSteady );
                 bb.done();
             }
-
+            if ( cloneStartMillis ) {
+                long long millis = ( cloneEndMillis ? cloneEndMillis : curTimeMillis64() ) - cloneStartMillis;
+                BSONObjBuilder bb( b.subobjStart( "clone" ) );
+                bb.appendBool( "streaming" , cloneStreaming );
+                // each batch is inserted in one transaction, and logged as one oplog entry
+                // when logBatchedInserts is on
+                bb.append( "batches" , numCloneBatches );
+                bb.append( "millis" , millis );
+                bb.append( "bytesPerSec" , millis > 0 ? clonedBytes * 1000 / millis : 0LL );
+                bb.done();
+            }
+            if ( cloneEndMillis ) {
+                // how far behind the donor's writes we are: ops applied in the last round of
+                // mods, and how long it's been since a round found nothing left to apply
+                BSONObjBuilder bb( b.subobjStart( "lag" ) );
+                bb.append( "lastRoundOps" , lastModsRoundOps );
+                bb.append( "millis" , lastModsRoundOps ? curTimeMillis64() - caughtUpMillis : 0LL );
+                bb.done();
+            }
 
         }
 
@@ -2172,9 +2310,16 @@ namespace mongo {
 
         long long numCloned;
         long long clonedBytes;
+        long long numCloneBatches;
         long long numCatchup;
         long long numSteady;
 
+        bool cloneStreaming;
+        long long cloneStartMillis;
+        long long cloneEndMillis;
+        long long lastModsRoundOps;
+        long long caughtUpMillis;
+
         int replSetMajorityCount;
 
         enum State { READY , CLONE , CATCHUP , STEADY , COMMIT_START , DONE , FAIL , ABORT } state;
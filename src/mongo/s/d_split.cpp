@@ -43,6 +43,7 @@
 #include "mongo/s/chunk.h" // for static genID only
 #include "mongo/s/chunk_version.h"
 #include "mongo/s/config.h"
+#include "mongo/s/d_chunk_heat.h"
 #include "mongo/s/d_logic.h"
 #include "mongo/s/type_chunk.h"
 #include "mongo/util/timer.h"
@@ -269,7 +270,7 @@ namespace mongo {
             _splitPoints.push_back(_lastSplitKey);
             KeyPattern kp(_idx->keyPattern());
             BSONObj modSplitKey = KeyPattern::toKeyFormat(kp.extendRangeBound(_lastSplitKey, false));
-            _chunkMin.reset(modSplitKey, _idx->isIdIndex() ? NULL : &minKey);
+            _chunkMin.reset(modSplitKey, _idx->isIdIndex() ? NULL : &minKey, _idx->keyFormat());
         }
 
         void slowFindSplitPoint(long long targetChunkSize) {
@@ -293,7 +294,7 @@ namespace mongo {
                         _splitPoints.push_back(_lastSplitKey);
                         KeyPattern kp(_idx->keyPattern());
                         BSONObj modSplitKey = KeyPattern::toKeyFormat(kp.extendRangeBound(_lastSplitKey, false));
-                        _chunkMin.reset(modSplitKey, _idx->isIdIndex() ? NULL : &minKey);
+                        _chunkMin.reset(modSplitKey, _idx->isIdIndex() ? NULL : &minKey, _idx->keyFormat());
                         return;
                     }
                 }
@@ -310,8 +311,8 @@ namespace mongo {
                   _idx(idx),
                   _chunkPattern(chunkPattern.getOwned()),
                   _ordering(Ordering::make(_idx->keyPattern())),
-                  _chunkMin(min, _idx->isIdIndex() ? NULL : &minKey),
-                  _chunkMax(max, _idx->isIdIndex() ? NULL : &maxKey),
+                  _chunkMin(min, _idx->isIdIndex() ? NULL : &minKey, _idx->keyFormat()),
+                  _chunkMax(max, _idx->isIdIndex() ? NULL : &maxKey, _idx->keyFormat()),
                   _splitPoints(splitPoints),
                   _chunkTooBig(false),
                   _doneFindingPoints(false),
@@ -399,6 +400,10 @@ namespace mongo {
                  "  \n"
                  "  { splitVector : \"blog.post\" , keyPattern:{x:1} , min:{x:10} , max:{x:20}, force: true }\n"
                  "  'force' will produce one split point even if data is small; defaults to false\n"
+                 "  \n"
+                 "  { splitVector : \"blog.post\" , keyPattern:{x:1} , min:{x:10} , max:{x:20}, maxChunkSize:200, hot: true }\n"
+                 "  'hot' will produce one split point at the median of the chunk's recent writes, if it's\n"
+                 "  written to often enough, even if data is small (see chunkHeat)\n"
                  "NOTE: This command may take a while to run";
         }
         virtual void addRequiredPrivileges(const std::string& dbname,
@@ -445,6 +450,18 @@ namespace mongo {
 
             vector<BSONObj> splitKeys;
 
+            if ( jsobj["hot"].trueValue() ) {
+                BSONObj splitKey;
+                if ( chunkHeat.hotSplitKey( ns , min , max , &splitKey ) ) {
+                    LOG(1) << "splitting hot chunk " << ns << " " << min << " -->> " << max
+                           << " at " << splitKey << endl;
+                    splitKeys.push_back( splitKey );
+                    result.append( "splitKeys" , splitKeys );
+                    result.appendBool( "hot" , true );
+                    return true;
+                }
+            }
+
             // Get the size estimate for this namespace
             Collection *cl = getCollection( ns );
             if ( ! cl ) {
@@ -29,6 +29,7 @@
 #include <string>
 #include <vector>
 
+#include "mongo/base/init.h"
 #include "mongo/db/auth/action_set.h"
 #include "mongo/db/auth/action_type.h"
 #include "mongo/db/auth/privilege.h"
@@ -39,9 +40,11 @@
 #include "mongo/client/connpool.h"
 #include "mongo/s/chunk_version.h"
 #include "mongo/s/config.h"
+#include "mongo/s/d_chunk_heat.h"
 #include "mongo/s/d_logic.h"
 #include "mongo/s/shard.h"
 #include "mongo/util/queue.h"
+#include "mongo/util/concurrency/connection_thread_locals.h"
 #include "mongo/util/concurrency/mutex.h"
 #include "mongo/util/concurrency/ticketholder.h"
 
@@ -131,6 +134,8 @@ namespace mongo {
         _shardName.clear();
         _shardHost.clear();
         _chunks.clear();
+
+        chunkHeat.reset();
     }
 
     // TODO we shouldn't need three ways for checking the version. Fix this.
@@ -359,6 +364,15 @@ namespace mongo {
 
     boost::thread_specific_ptr<ShardedConnectionInfo> ShardedConnectionInfo::_tl;
 
+    void ShardedConnectionInfo::registerConnectionThreadLocal() {
+        ConnectionThreadLocals::add( _tl );
+    }
+
+    MONGO_INITIALIZER(ShardedConnectionInfoThreadLocal)(InitializerContext* context) {
+        ShardedConnectionInfo::registerConnectionThreadLocal();
+        return Status::OK();
+    }
+
     ShardedConnectionInfo::ShardedConnectionInfo() {
         _forceVersionOk = false;
         _id.clear();
@@ -779,6 +793,38 @@ namespace mongo {
 
     } getShardVersion;
 
+    class ChunkHeatCmd : public MongodShardCommand {
+    public:
+        ChunkHeatCmd() : MongodShardCommand("chunkHeat") {}
+
+        virtual void help( stringstream& help ) const {
+            help << "recent reads and writes per second of this shard's chunks\n"
+                 << " example: { chunkHeat : 'alleyinsider.foo'  } ";
+        }
+
+        virtual LockType locktype() const { return NONE; }
+
+        virtual void addRequiredPrivileges(const std::string& dbname,
+                                           const BSONObj& cmdObj,
+                                           std::vector<Privilege>* out) {
+            ActionSet actions;
+            actions.addAction(ActionType::splitVector);
+            out->push_back(Privilege(AuthorizationManager::CLUSTER_RESOURCE_NAME, actions));
+        }
+
+        bool run(const string& , BSONObj& cmdObj, int, string& errmsg, BSONObjBuilder& result, bool) {
+            string ns = cmdObj["chunkHeat"].valuestrsafe();
+            if ( ns.size() == 0 ) {
+                errmsg = "need to specify full namespace";
+                return false;
+            }
+
+            chunkHeat.append( ns , result );
+            return true;
+        }
+
+    } chunkHeatCmd;
+
     class ShardingStateCmd : public MongodShardCommand {
     public:
         ShardingStateCmd() : MongodShardCommand( "shardingState" ) {}
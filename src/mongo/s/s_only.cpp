@@ -18,6 +18,7 @@
 
 #include "mongo/pch.h"
 
+#include "mongo/base/init.h"
 #include "mongo/client/connpool.h"
 #include "mongo/db/auth/authorization_manager.h"
 #include "mongo/db/auth/auth_external_state_s.h"
@@ -28,6 +29,7 @@
 #include "mongo/db/matcher.h"
 #include "mongo/db/commands.h"
 #include "mongo/db/namespacestring.h"
+#include "mongo/util/concurrency/connection_thread_locals.h"
 
 /*
   most a pile of hacks to make linking nicer
@@ -49,6 +51,11 @@ namespace mongo {
 
     TSP_DEFINE(Client,currentClient)
 
+    MONGO_INITIALIZER(ClientConnectionThreadLocal)(InitializerContext* context) {
+        ConnectionThreadLocals::add(currentClient);
+        return Status::OK();
+    }
+
     LockState::LockState(){} // ugh
 
     Client::Client(const char *desc , AbstractMessagingPort *p) :
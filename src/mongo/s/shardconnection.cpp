@@ -21,6 +21,7 @@
 
 #include <set>
 
+#include "mongo/base/init.h"
 #include "mongo/db/client.h"
 #include "mongo/db/commands.h"
 #include "mongo/db/lasterror.h"
@@ -31,6 +32,7 @@
 #include "mongo/s/stale_exception.h"
 #include "mongo/s/version_manager.h"
 #include "mongo/server.h"
+#include "mongo/util/concurrency/connection_thread_locals.h"
 #include "mongo/util/stacktrace.h"
 
 namespace mongo {
@@ -355,6 +357,11 @@ namespace mongo {
 
     thread_specific_ptr<ClientConnections> ClientConnections::_perThread;
 
+    MONGO_INITIALIZER(ClientConnectionsThreadLocal)(InitializerContext* context) {
+        ConnectionThreadLocals::add( ClientConnections::_perThread );
+        return Status::OK();
+    }
+
     /**
      * Appends info about all active client shard connections to a BOBuilder
      */
@@ -70,6 +70,7 @@ DBCollection.prototype.help = function () {
     print("\tdb." + shortName + ".addPartition( <pivot> ) - add partition to a partitioned collection, optionally pass in pivot");
     print("\tdb." + shortName + ".getPartitionInfo() - get partition information of partitioned collection");
     print("\tdb." + shortName + ".dropPartition( id ) - drop partition of partitioned collection with specified id");
+    print("\tdb." + shortName + ".setPartitionPolicy( policy ) - add and drop partitions in the background, e.g. {rolloverHours: 24, expireDays: 30}");
     return __magicNoPrint;
 }
 
@@ -707,6 +708,13 @@ DBCollection.prototype.dropPartition = function( partitionID ){
     return this._dbCommand( { dropPartition : this._shortName , id : partitionID } );
 }
 
+DBCollection.prototype.setPartitionPolicy = function( policy ){
+    if ( policy == undefined) {
+        throw "must specify a policy, {} to remove it";
+    }
+    return this._dbCommand( { setPartitionPolicy : this._shortName , policy : policy } );
+}
+
 MapReduceResult = function( db , o ){
     Object.extend( this , o );
     this._o = o;
@@ -0,0 +1,66 @@
+// connection_thread_locals.cpp
+
+/**
+*    Copyright (C) 2013 Tokutek Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "mongo/pch.h"
+
+#include "mongo/util/concurrency/connection_thread_locals.h"
+
+namespace mongo {
+
+    std::vector<ConnectionThreadLocals::SlotBase *> &ConnectionThreadLocals::slots() {
+        // Registered from initializers, so this can't be a static member that might not be
+        // constructed yet.
+        static std::vector<SlotBase *> *_slots = new std::vector<SlotBase *>();
+        return *_slots;
+    }
+
+    ConnectionThreadLocals::Saved::~Saved() {
+        // Values left detached would leak, destroy() them first.
+        dassert(_attached || _values.empty());
+    }
+
+    void ConnectionThreadLocals::Saved::detach() {
+        verify(_attached);
+        const std::vector<SlotBase *> &s = slots();
+        _values.resize(s.size());
+        for (size_t i = 0; i < s.size(); ++i) {
+            _values[i] = s[i]->release();
+        }
+        _attached = false;
+    }
+
+    void ConnectionThreadLocals::Saved::attach() {
+        verify(!_attached);
+        const std::vector<SlotBase *> &s = slots();
+        for (size_t i = 0; i < s.size(); ++i) {
+            verify(s[i]->release() == NULL);
+            s[i]->reset(_values[i]);
+        }
+        _values.clear();
+        _attached = true;
+    }
+
+    void ConnectionThreadLocals::Saved::destroy() {
+        verify(_attached);
+        const std::vector<SlotBase *> &s = slots();
+        for (size_t i = 0; i < s.size(); ++i) {
+            s[i]->reset(NULL);
+        }
+    }
+
+} // namespace mongo
@@ -0,0 +1,96 @@
+// connection_thread_locals.h
+
+/**
+*    Copyright (C) 2013 Tokutek Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <vector>
+
+#include <boost/thread/tss.hpp>
+
+#include "mongo/util/concurrency/threadlocal.h"
+
+namespace mongo {
+
+    /**
+     * Thread locals that really belong to a client connection, like its Client and LastError,
+     * because connections have always been served by a thread of their own.
+     *
+     * When connections are served by a pool of worker threads instead, the worker serving a
+     * connection detaches all of them into the connection's Saved when it is done, and the next
+     * worker to serve the connection attaches them again, so the connection sees the same
+     * values whichever thread it is on.
+     *
+     * Modules register their connection thread locals with add() in a MONGO_INITIALIZER.
+     */
+    class ConnectionThreadLocals {
+    public:
+        template<typename T>
+        static void add(boost::thread_specific_ptr<T> &ptr) {
+            slots().push_back(new Slot<boost::thread_specific_ptr<T>, T>(ptr));
+        }
+
+        template<typename T>
+        static void add(TSP<T> &ptr) {
+            slots().push_back(new Slot<TSP<T>, T>(ptr));
+        }
+
+        /** The values of a connection's thread locals while no thread is serving it. */
+        class Saved : boost::noncopyable {
+        public:
+            Saved() : _attached(true) {}
+            ~Saved();
+
+            /**
+             * Take the values off the current thread, which must be serving this connection,
+             * leaving the thread without any.
+             */
+            void detach();
+
+            /** Give the saved values to the current thread, which must not have any. */
+            void attach();
+
+            /** Destroy the values, which must be attached to the current thread. */
+            void destroy();
+
+        private:
+            std::vector<void *> _values;
+            bool _attached;
+        };
+
+    private:
+        class SlotBase {
+        public:
+            virtual ~SlotBase() {}
+            virtual void *release() = 0;
+            virtual void reset(void *value) = 0;
+        };
+
+        template<typename Ptr, typename T>
+        class Slot : public SlotBase {
+        public:
+            explicit Slot(Ptr &ptr) : _ptr(ptr) {}
+            virtual void *release() { return _ptr.release(); }
+            virtual void reset(void *value) { _ptr.reset(static_cast<T *>(value)); }
+        private:
+            Ptr &_ptr;
+        };
+
+        static std::vector<SlotBase *> &slots();
+    };
+
+} // namespace mongo
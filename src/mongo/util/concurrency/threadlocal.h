@@ -82,6 +82,8 @@ namespace mongo {
     public:
         T* get() const;
         void reset(T* v);
+        /** Give up ownership of the value without destroying it, leaving none. */
+        T* release();
         T* getMake() { 
             T *t = get();
             if( t == 0 )
@@ -100,6 +102,10 @@ namespace mongo {
     void TSP<T>::reset(T* v) { \
         tsp.reset(v); \
         _ ## p = v; \
+    } \
+    T* TSP<T>::release() { \
+        _ ## p = 0; \
+        return tsp.release(); \
     } 
 # else
 
@@ -114,6 +120,10 @@ namespace mongo {
         tsp.reset(v); \
         _ ## p = v; \
     } \
+    template<> T* TSP<T>::release() { \
+        _ ## p = 0; \
+        return tsp.release(); \
+    } \
     TSP<T> p;
 # endif
 
@@ -145,6 +155,12 @@ namespace mongo {
             verify( pthread_setspecific( _key, v ) == 0 ); 
         }
 
+        T* release() {
+            T* old = get();
+            verify( pthread_setspecific( _key, 0 ) == 0 );
+            return old;
+        }
+
         T* getMake() { 
             T *t = get();
             if( t == 0 ) {
@@ -167,6 +183,7 @@ namespace mongo {
     public:
         T* get() const { return tsp.get(); }
         void reset(T* v) { tsp.reset(v); }
+        T* release() { return tsp.release(); }
         T* getMake() { 
             T *t = get();
             if( t == 0 )
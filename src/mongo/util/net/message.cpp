@@ -26,6 +26,7 @@
 #include "listen.h"
 
 #include "../goodies.h"
+#include "mongo/util/concurrency/spin_lock.h"
 
 
 namespace mongo {
@@ -42,6 +43,79 @@ namespace mongo {
         }
     }
 
+    namespace {
+
+        // Size classes are powers of two from 1KB to 64KB.
+        const int minBufferSizeBits = 10;
+        const int nBufferSizeClasses = 7;
+        // Free buffers kept per size class, beyond that they're freed.
+        const size_t maxPooledBytesPerClass = 1024 * 1024;
+
+        // Each buffer is preceded by its size class, or -1 if it's bigger than all of them.
+        // Keeps the buffer 8 byte aligned.
+        const size_t bufferPrefixSize = 8;
+
+        struct BufferFreeList {
+            BufferFreeList() : head(NULL), count(0) {}
+            SpinLock lock;
+            // A free buffer holds the next one at its start.
+            char *head;
+            size_t count;
+        };
+
+        // we "new" this so it is still around when messages are destroyed during termination.
+        BufferFreeList *bufferFreeLists = new BufferFreeList[nBufferSizeClasses];
+
+        size_t bufferClassSize(int sizeClass) {
+            return size_t(1) << (minBufferSizeBits + sizeClass);
+        }
+
+        char *newBuffer(int sizeClass, size_t size) {
+            char *p = (char *) malloc(bufferPrefixSize + size);
+            verify(p);
+            *reinterpret_cast<int *>(p) = sizeClass;
+            return p + bufferPrefixSize;
+        }
+
+    } // namespace
+
+    char *MessageBufferPool::allocate(int size) {
+        int sizeClass = 0;
+        while (sizeClass < nBufferSizeClasses && bufferClassSize(sizeClass) < size_t(size)) {
+            sizeClass++;
+        }
+        if (sizeClass == nBufferSizeClasses) {
+            return newBuffer(-1, size);
+        }
+        BufferFreeList &freeList = bufferFreeLists[sizeClass];
+        {
+            scoped_spinlock lk(freeList.lock);
+            char *buf = freeList.head;
+            if (buf != NULL) {
+                freeList.head = *reinterpret_cast<char **>(buf);
+                freeList.count--;
+                return buf;
+            }
+        }
+        return newBuffer(sizeClass, bufferClassSize(sizeClass));
+    }
+
+    void MessageBufferPool::release(char *buf) {
+        char *p = buf - bufferPrefixSize;
+        const int sizeClass = *reinterpret_cast<int *>(p);
+        if (sizeClass >= 0) {
+            BufferFreeList &freeList = bufferFreeLists[sizeClass];
+            scoped_spinlock lk(freeList.lock);
+            if ((freeList.count + 1) * bufferClassSize(sizeClass) <= maxPooledBytesPerClass) {
+                *reinterpret_cast<char **>(buf) = freeList.head;
+                freeList.head = buf;
+                freeList.count++;
+                return;
+            }
+        }
+        free(p);
+    }
+
     MSGID NextMsgId;
 
     /*struct MsgStart {
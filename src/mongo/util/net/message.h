@@ -19,6 +19,7 @@
 
 #include "sock.h"
 #include "../../bson/util/atomic_int.h"
+#include "mongo/bson/bsonobj.h"
 #include "hostandport.h"
 
 namespace mongo {
@@ -43,7 +44,8 @@ namespace mongo {
         dbQuery = 2004,
         dbGetMore = 2005,
         dbDelete = 2006,
-        dbKillCursors = 2007
+        dbKillCursors = 2007,
+        dbCompressed = 2012 /* another message, compressed. see MessageCompressor */
     };
 
     bool doesOpGetAResponse( int op );
@@ -59,6 +61,7 @@ namespace mongo {
         case dbGetMore: return "getmore";
         case dbDelete: return "remove";
         case dbKillCursors: return "killcursors";
+        case dbCompressed: return "compressed";
         default:
             massert( 16141, str::stream() << "cannot translate opcode " << op, !op );
             return "";
@@ -74,6 +77,7 @@ namespace mongo {
         case dbQuery:
         case dbGetMore:
         case dbKillCursors:
+        case dbCompressed:
             return false;
 
         case dbUpdate:
@@ -147,15 +151,27 @@ namespace mongo {
     }
 #pragma pack()
 
+    /**
+     * Buffers for received messages, kept on free lists by size class so that receiving a
+     * stream of similar messages doesn't go to the allocator for each one.  Buffers bigger than
+     * the largest class are allocated and freed as usual.
+     */
+    class MessageBufferPool {
+    public:
+        /** @return a buffer of at least size bytes, to be given back with release() */
+        static char *allocate(int size);
+        static void release(char *buf);
+    };
+
     class Message {
     public:
         // we assume here that a vector with initial size 0 does no allocation (0 is the default, but wanted to make it explicit).
-        Message() : _buf( 0 ), _data( 0 ), _freeIt( false ) {}
+        Message() : _buf( 0 ), _data( 0 ), _freeIt( false ), _pooled( false ) {}
         Message( void * data , bool freeIt ) :
-            _buf( 0 ), _data( 0 ), _freeIt( false ) {
+            _buf( 0 ), _data( 0 ), _freeIt( false ), _pooled( false ) {
             _setData( reinterpret_cast< MsgData* >( data ), freeIt );
         };
-        Message(Message& r) : _buf( 0 ), _data( 0 ), _freeIt( false ) {
+        Message(Message& r) : _buf( 0 ), _data( 0 ), _freeIt( false ), _pooled( false ) {
             *this = r;
         }
         ~Message() {
@@ -223,6 +239,11 @@ namespace mongo {
             if ( r._data.size() > 0 ) {
                 _data.swap( r._data );
             }
+            if ( r._held.size() > 0 ) {
+                _held.swap( r._held );
+            }
+            _pooled = r._pooled;
+            r._pooled = false;
             r._freeIt = false;
             _freeIt = true;
             return *this;
@@ -231,15 +252,28 @@ namespace mongo {
         void reset() {
             if ( _freeIt ) {
                 if ( _buf ) {
-                    free( _buf );
+                    if ( _pooled ) {
+                        MessageBufferPool::release( (char*)_buf );
+                    }
+                    else {
+                        free( _buf );
+                    }
                 }
+                // buffers of held objects are in _data in the same order as in _held
+                vector<BSONObj>::const_iterator h = _held.begin();
                 for( vector< pair< char *, int > >::const_iterator i = _data.begin(); i != _data.end(); ++i ) {
+                    if ( h != _held.end() && i->first == h->objdata() ) {
+                        ++h;
+                        continue;
+                    }
                     free(i->first);
                 }
             }
             _buf = 0;
             _data.clear();
+            _held.clear();
             _freeIt = false;
+            _pooled = false;
         }
 
         // use to add a buffer
@@ -254,13 +288,18 @@ namespace mongo {
                 _setData( md, true );
                 return;
             }
-            verify( _freeIt );
-            if ( _buf ) {
-                _data.push_back( make_pair( (char*)_buf, _buf->len ) );
-                _buf = 0;
-            }
-            _data.push_back( make_pair( d, size ) );
-            header()->len += size;
+            _appendBuffer( d, size );
+        }
+
+        /**
+         * Add obj to the message without copying it, the message holds on to obj's buffer until
+         * it is sent.  obj must be owned, and the message must already have a header.
+         */
+        void appendObj(const BSONObj& obj) {
+            verify( !empty() );
+            verify( obj.isOwned() );
+            _held.push_back( obj );
+            _appendBuffer( const_cast<char*>( obj.objdata() ), obj.objsize() );
         }
 
         // use to set first buffer if empty
@@ -268,6 +307,12 @@ namespace mongo {
             verify( empty() );
             _setData( d, freeIt );
         }
+        // use to set the only buffer, which came from MessageBufferPool
+        void setPooledData(MsgData *d) {
+            verify( empty() );
+            _setData( d, true );
+            _pooled = true;
+        }
         void setData(int operation, const char *msgtxt) {
             setData(operation, msgtxt, strlen(msgtxt)+1);
         }
@@ -285,6 +330,17 @@ namespace mongo {
             return _freeIt;
         }
 
+        // the buffers the message is sent from, in order
+        void getBuffers( vector< pair< const char *, int > > &buffers ) const {
+            buffers.clear();
+            if ( _buf ) {
+                buffers.push_back( make_pair( (const char *) _buf, _buf->len ) );
+            }
+            else {
+                buffers.insert( buffers.end(), _data.begin(), _data.end() );
+            }
+        }
+
         void send( MessagingPort &p, const char *context );
         
         string toString() const;
@@ -294,12 +350,27 @@ namespace mongo {
             _freeIt = freeIt;
             _buf = d;
         }
+        void _appendBuffer( char *d, int size ) {
+            verify( _freeIt );
+            // only received messages are pooled, and those aren't added to
+            verify( !_pooled );
+            if ( _buf ) {
+                _data.push_back( make_pair( (char*)_buf, _buf->len ) );
+                _buf = 0;
+            }
+            _data.push_back( make_pair( d, size ) );
+            header()->len += size;
+        }
         // if just one buffer, keep it in _buf, otherwise keep a sequence of buffers in _data
         MsgData * _buf;
         // byte buffer(s) - the first must contain at least a full MsgData unless using _buf for storage instead
         typedef vector< pair< char*, int > > MsgVec;
         MsgVec _data;
+        // owned objects whose buffers are in _data, see appendObj()
+        vector<BSONObj> _held;
         bool _freeIt;
+        // whether _buf came from MessageBufferPool
+        bool _pooled;
     };
 
 
@@ -0,0 +1,198 @@
+// message_compressor.cpp
+
+/**
+*    Copyright (C) 2013 Tokutek Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "mongo/pch.h"
+
+#include "mongo/util/net/message_compressor.h"
+
+#include <zlib.h>
+
+#include "mongo/bson/bsonobjbuilder.h"
+#include "mongo/platform/atomic_word.h"
+#include "mongo/util/net/message.h"
+#include "mongo/util/scopeguard.h"
+
+namespace mongo {
+
+    namespace {
+
+#pragma pack(1)
+        struct CompressedMsgHeader {
+            MSGHEADER header;
+            int originalOpCode;
+            int uncompressedSize;
+            char compressor;
+        };
+#pragma pack()
+
+        // Smaller messages mostly fit in a packet anyway.
+        const int minCompressedMessageBytes = 1024;
+
+        AtomicUInt64 totalMessagesIn;
+        AtomicUInt64 totalBytesIn;
+        AtomicUInt64 totalWireBytesIn;
+        AtomicUInt64 totalMessagesOut;
+        AtomicUInt64 totalBytesOut;
+        AtomicUInt64 totalWireBytesOut;
+
+    } // namespace
+
+    void MessageCompressionStats::append(BSONObjBuilder &b) const {
+        BSONObjBuilder in(b.subobjStart("in"));
+        in.appendNumber("messages", messagesIn);
+        in.appendNumber("bytes", bytesIn);
+        in.appendNumber("wireBytes", wireBytesIn);
+        in.done();
+        BSONObjBuilder out(b.subobjStart("out"));
+        out.appendNumber("messages", messagesOut);
+        out.appendNumber("bytes", bytesOut);
+        out.appendNumber("wireBytes", wireBytesOut);
+        out.done();
+    }
+
+    const char *MessageCompressor::name(Id id) {
+        switch (id) {
+        case Zlib: return "zlib";
+        case None: break;
+        }
+        return "none";
+    }
+
+    MessageCompressor::Id MessageCompressor::fromName(const StringData &name) {
+        if (name == "zlib") {
+            return Zlib;
+        }
+        return None;
+    }
+
+    bool MessageCompressor::compress(Id id, const Message &m, Message &compressed,
+                                     MessageCompressionStats &stats) {
+        verify(id == Zlib);
+        const int size = m.size();
+        if (size < minCompressedMessageBytes) {
+            return false;
+        }
+        const int bodySize = size - sizeof(MSGHEADER);
+        const uLong bound = compressBound(bodySize);
+        char *buf = (char *) malloc(sizeof(CompressedMsgHeader) + bound);
+        verify(buf);
+        ScopeGuard guard = MakeGuard(free, buf);
+
+        z_stream stream;
+        memset(&stream, 0, sizeof stream);
+        int r = deflateInit(&stream, Z_DEFAULT_COMPRESSION);
+        massert(17358, str::stream() << "couldn't compress message, zlib error " << r, r == Z_OK);
+        stream.next_out = reinterpret_cast<Bytef *>(buf + sizeof(CompressedMsgHeader));
+        stream.avail_out = bound;
+
+        // The header isn't compressed.
+        vector< pair< const char *, int > > buffers;
+        m.getBuffers(buffers);
+        int skip = sizeof(MSGHEADER);
+        for (size_t i = 0; i < buffers.size(); ++i) {
+            const int skipped = std::min(skip, buffers[i].second);
+            skip -= skipped;
+            stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(buffers[i].first + skipped));
+            stream.avail_in = buffers[i].second - skipped;
+            r = deflate(&stream, i + 1 == buffers.size() ? Z_FINISH : Z_NO_FLUSH);
+            // Z_BUF_ERROR just means an empty buffer made no progress.
+            if (r != Z_OK && r != Z_STREAM_END && r != Z_BUF_ERROR) {
+                break;
+            }
+        }
+        deflateEnd(&stream);
+        massert(17359, str::stream() << "couldn't compress message, zlib error " << r,
+                r == Z_STREAM_END);
+
+        const int wireSize = sizeof(CompressedMsgHeader) + stream.total_out;
+        if (wireSize >= size) {
+            return false;
+        }
+
+        CompressedMsgHeader *h = reinterpret_cast<CompressedMsgHeader *>(buf);
+        const MSGHEADER *original = reinterpret_cast<const MSGHEADER *>(m.header());
+        h->header.messageLength = wireSize;
+        h->header.requestID = original->requestID;
+        h->header.responseTo = original->responseTo;
+        h->header.opCode = dbCompressed;
+        h->originalOpCode = original->opCode;
+        h->uncompressedSize = bodySize;
+        h->compressor = id;
+        guard.Dismiss();
+        compressed.setData(reinterpret_cast<MsgData *>(buf), true);
+
+        stats.messagesOut++;
+        stats.bytesOut += size;
+        stats.wireBytesOut += wireSize;
+        totalMessagesOut.fetchAndAdd(1);
+        totalBytesOut.fetchAndAdd(size);
+        totalWireBytesOut.fetchAndAdd(wireSize);
+        return true;
+    }
+
+    void MessageCompressor::decompress(const Message &compressed, Message &m,
+                                       MessageCompressionStats &stats) {
+        const int wireSize = compressed.size();
+        const CompressedMsgHeader *h =
+                reinterpret_cast<const CompressedMsgHeader *>(compressed.singleData());
+        uassert(17360, "compressed message too short",
+                wireSize >= static_cast<int>(sizeof(CompressedMsgHeader)));
+        uassert(17361, str::stream() << "unknown message compressor " << int(h->compressor),
+                h->compressor == Zlib);
+        uassert(17362, str::stream() << "compressed message too large: " << h->uncompressedSize,
+                h->uncompressedSize >= 0 &&
+                h->uncompressedSize <= MaxMessageSizeBytes - static_cast<int>(sizeof(MSGHEADER)));
+
+        const int size = sizeof(MSGHEADER) + h->uncompressedSize;
+        char *buf = MessageBufferPool::allocate(size);
+        ScopeGuard guard = MakeGuard(&MessageBufferPool::release, buf);
+        uLongf bodySize = h->uncompressedSize;
+        const int r = uncompress(reinterpret_cast<Bytef *>(buf + sizeof(MSGHEADER)), &bodySize,
+                                 reinterpret_cast<const Bytef *>(h + 1),
+                                 wireSize - sizeof(CompressedMsgHeader));
+        uassert(17363, str::stream() << "corrupt compressed message, zlib error " << r,
+                r == Z_OK && bodySize == uLongf(h->uncompressedSize));
+
+        MSGHEADER *original = reinterpret_cast<MSGHEADER *>(buf);
+        original->messageLength = size;
+        original->requestID = h->header.requestID;
+        original->responseTo = h->header.responseTo;
+        original->opCode = h->originalOpCode;
+        guard.Dismiss();
+        m.setPooledData(reinterpret_cast<MsgData *>(buf));
+
+        stats.messagesIn++;
+        stats.bytesIn += size;
+        stats.wireBytesIn += wireSize;
+        totalMessagesIn.fetchAndAdd(1);
+        totalBytesIn.fetchAndAdd(size);
+        totalWireBytesIn.fetchAndAdd(wireSize);
+    }
+
+    void MessageCompressor::appendStats(BSONObjBuilder &b) {
+        MessageCompressionStats total;
+        total.messagesIn = totalMessagesIn.load();
+        total.bytesIn = totalBytesIn.load();
+        total.wireBytesIn = totalWireBytesIn.load();
+        total.messagesOut = totalMessagesOut.load();
+        total.bytesOut = totalBytesOut.load();
+        total.wireBytesOut = totalWireBytesOut.load();
+        total.append(b);
+    }
+
+} // namespace mongo
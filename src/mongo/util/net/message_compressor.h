@@ -0,0 +1,87 @@
+// message_compressor.h
+
+/**
+*    Copyright (C) 2013 Tokutek Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "mongo/pch.h"
+
+#include "mongo/base/string_data.h"
+
+namespace mongo {
+
+    class BSONObjBuilder;
+    class Message;
+
+    /** Sizes of the messages compressed and decompressed on a connection. */
+    struct MessageCompressionStats {
+        MessageCompressionStats() :
+            messagesIn(0), bytesIn(0), wireBytesIn(0),
+            messagesOut(0), bytesOut(0), wireBytesOut(0) {}
+
+        void append(BSONObjBuilder &b) const;
+
+        // bytes are the messages' sizes, wireBytes their sizes compressed
+        long long messagesIn;
+        long long bytesIn;
+        long long wireBytesIn;
+        long long messagesOut;
+        long long bytesOut;
+        long long wireBytesOut;
+    };
+
+    /**
+     * Compresses and decompresses messages.  A compressed message is a dbCompressed message
+     * with the id and responseTo of the original, and a body of
+     *
+     *     int originalOpCode;
+     *     int uncompressedSize;  // of the original's body, after its header
+     *     char compressor;       // Id
+     *     ...                    // the original's body, compressed
+     *
+     * Compression is negotiated per connection with the _negotiateCompression command, after
+     * which MessagingPort compresses what it sends.  MessagingPort decompresses whatever
+     * compressed messages it receives.
+     */
+    class MessageCompressor {
+    public:
+        enum Id {
+            None = 0,
+            Zlib = 1
+        };
+
+        static const char *name(Id id);
+        /** @return the compressor called name, or None if there isn't one */
+        static Id fromName(const StringData &name);
+
+        /**
+         * Compress m into compressed with compressor id.
+         * @return false, leaving compressed empty, if m is too small to be worth compressing or
+         * doesn't get any smaller.
+         */
+        static bool compress(Id id, const Message &m, Message &compressed,
+                             MessageCompressionStats &stats);
+
+        /** Decompress a dbCompressed message into m.  uasserts if it's corrupt. */
+        static void decompress(const Message &compressed, Message &m,
+                               MessageCompressionStats &stats);
+
+        /** Append the totals over all connections. */
+        static void appendStats(BSONObjBuilder &b);
+    };
+
+} // namespace mongo
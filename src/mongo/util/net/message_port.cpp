@@ -126,18 +126,21 @@ namespace mongo {
     }
 
     MessagingPort::MessagingPort(int fd, const SockAddr& remote) 
-        : psock( new Socket( fd , remote ) ) , piggyBackData(0) {
+        : psock( new Socket( fd , remote ) ) , piggyBackData(0),
+          _compressor( MessageCompressor::None ), _compressAfterNextSend( false ) {
         ports.insert(this);
     }
 
     MessagingPort::MessagingPort( double timeout, int ll ) 
-        : psock( new Socket( timeout, ll ) ) {
+        : psock( new Socket( timeout, ll ) ),
+          _compressor( MessageCompressor::None ), _compressAfterNextSend( false ) {
         ports.insert(this);
         piggyBackData = 0;
     }
 
     MessagingPort::MessagingPort( boost::shared_ptr<Socket> sock )
-        : psock( sock ), piggyBackData( 0 ) {
+        : psock( sock ), piggyBackData( 0 ),
+          _compressor( MessageCompressor::None ), _compressAfterNextSend( false ) {
         ports.insert(this);
     }
 
@@ -189,11 +192,8 @@ again:
                 return false;
             }
 
-            int z = (len+1023)&0xfffffc00;
-            verify(z>=len);
-            MsgData *md = (MsgData *) malloc(z);
-            ScopeGuard guard = MakeGuard(free, md);
-            verify(md);
+            MsgData *md = (MsgData *) MessageBufferPool::allocate(len);
+            ScopeGuard guard = MakeGuard(&MessageBufferPool::release, (char *) md);
             md->len = len;
 
             char *p = (char *) &md->id;
@@ -202,7 +202,13 @@ again:
             psock->recv( p, left );
 
             guard.Dismiss();
-            m.setData(md, true);
+            m.setPooledData(md);
+
+            if ( md->operation() == dbCompressed ) {
+                Message compressed;
+                compressed = m;
+                MessageCompressor::decompress( compressed, m, _compressionStats );
+            }
             return true;
 
         }
@@ -257,20 +263,38 @@ again:
         toSend.header()->id = nextMessageId();
         toSend.header()->responseTo = responseTo;
 
+        Message compressed;
+        const bool compress = _compressor != MessageCompressor::None && !_compressAfterNextSend;
+        _compressAfterNextSend = false;
+        Message& m = ( compress &&
+                       MessageCompressor::compress( _compressor, toSend, compressed,
+                                                    _compressionStats ) )
+                     ? compressed : toSend;
+
         if ( piggyBackData && piggyBackData->len() ) {
             mmm( log() << "*     have piggy back" << endl; )
-            if ( ( piggyBackData->len() + toSend.header()->len ) > 1300 ) {
+            if ( ( piggyBackData->len() + m.header()->len ) > 1300 ) {
                 // won't fit in a packet - so just send it off
                 piggyBackData->flush();
             }
             else {
-                piggyBackData->append( toSend );
+                piggyBackData->append( m );
                 piggyBackData->flush();
                 return;
             }
         }
 
-        toSend.send( *this, "say" );
+        m.send( *this, "say" );
+    }
+
+    void MessagingPort::appendCompressionStats( BSONObjBuilder& b ) const {
+        if ( _compressor == MessageCompressor::None && _compressionStats.messagesIn == 0 ) {
+            return;
+        }
+        BSONObjBuilder sub( b.subobjStart( "compression" ) );
+        sub.append( "compressor", MessageCompressor::name( _compressor ) );
+        _compressionStats.append( sub );
+        sub.done();
     }
 
     void MessagingPort::piggyBack( Message& toSend , int responseTo ) {
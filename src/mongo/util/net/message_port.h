@@ -19,6 +19,7 @@
 
 #include "sock.h"
 #include "message.h"
+#include "mongo/util/net/message_compressor.h"
 
 namespace mongo {
 
@@ -40,6 +41,9 @@ namespace mongo {
         long long connectionId() const { return _connectionId; }
         void setConnectionId( long long connectionId );
 
+        /** Append how messages on this connection are compressed, if they are. */
+        virtual void appendCompressionStats( BSONObjBuilder& b ) const {}
+
     public:
         // TODO make this private with some helpers
 
@@ -119,9 +123,26 @@ namespace mongo {
             return psock->getSockCreationMicroSec();
         }
 
+        /**
+         * Compress what's sent from now on with compressor, which the other side has agreed
+         * to.  With afterNextSend, the next message (the reply agreeing to it) is still sent
+         * uncompressed.  Compressed messages received are decompressed regardless.
+         */
+        void setCompressor( MessageCompressor::Id compressor, bool afterNextSend = false ) {
+            _compressor = compressor;
+            _compressAfterNextSend = afterNextSend;
+        }
+        MessageCompressor::Id compressor() const { return _compressor; }
+
+        virtual void appendCompressionStats( BSONObjBuilder& b ) const;
+
     private:
         
         PiggyBackData * piggyBackData;
+
+        MessageCompressor::Id _compressor;
+        bool _compressAfterNextSend;
+        MessageCompressionStats _compressionStats;
         
         // this is the parsed version of remote
         // mutable because its initialized only on call to remote()
@@ -30,6 +30,7 @@
 #include "../../db/lasterror.h"
 #include "../../db/stats/counters.h"
 #include "mongo/util/concurrency/ticketholder.h"
+#include "mongo/util/net/message_server_reactor.h"
 #include "mongo/util/net/ssl_manager.h"
 
 #ifdef __linux__  // TODO: consider making this ifndef _WIN32
@@ -48,7 +49,8 @@ namespace mongo {
          *     and should make sure that it lives longer than this server.
          */
         PortMessageServer(  const MessageServer::Options& opts, MessageHandler * handler ) :
-            Listener( "" , opts.ipList, opts.port ), _handler(handler) {
+            Listener( "" , opts.ipList, opts.port ), _handler(handler),
+            _reactor(ConnectionReactor::create(handler)) {
         }
 
         virtual void acceptedMP(MessagingPort * p) {
@@ -65,6 +67,11 @@ namespace mongo {
             }
 
             try {
+                if ( _reactor ) {
+                    _reactor->accepted( p );
+                    return;
+                }
+
 #ifndef __linux__  // TODO: consider making this ifdef _WIN32
                 {
                     HandleIncomingMsgParam* himParam = new HandleIncomingMsgParam(p, _handler);
@@ -137,6 +144,8 @@ namespace mongo {
 
     private:
         MessageHandler* _handler;
+        // Serves connections instead of a thread each, if enabled.
+        scoped_ptr<ConnectionReactor> _reactor;
 
         /**
          * Simple holder for threadRun parameters. Should not destroy the objects it holds -
@@ -0,0 +1,308 @@
+// message_server_reactor.cpp
+
+/**
+*    Copyright (C) 2013 Tokutek Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "mongo/pch.h"
+
+#include "mongo/util/net/message_server_reactor.h"
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
+
+#include <boost/thread/thread.hpp>
+
+#include "mongo/base/counter.h"
+#include "mongo/db/cmdline.h"
+#include "mongo/db/commands/server_status.h"
+#include "mongo/db/lasterror.h"
+#include "mongo/db/server_parameters.h"
+#include "mongo/db/stats/counters.h"
+#include "mongo/util/concurrency/connection_thread_locals.h"
+#include "mongo/util/net/listen.h"
+#include "mongo/util/net/message_port.h"
+#include "mongo/util/net/message_server.h"
+#include "mongo/util/processinfo.h"
+
+namespace mongo {
+
+    // Serve connections from a pool of worker threads instead of a thread each.
+    MONGO_EXPORT_STARTUP_SERVER_PARAMETER(connectionReactor, bool, false);
+
+    // Number of worker threads serving connections with connectionReactor.  Zero uses four per
+    // core, and at least 32.  Requests that block (on locks, fsyncLock, awaitData cursors of
+    // secondaries, multi-statement transactions) hold their worker while they wait, so this
+    // should be well above the number of cores.  When every worker is busy, messages are queued.
+    MONGO_EXPORT_STARTUP_SERVER_PARAMETER(connectionWorkerThreads, int, 0);
+
+    // When messages are queued and no worker has finished one for this long, the workers are
+    // taken to be blocked, and queued messages are served on threads of their own, so a full
+    // pool can't keep out the request that would unblock it.  At most
+    // connectionMaxOverflowThreads such threads run at once; past that, messages wait.
+    MONGO_EXPORT_SERVER_PARAMETER(connectionWorkerStallMillis, int, 500);
+    MONGO_EXPORT_SERVER_PARAMETER(connectionMaxOverflowThreads, int, 64);
+
+    // How often the reactor checks for stalled workers when no connection has anything to read.
+    static const int stallCheckMillis = 100;
+
+    // Messages served on their own thread because the workers were stalled.
+    static Counter64 connectionOverflowThreads;
+    static ServerStatusMetricField<Counter64> displayConnectionOverflowThreads(
+            "network.reactor.overflowThreads", &connectionOverflowThreads);
+
+#ifdef __linux__
+
+    class ConnectionReactor::Session : boost::noncopyable {
+    public:
+        explicit Session(MessagingPort *p) : port(p), le(NULL) {
+            threadName = "conn";
+            if (p->connectionId() > 0) {
+                threadName = str::stream() << threadName << p->connectionId();
+            }
+        }
+
+        MessagingPort *port;
+        // Owned by the connection's lastError, which is in tls while no worker serves it.
+        LastError *le;
+        ConnectionThreadLocals::Saved tls;
+        string otherSide;
+        string threadName;
+    };
+
+    ConnectionReactor *ConnectionReactor::create(MessageHandler *handler) {
+        if (!connectionReactor) {
+            return NULL;
+        }
+#ifdef MONGO_SSL
+        if (cmdLine.sslOnNormalPorts) {
+            warning() << "connectionReactor is not supported with SSL, "
+                      << "serving each connection from its own thread" << endl;
+            return NULL;
+        }
+#endif
+        const int epfd = epoll_create(1);
+        if (epfd < 0) {
+            warning() << "epoll_create failed: " << errnoWithDescription()
+                      << ", serving each connection from its own thread" << endl;
+            return NULL;
+        }
+        int nThreads = connectionWorkerThreads;
+        if (nThreads <= 0) {
+            nThreads = std::max(4 * ProcessInfo().getNumCores(), 32U);
+        }
+        log() << "serving connections from " << nThreads << " worker threads" << endl;
+        return new ConnectionReactor(handler, epfd, nThreads);
+    }
+
+    ConnectionReactor::ConnectionReactor(MessageHandler *handler, int epfd, int nThreads) :
+        _handler(handler), _epfd(epfd), _nThreads(nThreads), _workers(nThreads),
+        _mutex("ConnectionReactor"), _busyWorkers(0), _lastProgressMillis(curTimeMillis64()),
+        _overflowThreads(0) {
+        boost::thread thr(boost::bind(&ConnectionReactor::run, this));
+    }
+
+    void ConnectionReactor::accepted(MessagingPort *p) {
+        auto_ptr<Session> s(new Session(p));
+        dispatch(boost::bind(&ConnectionReactor::connect, this, s.get()));
+        s.release();
+    }
+
+    void ConnectionReactor::dispatch(const Task &task) {
+        {
+            scoped_lock lk(_mutex);
+            if (_busyWorkers >= _nThreads) {
+                if (_queue.empty()) {
+                    // Workers that were idle a while ago aren't stalled.
+                    _lastProgressMillis = curTimeMillis64();
+                }
+                _queue.push_back(task);
+                return;
+            }
+            _busyWorkers++;
+        }
+        _workers.schedule(boost::bind(&ConnectionReactor::work, this, task));
+    }
+
+    void ConnectionReactor::work(Task task) {
+        while (true) {
+            task();
+            scoped_lock lk(_mutex);
+            _lastProgressMillis = curTimeMillis64();
+            if (_queue.empty()) {
+                _busyWorkers--;
+                return;
+            }
+            task = _queue.front();
+            _queue.pop_front();
+        }
+    }
+
+    void ConnectionReactor::overflow(const Task &task) {
+        task();
+        scoped_lock lk(_mutex);
+        _overflowThreads--;
+    }
+
+    void ConnectionReactor::checkStalled() {
+        scoped_lock lk(_mutex);
+        if (_queue.empty() ||
+            curTimeMillis64() - _lastProgressMillis < (long long) connectionWorkerStallMillis) {
+            return;
+        }
+        while (!_queue.empty() && _overflowThreads < connectionMaxOverflowThreads) {
+            try {
+                boost::thread thr(boost::bind(&ConnectionReactor::overflow, this, _queue.front()));
+            }
+            catch (boost::thread_resource_error&) {
+                warning() << "could not start a thread for a message waiting on stalled "
+                          << "connection workers" << endl;
+                return;
+            }
+            _queue.pop_front();
+            _overflowThreads++;
+            connectionOverflowThreads.increment();
+        }
+    }
+
+    void ConnectionReactor::run() {
+        setThreadName("connReactor");
+        static const int maxEvents = 256;
+        epoll_event events[maxEvents];
+        while (!inShutdown()) {
+            // Wake up now and then to notice shutdown and stalled workers.
+            const int n = epoll_wait(_epfd, events, maxEvents, stallCheckMillis);
+            checkStalled();
+            if (n < 0) {
+                if (errno != EINTR) {
+                    error() << "epoll_wait failed: " << errnoWithDescription() << endl;
+                    sleepmillis(10);
+                }
+                continue;
+            }
+            for (int i = 0; i < n; ++i) {
+                // Closed connections and errors are noticed when the worker reads.
+                dispatch(boost::bind(&ConnectionReactor::serve, this,
+                                     static_cast<Session *>(events[i].data.ptr)));
+            }
+        }
+    }
+
+    void ConnectionReactor::connect(Session *s) {
+        if (!handle(s, true)) {
+            close(s);
+            return;
+        }
+        s->tls.detach();
+        wait(s, EPOLL_CTL_ADD);
+    }
+
+    void ConnectionReactor::serve(Session *s) {
+        s->tls.attach();
+        if (!handle(s, false)) {
+            close(s);
+            return;
+        }
+        s->tls.detach();
+        wait(s, EPOLL_CTL_MOD);
+    }
+
+    bool ConnectionReactor::handle(Session *s, bool connecting) {
+        setThreadName(s->threadName.c_str());
+        MessagingPort *p = s->port;
+        try {
+            if (connecting) {
+                p->psock->setLogLevel(1);
+                s->le = new LastError();
+                lastError.reset(s->le); // lastError now has ownership
+                s->otherSide = p->psock->remoteString();
+                _handler->connected(p);
+                return true;
+            }
+
+            Message m;
+            p->psock->clearCounters();
+            if (inShutdown() || !p->recv(m)) {
+                if (!cmdLine.quiet) {
+                    int conns = Listener::globalTicketHolder.used() - 1;
+                    const char* word = (conns == 1 ? " connection" : " connections");
+                    log() << "end connection " << s->otherSide << " (" << conns << word << " now open)" << endl;
+                }
+                p->shutdown();
+                return false;
+            }
+            _handler->process(m, p, s->le);
+            networkCounter.hit(p->psock->getBytesIn(), p->psock->getBytesOut());
+            return true;
+        }
+        catch (AssertionException& e) {
+            log() << "AssertionException handling request, closing client connection: " << e << endl;
+        }
+        catch (SocketException& e) {
+            log() << "SocketException handling request, closing client connection: " << e << endl;
+        }
+        catch (const DBException& e) { // must be right above std::exception to avoid catching subclasses
+            log() << "DBException handling request, closing client connection: " << e << endl;
+        }
+        catch (std::exception &e) {
+            error() << "Uncaught std::exception: " << e.what() << ", terminating" << endl;
+            dbexit( EXIT_UNCAUGHT );
+        }
+        catch (...) {
+            error() << "Uncaught exception, terminating" << endl;
+            dbexit( EXIT_UNCAUGHT );
+        }
+        p->shutdown();
+        return false;
+    }
+
+    void ConnectionReactor::wait(Session *s, int op) {
+        // One shot, so only one worker at a time gets the connection, and the reactor doesn't
+        // hear about it again until the worker is done with it and rearms it here.
+        epoll_event event;
+        event.events = EPOLLIN | EPOLLONESHOT;
+        event.data.ptr = s;
+        if (epoll_ctl(_epfd, op, s->port->psock->rawFD(), &event) != 0) {
+            error() << "epoll_ctl failed, closing client connection " << s->otherSide << ": "
+                    << errnoWithDescription() << endl;
+            s->tls.attach();
+            s->port->shutdown();
+            close(s);
+        }
+    }
+
+    void ConnectionReactor::close(Session *s) {
+        // Closing the socket removes it from the epoll set.
+        _handler->disconnected(s->port);
+        s->tls.destroy();
+        delete s->port;
+        delete s;
+        Listener::globalTicketHolder.release();
+    }
+
+#else // !__linux__
+
+    ConnectionReactor *ConnectionReactor::create(MessageHandler *handler) {
+        if (connectionReactor) {
+            warning() << "connectionReactor is only supported on Linux, "
+                      << "serving each connection from its own thread" << endl;
+        }
+        return NULL;
+    }
+
+#endif
+
+} // namespace mongo
@@ -0,0 +1,111 @@
+// message_server_reactor.h
+
+/**
+*    Copyright (C) 2013 Tokutek Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "mongo/pch.h"
+
+#include <deque>
+
+#include "mongo/util/concurrency/mutex.h"
+#include "mongo/util/concurrency/thread_pool.h"
+
+namespace mongo {
+
+    class MessageHandler;
+    class MessagingPort;
+
+    /**
+     * Serves client connections from a fixed pool of worker threads instead of a thread per
+     * connection, so that many mostly idle connections don't cost a thread (and its stack) each.
+     *
+     * A reactor thread waits on all idle connections with epoll, and hands a connection to a
+     * worker when a message starts to arrive on it.  The worker reads and processes that one
+     * message, then gives the connection back to the reactor.  The connection's thread locals
+     * (its Client, LastError and so on, see ConnectionThreadLocals) move with it from worker to
+     * worker, so handlers see the same per-connection state as they do with a thread each.
+     *
+     * When every worker is busy, messages wait in a queue, which the workers drain as they
+     * finish.  A request that blocks (on a lock, an awaitData cursor, or a client that sends a
+     * message slowly) holds its worker until it's done, though.  If every worker were held that
+     * way, the request that would unblock them (fsyncUnlock, a commit, the writer an oplog tailer
+     * is waiting for) could sit in the queue forever.  So when messages are queued and no worker
+     * has finished anything for connectionWorkerStallMillis, the reactor serves queued messages
+     * on threads of their own, at most connectionMaxOverflowThreads at once.  Workers that are
+     * merely busy keep finishing requests, so load alone doesn't start such threads.
+     * connectionWorkerThreads should still allow for the number of requests expected to block at
+     * once, so that they stay rare.
+     *
+     * Only on Linux, and not for SSL connections, which can have data buffered in the SSL
+     * layer that epoll doesn't know about.
+     */
+    class ConnectionReactor : boost::noncopyable {
+    public:
+        /**
+         * @return a reactor serving connections with handler if the connectionReactor startup
+         * parameter is set and it is supported here, otherwise NULL.
+         */
+        static ConnectionReactor *create(MessageHandler *handler);
+
+        /**
+         * Serve a newly accepted connection.  Takes ownership of p, and of the connection ticket
+         * acquired for it, unless this throws.
+         */
+        void accepted(MessagingPort *p);
+
+    private:
+        class Session;
+
+        ConnectionReactor(MessageHandler *handler, int epfd, int nThreads);
+
+        typedef boost::function<void(void)> Task;
+
+        void run();
+        // Runs task on a worker, or queues it if every worker is busy.
+        void dispatch(const Task &task);
+        // Runs task and then queued tasks until there are none, on a worker.
+        void work(Task task);
+        // Runs task on an overflow thread.
+        void overflow(const Task &task);
+        // Starts overflow threads for queued tasks if the workers have stalled.
+        void checkStalled();
+        void connect(Session *s);
+        void serve(Session *s);
+        // @return false if the connection should be closed
+        bool handle(Session *s, bool connecting);
+        void wait(Session *s, int op);
+        void close(Session *s);
+
+        MessageHandler *_handler;
+        int _epfd;
+        const int _nThreads;
+        ThreadPool _workers;
+
+        // Protects the rest.
+        mongo::mutex _mutex;
+        // Workers running a task, at most _nThreads.
+        int _busyWorkers;
+        // Tasks waiting for a worker.
+        std::deque<Task> _queue;
+        // When a worker last finished a task, or the queue last became nonempty.
+        long long _lastProgressMillis;
+        // Overflow threads still running.
+        int _overflowThreads;
+    };
+
+} // namespace mongo
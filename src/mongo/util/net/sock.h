@@ -235,6 +235,9 @@ namespace mongo {
             return _fdCreationMicroSec;
         }
 
+        /** @return the file descriptor, for waiting on it with poll() or the like */
+        int rawFD() const { return _fd; }
+
     private:
         void _init();
 
@@ -27,9 +27,12 @@
 #endif
 
 #include "mongo/db/cmdline.h"
+#include "mongo/db/dbmessage.h"
+#include "mongo/db/jsobj.h"
 #include "mongo/unittest/unittest.h"
 #include "mongo/util/concurrency/synchronization.h"
 #include "mongo/util/fail_point_service.h"
+#include "mongo/util/net/message_port.h"
 
 namespace mongo {
 
@@ -343,4 +346,38 @@ namespace {
     }
 
 
+    TEST(MessageBufferPoolTest, ReusesBuffersOfASizeClass) {
+        char* const buf = MessageBufferPool::allocate(100);
+        MessageBufferPool::release(buf);
+        // 100 and 1000 bytes are both in the 1KB class.
+        char* const again = MessageBufferPool::allocate(1000);
+        ASSERT_TRUE(buf == again);
+        MessageBufferPool::release(again);
+
+        char* const big = MessageBufferPool::allocate(1024 * 1024);
+        big[1024 * 1024 - 1] = 'x';
+        MessageBufferPool::release(big);
+    }
+
+    TEST(MessagingPortTest, SendsHeldObjectsIntoPooledBuffers) {
+        const SocketPair sockets = socketPair(SOCK_STREAM);
+        MessagingPort from(sockets.first);
+        MessagingPort to(sockets.second);
+
+        const BSONObj obj = BSON("a" << 1 << "s" << std::string(3000, 'x'));
+        for (int i = 0; i < 2; ++i) {
+            Message sent;
+            replyToQueryHoldingObj(0, sent, obj);
+            ASSERT_EQUALS(static_cast<int>(sizeof(QueryResult)) + obj.objsize(), sent.size());
+            from.say(sent);
+
+            Message received;
+            ASSERT_TRUE(to.recv(received));
+            ASSERT_EQUALS(sent.size(), received.size());
+            QueryResult* const qr = reinterpret_cast<QueryResult*>(received.singleData());
+            ASSERT_EQUALS(1, qr->nReturned);
+            ASSERT_EQUALS(obj, BSONObj(qr->data()));
+        }
+    }
+
 } // namespace